@@ -75,6 +75,7 @@ namespace D3
 	PRIMITIVEMASK_IMPL(MetaColumn, Flags, LazyFetch,					0x00000100);
 	PRIMITIVEMASK_IMPL(MetaColumn, Flags, Password,						0x00000020);
 	PRIMITIVEMASK_IMPL(MetaColumn, Flags, EncodedValue,				0x00000400);
+	PRIMITIVEMASK_IMPL(MetaColumn, Flags, ChangeTracking,			0x00000800);
 
 	PRIMITIVEMASK_IMPL(MetaColumn, Flags, HiddenOnDetailView,	0x00000002);
 	PRIMITIVEMASK_IMPL(MetaColumn, Flags, HiddenOnListView,		0x00000200);
@@ -274,6 +275,21 @@ namespace D3
 
 
 
+	// If pEntity reserved a slot for this in its row buffer, construct the instance
+	// in place, otherwise allocate it on the heap.
+	//
+	ObjectPtr MetaColumn::ConstructInstance(EntityPtr pEntity)
+	{
+		void*		pMem = pEntity ? pEntity->GetColumnSlot(this) : NULL;
+
+		if (pMem)
+			return m_pInstanceClass->CreateInstance(pMem);
+
+		return m_pInstanceClass->CreateInstance();
+	}
+
+
+
 	std::string MetaColumn::ChoiceDescAsString(const std::string & strChoiceVal)
 	{
 		ColumnChoiceMapItr			itr;
@@ -490,6 +506,7 @@ namespace D3
 			ostrm << "\"LazyFetch\":"						<< (IsLazyFetch()						? "true" : "false") << ',';
 			ostrm << "\"Password\":"						<< (IsPassword()						? "true" : "false") << ',';
 			ostrm << "\"EncodedValue\":"				<< (IsEncodedValue()				? "true" : "false") << ',';
+			ostrm << "\"ChangeTracking\":"			<< (IsChangeTracking()			? "true" : "false") << ',';
 
 			ostrm << "\"HiddenOnDetailView\":"	<< (IsHiddenOnDetailView()	? "true" : "false") << ',';
 			ostrm << "\"HiddenOnListView\":"		<< (IsHiddenOnListView()		? "true" : "false") << ',';
@@ -1147,7 +1164,7 @@ namespace D3
 	{
 		ColumnStringPtr	pCol = NULL;
 
-		pCol = (ColumnStringPtr) m_pInstanceClass->CreateInstance();
+		pCol = (ColumnStringPtr) ConstructInstance(pEntity);
 
 		if (!pCol)
 			throw Exception(__FILE__, __LINE__, Exception_error, "MetaColumnString::CreateInstance(): Class factory %s failed to create instance of column %s!", m_pInstanceClass->Name().c_str(), GetFullName().c_str());
@@ -1272,7 +1289,7 @@ namespace D3
 	{
 		ColumnCharPtr	pCol = NULL;
 
-		pCol = (ColumnCharPtr) m_pInstanceClass->CreateInstance();
+		pCol = (ColumnCharPtr) ConstructInstance(pEntity);
 
 		if (!pCol)
 			throw Exception(__FILE__, __LINE__, Exception_error, "MetaColumnChar::CreateInstance(): Class factory %s failed to create instance of column %s!", m_pInstanceClass->Name().c_str(), GetFullName().c_str());
@@ -1361,7 +1378,7 @@ namespace D3
 	{
 		ColumnShortPtr	pCol = NULL;
 
-		pCol = (ColumnShortPtr) m_pInstanceClass->CreateInstance();
+		pCol = (ColumnShortPtr) ConstructInstance(pEntity);
 
 		if (!pCol)
 			throw Exception(__FILE__, __LINE__, Exception_error, "MetaColumnShort::CreateInstance(): Class factory %s failed to create instance of column %s!", m_pInstanceClass->Name().c_str(), GetFullName().c_str());
@@ -1451,7 +1468,7 @@ namespace D3
 	{
 		ColumnBoolPtr	pCol = NULL;
 
-		pCol = (ColumnBoolPtr) m_pInstanceClass->CreateInstance();
+		pCol = (ColumnBoolPtr) ConstructInstance(pEntity);
 
 		if (!pCol)
 			throw Exception(__FILE__, __LINE__, Exception_error, "MetaColumnBool::CreateInstance(): Class factory %s failed to create instance of column %s!", m_pInstanceClass->Name().c_str(), GetFullName().c_str());
@@ -1540,7 +1557,7 @@ namespace D3
 	{
 		ColumnIntPtr	pCol = NULL;
 
-		pCol = (ColumnIntPtr) m_pInstanceClass->CreateInstance();
+		pCol = (ColumnIntPtr) ConstructInstance(pEntity);
 
 		if (!pCol)
 			throw Exception(__FILE__, __LINE__, Exception_error, "MetaColumnInt::CreateInstance(): Class factory %s failed to create instance of column %s!", m_pInstanceClass->Name().c_str(), GetFullName().c_str());
@@ -1631,7 +1648,7 @@ namespace D3
 	{
 		ColumnLongPtr	pCol = NULL;
 
-		pCol = (ColumnLongPtr) m_pInstanceClass->CreateInstance();
+		pCol = (ColumnLongPtr) ConstructInstance(pEntity);
 
 		if (!pCol)
 			throw Exception(__FILE__, __LINE__, Exception_error, "MetaColumnLong::CreateInstance(): Class factory %s failed to create instance of column %s!", m_pInstanceClass->Name().c_str(), GetFullName().c_str());
@@ -1722,7 +1739,7 @@ namespace D3
 	{
 		ColumnFloatPtr	pCol = NULL;
 
-		pCol = (ColumnFloatPtr) m_pInstanceClass->CreateInstance();
+		pCol = (ColumnFloatPtr) ConstructInstance(pEntity);
 
 		if (!pCol)
 			throw Exception(__FILE__, __LINE__, Exception_error, "MetaColumnFloat::CreateInstance(): Class factory %s failed to create instance of column %s!", m_pInstanceClass->Name().c_str(), GetFullName().c_str());
@@ -1813,7 +1830,7 @@ namespace D3
 	{
 		ColumnDatePtr	pCol = NULL;
 
-		pCol = (ColumnDatePtr) m_pInstanceClass->CreateInstance();
+		pCol = (ColumnDatePtr) ConstructInstance(pEntity);
 
 		if (!pCol)
 			throw Exception(__FILE__, __LINE__, Exception_error, "MetaColumnDate::CreateInstance(): Class factory %s failed to create instance of column %s!", m_pInstanceClass->Name().c_str(), GetFullName().c_str());
@@ -1911,7 +1928,7 @@ namespace D3
 	{
 		ColumnBlobPtr	pCol = NULL;
 
-		pCol = (ColumnBlobPtr) m_pInstanceClass->CreateInstance();
+		pCol = (ColumnBlobPtr) ConstructInstance(pEntity);
 
 		if (!pCol)
 			throw Exception(__FILE__, __LINE__, Exception_error, "MetaColumnBlob::CreateInstance(): Class factory %s failed to create instance of column %s!", m_pInstanceClass->Name().c_str(), GetFullName().c_str());
@@ -2026,7 +2043,7 @@ namespace D3
 	{
 		ColumnBinaryPtr	pCol = NULL;
 
-		pCol = (ColumnBinaryPtr) m_pInstanceClass->CreateInstance();
+		pCol = (ColumnBinaryPtr) ConstructInstance(pEntity);
 
 		if (!pCol)
 			throw Exception(__FILE__, __LINE__, Exception_error, "MetaColumnBinary::CreateInstance(): Class factory %s failed to create instance of column %s!", m_pInstanceClass->Name().c_str(), GetFullName().c_str());
@@ -5102,6 +5119,8 @@ namespace D3
 		{
 			const char		cQuote = '\'';
 			D3Date				dt(m_dtValue);
+			char					szDate[D3_DATE_FORMAT_BUFFER_SIZE];
+			size_t				uLen;
 
 
 			dt.AdjustToTimeZone(m_pMetaColumn->GetMetaEntity()->GetMetaDatabase()->GetTimeZone());
@@ -5110,20 +5129,23 @@ namespace D3
 			switch (m_pMetaColumn->GetMetaEntity()->GetMetaDatabase()->GetTargetRDBMS())
 			{
 				case SQLServer:
+					uLen = dt.FormatString(szDate, sizeof(szDate), 3);
 					strTemp	 = cQuote;
-					strTemp += dt.AsString(3);
+					strTemp += uLen ? szDate : dt.AsString(3);
 					strTemp += cQuote;
 					break;
 
 				case Oracle:
+					uLen = dt.FormatString(szDate, sizeof(szDate));
 					strTemp  = "TO_DATE('";
-					strTemp += dt.AsString();
+					strTemp += uLen ? szDate : dt.AsString();
 					strTemp += "', 'YYYY-MM-DD HH24:MI:SS')";
 					break;
 
 				default:
+					uLen = dt.FormatString(szDate, sizeof(szDate));
 					strTemp  = cQuote;
-					strTemp += dt.AsString();
+					strTemp += uLen ? szDate : dt.AsString();
 					strTemp += cQuote;
 					break;
 			}
@@ -5429,14 +5451,21 @@ namespace D3
 
 	std::string ColumnDate::AsJSON(RoleUserPtr pRoleUser)
 	{
-		std::ostringstream	ostrm;
+		char				szDate[D3_DATE_FORMAT_BUFFER_SIZE + 2];
+		size_t			uLen;
 
 		if (IsNull())
-			ostrm << "null";
-		else
-			ostrm << '"' << m_dtValue.AsISOString(3) << '"';
+			return "null";
 
-		return ostrm.str();
+		uLen = m_dtValue.FormatISOString(szDate + 1, sizeof(szDate) - 2, 3);
+
+		if (!uLen)
+			return '"' + m_dtValue.AsISOString(3) + '"';
+
+		szDate[0] = '"';
+		szDate[uLen + 1] = '"';
+
+		return std::string(szDate, uLen + 2);
 	}
 
 
@@ -139,6 +139,7 @@ namespace D3
 				static const Mask LazyFetch;					//!< 0x00000100 - Column is lazy fetched (not fetched until explicitely requested)
 				static const Mask Password;						//!< 0x00000020 - Column is a password column (ignored if column is not of type string)
 				static const Mask EncodedValue;				//!< 0x00000400 - Only relevant if the column is a string or blob. If this flag is set, the value is will be returned as a base64 encoded string
+				static const Mask ChangeTracking;			//!< 0x00000800 - The RDBMS sets the column to an ever increasing value whenever the row changes (e.g. a rowversion or last modified column, see Database::RefreshCachedEntity())
 
 				static const Mask HiddenOnDetailView;	//!< 0x00000002 - Column will be hidden from entity detail views
 				static const Mask HiddenOnListView;		//!< 0x00000200 - Column will be hidden from entity list views
@@ -290,6 +291,9 @@ namespace D3
 			//! ctor helper
 			void											Init(const std::string & strInstanceClassName, const std::string & strDefaultClassName);
 
+			//! CreateInstance() helper which constructs the instance in pEntity's row buffer if it provides a slot for this
+			ObjectPtr									ConstructInstance(EntityPtr pEntity);
+
 		public:
 			//! Creates ako D3Column
 			/*! Creates ako D3Column based on this (if pEntity is NULL, the instance is detached and must be deleted
@@ -409,6 +413,7 @@ namespace D3
 			bool											IsAutoNum() const									{ return m_Flags & Flags::AutoNum; }			//!< Returns true if this column is an AutoNum column (value set by RDBMS on INSERT), false otherwise.
 			bool											IsDerived() const									{ return m_Flags & Flags::Derived; }			//!< Returns true if this column is not a column of the physical table in the RDBMS, false otherwise.
 			bool											IsEncodedValue() const						{ return m_Flags & Flags::EncodedValue;}	//!< Returns true if this's value will be passed to/retrieved from external clients as base64 encoded strings (external clients are those using ICE to communicate with APALSvc). This only applies to String and BLOB columns.
+			bool											IsChangeTracking() const					{ return m_Flags & Flags::ChangeTracking;}	//!< Returns true if this column's value increases whenever the row changes (rowversion or last modified column)
 
 			//! Returns true if this is a single choice column that knows the allowed values
 			bool											IsSingleChoice() const						{ return m_pMapColumnChoice && (m_Flags & Flags::SingleChoice) && !(m_Flags & Flags::MultiChoice); }
@@ -1695,6 +1700,7 @@ namespace D3
 	{
 		friend class MetaColumn;
 		friend class InstanceKey;
+		friend class Key;
 
 		D3_CLASS_DECL(ColumnString);
 
@@ -1761,6 +1767,7 @@ namespace D3
 	{
 		friend class MetaColumn;
 		friend class InstanceKey;
+		friend class Key;
 
 		D3_CLASS_DECL(ColumnChar);
 
@@ -1825,6 +1832,7 @@ namespace D3
 	{
 		friend class MetaColumn;
 		friend class InstanceKey;
+		friend class Key;
 
 		D3_CLASS_DECL(ColumnShort);
 
@@ -1889,6 +1897,7 @@ namespace D3
 	{
 		friend class MetaColumn;
 		friend class InstanceKey;
+		friend class Key;
 
 		D3_CLASS_DECL(ColumnBool);
 
@@ -1953,6 +1962,7 @@ namespace D3
 	{
 		friend class MetaColumn;
 		friend class InstanceKey;
+		friend class Key;
 
 		D3_CLASS_DECL(ColumnInt);
 
@@ -2017,6 +2027,7 @@ namespace D3
 	{
 		friend class MetaColumn;
 		friend class InstanceKey;
+		friend class Key;
 
 		D3_CLASS_DECL(ColumnLong);
 
@@ -2081,6 +2092,7 @@ namespace D3
 	{
 		friend class MetaColumn;
 		friend class InstanceKey;
+		friend class Key;
 
 		D3_CLASS_DECL(ColumnFloat);
 
@@ -2145,6 +2157,7 @@ namespace D3
 	{
 		friend class MetaColumn;
 		friend class InstanceKey;
+		friend class Key;
 
 		D3_CLASS_DECL(ColumnDate);
 
@@ -187,7 +187,7 @@ namespace D3
 	// no ancestor.
 	//
 	Class::Class(const std::string & strName, D3_CNSTRFUNC pfnCtor, int szObject)
-	 : m_strName(strName), m_pfnCtor(pfnCtor), m_szObject(szObject), m_pAncestor(NULL)
+	 : m_strName(strName), m_pfnCtor(pfnCtor), m_pfnPlacementCtor(NULL), m_szObject(szObject), m_pAncestor(NULL)
 	{
 		GetClassPtrList().push_back(this);
 	}
@@ -196,7 +196,16 @@ namespace D3
 	// ancestor.
 	//
 	Class::Class(const std::string & strName, D3_CNSTRFUNC pfnCtor, int szObject, Class* pAncestor)
-	 : m_strName(strName), m_pfnCtor(pfnCtor), m_szObject(szObject), m_pAncestor(pAncestor)
+	 : m_strName(strName), m_pfnCtor(pfnCtor), m_pfnPlacementCtor(NULL), m_szObject(szObject), m_pAncestor(pAncestor)
+	{
+		GetClassPtrList().push_back(this);
+	}
+
+	// Constructor for the creation of Class class instance for a class with
+	// ancestor which can also be constructed in caller provided memory.
+	//
+	Class::Class(const std::string & strName, D3_CNSTRFUNC pfnCtor, D3_PLACEMENTCNSTRFUNC pfnPlacementCtor, int szObject, Class* pAncestor)
+	 : m_strName(strName), m_pfnCtor(pfnCtor), m_pfnPlacementCtor(pfnPlacementCtor), m_szObject(szObject), m_pAncestor(pAncestor)
 	{
 		GetClassPtrList().push_back(this);
 	}
@@ -327,4 +336,173 @@ namespace D3
 
 
 
+
+	//========================================================================
+	// ObjectArena Implementation
+
+	ObjectArena::ObjectArena()
+	 : m_pSlabNext(NULL), m_pSlabEnd(NULL), m_lBlocksInUse(0), m_uBytesInUse(0)
+	{
+		for (unsigned int idx = 0; idx < D3_ARENA_SIZE_CLASSES; idx++)
+			m_arrFreeList[idx] = NULL;
+	}
+
+
+
+	ObjectArena::~ObjectArena()
+	{
+		assert(m_lBlocksInUse == 0);
+
+		for (unsigned int idx = 0; idx < m_vectSlab.size(); idx++)
+			::operator delete(m_vectSlab[idx]);
+	}
+
+
+
+	void* ObjectArena::Allocate(size_t uSize)
+	{
+		unsigned int		uClass;
+		void*						pMem;
+
+
+		// Large blocks aren't pooled
+		//
+		if (uSize == 0 || uSize > D3_ARENA_MAX_BLOCK)
+		{
+			pMem = ::operator new(uSize);
+
+			boost::mutex::scoped_lock		lk(m_mtxExclusive);
+			m_uBytesInUse += uSize;
+
+			return pMem;
+		}
+
+		uClass = (uSize - 1) / D3_ARENA_GRANULARITY;
+		uSize = (uClass + 1) * D3_ARENA_GRANULARITY;
+
+		boost::mutex::scoped_lock		lk(m_mtxExclusive);
+
+		if (m_arrFreeList[uClass])
+		{
+			pMem = m_arrFreeList[uClass];
+			m_arrFreeList[uClass] = m_arrFreeList[uClass]->pNext;
+		}
+		else
+		{
+			// Start a new slab if the current one is exhausted (the remainder is wasted)
+			//
+			if (m_pSlabNext + uSize > m_pSlabEnd)
+			{
+				m_pSlabNext = (char*) ::operator new(D3_ARENA_SLAB_SIZE);
+				m_pSlabEnd = m_pSlabNext + D3_ARENA_SLAB_SIZE;
+				m_vectSlab.push_back(m_pSlabNext);
+			}
+
+			pMem = m_pSlabNext;
+			m_pSlabNext += uSize;
+		}
+
+		m_lBlocksInUse++;
+		m_uBytesInUse += uSize;
+
+		return pMem;
+	}
+
+
+
+	void ObjectArena::Free(void* pMem, size_t uSize)
+	{
+		FreeBlock*			pBlock;
+		unsigned int		uClass;
+
+
+		if (!pMem)
+			return;
+
+		if (uSize == 0 || uSize > D3_ARENA_MAX_BLOCK)
+		{
+			::operator delete(pMem);
+
+			boost::mutex::scoped_lock		lk(m_mtxExclusive);
+			m_uBytesInUse -= uSize;
+
+			return;
+		}
+
+		uClass = (uSize - 1) / D3_ARENA_GRANULARITY;
+
+		boost::mutex::scoped_lock		lk(m_mtxExclusive);
+
+		pBlock = (FreeBlock*) pMem;
+		pBlock->pNext = m_arrFreeList[uClass];
+		m_arrFreeList[uClass] = pBlock;
+
+		assert(m_lBlocksInUse > 0);
+		m_lBlocksInUse--;
+		m_uBytesInUse -= (uClass + 1) * D3_ARENA_GRANULARITY;
+	}
+
+
+
+	void* ObjectArena::AllocateObject(ObjectArenaPtr pArena, size_t uSize)
+	{
+		ObjectHeader*		pHeader;
+
+
+		uSize += D3_ARENA_HEADER_SIZE;
+
+		if (pArena)
+			pHeader = (ObjectHeader*) pArena->Allocate(uSize);
+		else
+			pHeader = (ObjectHeader*) ::operator new(uSize);
+
+		pHeader->pArena = pArena;
+		pHeader->uSize = uSize;
+
+		return (char*) pHeader + D3_ARENA_HEADER_SIZE;
+	}
+
+
+
+	void ObjectArena::FreeObject(void* pObj)
+	{
+		ObjectHeader*		pHeader;
+
+
+		if (!pObj)
+			return;
+
+		pHeader = (ObjectHeader*) ((char*) pObj - D3_ARENA_HEADER_SIZE);
+
+		if (pHeader->pArena)
+			pHeader->pArena->Free(pHeader, pHeader->uSize);
+		else
+			::operator delete(pHeader);
+	}
+
+
+
+	ObjectPtr ObjectArena::CreateInstance(ObjectArenaPtr pArena, const Class & aClass)
+	{
+		void*						pMem;
+
+
+		if (!pArena || !aClass.CanCreateInstanceInPlace())
+			return aClass.CreateInstance();
+
+		pMem = AllocateObject(pArena, aClass.Size());
+
+		try
+		{
+			return aClass.CreateInstance(pMem);
+		}
+		catch(...)
+		{
+			FreeObject(pMem);
+			throw;
+		}
+	}
+
+
+
 } // end namespace D3
@@ -23,6 +23,7 @@
 	protected: \
 		static	const Class			M_Class; \
 		static  Object*					ClassCtor()		{ return new d3cls(); } \
+		static  Object*					ClassPlacementCtor(void* pMem)	{ return new (pMem) d3cls(); } \
 	public: \
 		static  const Class&		ClassObject() { return M_Class; } \
 		virtual const Class&		IAm() const		{ return M_Class; }
@@ -35,11 +36,23 @@
 		virtual const Class&		IAm() const		{ return M_Class; }
 
 #define D3_CLASS_IMPL(d3cls, d3ancestor) \
-const Class  d3cls::M_Class(#d3cls, &(d3cls::ClassCtor), sizeof(d3cls), (Class*) &(d3ancestor::ClassObject()))
+const Class  d3cls::M_Class(#d3cls, &(d3cls::ClassCtor), &(d3cls::ClassPlacementCtor), sizeof(d3cls), (Class*) &(d3ancestor::ClassObject()))
 
 #define D3_CLASS_IMPL_PV(d3cls, d3ancestor) \
 const Class  d3cls::M_Class(#d3cls, NULL, sizeof(d3cls), (Class*) &(d3ancestor::ClassObject()))
 
+// Classes whose instances can be allocated from a Database's ObjectArena must use
+// this macro (see ObjectArena)
+//
+#define D3_ARENA_OPERATORS \
+	public: \
+		static	void*						operator new(size_t uSize)									{ return ObjectArena::AllocateObject(NULL, uSize); } \
+		static	void*						operator new(size_t uSize, void* pMem)			{ return pMem; } \
+		static	void						operator delete(void* pObj)									{ ObjectArena::FreeObject(pObj); } \
+		static	void						operator delete(void* pObj, void* pMem)			{}
+
+#include <boost/thread/mutex.hpp>
+
 
 
 
@@ -91,6 +104,7 @@ namespace D3
 			std::string					m_strSysadminPWD;
 			std::string					m_strAdminPWD;
 			DatabaseVersionMap	m_mapDBVersions;
+			bool								m_bUseObjectArena;
 
 
 		public:
@@ -103,7 +117,8 @@ namespace D3
 				m_iRejectReusingPasswordsUsedInPastXDays(0),
 				m_iMaxPasswordRetries(0),
 				m_strSysadminPWD("HVpiLQ4KEEsKNwckHHAiJRIgBmEJI3l/"),
-				m_strAdminPWD("0Ud6Qsc0zK+oA/aRkMl3yw==")
+				m_strAdminPWD("0Ud6Qsc0zK+oA/aRkMl3yw=="),
+				m_bUseObjectArena(true)
 			{}
 
 			~Settings() {}
@@ -118,6 +133,9 @@ namespace D3
 			void				Imperial(bool bImperial)												{ m_bImperial = bImperial; }
 			bool				Imperial()																			{	return m_bImperial;	}
 
+			void				UseObjectArena(bool bUse)												{ m_bUseObjectArena = bUse; }
+			bool				UseObjectArena()																{	return m_bUseObjectArena;	}
+
 			void				PasswordExpiresInDays(int days)									{ m_iPasswordExpiresInDays = std::max(days, 0); }
 			int					PasswordExpiresInDays()													{ return m_iPasswordExpiresInDays; }
 
@@ -213,6 +231,7 @@ namespace D3
 	//
 
 	typedef	ObjectPtr (*D3_CNSTRFUNC)();
+	typedef	ObjectPtr (*D3_PLACEMENTCNSTRFUNC)(void*);
 
 	class D3_API Class : public Object
 	{
@@ -230,6 +249,7 @@ namespace D3
 			//
 			std::string					m_strName;			// Class name
 			D3_CNSTRFUNC				m_pfnCtor;			// Function creating a class instance
+			D3_PLACEMENTCNSTRFUNC	m_pfnPlacementCtor;	// Function constructing a class instance in memory provided by the caller
 			int									m_szObject;			// Shallow-copy class instance size
 			Class*							m_pAncestor;		// Ancestor Class class object
 
@@ -238,6 +258,7 @@ namespace D3
 			//
 			Class(const std::string & strName, D3_CNSTRFUNC pfnCtor, int szObject);
 			Class(const std::string & strName, D3_CNSTRFUNC pfnCtor, int szObject, Class* pAncestor);
+			Class(const std::string & strName, D3_CNSTRFUNC pfnCtor, D3_PLACEMENTCNSTRFUNC pfnPlacementCtor, int szObject, Class* pAncestor);
 			~Class();
 
 			bool									operator==(const Class & aCls) const { return this == &aCls; }
@@ -258,6 +279,21 @@ namespace D3
 				return NULL;
 			}
 
+			//! Constructs an instance in pMem which must be at least Size() bytes and suitably aligned.
+			/*! The caller owns the memory and must invoke the destructor explicitly rather
+					than delete the returned object. Returns NULL if the class is abstract.
+			*/
+			ObjectPtr							CreateInstance(void* pMem) const
+			{
+				if (m_pfnPlacementCtor && pMem)
+					return (m_pfnPlacementCtor)(pMem);
+
+				return NULL;
+			}
+
+			//! Returns true if instances can be constructed in caller provided memory
+			bool									CanCreateInstanceInPlace() const	{ return m_pfnPlacementCtor != NULL; }
+
 			// Other public methods
 			//
 			static	ObjectPtr			CreateInstance(const std::string & strClsName);
@@ -289,6 +325,81 @@ namespace D3
 
 	};
 
+
+
+	//! The ObjectArena class is a size-classed slab allocator.
+	/*! Each Database owns an ObjectArena (unless Settings::UseObjectArena() is false)
+			from which the Entity, InstanceKey and Relation objects that belong to the
+			database as well as the Entity row buffers are allocated. Blocks up to
+			D3_ARENA_MAX_BLOCK bytes are carved from D3_ARENA_SLAB_SIZE slabs and recycled
+			through one free list per D3_ARENA_GRANULARITY sized class, larger blocks go to
+			the heap. All slabs are released in one go when the arena is deleted.
+
+			Objects are allocated through AllocateObject() which prepends a small header
+			recording the arena (or NULL if the object lives on the heap) and the size of
+			the block. Classes using D3_ARENA_OPERATORS route new and delete through
+			AllocateObject()/FreeObject() so that a plain delete always returns the memory
+			to where it came from. An ObjectArena must outlive all objects allocated from it.
+	*/
+	class D3_API ObjectArena
+	{
+		protected:
+			#define D3_ARENA_GRANULARITY		16
+			#define D3_ARENA_MAX_BLOCK			512
+			#define D3_ARENA_SIZE_CLASSES		(D3_ARENA_MAX_BLOCK / D3_ARENA_GRANULARITY)
+			#define D3_ARENA_SLAB_SIZE			65536
+			#define D3_ARENA_HEADER_SIZE		16
+
+			//! Free blocks are chained through their first word
+			struct FreeBlock
+			{
+				FreeBlock*				pNext;
+			};
+
+			//! Each block returned by AllocateObject() is preceded by this header
+			struct ObjectHeader
+			{
+				ObjectArenaPtr		pArena;
+				size_t						uSize;
+			};
+
+			boost::mutex							m_mtxExclusive;											//!< Databases can be shared between threads (e.g. the global database)
+			FreeBlock*								m_arrFreeList[D3_ARENA_SIZE_CLASSES];	//!< m_arrFreeList[i] chains free blocks of (i + 1) * D3_ARENA_GRANULARITY bytes
+			std::vector<char*>				m_vectSlab;													//!< All slabs allocated so far
+			char*											m_pSlabNext;												//!< Next unused byte in the current slab
+			char*											m_pSlabEnd;													//!< End of the current slab
+			unsigned long							m_lBlocksInUse;											//!< Number of blocks currently allocated
+			size_t										m_uBytesInUse;											//!< Number of bytes currently allocated (including blocks passed on to the heap)
+
+		public:
+			ObjectArena();
+			//! Releases all slabs. All objects allocated from this must have been destroyed.
+			~ObjectArena();
+
+			//! Returns a block of at least uSize bytes
+			void*											Allocate(size_t uSize);
+			//! Returns a block previously obtained from Allocate(uSize) to this
+			void											Free(void* pMem, size_t uSize);
+
+			//! Returns the number of blocks currently allocated from this
+			unsigned long							GetBlocksInUse()										{ return m_lBlocksInUse; }
+			//! Returns the number of bytes currently allocated from this
+			size_t										GetBytesInUse()											{ return m_uBytesInUse; }
+			//! Returns the number of bytes held by this' slabs
+			size_t										GetReservedSize()										{ return m_vectSlab.size() * D3_ARENA_SLAB_SIZE; }
+
+			//! Allocates uSize bytes plus a header from pArena (or the heap if pArena is NULL)
+			static void*							AllocateObject(ObjectArenaPtr pArena, size_t uSize);
+			//! Releases memory returned by AllocateObject()
+			static void								FreeObject(void* pObj);
+
+			//! Constructs an instance of aClass in memory obtained from pArena (aClass must use D3_ARENA_OPERATORS)
+			/*! If pArena is NULL or aClass can't be constructed in place, the instance is created through the
+					class factory as usual. Either way, the returned object must be released using delete.
+			*/
+			static ObjectPtr					CreateInstance(ObjectArenaPtr pArena, const Class & aClass);
+	};
+
 } // end namespace D3
 
 #endif /* _D3_H_ */
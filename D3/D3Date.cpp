@@ -22,6 +22,8 @@
 #include "D3Types.h"
 
 #include <time.h>
+#include <string.h>
+#include <ctype.h>
 #include <sstream>
 #include <stdexcept>
 #include "D3Date.h"
@@ -79,6 +81,443 @@ std::string& uglyTruncateDateFractions(std::string& strIn, unsigned short fracti
 
 
 
+// Two digit strings for 0 to 99 used by the Format...() methods
+//
+static const char szDigitPairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static const char szMonthNames[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+
+
+static inline char* putTwoDigits(char* p, unsigned int u)
+{
+	p[0] = szDigitPairs[2 * u];
+	p[1] = szDigitPairs[2 * u + 1];
+	return p + 2;
+}
+
+
+
+// Writes the fractional seconds the way uglyTruncateDateFractions() leaves them: at most
+// fractionalPrecision digits, no trailing '0' and nothing at all if all digits are '0'
+//
+static char* putFraction(char* p, unsigned long uMicro, unsigned short fractionalPrecision)
+{
+	char			szDigits[6];
+	unsigned	uDigits = fractionalPrecision > 6 ? 6 : fractionalPrecision;
+
+	for (int i = 5; i >= 0; i--)
+	{
+		szDigits[i] = (char) ('0' + uMicro % 10);
+		uMicro /= 10;
+	}
+
+	while (uDigits > 0 && szDigits[uDigits - 1] == '0')
+		uDigits--;
+
+	if (uDigits > 0)
+	{
+		*p++ = '.';
+		memcpy(p, szDigits, uDigits);
+		p += uDigits;
+	}
+
+	return p;
+}
+
+
+
+// The broken down parts of a tick value
+//
+struct DateTimeParts
+{
+	int						year;
+	unsigned int	month, day, hour, minute, second;
+	unsigned long	micro;
+};
+
+
+
+// Breaks ticks (microseconds since 1970-01-01) down into gregorian date and time parts
+//
+static void splitTicks(D3TimeZone::Ticks lTicks, DateTimeParts & parts)
+{
+	const D3TimeZone::Ticks		lTicksPerDay = 86400000000LL;
+	D3TimeZone::Ticks					lDays = lTicks / lTicksPerDay;
+	D3TimeZone::Ticks					lTime = lTicks % lTicksPerDay;
+
+	if (lTime < 0)
+	{
+		lTime += lTicksPerDay;
+		lDays--;
+	}
+
+	parts.micro		= (unsigned long) (lTime % 1000000);
+	lTime /= 1000000;
+	parts.second	= (unsigned int) (lTime % 60);
+	lTime /= 60;
+	parts.minute	= (unsigned int) (lTime % 60);
+	parts.hour		= (unsigned int) (lTime / 60);
+
+	// Convert days since epoch to a civil date (proleptic gregorian calendar, eras of 400 years)
+	D3TimeZone::Ticks		z = lDays + 719468;
+	D3TimeZone::Ticks		era = (z >= 0 ? z : z - 146096) / 146097;
+	unsigned int				doe = (unsigned int) (z - era * 146097);
+	unsigned int				yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	unsigned int				doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	unsigned int				mp = (5 * doy + 2) / 153;
+
+	parts.day			= doy - (153 * mp + 2) / 5 + 1;
+	parts.month		= mp < 10 ? mp + 3 : mp - 9;
+	parts.year		= (int) (yoe + era * 400) + (parts.month <= 2 ? 1 : 0);
+}
+
+
+
+// Writes YYYY-MM-DDTHH:MM:SS[.fff] or YYYY-Mmm-DD HH:MM:SS[.fff] and returns a pointer past the last character written
+//
+static char* putDateTime(char* p, const DateTimeParts & parts, bool bISO, unsigned short fractionalPrecision)
+{
+	p = putTwoDigits(p, (unsigned int) parts.year / 100 % 100);
+	p = putTwoDigits(p, (unsigned int) parts.year % 100);
+	*p++ = '-';
+
+	if (bISO)
+	{
+		p = putTwoDigits(p, parts.month);
+	}
+	else
+	{
+		memcpy(p, szMonthNames + 3 * (parts.month - 1), 3);
+		p += 3;
+	}
+
+	*p++ = '-';
+	p = putTwoDigits(p, parts.day);
+	*p++ = bISO ? 'T' : ' ';
+	p = putTwoDigits(p, parts.hour);
+	*p++ = ':';
+	p = putTwoDigits(p, parts.minute);
+	*p++ = ':';
+	p = putTwoDigits(p, parts.second);
+
+	if (fractionalPrecision > 0 && parts.micro > 0)
+		p = putFraction(p, parts.micro, fractionalPrecision);
+
+	return p;
+}
+
+
+
+
+
+// The numeric parts of a date string recognised by scanDateString()
+//
+struct DateStringParts
+{
+	int		year, month, day, hour, minute, second, micro;
+	int		ofsHrs, ofsMins;		// signed UTC offset (ISO8601 only)
+};
+
+enum DateStringFormat
+{
+	DateString_Unrecognised,		// Let the regular expressions have a go
+	DateString_Local,						// A format D3Date::operator=() passes to setFromParts()
+	DateString_ISO8601					// A format D3Date::operator=() passes to setFromISO8601()
+};
+
+
+
+// Reads between iMin and iMax digits from p and advances p past them. Returns the number of digits read or -1 if fewer than iMin digits are found.
+//
+static inline int scanDigits(const char*& p, const char* pEnd, int iMin, int iMax, int& iValue)
+{
+	int		iCount = 0;
+
+	iValue = 0;
+
+	while (p < pEnd && iCount < iMax && *p >= '0' && *p <= '9')
+	{
+		iValue = iValue * 10 + (*p++ - '0');
+		iCount++;
+	}
+
+	return iCount < iMin ? -1 : iCount;
+}
+
+
+
+// Reads the digits following a fractional separator as microseconds (extra digits are truncated, missing ones are padded with 0). Returns the number of digits read.
+//
+static inline int scanMicros(const char*& p, const char* pEnd, int& iMicro)
+{
+	int		iCount = 0;
+
+	iMicro = 0;
+
+	while (p < pEnd && *p >= '0' && *p <= '9')
+	{
+		if (iCount < 6)
+			iMicro = iMicro * 10 + (*p - '0');
+
+		p++;
+		iCount++;
+	}
+
+	for (int i = iCount; i < 6; i++)
+		iMicro *= 10;
+
+	return iCount;
+}
+
+
+
+// Reads "h[h]:mm:ss[{.|,}f{1,9}]" which must be followed by pEnd (this is what rgxDateTime and friends accept after the date)
+//
+static bool scanLocalTime(const char* p, const char* pEnd, DateStringParts& parts)
+{
+	if (scanDigits(p, pEnd, 1, 2, parts.hour) < 0)
+		return false;
+
+	if (p == pEnd || *p++ != ':' || scanDigits(p, pEnd, 2, 2, parts.minute) < 0)
+		return false;
+
+	if (p == pEnd || *p++ != ':' || scanDigits(p, pEnd, 2, 2, parts.second) < 0)
+		return false;
+
+	if (p < pEnd && (*p == '.' || *p == ','))
+	{
+		int iDigits = scanMicros(++p, pEnd, parts.micro);
+
+		if (iDigits < 1 || iDigits > 9)
+			return false;
+	}
+
+	return p == pEnd;
+}
+
+
+
+// Single pass scanner for the date formats most frequently passed to D3Date::operator=().
+//
+// The scanner only accepts strings for which it can be certain that the regular expression
+// cascade in D3Date::operator=() would produce the same parts and pass them to the same
+// helper. Anything else yields DateString_Unrecognised so that the regular expressions
+// remain the final authority. Accepted are:
+//
+//   YYYY[-]MM[-]DD[ ][hh[:]mm[:]ss]                               (rgxAPALDateShort/Long)
+//   YYYY[-]MM[-]DDThh[:]mm[:]ss[.f+][Z|{+|-}hh[:]mm]              (rgxISO8601)
+//   YYYY-MM-DD h[h]:mm:ss[{.|,}f{1,9}]                            (rgxDateTime/Micro)
+//   YYYY{/| }M[M]{-|/| }D[D][ h[h]:mm:ss[{.|,}f{1,9}]]            (rgxDate/DateTime/Micro)
+//   YYYY{-|/| }Mon{-|/| }D[D][ h[h]:mm:ss[{.|,}f{1,9}]]           (rgxSimpleDate/DateTime/Micro)
+//
+static DateStringFormat scanDateString(const char* p, const char* pEnd, DateStringParts& parts)
+{
+	static const char		szMonths[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+
+	memset(&parts, 0, sizeof(parts));
+
+	if (scanDigits(p, pEnd, 4, 4, parts.year) < 0 || p == pEnd)
+		return DateString_Unrecognised;
+
+	// Month names
+	if ((*p == '-' || *p == '/' || *p == ' ') && pEnd - p > 3 && isalpha((unsigned char) p[1]))
+	{
+		const char*	pName;
+
+		for (pName = szMonths; *pName; pName += 3)
+		{
+			if (tolower((unsigned char) p[1]) == pName[0] && tolower((unsigned char) p[2]) == pName[1] && tolower((unsigned char) p[3]) == pName[2])
+				break;
+		}
+
+		if (!*pName)
+			return DateString_Unrecognised;
+
+		parts.month = (int) (pName - szMonths) / 3 + 1;
+		p += 4;
+
+		if (p == pEnd || (*p != '-' && *p != '/' && *p != ' '))
+			return DateString_Unrecognised;
+
+		if (scanDigits(++p, pEnd, 1, 2, parts.day) < 0)
+			return DateString_Unrecognised;
+
+		if (p == pEnd)
+			return DateString_Local;
+
+		if (*p != ' ' || !scanLocalTime(p + 1, pEnd, parts))
+			return DateString_Unrecognised;
+
+		return DateString_Local;
+	}
+
+	// rgxDate and friends (neither rgxAPALDate* nor rgxISO8601 accept '/' or ' ' as the first separator)
+	if (*p == '/' || *p == ' ')
+	{
+		if (scanDigits(++p, pEnd, 1, 2, parts.month) < 0)
+			return DateString_Unrecognised;
+
+		if (p == pEnd || (*p != '-' && *p != '/' && *p != ' '))
+			return DateString_Unrecognised;
+
+		if (scanDigits(++p, pEnd, 1, 2, parts.day) < 0)
+			return DateString_Unrecognised;
+
+		if (p == pEnd)
+			return DateString_Local;
+
+		if (*p != ' ' || !scanLocalTime(p + 1, pEnd, parts))
+			return DateString_Unrecognised;
+
+		return DateString_Local;
+	}
+
+	// rgxAPALDate*, rgxISO8601 and rgxDateTime* with '-' separators and a two digit month and day
+	bool	bDash1 = false, bDash2 = false;
+
+	if (*p == '-')
+	{
+		bDash1 = true;
+		p++;
+	}
+
+	if (scanDigits(p, pEnd, 2, 2, parts.month) < 0)
+		return DateString_Unrecognised;
+
+	if (p < pEnd && *p == '-')
+	{
+		bDash2 = true;
+		p++;
+	}
+
+	if (scanDigits(p, pEnd, 2, 2, parts.day) < 0)
+		return DateString_Unrecognised;
+
+	// rgxAPALDateShort
+	if (p == pEnd)
+		return DateString_Local;
+
+	if (*p == 'T')
+	{
+		// rgxISO8601 (insisting on two digit hours)
+		p++;
+
+		if (scanDigits(p, pEnd, 2, 2, parts.hour) < 0)
+			return DateString_Unrecognised;
+
+		if (p < pEnd && *p == ':')
+			p++;
+
+		if (scanDigits(p, pEnd, 2, 2, parts.minute) < 0)
+			return DateString_Unrecognised;
+
+		if (p < pEnd && *p == ':')
+			p++;
+
+		if (scanDigits(p, pEnd, 2, 2, parts.second) < 0)
+			return DateString_Unrecognised;
+
+		if (p < pEnd && *p == '.')
+		{
+			if (scanMicros(++p, pEnd, parts.micro) < 1)
+				return DateString_Unrecognised;
+		}
+
+		if (p == pEnd)
+			return DateString_ISO8601;
+
+		if (*p == 'Z')
+			return p + 1 == pEnd ? DateString_ISO8601 : DateString_Unrecognised;
+
+		if (*p != '+' && *p != '-')
+			return DateString_Unrecognised;
+
+		int		iSign = *p++ == '-' ? -1 : 1;
+
+		if (scanDigits(p, pEnd, 2, 2, parts.ofsHrs) < 0)
+			return DateString_Unrecognised;
+
+		if (p < pEnd && *p == ':')
+			p++;
+
+		if (scanDigits(p, pEnd, 2, 2, parts.ofsMins) < 0 || p != pEnd)
+			return DateString_Unrecognised;
+
+		parts.ofsHrs *= iSign;
+		parts.ofsMins *= iSign;
+
+		return DateString_ISO8601;
+	}
+
+	// rgxAPALDateLong without the optional blank
+	if (*p >= '0' && *p <= '9')
+	{
+		if (scanDigits(p, pEnd, 2, 2, parts.hour) < 0)
+			return DateString_Unrecognised;
+
+		if (p < pEnd && *p == ':')
+			p++;
+
+		if (scanDigits(p, pEnd, 2, 2, parts.minute) < 0)
+			return DateString_Unrecognised;
+
+		if (p < pEnd && *p == ':')
+			p++;
+
+		if (scanDigits(p, pEnd, 2, 2, parts.second) < 0 || p != pEnd)
+			return DateString_Unrecognised;
+
+		return DateString_Local;
+	}
+
+	if (*p != ' ')
+		return DateString_Unrecognised;
+
+	p++;
+
+	// rgxAPALDateLong with the blank: hhmmss with optional colons
+	if (pEnd - p >= 6 && isdigit((unsigned char) p[0]) && isdigit((unsigned char) p[1]))
+	{
+		const char*	pTime = p;
+
+		if (scanDigits(pTime, pEnd, 2, 2, parts.hour) >= 0)
+		{
+			if (pTime < pEnd && *pTime == ':')
+				pTime++;
+
+			if (scanDigits(pTime, pEnd, 2, 2, parts.minute) >= 0)
+			{
+				if (pTime < pEnd && *pTime == ':')
+					pTime++;
+
+				if (scanDigits(pTime, pEnd, 2, 2, parts.second) >= 0 && pTime == pEnd)
+					return DateString_Local;
+			}
+		}
+	}
+
+	// rgxDateTime and rgxDateTimeMicro
+	if (!bDash1 || !bDash2 || !scanLocalTime(p, pEnd, parts))
+		return DateString_Unrecognised;
+
+	return DateString_Local;
+}
+
+
+
+
+
 
 // ==========================================================================
 // D3TimeZone implementation
@@ -89,6 +528,37 @@ D3TimeZone		D3TimeZone::M_defaultServerTimeZone;
 D3TimeZone		D3TimeZone::M_explicitServerTimeZone;
 D3TimeZone		D3TimeZone::M_utcTimeZone("UTC");
 
+D3TimeZone::ZoneInfo*			D3TimeZone::M_arrZoneInfo[D3_TZ_MAX_ZONES];
+volatile unsigned int			D3TimeZone::M_uZoneCount = 0;
+boost::mutex							D3TimeZone::M_mtxZones;
+
+// Sentinel tick values representing boost's special time values
+static const D3TimeZone::Ticks	TICKS_NEG_INFINITY	= -0x7FFFFFFFFFFFFFFFLL - 1;
+static const D3TimeZone::Ticks	TICKS_NOT_A_DATE		= -0x7FFFFFFFFFFFFFFFLL;
+static const D3TimeZone::Ticks	TICKS_POS_INFINITY	=  0x7FFFFFFFFFFFFFFFLL;
+
+// Average length of a gregorian year used to guess the index into a DST table
+static const D3TimeZone::Ticks	TICKS_PER_YEAR			= 31556952000000LL;
+
+static const D3TimeZone::Ticks	TICKS_PER_SECOND		= 1000000LL;
+static const D3TimeZone::Ticks	TICKS_PER_DAY				= 86400000000LL;
+
+static inline bool IsSpecialTicks(D3TimeZone::Ticks l)
+{
+	return l == TICKS_NEG_INFINITY || l == TICKS_NOT_A_DATE || l == TICKS_POS_INFINITY;
+}
+
+// Division which rounds towards negative infinity (so that times before 1970 truncate correctly)
+static inline D3TimeZone::Ticks FloorDiv(D3TimeZone::Ticks l, D3TimeZone::Ticks lDivisor)
+{
+	D3TimeZone::Ticks		q = l / lDivisor;
+
+	if (l % lDivisor != 0 && l < 0)
+		q--;
+
+	return q;
+}
+
 
 
 
@@ -186,6 +656,245 @@ void D3TimeZone::Dump(int indent)
 
 
 
+
+/* static */
+D3TimeZone::Ticks D3TimeZone::ToTicks(const boost::posix_time::ptime & tm)
+{
+	static const boost::posix_time::ptime		tmEpoch(boost::gregorian::date(1970, 1, 1));
+
+	if (tm.is_special())
+	{
+		if (tm.is_neg_infinity())
+			return TICKS_NEG_INFINITY;
+
+		if (tm.is_pos_infinity())
+			return TICKS_POS_INFINITY;
+
+		return TICKS_NOT_A_DATE;
+	}
+
+	return (tm - tmEpoch).total_microseconds();
+}
+
+
+
+
+/* static */
+boost::posix_time::ptime D3TimeZone::FromTicks(Ticks lTicks)
+{
+	static const boost::posix_time::ptime		tmEpoch(boost::gregorian::date(1970, 1, 1));
+
+	switch (lTicks)
+	{
+		case TICKS_NEG_INFINITY:
+			return boost::posix_time::ptime(boost::date_time::neg_infin);
+		case TICKS_NOT_A_DATE:
+			return boost::posix_time::ptime(boost::date_time::not_a_date_time);
+		case TICKS_POS_INFINITY:
+			return boost::posix_time::ptime(boost::date_time::pos_infin);
+	}
+
+	return tmEpoch + boost::posix_time::microseconds(lTicks);
+}
+
+
+
+
+/* static */
+D3TimeZone::ZoneInfo* D3TimeZone::GetZoneInfo(const boost::local_time::time_zone_ptr & pZone)
+{
+	if (!pZone)
+		return NULL;
+
+	const void*		pRaw = pZone.get();
+	unsigned int	uCount = M_uZoneCount;
+	unsigned int	idx;
+
+	// Published entries never change, so this scan doesn't need the lock
+	for (idx = 0; idx < uCount; idx++)
+	{
+		if (M_arrZoneInfo[idx]->pZone.get() == pRaw)
+			return M_arrZoneInfo[idx];
+	}
+
+	boost::mutex::scoped_lock		lk(M_mtxZones);
+
+	// Another thread may have registered the zone while we were waiting
+	for (; idx < M_uZoneCount; idx++)
+	{
+		if (M_arrZoneInfo[idx]->pZone.get() == pRaw)
+			return M_arrZoneInfo[idx];
+	}
+
+	if (M_uZoneCount >= D3_TZ_MAX_ZONES)
+		return NULL;
+
+	ZoneInfo*		pInfo = new ZoneInfo;
+
+	pInfo->pZone				= pZone;
+	pInfo->uIndex				= (unsigned short) (M_uZoneCount + 1);
+	pInfo->lBaseOffset	= pZone->base_utc_offset().total_microseconds();
+	pInfo->lDSTOffset		= pZone->has_dst() ? pZone->dst_offset().total_microseconds() : 0;
+	pInfo->bHasDST			= pZone->has_dst();
+	pInfo->lTableEnd		= ToTicks(boost::posix_time::ptime(boost::gregorian::date(D3_TZ_LAST_YEAR + 1, 1, 1)));
+
+	for (int iYear = D3_TZ_FIRST_YEAR; iYear <= D3_TZ_LAST_YEAR; iYear++)
+	{
+		DSTPeriod &		period = pInfo->arrDST[iYear - D3_TZ_FIRST_YEAR];
+
+		period.lYearStart	= ToTicks(boost::posix_time::ptime(boost::gregorian::date(iYear, 1, 1)));
+		period.lStartUTC	= 0;
+		period.lEndUTC		= 0;
+		period.bValid			= true;
+
+		if (pInfo->bHasDST)
+		{
+			try
+			{
+				// boost treats [start, end - dst) in standard local time as DST, convert this to UTC
+				period.lStartUTC	= ToTicks(pZone->dst_local_start_time(iYear)) - pInfo->lBaseOffset;
+				period.lEndUTC		= ToTicks(pZone->dst_local_end_time(iYear)) - pInfo->lBaseOffset - pInfo->lDSTOffset;
+			}
+			catch (...)
+			{
+				period.bValid = false;
+			}
+		}
+	}
+
+	M_arrZoneInfo[M_uZoneCount] = pInfo;
+	M_uZoneCount++;
+
+	return pInfo;
+}
+
+
+
+
+/* static */
+const D3TimeZone::DSTPeriod* D3TimeZone::GetDSTPeriod(const ZoneInfo* pInfo, Ticks lLocalStd)
+{
+	const int		iYears = D3_TZ_LAST_YEAR - D3_TZ_FIRST_YEAR + 1;
+
+	if (lLocalStd < pInfo->arrDST[0].lYearStart || lLocalStd >= pInfo->lTableEnd)
+		return NULL;
+
+	int		idx = (int) ((lLocalStd - pInfo->arrDST[0].lYearStart) / TICKS_PER_YEAR);
+
+	if (idx >= iYears)
+		idx = iYears - 1;
+
+	while (idx > 0 && lLocalStd < pInfo->arrDST[idx].lYearStart)
+		idx--;
+
+	while (idx + 1 < iYears && lLocalStd >= pInfo->arrDST[idx + 1].lYearStart)
+		idx++;
+
+	return pInfo->arrDST[idx].bValid ? &pInfo->arrDST[idx] : NULL;
+}
+
+
+
+
+/* static */
+D3TimeZone D3TimeZone::GetZone(unsigned short uZoneIdx)
+{
+	if (uZoneIdx == 0 || uZoneIdx > M_uZoneCount)
+		return D3TimeZone();
+
+	return D3TimeZone(M_arrZoneInfo[uZoneIdx - 1]->pZone);
+}
+
+
+
+
+bool D3TimeZone::IsDST(Ticks lUTC) const
+{
+	if (!*this || IsSpecialTicks(lUTC))
+		return false;
+
+	ZoneInfo*		pInfo = GetZoneInfo(*this);
+
+	if (pInfo)
+	{
+		if (!pInfo->bHasDST)
+			return false;
+
+		const DSTPeriod*	pPeriod = GetDSTPeriod(pInfo, lUTC + pInfo->lBaseOffset);
+
+		if (pPeriod)
+		{
+			if (pPeriod->lStartUTC < pPeriod->lEndUTC)
+				return lUTC >= pPeriod->lStartUTC && lUTC < pPeriod->lEndUTC;
+
+			// Southern hemisphere, DST spans the turn of the year
+			return lUTC >= pPeriod->lStartUTC || lUTC < pPeriod->lEndUTC;
+		}
+	}
+
+	return boost::local_time::local_date_time(FromTicks(lUTC), *this).is_dst();
+}
+
+
+
+
+/* static */
+D3TimeZone::Ticks D3TimeZone::GetUTCOffset(const boost::local_time::time_zone_ptr & pZone, Ticks lUTC)
+{
+	if (!pZone || IsSpecialTicks(lUTC))
+		return 0;
+
+	ZoneInfo*		pInfo = GetZoneInfo(pZone);
+
+	if (pInfo)
+	{
+		if (!pInfo->bHasDST)
+			return pInfo->lBaseOffset;
+
+		const DSTPeriod*	pPeriod = GetDSTPeriod(pInfo, lUTC + pInfo->lBaseOffset);
+
+		if (pPeriod)
+		{
+			bool		bDST;
+
+			if (pPeriod->lStartUTC < pPeriod->lEndUTC)
+				bDST = lUTC >= pPeriod->lStartUTC && lUTC < pPeriod->lEndUTC;
+			else
+				bDST = lUTC >= pPeriod->lStartUTC || lUTC < pPeriod->lEndUTC;
+
+			return bDST ? pInfo->lBaseOffset + pInfo->lDSTOffset : pInfo->lBaseOffset;
+		}
+	}
+
+	// Not in the table, let boost work it out
+	return ToTicks(boost::local_time::local_date_time(FromTicks(lUTC), pZone).local_time()) - lUTC;
+}
+
+
+
+
+D3TimeZone::Ticks D3TimeZone::LocalToUTC(Ticks lLocal) const
+{
+	if (!*this || IsSpecialTicks(lLocal))
+		return lLocal;
+
+	Ticks		lBase = (*this)->base_utc_offset().total_microseconds();
+
+	if (!(*this)->has_dst())
+		return lLocal - lBase;
+
+	// Prefer the DST interpretation, this resolves ambiguous times to DST and
+	// times which don't exist (the hour skipped in spring) to standard time
+	Ticks		lDSTCandidate = lLocal - lBase - (*this)->dst_offset().total_microseconds();
+
+	if (IsDST(lDSTCandidate))
+		return lDSTCandidate;
+
+	return lLocal - lBase;
+}
+
+
+
 // ==========================================================================
 // D3Date implementation
 //
@@ -252,9 +961,34 @@ D3Date & D3Date::operator=(const std::string & strDateIn)
 	static const boost::regex		rgxDateTime						("\\A(\\d{4})[-/ ](\\d{1,2})[-/ ](\\d{1,2})\\s+(\\d{1,2})[:](\\d{2})[:](\\d{2})\\z");
 	static const boost::regex		rgxDateTimeMicro			("\\A(\\d{4})[-/ ](\\d{1,2})[-/ ](\\d{1,2})\\s+(\\d{1,2})[:](\\d{2})[:](\\d{2})[\\.,](\\d{1,9})\\z");
 	boost::smatch								matchResult;
-	std::string									strDate(strDateIn);
 	std::string::size_type			pos;
 	std::string									strParts[7];		// [0]=year,[1]=month,[2]=day,[3]=hour,[4]=min,[5]=secs,[6]=micros
+	DateStringParts							parts;
+	const char*									pBegin = strDateIn.c_str();
+	const char*									pEnd = pBegin + strDateIn.size();
+
+	// Try the scanner first, it handles all frequently used formats without allocating memory
+	while (pBegin < pEnd && *pBegin == ' ')
+		pBegin++;
+
+	while (pEnd > pBegin && pEnd[-1] == ' ')
+		pEnd--;
+
+	switch (scanDateString(pBegin, pEnd, parts))
+	{
+		case DateString_Local:
+			setFromParts(parts.year, parts.month, parts.day, parts.hour, parts.minute, parts.second, parts.micro);
+			return *this;
+
+		case DateString_ISO8601:
+			setFromISO8601(parts.year, parts.month, parts.day, parts.hour, parts.minute, parts.second, parts.micro, parts.ofsHrs, parts.ofsMins);
+			return *this;
+
+		default:
+			break;
+	}
+
+	std::string									strDate(strDateIn);
 
 	// remove leading and trailing blanks
 	pos = strDate.find_first_not_of(' ');
@@ -414,7 +1148,13 @@ bool D3Date::HasFractional()
 // AsUTCString
 std::string D3Date::AsString(unsigned short fractionalPrecision) const
 {
-	std::string strBuffer(boost::posix_time::to_simple_string(local_time()));
+	char		szBuffer[D3_DATE_FORMAT_BUFFER_SIZE];
+	size_t	uLen = FormatString(szBuffer, sizeof(szBuffer), fractionalPrecision);
+
+	if (uLen)
+		return std::string(szBuffer, uLen);
+
+	std::string strBuffer(boost::posix_time::to_simple_string(LocalTime()));
 	uglyTruncateDateFractions(strBuffer, fractionalPrecision);
 	return  strBuffer;
 }
@@ -425,6 +1165,12 @@ std::string D3Date::AsString(unsigned short fractionalPrecision) const
 // AsUTCString
 std::string D3Date::AsUTCString(unsigned short fractionalPrecision) const
 {
+	char		szBuffer[D3_DATE_FORMAT_BUFFER_SIZE];
+	size_t	uLen = FormatUTCString(szBuffer, sizeof(szBuffer), fractionalPrecision);
+
+	if (uLen)
+		return std::string(szBuffer, uLen);
+
 	std::string strBuffer(boost::posix_time::to_simple_string(utc_time()));
 	uglyTruncateDateFractions(strBuffer, fractionalPrecision);
 	return  strBuffer;
@@ -494,18 +1240,27 @@ std::string D3Date::As24HrLocalString(unsigned short fractionalPrecision, bool b
 // AsISOString
 std::string D3Date::AsISOString(unsigned short fractionalPrecision) const
 {
+	char																szBuffer[D3_DATE_FORMAT_BUFFER_SIZE];
+	size_t															uLen = FormatISOString(szBuffer, sizeof(szBuffer), fractionalPrecision);
+
+	if (uLen)
+		return std::string(szBuffer, uLen);
+
 	std::string													strISO8601;
-	boost::posix_time::ptime						tm(local_time());
-	boost::posix_time::time_duration		td = utc_time() - tm;
+	Ticks																lUTC = GetUTCTicks();
+	Ticks																lOffset = D3TimeZone::GetUTCOffset(zone(), lUTC);
+	Ticks																lAbsOffset = lOffset < 0 ? -lOffset : lOffset;
+	int																	iHours = (int) (lAbsOffset / (3600 * TICKS_PER_SECOND));
+	int																	iMinutes = (int) ((lAbsOffset / (60 * TICKS_PER_SECOND)) % 60);
 
-	strISO8601 = asBaseISO8601String(local_time(), fractionalPrecision);
+	strISO8601 = asBaseISO8601String(is_special() ? local_time() : D3TimeZone::FromTicks(lUTC + lOffset), fractionalPrecision);
 
-	strISO8601 += td.is_negative() ? '+' : '-';
-	strISO8601 += '0' + (char) (abs(td.hours()) / 10);
-	strISO8601 += '0' + (char) (abs(td.hours()) % 10);
+	strISO8601 += lOffset > 0 ? '+' : '-';
+	strISO8601 += '0' + (char) (iHours / 10);
+	strISO8601 += '0' + (char) (iHours % 10);
 	strISO8601 += ':';
-	strISO8601 += '0' + (char) (abs(td.minutes()) / 10);
-	strISO8601 += '0' + (char) (abs(td.minutes()) % 10);
+	strISO8601 += '0' + (char) (iMinutes / 10);
+	strISO8601 += '0' + (char) (iMinutes % 10);
 
 	return strISO8601;
 }
@@ -517,6 +1272,12 @@ std::string D3Date::AsISOString(unsigned short fractionalPrecision) const
 // AsUTCISOString
 std::string D3Date::AsUTCISOString(unsigned short fractionalPrecision) const
 {
+	char					szBuffer[D3_DATE_FORMAT_BUFFER_SIZE];
+	size_t				uLen = FormatUTCISOString(szBuffer, sizeof(szBuffer), fractionalPrecision);
+
+	if (uLen)
+		return std::string(szBuffer, uLen);
+
 	std::string		strISO8601 = asBaseISO8601String(utc_time(), fractionalPrecision);
 
 	strISO8601 += 'Z';
@@ -528,6 +1289,92 @@ std::string D3Date::AsUTCISOString(unsigned short fractionalPrecision) const
 
 
 
+size_t D3Date::FormatString(char* pBuffer, size_t uBufferSize, unsigned short fractionalPrecision) const
+{
+	if (is_special() || !pBuffer || uBufferSize < D3_DATE_FORMAT_BUFFER_SIZE)
+		return 0;
+
+	DateTimeParts		parts;
+	char*						p;
+
+	splitTicks(GetLocalTicks(), parts);
+	p = putDateTime(pBuffer, parts, false, fractionalPrecision);
+	*p = '\0';
+
+	return p - pBuffer;
+}
+
+
+
+
+
+size_t D3Date::FormatUTCString(char* pBuffer, size_t uBufferSize, unsigned short fractionalPrecision) const
+{
+	if (is_special() || !pBuffer || uBufferSize < D3_DATE_FORMAT_BUFFER_SIZE)
+		return 0;
+
+	DateTimeParts		parts;
+	char*						p;
+
+	splitTicks(GetUTCTicks(), parts);
+	p = putDateTime(pBuffer, parts, false, fractionalPrecision);
+	*p = '\0';
+
+	return p - pBuffer;
+}
+
+
+
+
+
+size_t D3Date::FormatISOString(char* pBuffer, size_t uBufferSize, unsigned short fractionalPrecision) const
+{
+	if (is_special() || !pBuffer || uBufferSize < D3_DATE_FORMAT_BUFFER_SIZE)
+		return 0;
+
+	DateTimeParts		parts;
+	char*						p;
+	Ticks						lUTC = GetUTCTicks();
+	Ticks						lOffset = D3TimeZone::GetUTCOffset(zone(), lUTC);
+	Ticks						lAbsOffset = lOffset < 0 ? -lOffset : lOffset;
+
+	splitTicks(lUTC + lOffset, parts);
+	p = putDateTime(pBuffer, parts, true, fractionalPrecision);
+
+	// Same as AsISOString(): a zero offset is written as -00:00
+	*p++ = lOffset > 0 ? '+' : '-';
+	p = putTwoDigits(p, (unsigned int) (lAbsOffset / (3600 * TICKS_PER_SECOND) % 100));
+	*p++ = ':';
+	p = putTwoDigits(p, (unsigned int) ((lAbsOffset / (60 * TICKS_PER_SECOND)) % 60));
+	*p = '\0';
+
+	return p - pBuffer;
+}
+
+
+
+
+
+size_t D3Date::FormatUTCISOString(char* pBuffer, size_t uBufferSize, unsigned short fractionalPrecision) const
+{
+	if (is_special() || !pBuffer || uBufferSize < D3_DATE_FORMAT_BUFFER_SIZE)
+		return 0;
+
+	DateTimeParts		parts;
+	char*						p;
+
+	splitTicks(GetUTCTicks(), parts);
+	p = putDateTime(pBuffer, parts, true, fractionalPrecision);
+	*p++ = 'Z';
+	*p = '\0';
+
+	return p - pBuffer;
+}
+
+
+
+
+
 // Format
 std::string	D3Date::Format(const std::string& strMask) const
 {
@@ -852,10 +1699,6 @@ void	D3Date::setFromParts (const std::string& strYear,
 	int short year, month, day, hour, minute, second;
 	int				micro;
 
-	const int	iMaxYear = 2037;
-	const int	iMaxMonth = 12;
-	const int	iMaxDay = 31;
-
 	// the month can be a 3 char month name
 	if (strMonth.length() == 3)
 	{
@@ -894,6 +1737,17 @@ void	D3Date::setFromParts (const std::string& strYear,
 	minute	= atoi(strMinute.c_str());
 	second	= atoi(strSecond.c_str());
 
+	setFromParts(year, month, day, hour, minute, second, micro);
+}
+
+
+
+void	D3Date::setFromParts(int year, int month, int day, int hour, int minute, int second, int micro)
+{
+	const int	iMaxYear = 2037;
+	const int	iMaxMonth = 12;
+	const int	iMaxDay = 31;
+
 	if (year < 100)
 		year += 2000;
 
@@ -924,7 +1778,7 @@ void D3Date::setFromISO8601(const boost::smatch& matches)
 	std::string								aryMatch[20];
 	int short									year, month, day, hour, minute, second;
 	int												micro;
-	boost::posix_time::ptime	tm;
+	int short									ofsHrs = 0, ofsMins = 0;
 
 
 	for (unsigned idx=0; idx < matches.size() && idx < 20; idx++)
@@ -934,11 +1788,10 @@ void D3Date::setFromISO8601(const boost::smatch& matches)
 	month		= atoi(aryMatch[3].c_str());
 	day			= atoi(aryMatch[5].c_str());
 
-	boost::gregorian::date							dt(year, month, day);
-
 	if (aryMatch[7].empty())
 	{
-		tm = boost::posix_time::ptime(dt);
+		hour = minute = second = 0;
+		micro = 0;
 	}
 	else
 	{
@@ -968,25 +1821,33 @@ void D3Date::setFromISO8601(const boost::smatch& matches)
 			micro = 0;
 		}
 
-		assert(month > 12 || day > 31 || hour > 23 || minute > 59 || second > 59 || micro > 999999 == false);
-
-		boost::posix_time::time_duration		t(hour, minute, second, micro);
-
-		tm = boost::posix_time::ptime(dt, t);
-
 		// Nothing or a 'Z' indicates UTC, otherwise we expect something like [+|-]hh[:]mm
 		if (!aryMatch[14].empty() && aryMatch[14] != "Z")
 		{
-			int short														opr, ofsHrs, ofsMins;
+			int short														opr;
 
 			opr = ((aryMatch[15] == "-") ? -1 : 1);
 			ofsHrs = opr * atoi(aryMatch[16].c_str());
 			ofsMins = opr * atoi(aryMatch[18].c_str());
-
-			tm = tm - boost::posix_time::time_duration(ofsHrs, ofsMins, 0);
 		}
 	}
 
+	setFromISO8601(year, month, day, hour, minute, second, micro, ofsHrs, ofsMins);
+}
+
+
+
+void D3Date::setFromISO8601(int year, int month, int day, int hour, int minute, int second, int micro, int ofsHrs, int ofsMins)
+{
+	boost::gregorian::date							dt(year, month, day);
+
+	assert(month > 12 || day > 31 || hour > 23 || minute > 59 || second > 59 || micro > 999999 == false);
+
+	boost::posix_time::ptime						tm(dt, boost::posix_time::time_duration(hour, minute, second, micro));
+
+	if (ofsHrs || ofsMins)
+		tm = tm - boost::posix_time::time_duration(ofsHrs, ofsMins, 0);
+
 	*this = D3Date(tm, zone());
 }
 
@@ -1065,6 +1926,16 @@ void D3Date::AdjustToTimeZone(D3TimeZone tz)
 
 int D3Date::Compare(D3Date & dtRHS) const
 {
+	if (!is_special() && !dtRHS.is_special())
+	{
+		// Both sides as whole local seconds in this' zone
+		Ticks		lUTCLHS = GetUTCTicks(), lUTCRHS = dtRHS.GetUTCTicks();
+		Ticks		lLHS = FloorDiv(lUTCLHS + D3TimeZone::GetUTCOffset(zone(), lUTCLHS), TICKS_PER_SECOND);
+		Ticks		lRHS = FloorDiv(lUTCRHS + D3TimeZone::GetUTCOffset(zone(), lUTCRHS), TICKS_PER_SECOND);
+
+		return lLHS < lRHS ? -1 : (lLHS > lRHS ? 1 : 0);
+	}
+
 	D3Date																					dtRHSNormalized(dtRHS.utc_time(), (D3TimeZone) zone());
 	boost::posix_time::ptime::date_type							dLHS(local_time().date()), dRHS(dtRHSNormalized.local_time().date());
 	boost::posix_time::time_duration::duration_type	tmLHS(local_time().time_of_day()), tmRHS(dtRHSNormalized.local_time().time_of_day());
@@ -1101,6 +1972,16 @@ int D3Date::Compare(D3Date & dtRHS) const
 
 int D3Date::CompareDateOnly(D3Date & dtRHS) const
 {
+	if (!is_special() && !dtRHS.is_special())
+	{
+		// Both sides as local days in this' zone
+		Ticks		lUTCLHS = GetUTCTicks(), lUTCRHS = dtRHS.GetUTCTicks();
+		Ticks		lLHS = FloorDiv(lUTCLHS + D3TimeZone::GetUTCOffset(zone(), lUTCLHS), TICKS_PER_DAY);
+		Ticks		lRHS = FloorDiv(lUTCRHS + D3TimeZone::GetUTCOffset(zone(), lUTCRHS), TICKS_PER_DAY);
+
+		return lLHS < lRHS ? -1 : (lLHS > lRHS ? 1 : 0);
+	}
+
 	D3Date																					dtRHSNormalized(dtRHS.utc_time(), (D3TimeZone) zone());
 	boost::posix_time::ptime::date_type							dLHS(local_time().date()), dRHS(dtRHSNormalized.local_time().date());
 
@@ -1126,7 +2007,11 @@ std::string D3Date::getTZAbbrv() const
 {
 	bool bDST = false;
 
-	if (this->zone()->has_dst())
+	if (!is_special())
+	{
+		bDST = D3TimeZone(zone()).IsDST(GetUTCTicks());
+	}
+	else if (this->zone()->has_dst())
 	{
 		if (this->zone()->dst_local_start_time(this->getYear()) < this->zone()->dst_local_end_time(this->getYear()))
 			bDST = local_time() >= this->zone()->dst_local_start_time(this->getYear()) && local_time() <= this->zone()->dst_local_end_time(this->getYear());
@@ -21,6 +21,7 @@
 #include <boost/date_time/gregorian/gregorian.hpp>
 #include <boost/date_time/local_time/local_time.hpp>
 #include <boost/regex.hpp>
+#include <boost/thread/mutex.hpp>
 
 #ifdef APAL_SUPPORT_ODBC
 	#include <odbc++/types.h>
@@ -30,6 +31,12 @@
 	#include "OTLParams.h"
 #endif
 
+#define D3_TZ_MAX_ZONES				64			//!< Maximum number of distinct zones that get a DST table (other zones fall back to boost's calculations)
+#define D3_TZ_FIRST_YEAR			1970		//!< First year covered by the DST tables
+#define D3_TZ_LAST_YEAR				2100		//!< Last year covered by the DST tables
+
+#define D3_DATE_FORMAT_BUFFER_SIZE	40		//!< Minimum size of the buffer passed to the D3Date::Format...() methods
+
 //! A D3TimeZone is a boost smart pointer holding a pointer to a time zone
 /*! The purpose of this class is to provided additional mechanisms required
 		to conver native data store dates to a date type common to all other
@@ -37,11 +44,45 @@
 */
 class D3TimeZone : public boost::local_time::time_zone_ptr
 {
+	public:
+		//! Microseconds since 1970-01-01 00:00:00
+		typedef boost::int64_t				Ticks;
+
 	protected:
+		//! The DST period of one year expressed in UTC ticks
+		struct DSTPeriod
+		{
+			Ticks												lYearStart;				//!< Jan 1st 00:00:00 of the year in standard local time ticks
+			Ticks												lStartUTC;				//!< DST starts at this UTC tick
+			Ticks												lEndUTC;					//!< DST ends at this UTC tick
+			bool												bValid;						//!< False if boost couldn't compute the DST period for the year
+		};
+
+		//! The transition table for a zone
+		struct ZoneInfo
+		{
+			boost::local_time::time_zone_ptr	pZone;						//!< Holds on to the zone so that its address can't be reused
+			unsigned short							uIndex;						//!< The zone index (1 based)
+			Ticks												lBaseOffset;			//!< Standard offset from UTC
+			Ticks												lDSTOffset;				//!< Additional offset during DST
+			bool												bHasDST;					//!< True if the zone observes DST
+			Ticks												lTableEnd;				//!< Jan 1st 00:00:00 of the year following D3_TZ_LAST_YEAR
+			DSTPeriod										arrDST[D3_TZ_LAST_YEAR - D3_TZ_FIRST_YEAR + 1];
+		};
+
 		static D3TimeZone							M_explicitServerTimeZone;
 		static D3TimeZone							M_defaultServerTimeZone;
 		static D3TimeZone							M_utcTimeZone;
 
+		static ZoneInfo*							M_arrZoneInfo[D3_TZ_MAX_ZONES];		//!< Registered zones (M_arrZoneInfo[idx - 1] has zone index idx)
+		static volatile unsigned int	M_uZoneCount;											//!< Number of entries in M_arrZoneInfo (entries never change once published)
+		static boost::mutex						M_mtxZones;												//!< Serialises registering zones
+
+		//! Returns the transition table for pZone, registering the zone if needed (returns NULL if pZone is NULL or the registry is full)
+		D3_API	static ZoneInfo*									GetZoneInfo(const boost::local_time::time_zone_ptr & pZone);
+		//! Returns the DST period for the year in which the standard local time lLocalStd falls (NULL if out of range or invalid)
+		D3_API	static const DSTPeriod*						GetDSTPeriod(const ZoneInfo* pInfo, Ticks lLocalStd);
+
 	public:
 		//! Essentially, same as UTC
 		D3_API	D3TimeZone() {}
@@ -107,6 +148,35 @@ class D3TimeZone : public boost::local_time::time_zone_ptr
 		*/
 		D3_API	void																Dump(int indent = 0);
 
+		//! Returns a small number identifying this zone (0 if this is empty or the zone couldn't be registered)
+		/*! Zones are registered on first use and get a table of DST periods for the years
+				D3_TZ_FIRST_YEAR to D3_TZ_LAST_YEAR so that converting between UTC and local time
+				becomes a table lookup. Zones are identified by the address of the underlying boost
+				time zone object, so reuse D3TimeZone objects rather than creating them from strings
+				over and over.
+		*/
+		D3_API	unsigned short											GetZoneIndex() const	{ ZoneInfo* pInfo = GetZoneInfo(*this); return pInfo ? pInfo->uIndex : 0; }
+
+		//! Returns the zone with the specified index (an empty D3TimeZone if uZoneIdx is unknown)
+		D3_API	static D3TimeZone										GetZone(unsigned short uZoneIdx);
+
+		//! Returns the offset of local time from UTC in ticks for the UTC time lUTC
+		D3_API	Ticks																GetUTCOffset(Ticks lUTC) const				{ return GetUTCOffset(*this, lUTC); }
+		//! Returns the offset of local time from UTC in ticks for the UTC time lUTC in zone pZone
+		D3_API	static Ticks												GetUTCOffset(const boost::local_time::time_zone_ptr & pZone, Ticks lUTC);
+
+		//! Converts the local time lLocal to UTC (ambiguous local times resolve to DST, non-existing ones to standard time)
+		D3_API	Ticks																LocalToUTC(Ticks lLocal) const;
+
+		//! Returns true if the UTC time lUTC falls into DST in this zone
+		D3_API	bool																IsDST(Ticks lUTC) const;
+
+		//! Converts a ptime to ticks (special values map to sentinel ticks which FromTicks() maps back)
+		D3_API	static Ticks												ToTicks(const boost::posix_time::ptime & tm);
+		//! Converts ticks to a ptime
+		D3_API	static boost::posix_time::ptime			FromTicks(Ticks lTicks);
+
+
 		//! Returns the UTC time zone
 		D3_API	static D3TimeZone										GetUTCTimeZone()		{ return M_utcTimeZone; }
 
@@ -149,6 +219,25 @@ class D3_API D3Date : public boost::local_time::local_date_time
 	public:
 		static const char*	MaxISO8601DateTime;		//!< Contains "20371231T23:59:59Z" which can be passed in a D3Date ctor like D3Date(D3Date::MaxISO8601DateTime) to create a date tim value that works reliably in C++, ruby and javascript
 
+		typedef D3TimeZone::Ticks		Ticks;
+
+		//! A compact representation of a D3Date: UTC microseconds since epoch plus a zone index (see D3TimeZone::GetZoneIndex())
+		/*! Unlike a D3Date, a Compact is a plain 16 byte value without a reference counted
+				time zone pointer, so it is cheap to copy, compare and hash.
+		*/
+		struct Compact
+		{
+			Ticks						lUTC;
+			unsigned short	uZoneIdx;
+
+			Compact() : lUTC(0), uZoneIdx(0) {}
+			Compact(Ticks l, unsigned short u) : lUTC(l), uZoneIdx(u) {}
+
+			bool	operator< (const Compact & rhs) const		{ return lUTC <  rhs.lUTC; }
+			bool	operator==(const Compact & rhs) const		{ return lUTC == rhs.lUTC; }
+			bool	operator!=(const Compact & rhs) const		{ return lUTC != rhs.lUTC; }
+		};
+
 		//! The passed time information understood to be in the passed tz. The DST flag is calculated according to the specified rule. May throw a ambiguous_result or time_label_invalid exception.
 		D3Date(	boost::gregorian::date d,
 						time_duration_type t,
@@ -175,6 +264,12 @@ class D3_API D3Date : public boost::local_time::local_date_time
 		//! The default constructor will set this date to Now()
 		D3Date(D3TimeZone tz = D3TimeZone::GetLocalServerTimeZone());
 
+		//! Constructs a date from its compact representation
+		explicit
+		D3Date(const Compact & compact)
+			: boost::local_time::local_date_time(D3TimeZone::FromTicks(compact.lUTC), D3TimeZone::GetZone(compact.uZoneIdx))
+		{}
+
 		//! Converts a date string to a D3Date (see operator=(const std::string&) for details)
 		/*! Please refer to operator=() for a detailed explanations on how the string is interpreted.
 		*/
@@ -275,6 +370,24 @@ class D3_API D3Date : public boost::local_time::local_date_time
 		//! Convert to UTC YYYYMMDDTHHMMSS[.ffffff]Z Fractional seconds only included if non-zero and fractionalPrecision > 0.
 		std::string			AsUTCISOString(unsigned short fractionalPrecision = 6) const;
 
+		//! @name Allocation free formatting
+		/*! These methods write the same text as their As...() counterparts into a buffer supplied
+				by the caller without using streams, locales or the heap. The text is '\0' terminated.
+				They return the number of characters written (excluding the '\0') or 0 if this is a
+				special value (e.g. not-a-date-time) or if uBufferSize is less than
+				D3_DATE_FORMAT_BUFFER_SIZE. In the latter cases nothing is written.
+		*/
+		//@{
+		//! Same as AsString()
+		size_t					FormatString(char* pBuffer, size_t uBufferSize, unsigned short fractionalPrecision = 0) const;
+		//! Same as AsUTCString()
+		size_t					FormatUTCString(char* pBuffer, size_t uBufferSize, unsigned short fractionalPrecision = 0) const;
+		//! Same as AsISOString()
+		size_t					FormatISOString(char* pBuffer, size_t uBufferSize, unsigned short fractionalPrecision = 6) const;
+		//! Same as AsUTCISOString()
+		size_t					FormatUTCISOString(char* pBuffer, size_t uBufferSize, unsigned short fractionalPrecision = 6) const;
+		//@}
+
 		//! Return a string that reflects this in compliance with with the strMask passed in.
 		/*!
 				The strMask parameter is interpreted as follows [samples in brackets]:
@@ -337,15 +450,25 @@ class D3_API D3Date : public boost::local_time::local_date_time
 		//! Returns true if this has fractional seconds (milli and nano seconds)
 		bool						HasFractional();
 
+		//! Returns this as UTC microseconds since epoch
+		Ticks						GetUTCTicks() const					{ return D3TimeZone::ToTicks(utc_time()); }
+		//! Returns this as local microseconds since epoch (uses the zone's DST table)
+		Ticks						GetLocalTicks() const				{ Ticks lUTC = GetUTCTicks(); return lUTC + D3TimeZone::GetUTCOffset(zone(), lUTC); }
+		//! Returns this' compact representation
+		Compact					AsCompact() const						{ return Compact(GetUTCTicks(), D3TimeZone(zone()).GetZoneIndex()); }
+
+		//! Same as local_time() but uses the zone's DST table rather than evaluating the DST rules
+		boost::posix_time::ptime	LocalTime() const		{ if (is_special()) return local_time(); return D3TimeZone::FromTicks(GetLocalTicks()); }
+
 		//@{ Date component accessors
-		unsigned short	getYear() const					{ return local_time().date().year(); }
-		unsigned short	getMonth() const				{ return local_time().date().month(); }
-		unsigned short	getDay() const					{ return local_time().date().day(); }
-		unsigned long		getHours() const				{ return local_time().time_of_day().hours(); }
-		unsigned long		getMinutes() const			{ return local_time().time_of_day().minutes(); }
-		unsigned long		getSeconds() const			{ return local_time().time_of_day().seconds(); }
-		unsigned long		getMicroseconds() const	{ return (long) local_time().time_of_day().fractional_seconds(); }
-		unsigned short	getDayofWeek() const		{ return local_time().date().day_of_week().as_number(); }
+		unsigned short	getYear() const					{ return LocalTime().date().year(); }
+		unsigned short	getMonth() const				{ return LocalTime().date().month(); }
+		unsigned short	getDay() const					{ return LocalTime().date().day(); }
+		unsigned long		getHours() const				{ return LocalTime().time_of_day().hours(); }
+		unsigned long		getMinutes() const			{ return LocalTime().time_of_day().minutes(); }
+		unsigned long		getSeconds() const			{ return LocalTime().time_of_day().seconds(); }
+		unsigned long		getMicroseconds() const	{ return (long) LocalTime().time_of_day().fractional_seconds(); }
+		unsigned short	getDayofWeek() const		{ return LocalTime().date().day_of_week().as_number(); }
 
 		unsigned short	getUTCYear() const							{ return utc_time().date().year(); }
 		unsigned short	getUTCMonth() const							{ return utc_time().date().month(); }
@@ -431,9 +554,15 @@ class D3_API D3Date : public boost::local_time::local_date_time
 																											const std::string& strSecond = "0",
 																											const std::string& strMicro = "0");
 
+		//! Same as above but takes numeric parts (strMicro above corresponds to micro here)
+		void																setFromParts(int year, int month, int day, int hour, int minute, int second, int micro);
+
 		//! Helper that attempts to set this from the IS8601 parts passed in.
 		void																setFromISO8601(const boost::smatch& matches);
 
+		//! Same as above but takes numeric parts. The time is UTC adjusted by the signed offset ofsHrs:ofsMins
+		void																setFromISO8601(int year, int month, int day, int hour, int minute, int second, int micro, int ofsHrs, int ofsMins);
+
 		//! returns this as a ptime object converted to the local date/time
 		static boost::posix_time::ptime			asLocalDate(const boost::posix_time::ptime& utcTime);
 
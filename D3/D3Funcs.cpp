@@ -1127,7 +1127,12 @@ namespace D3
 		if (outVal == NULL)
 			throw Exception(__FILE__, __LINE__, Exception_error, "Convert(char*, bool, unsigned int) output argument is NULL.");
 
-		strncpy(outVal, inVal.AsISOString().c_str(), outSize);
+		char		szDate[D3_DATE_FORMAT_BUFFER_SIZE];
+
+		if (inVal.FormatISOString(szDate, sizeof(szDate)))
+			strncpy(outVal, szDate, outSize);
+		else
+			strncpy(outVal, inVal.AsISOString().c_str(), outSize);
 	}
 
 
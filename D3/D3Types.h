@@ -123,6 +123,7 @@ typedef unsigned char D3_BYTE;
 #include <map>
 #include <set>
 #include <vector>
+#include <new>
 #include <algorithm>
 #include <stdio.h>
 #include <math.h>
@@ -201,6 +202,7 @@ namespace D3
 	D3_CLASS_TYPEDEFS(Class);
 	D3_CLASS_TYPEDEFS(Object);
 	D3_CLASS_TYPEDEFS(Archiver);
+	D3_CLASS_TYPEDEFS(ObjectArena);
 
 	D3_CLASS_TYPEDEFS(ODBCDatabase);
 	D3_CLASS_TYPEDEFS(OTLDatabase);
@@ -302,13 +304,15 @@ namespace D3
 			keep one Relation object per Database if the related Entity is not part
 			of a \a cached Entity.
 
-			The following typedefs support a generalised implementation of relation collections:
+			The following typedefs support a generalised implementation of relation collections
+			(see RelationSlot):
 	*/
 	//@{
+	class RelationSlot;
 	typedef std::map<DatabasePtr, RelationPtr>						RelationPtrMap;
 	typedef RelationPtrMap*																RelationPtrMapPtr;
 	typedef RelationPtrMap::iterator											RelationPtrMapItr;
-	typedef std::vector<RelationPtrMapPtr>								DatabaseRelationVect;
+	typedef std::vector<RelationSlot>											DatabaseRelationVect;
 	typedef DatabaseRelationVect*													DatabaseRelationVectPtr;
 	typedef DatabaseRelationVect::iterator								DatabaseRelationVectItr;
 	//@}
@@ -89,6 +89,14 @@ int							g_GlobalD3DebugLevel = 0;
 // #include <ifstream>
 #include <json/json.h>
 
+// Required for cache snapshots
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
 // uses Centerpoint XML
 #include <DOM/DOMBuilder.h>
 #include <DOM/Document.h>
@@ -493,10 +501,12 @@ namespace D3
 	// MetaDatabaseAlert implementation
 	//
 
-	MetaDatabaseAlert::MetaDatabaseAlert(MetaDatabasePtr pMetaDatabase, const std::string& strName, const std::string& strSQL)
+	MetaDatabaseAlert::MetaDatabaseAlert(MetaDatabasePtr pMetaDatabase, const std::string& strName, const std::string& strSQL, const std::string& strMetaEntity)
 		: m_pMetaDatabase(pMetaDatabase),
 			m_strName(strName),
-			m_strSQL(strSQL)
+			m_strSQL(strSQL),
+			m_strMetaEntity(strMetaEntity),
+			m_pMetaEntity(NULL)
 	{
 		assert(m_pMetaDatabase);
 		assert(!m_strName.empty());
@@ -518,6 +528,57 @@ namespace D3
 
 
 
+	MetaEntityPtr MetaDatabaseAlert::GetMetaEntity()
+	{
+		std::string						strSQL, strTable;
+		std::string::size_type	idx, idxEnd;
+
+
+		if (m_pMetaEntity)
+			return m_pMetaEntity;
+
+		if (!m_strMetaEntity.empty())
+		{
+			m_pMetaEntity = m_pMetaDatabase->GetMetaEntity(m_strMetaEntity);
+
+			if (!m_pMetaEntity)
+				ReportWarning("MetaDatabaseAlert::GetMetaEntity(): Alert %s specifies unknown MetaEntity %s.", m_strName.c_str(), m_strMetaEntity.c_str());
+
+			return m_pMetaEntity;
+		}
+
+		// Use the first table in the FROM clause, e.g. "SELECT A,B,C FROM dbo.TBL" yields TBL
+		strSQL = ToUpper(m_strSQL);
+		idx = strSQL.find(" FROM ");
+
+		if (idx == std::string::npos)
+			return NULL;
+
+		idx = m_strSQL.find_first_not_of(" \t\r\n", idx + 6);
+
+		if (idx == std::string::npos)
+			return NULL;
+
+		idxEnd = m_strSQL.find_first_of(" \t\r\n,;", idx);
+		strTable = m_strSQL.substr(idx, idxEnd == std::string::npos ? std::string::npos : idxEnd - idx);
+
+		idx = strTable.rfind('.');
+
+		if (idx != std::string::npos)
+			strTable.erase(0, idx + 1);
+
+		if (strTable.size() > 1 && strTable[0] == '[' && strTable[strTable.size() - 1] == ']')
+			strTable = strTable.substr(1, strTable.size() - 2);
+
+		m_pMetaEntity = m_pMetaDatabase->GetMetaEntity(strTable);
+
+		return m_pMetaEntity;
+	}
+
+
+
+
+
 	bool MetaDatabaseAlert::HasDatabaseAlert(DatabaseAlertPtr pDBAlert)
 	{
 		DatabaseAlertPtrListItr itr;
@@ -722,6 +783,310 @@ namespace D3
 
 
 
+	// Removes the resident instances in listEntity from memory (but not from the database).
+	// Deleting an instance also deletes its children which may be in listEntity as well, so
+	// each one is looked up by its primary key again right before it is deleted.
+	static void DeleteResidentInstances(DatabasePtr pDB, EntityPtrList & listEntity)
+	{
+		TemporaryKeyPtrList				listKey;
+		TemporaryKeyPtrListItr		itrKey;
+		EntityPtrListItr					itrEntity;
+		InstanceKeyPtr						pKey;
+		EntityPtr									pEntity;
+
+
+		for (itrEntity = listEntity.begin(); itrEntity != listEntity.end(); itrEntity++)
+			listKey.push_back(new TemporaryKey(*((*itrEntity)->GetPrimaryKey())));
+
+		listEntity.clear();
+
+		for (itrKey = listKey.begin(); itrKey != listKey.end(); itrKey++)
+		{
+			pKey = (*itrKey)->GetMetaKey()->FindInstanceKey(*itrKey, pDB);
+			pEntity = pKey ? pKey->GetEntity() : NULL;
+
+			if (pEntity && !pEntity->IsNew() && !pEntity->IsDestroying())
+				delete pEntity;
+
+			delete *itrKey;
+		}
+	}
+
+
+
+
+
+
+	//===========================================================================
+	//
+	// CacheCoherenceListener implementation
+	//
+
+	boost::mutex																	CacheCoherenceListener::M_mtxPending;
+	CacheCoherenceListener::PendingRefreshMap			CacheCoherenceListener::M_mapPending;
+	unsigned long																	CacheCoherenceListener::M_uSettleMS = 500;
+	unsigned long																	CacheCoherenceListener::M_uMaxDelayMS = 5000;
+	unsigned long																	CacheCoherenceListener::M_uMaxKeys = 100;
+
+
+
+	void CacheCoherenceListener::Listen(DatabaseAlertManagerPtr pDAM, const std::string & strAlertName, int iTimeout)
+	{
+		pDAM->AddAlertListener(strAlertName, &CacheCoherenceListener::On_DatabaseAlert, iTimeout, DatabaseAlertManager::recurring);
+	}
+
+
+
+
+
+	void CacheCoherenceListener::StopListening(DatabaseAlertManagerPtr pDAM, const std::string & strAlertName)
+	{
+		pDAM->RemoveAlertListener(strAlertName, &CacheCoherenceListener::On_DatabaseAlert);
+	}
+
+
+
+
+
+	void CacheCoherenceListener::SetCoalescing(unsigned long uSettleMS, unsigned long uMaxDelayMS, unsigned long uMaxKeys)
+	{
+		boost::mutex::scoped_lock		lk(M_mtxPending);
+
+		M_uSettleMS = uSettleMS;
+		M_uMaxDelayMS = uMaxDelayMS;
+		M_uMaxKeys = uMaxKeys;
+	}
+
+
+
+
+
+	void CacheCoherenceListener::On_DatabaseAlert(DatabaseAlertPtr pDBAlert)
+	{
+		MetaEntityPtr							pME;
+		std::string::size_type		idx;
+		boost::posix_time::ptime	tNow = boost::get_system_time();
+
+
+		// Timeouts carry no information
+		if (pDBAlert->GetStatus() > 0)
+			return;
+
+		pME = pDBAlert->GetMetaEntity();
+
+		if (!pME)
+		{
+			ReportWarning("CacheCoherenceListener::On_DatabaseAlert(): Can't determine the MetaEntity monitored by alert %s, alert ignored.", pDBAlert->GetName().c_str());
+			return;
+		}
+
+		if (!pME->IsCached())
+			return;
+
+		boost::mutex::scoped_lock		lk(M_mtxPending);
+		PendingRefresh &						pending = M_mapPending[pME];
+
+		if (pending.tmFirst.is_not_a_date_time())
+			pending.tmFirst = tNow;
+
+		pending.tmLast = tNow;
+
+		if (pending.bAll)
+			return;
+
+		// Errors could mean we missed changes, so refresh all
+		idx = pDBAlert->GetMessage().find(':');
+
+		if (pDBAlert->GetStatus() < 0 || idx == std::string::npos || idx + 1 == pDBAlert->GetMessage().size())
+		{
+			pending.bAll = true;
+			pending.setKeys.clear();
+			return;
+		}
+
+		pending.setKeys.insert(pDBAlert->GetMessage().substr(idx + 1));
+
+		if (pending.setKeys.size() > M_uMaxKeys)
+		{
+			pending.bAll = true;
+			pending.setKeys.clear();
+		}
+	}
+
+
+
+
+
+	bool CacheCoherenceListener::HasPending()
+	{
+		boost::mutex::scoped_lock		lk(M_mtxPending);
+
+		return !M_mapPending.empty();
+	}
+
+
+
+
+
+	long CacheCoherenceListener::ProcessPending(bool bForce)
+	{
+		PendingRefreshMap						mapDue;
+		PendingRefreshMapItr				itr;
+		boost::posix_time::ptime		tNow = boost::get_system_time();
+		DatabasePtr									pDB;
+		long												lEntities = 0;
+
+
+		// Move the due refreshes out so that alerts can be recorded while we're refreshing
+		{
+			boost::mutex::scoped_lock		lk(M_mtxPending);
+
+			for (itr = M_mapPending.begin(); itr != M_mapPending.end(); )
+			{
+				if (bForce ||
+						(unsigned long) (tNow - itr->second.tmLast).total_milliseconds() >= M_uSettleMS ||
+						(unsigned long) (tNow - itr->second.tmFirst).total_milliseconds() >= M_uMaxDelayMS)
+				{
+					mapDue.insert(*itr);
+					M_mapPending.erase(itr++);
+				}
+				else
+				{
+					itr++;
+				}
+			}
+		}
+
+		for (itr = mapDue.begin(); itr != mapDue.end(); itr++)
+		{
+			bool		bFailed = false;
+
+			try
+			{
+				pDB = itr->first->GetMetaDatabase()->GetGlobalDatabase();
+
+				if (!pDB)
+					continue;
+
+				if (itr->second.bAll || !RefreshRows(pDB, itr->first, itr->second.setKeys))
+					bFailed = pDB->RefreshCachedEntity(itr->first) < 0;
+
+				if (!bFailed)
+					lEntities++;
+			}
+			catch(...)
+			{
+				GenericExceptionHandler("CacheCoherenceListener::ProcessPending(): Failed to refresh cached entity %s.", itr->first->GetFullName().c_str());
+				bFailed = true;
+			}
+
+			// The changes haven't been applied, so try again with a full refresh
+			if (bFailed)
+			{
+				boost::mutex::scoped_lock		lk(M_mtxPending);
+				PendingRefresh &						pending = M_mapPending[itr->first];
+
+				if (pending.tmFirst.is_not_a_date_time())
+					pending.tmFirst = tNow;
+
+				if (pending.tmLast.is_not_a_date_time())
+					pending.tmLast = tNow;
+
+				pending.bAll = true;
+				pending.setKeys.clear();
+			}
+		}
+
+		return lEntities;
+	}
+
+
+
+
+
+	bool CacheCoherenceListener::RefreshRows(DatabasePtr pDB, MetaEntityPtr pME, const std::set<std::string> & setKeys)
+	{
+		MetaKeyPtr														pMK = pME->GetPrimaryMetaKey();
+		std::set<std::string>::const_iterator	itrKey;
+		KeyColumnArrayItr											itrColumn;
+		std::string														strWhere, strValue;
+		std::string::size_type								idx, idxEnd;
+		InstanceKeyPtr												pKey;
+		EntityPtrList													listResident;
+		EntityPtrListItr											itrEntity;
+		EntityPtrListPtr											pEL;
+		std::set<EntityPtr>										setFetched;
+
+
+		for (itrKey = setKeys.begin(); itrKey != setKeys.end(); itrKey++)
+		{
+			TemporaryKey		tmpKey(*pMK);
+
+			idx = 0;
+
+			if (!strWhere.empty())
+				strWhere += " OR ";
+
+			strWhere += "(";
+
+			for (itrColumn = tmpKey.GetColumns().begin(); itrColumn != tmpKey.GetColumns().end(); itrColumn++)
+			{
+				if (idx == std::string::npos)
+					return false;
+
+				idxEnd = itrKey->find('|', idx);
+				strValue = itrKey->substr(idx, idxEnd == std::string::npos ? std::string::npos : idxEnd - idx);
+				idx = idxEnd == std::string::npos ? std::string::npos : idxEnd + 1;
+
+				if (!(*itrColumn)->SetValue(strValue))
+					return false;
+
+				if (itrColumn != tmpKey.GetColumns().begin())
+					strWhere += " AND ";
+
+				strWhere += (*itrColumn)->GetMetaColumn()->GetName();
+				strWhere += " = ";
+				strWhere += (*itrColumn)->AsSQLString();
+			}
+
+			// Too many values
+			if (idx != std::string::npos)
+				return false;
+
+			strWhere += ")";
+
+			pKey = pMK->FindInstanceKey(&tmpKey, pDB);
+
+			if (pKey && pKey->GetEntity() && !pKey->GetEntity()->IsNew())
+				listResident.push_back(pKey->GetEntity());
+		}
+
+		pEL = pDB->LoadObjectsThroughQuery(pME, strWhere, "", true);
+
+		// Without a result we can't tell which rows were deleted
+		if (!pEL)
+			return false;
+
+		setFetched.insert(pEL->begin(), pEL->end());
+		delete pEL;
+
+		// Resident rows that weren't fetched have been deleted
+		for (itrEntity = listResident.begin(); itrEntity != listResident.end(); )
+		{
+			if (setFetched.find(*itrEntity) != setFetched.end())
+				listResident.erase(itrEntity++);
+			else
+				itrEntity++;
+		}
+
+		DeleteResidentInstances(pDB, listResident);
+
+		return true;
+	}
+
+
+
+
 
 	// ==========================================================================
 	// MetaDatabase::Flags class implementation
@@ -987,7 +1352,8 @@ namespace D3
 	 :	m_uID(uID),
 			m_bInitialised(false),
 			m_pInstanceClass(NULL),
-			m_bVersionChecked(false)
+			m_bVersionChecked(false),
+			m_pfnCacheDeltaFilter(NULL)
 	{
 		m_TransactionManager.m_pMD = this;
 		M_mapMetaDatabase.insert(MetaDatabasePtrMap::value_type(m_uID, this));
@@ -1190,7 +1556,7 @@ namespace D3
 		CSL::XML::Node*					pNode = pAlerts;
 		CSL::XML::Node*					pChildNode;
 		CSL::XML::NodeList*			pChildNodes = NULL;
-		std::string							strName, strSQL;
+		std::string							strName, strSQL, strMetaEntity;
 		unsigned long						i;
 
 
@@ -1207,6 +1573,7 @@ namespace D3
 					{
 						strName.erase();
 						strSQL.erase();
+						strMetaEntity.erase();
 
 						pChildNodes = pNode->getChildNodes();
 
@@ -1222,6 +1589,9 @@ namespace D3
 								// and "SQLQuery" node
 								else if (pChildNode->getNodeName() == "SQLQuery")
 									strSQL = pChildNode->getFirstChild()->getNodeValue();
+								// and optional "MetaEntity" node
+								else if (pChildNode->getNodeName() == "MetaEntity")
+									strMetaEntity = pChildNode->getFirstChild()->getNodeValue();
 							}
 						}
 
@@ -1231,7 +1601,7 @@ namespace D3
 							if (GetMetaDatabaseAlert(strName))
 								ReportError("MetaDatabase::InitialiseMetaAlerts: Alert %s already exists, check you application initialisation file", strName.c_str());
 							else
-								new MetaDatabaseAlert(this, strName, strSQL);
+								new MetaDatabaseAlert(this, strName, strSQL, strMetaEntity);
 						}
 						else
 						{
@@ -5313,214 +5683,1759 @@ namespace D3
 
 	//===========================================================================
 	//
-	// Database implementation
+	// RowView implementation
 	//
-	D3_CLASS_IMPL_PV(Database, Object);
-
-
-
-	Database::~Database ()
+	RowView::RowView(MetaEntityPtr pMetaEntity, bool bLazyFetch)
+		: m_pMetaEntity(pMetaEntity),
+			m_bLazyFetch(bLazyFetch)
 	{
-		// Delete any resultsets we still have
-		if (m_plistResultSet)
-		{
-			ResultSetPtr		pRS;
+		MetaColumnPtrVectPtr		pVectMC = pMetaEntity->GetMetaColumnsInFetchOrder();
+		unsigned int						idx;
 
-			while (!m_plistResultSet->empty())
-			{
-				pRS = m_plistResultSet->front();
-				delete pRS;
-			}
 
-			delete m_plistResultSet;
-		}
+		for (idx = 0; idx < pVectMC->size() && !(*pVectMC)[idx]->IsDerived(); idx++)
+			m_vectMetaColumn.push_back((*pVectMC)[idx]);
 
-		m_pMetaDatabase->On_InstanceDeleted(this);
-		m_pDatabaseWorkspace->On_DatabaseDeleted(this);
+		m_vectValue.resize(m_vectMetaColumn.size());
 	}
 
 
 
-	// Throw if we get here as this should be dealt with by subclasses
-	DatabaseAlertPtr Database::MonitorDatabaseAlerts(DatabaseAlertManagerPtr)
+	RowView::RowView(MetaKeyPtr pMetaKey)
+		: m_pMetaEntity(pMetaKey->GetMetaEntity()),
+			m_bLazyFetch(false)
 	{
-		throw Exception(__FILE__, __LINE__, Exception_error, "Database::MonitorDatabaseAlerts(): Database %s does not support alerts!", m_pMetaDatabase->GetAlias().c_str());
-		return NULL;
-	}
+		MetaColumnPtrListItr		itr;
 
 
+		for (itr = pMetaKey->GetMetaColumns()->begin(); itr != pMetaKey->GetMetaColumns()->end(); itr++)
+			m_vectMetaColumn.push_back(*itr);
 
-
-	void Database::SetLastError(const char * pszLastError)
-	{
-		GetExceptionContext()->ReportErrorX(__FILE__, __LINE__, "Database::SetLastError(): %s", (void*) pszLastError);
+		m_vectValue.resize(m_vectMetaColumn.size());
 	}
 
 
 
-	// 07/06/03 - R4 - HugP
-	//
-	// Debug helper
-	//
-	std::string Database::GetObjectStatisticsText()
+	bool RowView::AssignTo(ColumnPtr pCol, unsigned int idx) const
 	{
-		std::string			strStats, strTemp;
-		MetaEntityPtr		pME;
-		unsigned int		idx1, idx2, iObjectCount, iMaxLength = 0;
+		const Value&		val = m_vectValue[idx];
 
 
-		strStats  = m_pMetaDatabase->GetName();
-		char	buffer[100];
-		sprintf(buffer, " (" PRINTF_POINTER_MASK ")", (int) this);
-		strStats += buffer;
-		strStats += " - Statistics:\n\n";
+		if (val.bNull)
+			return pCol->SetNull();
 
-		// Determine maximum name length
-		//
-		for (idx1 = 0; idx1 <  m_pMetaDatabase->GetMetaEntities()->size(); idx1++)
+		switch (m_vectMetaColumn[idx]->GetType())
 		{
+			case MetaColumn::dbfString:
+				return pCol->SetValue(val.strValue);
 
-			pME = m_pMetaDatabase->GetMetaEntity(idx1);
-
-			if (pME->GetName().size() > iMaxLength)
-				iMaxLength = pME->GetName().size();
-		}
-
-		iMaxLength++;	// account for colon
+			case MetaColumn::dbfBlob:
+			{
+				// ColumnBlob::SetValue(std::string) expects base64, the value holds raw bytes
+				std::istringstream		strm(val.strValue);
 
+				((ColumnBlobPtr) pCol)->FromStream(strm);
+				return true;
+			}
 
-		// Populate stats string
-		//
-		for (idx1 = 0; idx1 <  m_pMetaDatabase->GetMetaEntities()->size(); idx1++)
-		{
-			pME = m_pMetaDatabase->GetMetaEntity(idx1);
+			case MetaColumn::dbfChar:
+				return pCol->SetValue((char) val.lValue);
 
-			iObjectCount =  pME->GetPrimaryMetaKey()->GetInstanceKeySet(this)->size();
+			case MetaColumn::dbfShort:
+				return pCol->SetValue((short) val.lValue);
 
-			if (iObjectCount)
-			{
-				strStats += pME->GetName();
+			case MetaColumn::dbfBool:
+				return pCol->SetValue(val.lValue != 0);
 
-				for (idx2 = iMaxLength; idx2 > pME->GetName().size(); idx2--)
+			case MetaColumn::dbfInt:
+				return pCol->SetValue((int) val.lValue);
 
-					strStats += ".";
+			case MetaColumn::dbfLong:
+				return pCol->SetValue(val.lValue);
 
-				strStats += ": ";
+			case MetaColumn::dbfFloat:
+				return pCol->SetValue(val.fValue);
 
-				Convert(strTemp, iObjectCount);
+			case MetaColumn::dbfDate:
+				return pCol->SetValue(val.dtValue);
 
-				strStats += strTemp;
-				strStats += "\n";
-			}
+			case MetaColumn::dbfBinary:
+				return pCol->SetValue((const unsigned char*) val.strValue.data(), val.strValue.size());
 		}
 
-		strStats += "\n";
-
-
-		return strStats;
+		return false;
 	}
 
 
 
-	void Database::On_PostCreate()
+	int RowView::GetColumnIndex(const std::string & strName) const
 	{
-		// Some sanity checks (this must NOT be initialised and both MetaDatabase and DatabaseWorkspace must be defined)
-		//
-		if (m_bInitialised || !m_pMetaDatabase || !m_pDatabaseWorkspace)
-			throw Exception(__FILE__, __LINE__, Exception_error, "Database::On_PostCreate(): Initialisation sequence error!");
+		unsigned int		idx;
 
-		m_pDatabaseWorkspace->On_DatabaseCreated(this);
-		m_pMetaDatabase->On_InstanceCreated(this);
-		m_uTrace = g_GlobalD3DebugLevel;
-		m_bInitialised = true;
+
+		for (idx = 0; idx < m_vectMetaColumn.size(); idx++)
+		{
+			if (m_vectMetaColumn[idx]->GetName() == strName)
+				return idx;
+		}
+
+		return -1;
 	}
 
 
 
-	EntityPtrListPtr Database::LoadObjectsThroughQuery(MetaEntityPtr pME, const std::string & strWhere, const std::string & strOrderBy, bool bRefresh, bool bLazyFetch)
+
+
+
+	//===========================================================================
+	//
+	// AsyncResult implementation
+	//
+	bool AsyncResult::IsReady()
 	{
-		std::string		strSQL;
+		boost::mutex::scoped_lock		lk(m_mtxExclusive);
 
-		assert(pME && m_pMetaDatabase == pME->GetMetaDatabase());
+		return m_bReady;
+	}
 
-		strSQL = "SELECT ";
-		strSQL += pME->AsSQLSelectList(bLazyFetch);
-		strSQL += " FROM ";
-		strSQL += pME->GetName();
 
-		if (!strWhere.empty())
+
+	void AsyncResult::Wait()
+	{
+		boost::mutex::scoped_lock		lk(m_mtxExclusive);
+
+		while (!m_bReady)
+			m_condReady.wait(lk);
+	}
+
+
+
+	void AsyncResult::Check()
+	{
+		Wait();
+
+		if (!m_strError.empty())
+			throw Exception(__FILE__, __LINE__, Exception_error, "AsyncResult::Check(): Asynchronous operation failed. %s", m_strError.c_str());
+	}
+
+
+
+	void AsyncResult::SetReady(const std::string & strError)
+	{
 		{
-			strSQL += " WHERE ";
-			strSQL += strWhere;
+			boost::mutex::scoped_lock		lk(m_mtxExclusive);
+
+			m_strError = strError;
+			m_bReady = true;
 		}
 
-		if (!strOrderBy.empty())
+		m_condReady.notify_all();
+	}
+
+
+
+
+
+
+	//===========================================================================
+	//
+	// AsyncLoadResult implementation
+	//
+	EntityPtrListPtr AsyncLoadResult::Get()
+	{
+		EntityPtrListPtr		pEL = NULL;
+
+
+		Check();
+
+		// Loaded synchronously
+		if (m_pListEntity)
 		{
-			strSQL += " ORDER BY ";
-			strSQL += strOrderBy;
+			pEL = m_pListEntity;
+			m_pListEntity = NULL;
+			return pEL;
 		}
 
-		return this->LoadObjects(pME, strSQL, bRefresh, bLazyFetch);
+		if (!m_pDatabase)
+			return NULL;
+
+		RowView							row(m_pMetaEntity, m_bLazyFetch);
+
+		pEL = new EntityPtrList();
+
+		try
+		{
+			while (!m_listRows.empty())
+			{
+				row.m_vectValue.swap(m_listRows.front());
+				m_listRows.pop_front();
+
+				pEL->push_back(m_pDatabase->MakeResident(row, m_bRefresh));
+			}
+		}
+		catch (...)
+		{
+			delete pEL;
+			throw;
+		}
+
+		m_pDatabase = NULL;
+
+		return pEL;
 	}
 
 
 
-	void Database::DeleteAllObjects()
+
+
+
+	//===========================================================================
+	//
+	// Database implementation
+	//
+	D3_CLASS_IMPL_PV(Database, Object);
+
+
+
+	Database::~Database ()
 	{
-		for (unsigned int idx = 0; idx <  m_pMetaDatabase->GetMetaEntities()->size(); idx++)
-			m_pMetaDatabase->GetMetaEntity(idx)->DeleteAllObjects(this);
+		// Delete any resultsets we still have
+		if (m_plistResultSet)
+		{
+			ResultSetPtr		pRS;
+
+			while (!m_plistResultSet->empty())
+			{
+				pRS = m_plistResultSet->front();
+				delete pRS;
+			}
+
+			delete m_plistResultSet;
+		}
+
+		// Tear down all objects in bulk before the MetaDatabase is told
+		//
+		DeleteAllObjects();
+
+		m_pMetaDatabase->On_InstanceDeleted(this);
+		m_pDatabaseWorkspace->On_DatabaseDeleted(this);
+
+		// All objects allocated from the arena are gone now
+		//
+		delete m_pObjectArena;
+		m_pObjectArena = NULL;
 	}
 
 
-	void Database::RegisterDatabaseAlert(DatabaseAlertPtr pDBAlert)
+
+	// Throw if we get here as this should be dealt with by subclasses
+	DatabaseAlertPtr Database::MonitorDatabaseAlerts(DatabaseAlertManagerPtr)
 	{
-		throw Exception(__FILE__, __LINE__, Exception_error, "Database::RegisterDatabaseAlert(): Failed to register alert %s. %s Databases do not support DatabaseAlerts.", pDBAlert->GetName().c_str(), m_pMetaDatabase->GetAlias().c_str());
+		throw Exception(__FILE__, __LINE__, Exception_error, "Database::MonitorDatabaseAlerts(): Database %s does not support alerts!", m_pMetaDatabase->GetAlias().c_str());
+		return NULL;
 	}
 
 
-	void Database::UnRegisterDatabaseAlert(DatabaseAlertPtr pDBAlert)
+
+
+	long Database::LoadColumns(MetaColumnPtr pMC, EntityPtrList & listEntity)
 	{
-		throw Exception(__FILE__, __LINE__, Exception_error, "Database::UnRegisterDatabaseAlert(): Failed to unregister alert %s. %s Databases do not support DatabaseAlerts.", pDBAlert->GetName().c_str(), m_pMetaDatabase->GetAlias().c_str());
+		EntityPtrListItr		itrEntity;
+		EntityPtr						pEntity;
+		ColumnPtr						pCol;
+		long								lCount = 0;
+
+
+		for ( itrEntity =  listEntity.begin();
+					itrEntity != listEntity.end();
+					itrEntity++)
+		{
+			pEntity = *itrEntity;
+
+			if (!pEntity || pEntity->GetMetaEntity() != pMC->GetMetaEntity() || pEntity->GetDatabase() != this || pEntity->IsNew())
+				continue;
+
+			pCol = pEntity->GetColumn(pMC);
+
+			if (!pCol || pCol->IsFetched())
+				continue;
+
+			if (!LoadColumn(pCol))
+				return -1;
+
+			pCol->MarkFetched();
+			lCount++;
+		}
+
+		return lCount;
 	}
 
 
-	// Load all instances from each MetaEntity object marked cached (IsCached() == true)
-	//
-	void Database::LoadCache()
+
+	long Database::LoadLazyColumns(EntityPtrList & listEntity)
 	{
-		MetaEntityPtrList				listME;
-		MetaEntityPtrListItr		itrME;
-		MetaEntityPtr						pME;
+		std::set<MetaEntityPtr>						setME;
+		std::set<MetaEntityPtr>::iterator	itrME;
+		EntityPtrListItr									itrEntity;
+		MetaColumnPtrVectPtr							pVectMC;
+		unsigned int											idx;
+		long															lTotal = 0, lCount;
 
 
-		try
+		for ( itrEntity =  listEntity.begin();
+					itrEntity != listEntity.end();
+					itrEntity++)
 		{
-			ReportInfo("Database::LoadCache(): Caching database %s...", m_pMetaDatabase->GetAlias().c_str());
+			if (*itrEntity)
+				setME.insert((*itrEntity)->GetMetaEntity());
+		}
 
-			listME = m_pMetaDatabase->GetDependencyOrderedMetaEntities();
+		for ( itrME =  setME.begin();
+					itrME != setME.end();
+					itrME++)
+		{
+			pVectMC = (*itrME)->GetMetaColumns();
 
-			for ( itrME  = listME.begin();
-						itrME != listME.end();
-						itrME++)
+			for (idx = 0; idx < pVectMC->size(); idx++)
 			{
-				pME = *itrME;
+				if (!(*pVectMC)[idx]->IsLazyFetch() || (*pVectMC)[idx]->IsDerived())
+					continue;
 
-				if (pME->IsCached())
-					pME->LoadAll(this);
+				lCount = LoadColumns((*pVectMC)[idx], listEntity);
+
+				if (lCount < 0)
+					return lCount;
+
+				lTotal += lCount;
 			}
+		}
 
-			ReportInfo("Database::LoadCache(): ...done!");
+		return lTotal;
+	}
+
+
+
+	// A node in the tree of relation paths passed to Database::Prefetch()
+	struct PrefetchNode
+	{
+		MetaRelationPtr						pMR;
+		std::list<PrefetchNode>		listChild;
+
+		PrefetchNode() : pMR(NULL) {}
+	};
+
+	typedef std::list<PrefetchNode>						PrefetchNodeList;
+	typedef PrefetchNodeList::iterator				PrefetchNodeListItr;
+
+
+
+	// Load each relation in listNode for all parents in listParent and recurse into the next hop
+	static long PrefetchRelations(DatabasePtr pDB, EntityPtrList & listParent, PrefetchNodeList & listNode, bool bRefresh, bool bLazyFetch)
+	{
+		PrefetchNodeListItr			itrNode;
+		EntityPtrListItr				itrParent;
+		EntityPtrList						listChild;
+		RelationPtr							pRelation;
+		long										lTotal = 0, lCount;
+
+
+		for ( itrNode =  listNode.begin();
+					itrNode != listNode.end();
+					itrNode++)
+		{
+			lCount = Relation::LoadAll(itrNode->pMR, listParent, bRefresh, bLazyFetch, pDB);
+
+			if (lCount < 0)
+				return lCount;
+
+			lTotal += lCount;
+
+			if (itrNode->listChild.empty())
+				continue;
+
+			// The children of this hop are the parents of the next
+			//
+			listChild.clear();
+
+			for ( itrParent =  listParent.begin();
+						itrParent != listParent.end();
+						itrParent++)
+			{
+				if ((*itrParent)->GetMetaEntity() != itrNode->pMR->GetParentMetaKey()->GetMetaEntity())
+					continue;
+
+				pRelation = (*itrParent)->GetChildRelation(itrNode->pMR, pDB);
+
+				if (pRelation)
+					pRelation->GetSnapshot(&listChild);
+			}
+
+			if (listChild.empty())
+				continue;
+
+			lCount = PrefetchRelations(pDB, listChild, itrNode->listChild, bRefresh, bLazyFetch);
+
+			if (lCount < 0)
+				return lCount;
+
+			lTotal += lCount;
 		}
-		catch(Exception & e)
+
+		return lTotal;
+	}
+
+
+
+	long Database::Prefetch(EntityPtrList & listEntity, const std::string & strPaths, bool bRefresh, bool bLazyFetch)
+	{
+		PrefetchNodeList				listRoot;
+		PrefetchNodeList*				pListNode;
+		PrefetchNodeListItr			itrNode;
+		MetaEntityPtr						pME;
+		MetaRelationPtr					pMR;
+		std::string							strPath, strName;
+		std::string::size_type	iPathStart, iPathEnd, iNameStart, iNameEnd;
+
+
+		if (listEntity.empty() || strPaths.empty())
+			return 0;
+
+		pME = listEntity.front()->GetMetaEntity();
+
+		// Build the tree of relation paths
+		//
+		for (iPathStart = 0; iPathStart <= strPaths.size(); iPathStart = iPathEnd + 1)
 		{
-			e.AddMessage("Database::LoadCache(): Loading cache for database %s failed", m_pMetaDatabase->GetName().c_str());
-			e.LogError();
-			throw;
+			iPathEnd = strPaths.find(',', iPathStart);
+
+			if (iPathEnd == std::string::npos)
+				iPathEnd = strPaths.size();
+
+			strPath = strPaths.substr(iPathStart, iPathEnd - iPathStart);
+			pListNode = &listRoot;
+			pMR = NULL;
+
+			for (iNameStart = 0; iNameStart <= strPath.size(); iNameStart = iNameEnd + 1)
+			{
+				iNameEnd = strPath.find('.', iNameStart);
+
+				if (iNameEnd == std::string::npos)
+					iNameEnd = strPath.size();
+
+				strName = AllTrim(strPath.substr(iNameStart, iNameEnd - iNameStart));
+
+				if (strName.empty())
+					continue;
+
+				pMR = (pMR ? pMR->GetChildMetaKey()->GetMetaEntity() : pME)->GetChildMetaRelation(strName);
+
+				if (!pMR)
+					throw Exception(__FILE__, __LINE__, Exception_error, "Database::Prefetch(): Path %s contains unknown relation %s.", strPath.c_str(), strName.c_str());
+
+				for (itrNode = pListNode->begin(); itrNode != pListNode->end() && itrNode->pMR != pMR; itrNode++);
+
+				if (itrNode == pListNode->end())
+				{
+					pListNode->push_back(PrefetchNode());
+					pListNode->back().pMR = pMR;
+					itrNode = --pListNode->end();
+				}
+
+				pListNode = &(itrNode->listChild);
+			}
 		}
-		catch(...)
+
+		return PrefetchRelations(this, listEntity, listRoot, bRefresh, bLazyFetch);
+	}
+
+
+
+	long Database::LoadObjects(RelationPtrList & listRelation, bool bRefresh, bool bLazyFetch)
+	{
+		RelationPtrListItr	itrRelation;
+		long								lTotal = 0, lCount;
+
+
+		for ( itrRelation =  listRelation.begin();
+					itrRelation != listRelation.end();
+					itrRelation++)
 		{
-			throw Exception(__FILE__, __LINE__, Exception_error, "Database::LoadCache(): Unspecified error occurred loading cache for database %s.", m_pMetaDatabase->GetName().c_str());
+			lCount = LoadObjects(*itrRelation, bRefresh, bLazyFetch);
+
+			if (lCount < 0)
+				return lCount;
+
+			lTotal += lCount;
+		}
+
+		return lTotal;
+	}
+
+
+
+
+	bool Database::UpdateObjects(EntityPtrList & listEntity)
+	{
+		EntityPtrListItr		itrEntity;
+
+
+		for ( itrEntity =  listEntity.begin();
+					itrEntity != listEntity.end();
+					itrEntity++)
+		{
+			if (!UpdateObject(*itrEntity))
+				return false;
 		}
+
+		return true;
+	}
+
+
+
+
+	void Database::SetLastError(const char * pszLastError)
+	{
+		GetExceptionContext()->ReportErrorX(__FILE__, __LINE__, "Database::SetLastError(): %s", (void*) pszLastError);
+	}
+
+
+
+	// 07/06/03 - R4 - HugP
+	//
+	// Debug helper
+	//
+	std::string Database::GetObjectStatisticsText()
+	{
+		std::string			strStats, strTemp;
+		MetaEntityPtr		pME;
+		unsigned int		idx1, idx2, iObjectCount, iMaxLength = 0;
+
+
+		strStats  = m_pMetaDatabase->GetName();
+		char	buffer[100];
+		sprintf(buffer, " (" PRINTF_POINTER_MASK ")", (int) this);
+		strStats += buffer;
+		strStats += " - Statistics:\n\n";
+
+		// Determine maximum name length
+		//
+		for (idx1 = 0; idx1 <  m_pMetaDatabase->GetMetaEntities()->size(); idx1++)
+		{
+
+			pME = m_pMetaDatabase->GetMetaEntity(idx1);
+
+			if (pME->GetName().size() > iMaxLength)
+				iMaxLength = pME->GetName().size();
+		}
+
+		iMaxLength++;	// account for colon
+
+
+		// Populate stats string
+		//
+		for (idx1 = 0; idx1 <  m_pMetaDatabase->GetMetaEntities()->size(); idx1++)
+		{
+			pME = m_pMetaDatabase->GetMetaEntity(idx1);
+
+			iObjectCount =  pME->GetPrimaryMetaKey()->GetInstanceKeySet(this)->size();
+
+			if (iObjectCount)
+			{
+				strStats += pME->GetName();
+
+				for (idx2 = iMaxLength; idx2 > pME->GetName().size(); idx2--)
+
+					strStats += ".";
+
+				strStats += ": ";
+
+				Convert(strTemp, iObjectCount);
+
+				strStats += strTemp;
+				strStats += "\n";
+			}
+		}
+
+		strStats += "\n";
+
+
+		return strStats;
+	}
+
+
+
+	void Database::On_PostCreate()
+	{
+		// Some sanity checks (this must NOT be initialised and both MetaDatabase and DatabaseWorkspace must be defined)
+		//
+		if (m_bInitialised || !m_pMetaDatabase || !m_pDatabaseWorkspace)
+			throw Exception(__FILE__, __LINE__, Exception_error, "Database::On_PostCreate(): Initialisation sequence error!");
+
+		if (Settings::Singleton().UseObjectArena())
+			m_pObjectArena = new ObjectArena();
+
+		m_pDatabaseWorkspace->On_DatabaseCreated(this);
+		m_pMetaDatabase->On_InstanceCreated(this);
+		m_uTrace = g_GlobalD3DebugLevel;
+		m_bInitialised = true;
+	}
+
+
+
+	AsyncLoadResultPtr Database::LoadObjectsAsync(MetaEntityPtr pME, const std::string & strSQL, bool bRefresh, bool bLazyFetch)
+	{
+		AsyncLoadResultPtr		pResult(new AsyncLoadResult(this, pME, bRefresh, bLazyFetch));
+
+
+		try
+		{
+			pResult->m_pListEntity = LoadObjects(pME, strSQL, bRefresh, bLazyFetch);
+			pResult->SetReady(pResult->m_pListEntity ? "" : "LoadObjects() failed.");
+		}
+		catch (...)
+		{
+			pResult->SetReady(ShortGenericExceptionHandler());
+		}
+
+		return pResult;
+	}
+
+
+
+	AsyncLoadResultPtr Database::LoadObjectsThroughQueryAsync(MetaEntityPtr pME, const std::string & strWhere, const std::string & strOrderBy, bool bRefresh, bool bLazyFetch)
+	{
+		std::string		strSQL;
+
+		assert(pME && m_pMetaDatabase == pME->GetMetaDatabase());
+
+		strSQL = "SELECT ";
+		strSQL += pME->AsSQLSelectList(bLazyFetch);
+		strSQL += " FROM ";
+		strSQL += pME->GetName();
+
+		if (!strWhere.empty())
+		{
+			strSQL += " WHERE ";
+			strSQL += strWhere;
+		}
+
+		if (!strOrderBy.empty())
+		{
+			strSQL += " ORDER BY ";
+			strSQL += strOrderBy;
+		}
+
+		return LoadObjectsAsync(pME, strSQL, bRefresh, bLazyFetch);
+	}
+
+
+
+	AsyncJSONResultPtr Database::ExecuteQueryAsJSONAsync(const std::string & strSQL)
+	{
+		AsyncJSONResultPtr		pResult(new AsyncJSONResult());
+		std::ostringstream		ostrm;
+
+
+		try
+		{
+			ExecuteQueryAsJSON(strSQL, ostrm);
+			pResult->m_strJSON = ostrm.str();
+			pResult->SetReady();
+		}
+		catch (...)
+		{
+			pResult->SetReady(ShortGenericExceptionHandler());
+		}
+
+		return pResult;
+	}
+
+
+
+	EntityPtr Database::MakeResident(const RowView & row, bool bRefresh)
+	{
+		MetaEntityPtr				pME = row.GetMetaEntity();
+		MetaKeyPtr					pMK = pME->GetPrimaryMetaKey();
+		TemporaryKey				tmpKey = *pMK;
+		KeyColumnArrayItr		itrColumn;
+		InstanceKeyPtr			pInstanceKey;
+		EntityPtr						pObject = NULL;
+		ColumnPtr						pCol;
+		unsigned int				idx;
+		int									iIdx;
+		bool								bDeleteObject = false;
+		bool								bDoAfterPopulate = false;
+
+
+		// See if the object exists
+		//
+		for ( itrColumn =  tmpKey.GetColumns().begin();
+					itrColumn != tmpKey.GetColumns().end();
+					itrColumn++)
+		{
+			iIdx = row.GetColumnIndex((*itrColumn)->GetMetaColumn()->GetName());
+
+			if (iIdx < 0 || !row.AssignTo(*itrColumn, iIdx))
+				throw Exception(__FILE__, __LINE__, Exception_error, "Database::MakeResident(): Failed to set key column %s.", (*itrColumn)->GetMetaColumn()->GetFullName().c_str());
+		}
+
+		pInstanceKey = pMK->FindInstanceKey(&tmpKey, this);
+
+		if (pInstanceKey)
+		{
+			pObject = pInstanceKey->GetEntity();
+
+			if (!bRefresh)
+				return pObject;
+		}
+		else
+		{
+			bDeleteObject = true;
+			pObject = pME->CreateInstance(this);
+		}
+
+		if (!pObject)
+			return NULL;
+
+		try
+		{
+			bDoAfterPopulate = true;
+			pObject->On_BeforePopulatingObject();
+
+			for (idx = 0; idx < row.GetColumnCount(); idx++)
+			{
+				pCol = pObject->GetColumn(row.GetMetaColumn(idx));
+
+				if (!row.IsFetched(idx))
+				{
+					pCol->MarkUnfetched();
+					continue;
+				}
+
+				if (!row.AssignTo(pCol, idx))
+				{
+					pCol->MarkUnfetched();
+					throw Exception(__FILE__, __LINE__, Exception_error, "Failed to populate column %s.", pCol->GetMetaColumn()->GetFullName().c_str());
+				}
+
+				pCol->MarkFetched();
+			}
+		}
+		catch (...)
+		{
+			if (bDoAfterPopulate)
+				pObject->On_AfterPopulatingObject();
+
+			if (bDeleteObject)
+				delete pObject;
+
+			throw;
+		}
+
+		pObject->On_AfterPopulatingObject();
+
+		return pObject;
+	}
+
+
+
+	long Database::VisitObjects(MetaEntityPtr pME, const std::string & strWhere, const std::string & strOrderBy, RowVisitor & visitor, bool bLazyFetch)
+	{
+		std::string		strSQL;
+
+		assert(pME && m_pMetaDatabase == pME->GetMetaDatabase());
+
+		strSQL = "SELECT ";
+		strSQL += pME->AsSQLSelectList(bLazyFetch);
+		strSQL += " FROM ";
+		strSQL += pME->GetName();
+
+		if (!strWhere.empty())
+		{
+			strSQL += " WHERE ";
+			strSQL += strWhere;
+		}
+
+		if (!strOrderBy.empty())
+		{
+			strSQL += " ORDER BY ";
+			strSQL += strOrderBy;
+		}
+
+		return VisitRows(pME, strSQL, visitor, bLazyFetch);
+	}
+
+
+
+
+	long Database::VisitKeys(MetaKeyPtr pMK, const std::string & strWhere, RowVisitor & visitor)
+	{
+		RowView					row(pMK);
+		std::string			strSQL;
+		unsigned int		idx;
+
+		assert(pMK && m_pMetaDatabase == pMK->GetMetaEntity()->GetMetaDatabase());
+
+		strSQL = "SELECT ";
+
+		for (idx = 0; idx < row.GetColumnCount(); idx++)
+		{
+			if (idx)
+				strSQL += ',';
+
+			strSQL += row.GetMetaColumn(idx)->GetName();
+		}
+
+		strSQL += " FROM ";
+		strSQL += pMK->GetMetaEntity()->GetName();
+
+		if (!strWhere.empty())
+		{
+			strSQL += " WHERE ";
+			strSQL += strWhere;
+		}
+
+		return VisitRows(row, strSQL, visitor);
+	}
+
+
+
+
+	EntityPtrListPtr Database::LoadObjectsThroughQuery(MetaEntityPtr pME, const std::string & strWhere, const std::string & strOrderBy, bool bRefresh, bool bLazyFetch)
+	{
+		std::string		strSQL;
+
+		assert(pME && m_pMetaDatabase == pME->GetMetaDatabase());
+
+		strSQL = "SELECT ";
+		strSQL += pME->AsSQLSelectList(bLazyFetch);
+		strSQL += " FROM ";
+		strSQL += pME->GetName();
+
+		if (!strWhere.empty())
+		{
+			strSQL += " WHERE ";
+			strSQL += strWhere;
+		}
+
+		if (!strOrderBy.empty())
+		{
+			strSQL += " ORDER BY ";
+			strSQL += strOrderBy;
+		}
+
+		return this->LoadObjects(pME, strSQL, bRefresh, bLazyFetch);
+	}
+
+
+
+	void Database::DeleteAllObjects()
+	{
+		MetaEntityPtr		pME;
+		unsigned int		idx, idx2;
+
+
+		if (m_bBulkDeleting)
+			return;
+
+		m_bBulkDeleting = true;
+
+		try
+		{
+			for (idx = 0; idx <  m_pMetaDatabase->GetMetaEntities()->size(); idx++)
+			{
+				pME = m_pMetaDatabase->GetMetaEntity(idx);
+
+				for (idx2 = 0; idx2 < pME->GetMetaKeyCount(); idx2++)
+					pME->GetMetaKey(idx2)->On_BeforeDeleteAllObjects(this);
+			}
+
+			for (idx = 0; idx <  m_pMetaDatabase->GetMetaEntities()->size(); idx++)
+				m_pMetaDatabase->GetMetaEntity(idx)->DeleteAllObjects(this);
+		}
+		catch(...)
+		{
+			m_bBulkDeleting = false;
+			throw;
+		}
+
+		m_bBulkDeleting = false;
+	}
+
+
+	void Database::RegisterDatabaseAlert(DatabaseAlertPtr pDBAlert)
+	{
+		throw Exception(__FILE__, __LINE__, Exception_error, "Database::RegisterDatabaseAlert(): Failed to register alert %s. %s Databases do not support DatabaseAlerts.", pDBAlert->GetName().c_str(), m_pMetaDatabase->GetAlias().c_str());
+	}
+
+
+	void Database::UnRegisterDatabaseAlert(DatabaseAlertPtr pDBAlert)
+	{
+		throw Exception(__FILE__, __LINE__, Exception_error, "Database::UnRegisterDatabaseAlert(): Failed to unregister alert %s. %s Databases do not support DatabaseAlerts.", pDBAlert->GetName().c_str(), m_pMetaDatabase->GetAlias().c_str());
+	}
+
+
+	// Load all instances from each MetaEntity object marked cached (IsCached() == true)
+	//
+	void Database::LoadCache()
+	{
+		typedef std::map<MetaEntityPtr, unsigned int>		LevelMap;
+		typedef std::vector<MetaEntityPtrList>					LevelVect;
+
+		MetaEntityPtrList				listME;
+		MetaEntityPtrListItr		itrME;
+		MetaEntityPtr						pME, pMEParent;
+		MetaRelationPtrVectItr	itrPMR;
+		LevelMap								mapLevel;
+		LevelMap::iterator			itrLevel;
+		LevelVect								vectLevel;
+		unsigned int						uLevel, idx, uResult;
+		std::string							strWatermark;
+		bool										bRefresh = false;
+
+
+		try
+		{
+			ReportInfo("Database::LoadCache(): Caching database %s...", m_pMetaDatabase->GetAlias().c_str());
+
+			listME = m_pMetaDatabase->GetDependencyOrderedMetaEntities();
+
+			// Restore from the snapshot and fetch only what changed since
+			if (!m_pMetaDatabase->GetCacheSnapshotFile().empty())
+			{
+				try
+				{
+					if (LoadCacheSnapshot(m_pMetaDatabase->GetCacheSnapshotFile(), strWatermark))
+					{
+						CacheDeltaFilterFunc		pfnDeltaFilter = m_pMetaDatabase->GetCacheDeltaFilter();
+
+						for ( itrME  = listME.begin();
+									itrME != listME.end();
+									itrME++)
+						{
+							pME = *itrME;
+
+							if (!pME->IsCached())
+								continue;
+
+							if (!pfnDeltaFilter)
+							{
+								RefreshCachedEntity(pME);
+							}
+							else
+							{
+								std::string		strWhere = pfnDeltaFilter(pME, strWatermark);
+
+								if (!strWhere.empty())
+									delete LoadObjectsThroughQuery(pME, strWhere, "", true);
+							}
+						}
+
+						ReportInfo("Database::LoadCache(): ...done (restored from snapshot %s)!", m_pMetaDatabase->GetCacheSnapshotFile().c_str());
+						return;
+					}
+				}
+				catch (...)
+				{
+					ReportWarning("Database::LoadCache(): Restoring database %s from snapshot %s failed, loading all cached entities. %s", m_pMetaDatabase->GetAlias().c_str(), m_pMetaDatabase->GetCacheSnapshotFile().c_str(), ShortGenericExceptionHandler().c_str());
+
+					// Some objects may have been restored from the snapshot
+					bRefresh = true;
+				}
+			}
+
+			// Parents precede their children in listME, except where dependencies are
+			// cyclic, and such parents are ignored here too
+			for ( itrME  = listME.begin();
+						itrME != listME.end();
+						itrME++)
+			{
+				pME = *itrME;
+				uLevel = 0;
+
+				for ( itrPMR =  pME->GetParentMetaRelations()->begin();
+							itrPMR != pME->GetParentMetaRelations()->end();
+							itrPMR++)
+				{
+					pMEParent = (*itrPMR)->GetParentMetaKey()->GetMetaEntity();
+					itrLevel = mapLevel.find(pMEParent);
+
+					if (pMEParent != pME && itrLevel != mapLevel.end() && itrLevel->second >= uLevel)
+						uLevel = itrLevel->second + 1;
+				}
+
+				mapLevel[pME] = uLevel;
+
+				if (pME->IsCached())
+				{
+					if (vectLevel.size() <= uLevel)
+						vectLevel.resize(uLevel + 1);
+
+					vectLevel[uLevel].push_back(pME);
+				}
+			}
+
+			for (idx = 0; idx < vectLevel.size(); idx++)
+			{
+				std::vector<AsyncLoadResultPtr>		vectResult;
+
+				// Nothing to gain from a worker for a single entity
+				if (vectLevel[idx].size() == 1)
+				{
+					vectLevel[idx].front()->LoadAll(this, bRefresh);
+					continue;
+				}
+
+				for ( itrME  = vectLevel[idx].begin();
+							itrME != vectLevel[idx].end();
+							itrME++)
+				{
+					vectResult.push_back(LoadAllAsync(*itrME, bRefresh));
+				}
+
+				// Insertion into this' key sets and relations happens here, one entity at a time
+				for (uResult = 0; uResult < vectResult.size(); uResult++)
+					delete vectResult[uResult]->Get();
+			}
+
+			ReportInfo("Database::LoadCache(): ...done!");
+		}
+		catch(Exception & e)
+		{
+			e.AddMessage("Database::LoadCache(): Loading cache for database %s failed", m_pMetaDatabase->GetName().c_str());
+			e.LogError();
+			throw;
+		}
+		catch(...)
+		{
+			throw Exception(__FILE__, __LINE__, Exception_error, "Database::LoadCache(): Unspecified error occurred loading cache for database %s.", m_pMetaDatabase->GetName().c_str());
+		}
+	}
+
+
+
+	// Cache snapshot file layout (all integers in the byte order of the writer):
+	//
+	//   "D3CS", format version, byte order mark, MetaDatabase alias and version, watermark,
+	//   number of cached entities, per entity: name, number of columns, per column: name, type
+	//   per entity: number of rows, size of the rows in bytes, per row and column: flags [, value]
+	//
+	// Only the columns a RowView holds (the non-derived columns in fetch order) are stored.
+	// Strings are stored as a 32 bit length followed by the characters.
+	#define D3_CACHE_SNAPSHOT_MAGIC						"D3CS"
+	#define D3_CACHE_SNAPSHOT_VERSION					2
+	#define D3_CACHE_SNAPSHOT_BYTE_ORDER			0x01020304
+
+	#define D3_CACHE_SNAPSHOT_NULL						0x01
+	#define D3_CACHE_SNAPSHOT_FETCHED					0x02
+
+	static void WriteSnapshotUInt32(std::ostream & ostrm, boost::uint32_t u)
+	{
+		ostrm.write((const char*) &u, sizeof(u));
+	}
+
+
+
+	static void WriteSnapshotInt64(std::ostream & ostrm, boost::int64_t l)
+	{
+		ostrm.write((const char*) &l, sizeof(l));
+	}
+
+
+
+	static void WriteSnapshotString(std::ostream & ostrm, const char* p, size_t uLen)
+	{
+		WriteSnapshotUInt32(ostrm, (boost::uint32_t) uLen);
+		ostrm.write(p, uLen);
+	}
+
+
+
+	static void WriteSnapshotString(std::ostream & ostrm, const std::string & str)
+	{
+		WriteSnapshotString(ostrm, str.data(), str.size());
+	}
+
+
+
+	// Reads the values written by the functions above from a memory mapped snapshot
+	class SnapshotReader
+	{
+		protected:
+			const char*						m_pBegin;
+			const char*						m_pCurrent;
+			const char*						m_pEnd;
+
+			const char*						Advance(size_t uLen)
+			{
+				const char*		p = m_pCurrent;
+
+				if ((size_t) (m_pEnd - m_pCurrent) < uLen)
+					throw Exception(__FILE__, __LINE__, Exception_error, "SnapshotReader::Advance(): The cache snapshot is truncated.");
+
+				m_pCurrent += uLen;
+
+				return p;
+			}
+
+		public:
+			SnapshotReader(const void* p, size_t uLen) : m_pBegin((const char*) p), m_pCurrent((const char*) p), m_pEnd((const char*) p + uLen) {}
+
+			size_t								GetOffset() const											{ return m_pCurrent - m_pBegin; }
+			void									SetOffset(size_t uOffset)							{ m_pCurrent = m_pBegin; Advance(uOffset); }
+			size_t								GetRemaining() const									{ return m_pEnd - m_pCurrent; }
+
+			boost::uint32_t				ReadUInt32()													{ boost::uint32_t u; memcpy(&u, Advance(sizeof(u)), sizeof(u)); return u; }
+			boost::int64_t				ReadInt64()														{ boost::int64_t l; memcpy(&l, Advance(sizeof(l)), sizeof(l)); return l; }
+			unsigned char					ReadByte()														{ return (unsigned char) *Advance(1); }
+			void									ReadString(std::string & str)					{ boost::uint32_t uLen = ReadUInt32(); str.assign(Advance(uLen), uLen); }
+			std::string						ReadString()													{ std::string str; ReadString(str); return str; }
+			bool									Match(const char* p, size_t uLen)			{ return (size_t) (m_pEnd - m_pCurrent) >= uLen && memcmp(Advance(uLen), p, uLen) == 0; }
+
+			void									ReadRow(RowView & row, const D3TimeZone & tz);
+	};
+
+
+
+	// Decodes the next row written by Database::SaveCacheSnapshot() into row
+	void SnapshotReader::ReadRow(RowView & row, const D3TimeZone & tz)
+	{
+		unsigned int			idx;
+
+
+		for (idx = 0; idx < row.m_vectMetaColumn.size(); idx++)
+		{
+			RowView::Value&		val = row.m_vectValue[idx];
+			unsigned char			ucFlags = ReadByte();
+
+			val.bFetched = (ucFlags & D3_CACHE_SNAPSHOT_FETCHED) != 0;
+			val.bNull = (ucFlags & D3_CACHE_SNAPSHOT_NULL) != 0;
+
+			if (!val.bFetched || val.bNull)
+				continue;
+
+			switch (row.m_vectMetaColumn[idx]->GetType())
+			{
+				case MetaColumn::dbfString:
+				case MetaColumn::dbfBlob:
+				case MetaColumn::dbfBinary:
+					ReadString(val.strValue);
+					break;
+
+				case MetaColumn::dbfChar:
+				case MetaColumn::dbfShort:
+				case MetaColumn::dbfBool:
+				case MetaColumn::dbfInt:
+				case MetaColumn::dbfLong:
+					val.lValue = (long) ReadInt64();
+					break;
+
+				case MetaColumn::dbfFloat:
+				{
+					boost::uint32_t		u = ReadUInt32();
+
+					memcpy(&val.fValue, &u, sizeof(val.fValue));
+					break;
+				}
+
+				case MetaColumn::dbfDate:
+					val.dtValue = D3Date(D3TimeZone::FromTicks(ReadInt64()), tz);
+					break;
+			}
+		}
+	}
+
+
+
+	void Database::SaveCacheSnapshot(const std::string & strFileName, const std::string & strWatermark)
+	{
+		MetaEntityPtrList &					listME = m_pMetaDatabase->GetDependencyOrderedMetaEntities();
+		MetaEntityPtrList						listCached;
+		MetaEntityPtrListItr				itrME;
+		MetaEntityPtr								pME;
+		InstanceKeyPtrSetPtr				pSet;
+		InstanceKeyPtrSetItr				itrKey;
+		EntityPtr										pEntity;
+		ColumnPtr										pCol;
+		std::string									strTempFile = strFileName + ".tmp";
+		std::ofstream								ostrm(strTempFile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		unsigned int								idx;
+		unsigned long								lRows = 0;
+
+
+		if (!ostrm)
+			throw Exception(__FILE__, __LINE__, Exception_error, "Database::SaveCacheSnapshot(): Unable to create file %s.", strTempFile.c_str());
+
+		for (itrME = listME.begin(); itrME != listME.end(); itrME++)
+		{
+			if ((*itrME)->IsCached())
+				listCached.push_back(*itrME);
+		}
+
+		// Header
+		ostrm.write(D3_CACHE_SNAPSHOT_MAGIC, 4);
+		WriteSnapshotUInt32(ostrm, D3_CACHE_SNAPSHOT_VERSION);
+		WriteSnapshotUInt32(ostrm, D3_CACHE_SNAPSHOT_BYTE_ORDER);
+		WriteSnapshotString(ostrm, m_pMetaDatabase->GetAlias());
+		WriteSnapshotUInt32(ostrm, m_pMetaDatabase->GetVersionMajor());
+		WriteSnapshotUInt32(ostrm, m_pMetaDatabase->GetVersionMinor());
+		WriteSnapshotUInt32(ostrm, m_pMetaDatabase->GetVersionRevision());
+		WriteSnapshotString(ostrm, strWatermark);
+
+		// Layout
+		WriteSnapshotUInt32(ostrm, listCached.size());
+
+		for (itrME = listCached.begin(); itrME != listCached.end(); itrME++)
+		{
+			RowView				row(*itrME, false);
+
+			WriteSnapshotString(ostrm, (*itrME)->GetName());
+			WriteSnapshotUInt32(ostrm, row.m_vectMetaColumn.size());
+
+			for (idx = 0; idx < row.m_vectMetaColumn.size(); idx++)
+			{
+				WriteSnapshotString(ostrm, row.m_vectMetaColumn[idx]->GetName());
+				ostrm.put((char) row.m_vectMetaColumn[idx]->GetType());
+			}
+		}
+
+		// Rows
+		for (itrME = listCached.begin(); itrME != listCached.end(); itrME++)
+		{
+			EntityPtrList			listEntity;
+			EntityPtrListItr	itrEntity;
+			std::streampos		posSize, posRows, posEnd;
+
+			pME = *itrME;
+
+			RowView						row(pME, false);
+
+			pSet = pME->GetPrimaryMetaKey()->GetInstanceKeySet(this);
+
+			if (pSet)
+			{
+				for (itrKey = pSet->begin(); itrKey != pSet->end(); itrKey++)
+				{
+					pEntity = ((InstanceKeyPtr) *itrKey)->GetEntity();
+
+					if (pEntity && !pEntity->IsNew())
+						listEntity.push_back(pEntity);
+				}
+			}
+
+			// The size is patched in once the rows are written
+			WriteSnapshotUInt32(ostrm, listEntity.size());
+			posSize = ostrm.tellp();
+			WriteSnapshotInt64(ostrm, 0);
+			posRows = ostrm.tellp();
+
+			for (itrEntity = listEntity.begin(); itrEntity != listEntity.end(); itrEntity++)
+			{
+				pEntity = *itrEntity;
+
+				for (idx = 0; idx < row.m_vectMetaColumn.size(); idx++)
+				{
+					pCol = pEntity->GetColumn(row.m_vectMetaColumn[idx]);
+
+					if (!pCol->IsFetched())
+					{
+						ostrm.put((char) 0);
+						continue;
+					}
+
+					if (pCol->IsNull())
+					{
+						ostrm.put((char) (D3_CACHE_SNAPSHOT_FETCHED | D3_CACHE_SNAPSHOT_NULL));
+						continue;
+					}
+
+					ostrm.put((char) D3_CACHE_SNAPSHOT_FETCHED);
+
+					switch (pCol->GetMetaColumn()->GetType())
+					{
+						case MetaColumn::dbfString:
+							WriteSnapshotString(ostrm, (const std::string &) *((ColumnStringPtr) pCol));
+							break;
+
+						case MetaColumn::dbfChar:
+							WriteSnapshotInt64(ostrm, pCol->AsChar());
+							break;
+
+						case MetaColumn::dbfShort:
+							WriteSnapshotInt64(ostrm, pCol->AsShort());
+							break;
+
+						case MetaColumn::dbfBool:
+							WriteSnapshotInt64(ostrm, pCol->AsBool() ? 1 : 0);
+							break;
+
+						case MetaColumn::dbfInt:
+							WriteSnapshotInt64(ostrm, pCol->AsInt());
+							break;
+
+						case MetaColumn::dbfLong:
+							WriteSnapshotInt64(ostrm, pCol->AsLong());
+							break;
+
+						case MetaColumn::dbfFloat:
+						{
+							float		fValue = pCol->AsFloat();
+
+							ostrm.write((const char*) &fValue, sizeof(fValue));
+							break;
+						}
+
+						case MetaColumn::dbfDate:
+							WriteSnapshotInt64(ostrm, pCol->AsDate().GetUTCTicks());
+							break;
+
+						case MetaColumn::dbfBlob:
+							WriteSnapshotString(ostrm, ((const std::stringstream &) *((ColumnBlobPtr) pCol)).str());
+							break;
+
+						case MetaColumn::dbfBinary:
+						{
+							const Data &		data = *((ColumnBinaryPtr) pCol);
+
+							WriteSnapshotString(ostrm, (const char*) (const unsigned char*) data, data.length());
+							break;
+						}
+					}
+				}
+			}
+
+			posEnd = ostrm.tellp();
+			ostrm.seekp(posSize);
+			WriteSnapshotInt64(ostrm, (boost::int64_t) (posEnd - posRows));
+			ostrm.seekp(posEnd);
+
+			lRows += listEntity.size();
+		}
+
+		ostrm.close();
+
+		if (ostrm.fail())
+		{
+			remove(strTempFile.c_str());
+			throw Exception(__FILE__, __LINE__, Exception_error, "Database::SaveCacheSnapshot(): Failed to write file %s.", strTempFile.c_str());
+		}
+
+		// rename() doesn't replace existing files on all platforms
+		remove(strFileName.c_str());
+
+		if (rename(strTempFile.c_str(), strFileName.c_str()))
+			throw Exception(__FILE__, __LINE__, Exception_error, "Database::SaveCacheSnapshot(): Failed to rename %s to %s.", strTempFile.c_str(), strFileName.c_str());
+
+		ReportInfo("Database::SaveCacheSnapshot(): Wrote %lu objects of %u cached entities of database %s to %s.", lRows, (unsigned int) listCached.size(), m_pMetaDatabase->GetAlias().c_str(), strFileName.c_str());
+	}
+
+
+
+	bool Database::LoadCacheSnapshot(const std::string & strFileName, std::string & strWatermark)
+	{
+		MetaEntityPtrList &					listME = m_pMetaDatabase->GetDependencyOrderedMetaEntities();
+		MetaEntityPtrList						listCached;
+		MetaEntityPtrListItr				itrME;
+		MetaEntityPtr								pME;
+		std::vector<size_t>					vectOffset;
+		unsigned int								idx, uRows, uRow;
+		boost::int64_t							lSize;
+		size_t											uStart;
+		unsigned long								lRows = 0;
+		std::string									strName;
+
+
+		for (itrME = listME.begin(); itrME != listME.end(); itrME++)
+		{
+			if ((*itrME)->IsCached())
+				listCached.push_back(*itrME);
+		}
+
+		try
+		{
+			boost::interprocess::file_mapping		mapping(strFileName.c_str(), boost::interprocess::read_only);
+			boost::interprocess::mapped_region	region(mapping, boost::interprocess::read_only);
+			SnapshotReader											reader(region.get_address(), region.get_size());
+
+			// Check the header and layout before anything is made resident
+			if (!reader.Match(D3_CACHE_SNAPSHOT_MAGIC, 4) ||
+					reader.ReadUInt32() != D3_CACHE_SNAPSHOT_VERSION ||
+					reader.ReadUInt32() != D3_CACHE_SNAPSHOT_BYTE_ORDER)
+			{
+				ReportWarning("Database::LoadCacheSnapshot(): %s is not a cache snapshot this version of D3 can read.", strFileName.c_str());
+				return false;
+			}
+
+			if (reader.ReadString() != m_pMetaDatabase->GetAlias() ||
+					reader.ReadUInt32() != m_pMetaDatabase->GetVersionMajor() ||
+					reader.ReadUInt32() != m_pMetaDatabase->GetVersionMinor() ||
+					reader.ReadUInt32() != m_pMetaDatabase->GetVersionRevision())
+			{
+				ReportWarning("Database::LoadCacheSnapshot(): %s was not written for database %s %s.", strFileName.c_str(), m_pMetaDatabase->GetAlias().c_str(), m_pMetaDatabase->GetVersion().c_str());
+				return false;
+			}
+
+			reader.ReadString(strWatermark);
+
+			bool		bMatch = reader.ReadUInt32() == listCached.size();
+
+			for (itrME = listCached.begin(); bMatch && itrME != listCached.end(); itrME++)
+			{
+				RowView				row(*itrME, false);
+
+				if (reader.ReadString() != (*itrME)->GetName() || reader.ReadUInt32() != row.m_vectMetaColumn.size())
+				{
+					bMatch = false;
+					break;
+				}
+
+				for (idx = 0; bMatch && idx < row.m_vectMetaColumn.size(); idx++)
+				{
+					reader.ReadString(strName);
+					bMatch = strName == row.m_vectMetaColumn[idx]->GetName() && reader.ReadByte() == (unsigned char) row.m_vectMetaColumn[idx]->GetType();
+				}
+			}
+
+			if (!bMatch)
+			{
+				ReportWarning("Database::LoadCacheSnapshot(): The layout of the cached entities in %s doesn't match database %s.", strFileName.c_str(), m_pMetaDatabase->GetAlias().c_str());
+				return false;
+			}
+
+			// Decode every entity's rows once so that a corrupt file is rejected before anything is made resident
+			try
+			{
+				for (itrME = listCached.begin(); bMatch && itrME != listCached.end(); itrME++)
+				{
+					RowView				row(*itrME, false);
+
+					vectOffset.push_back(reader.GetOffset());
+
+					uRows = reader.ReadUInt32();
+					lSize = reader.ReadInt64();
+					uStart = reader.GetOffset();
+
+					if (lSize < 0 || (boost::uint64_t) lSize > reader.GetRemaining())
+					{
+						bMatch = false;
+						break;
+					}
+
+					for (uRow = 0; uRow < uRows; uRow++)
+						reader.ReadRow(row, m_pMetaDatabase->GetTimeZone());
+
+					bMatch = reader.GetOffset() - uStart == (size_t) lSize;
+				}
+
+				bMatch = bMatch && reader.GetRemaining() == 0;
+			}
+			catch (Exception &)
+			{
+				bMatch = false;
+			}
+
+			if (!bMatch)
+			{
+				ReportWarning("Database::LoadCacheSnapshot(): The rows in %s are corrupt.", strFileName.c_str());
+				return false;
+			}
+
+			// Make the rows resident
+			for (idx = 0, itrME = listCached.begin(); itrME != listCached.end(); idx++, itrME++)
+			{
+				pME = *itrME;
+
+				RowView				row(pME, false);
+
+				reader.SetOffset(vectOffset[idx]);
+				uRows = reader.ReadUInt32();
+				reader.ReadInt64();
+
+				for (uRow = 0; uRow < uRows; uRow++)
+				{
+					reader.ReadRow(row, m_pMetaDatabase->GetTimeZone());
+					MakeResident(row, false);
+				}
+
+				lRows += uRows;
+			}
+		}
+		catch (boost::interprocess::interprocess_exception & e)
+		{
+			ReportWarning("Database::LoadCacheSnapshot(): Unable to map cache snapshot %s. %s", strFileName.c_str(), e.what());
+			return false;
+		}
+
+		ReportInfo("Database::LoadCacheSnapshot(): Restored %lu objects of database %s from %s.", lRows, m_pMetaDatabase->GetAlias().c_str(), strFileName.c_str());
+
+		return true;
+	}
+
+
+
+	// Estimated bytes an instance of pME occupies when no ObjectArena keeps track
+	static size_t EstimateInstanceSize(MetaEntityPtr pME)
+	{
+		return sizeof(Entity) + pME->GetRowSize() + pME->GetMetaKeys()->size() * (sizeof(InstanceKey) + 4 * sizeof(void*));
+	}
+
+
+
+	size_t Database::GetResidentSize()
+	{
+		MetaEntityPtrVectPtr		pVectME;
+		InstanceKeyPtrSetPtr		pSet;
+		size_t									uSize = 0;
+		unsigned int						idx;
+
+
+		if (m_pObjectArena)
+			return m_pObjectArena->GetBytesInUse();
+
+		pVectME = m_pMetaDatabase->GetMetaEntities();
+
+		for (idx = 0; idx < pVectME->size(); idx++)
+		{
+			pSet = (*pVectME)[idx]->GetPrimaryMetaKey()->GetInstanceKeySet(this);
+
+			if (pSet)
+				uSize += pSet->size() * EstimateInstanceSize((*pVectME)[idx]);
+		}
+
+		return uSize;
+	}
+
+
+
+	long Database::EnforceMemoryBudget()
+	{
+		MetaEntityPtrVectPtr		pVectME = m_pMetaDatabase->GetMetaEntities();
+		MetaEntityPtr						pME;
+		EntityPtrList						listEntity;
+		EntityPtrListItr				itrEntity;
+		EntityPtr								pEntity;
+		size_t									uSize, uTarget;
+		unsigned int						uVisited;
+		long										lEvicted = 0;
+
+
+		if (!m_uMemoryBudget || pVectME->empty())
+			return 0;
+
+		uSize = GetResidentSize();
+
+		if (uSize <= m_uMemoryBudget)
+			return 0;
+
+		uTarget = m_uMemoryBudget - m_uMemoryBudget / 10;
+
+		// Two revolutions: the first may only clear reference bits
+		for (uVisited = 0; uVisited < 2 * pVectME->size() && uSize > uTarget; uVisited++)
+		{
+			if (m_uEvictionHand >= pVectME->size())
+				m_uEvictionHand = 0;
+
+			pME = (*pVectME)[m_uEvictionHand];
+
+			if (!pME->IsCached())
+			{
+				listEntity.clear();
+				pME->CollectAllInstances(this, listEntity);
+
+				for (itrEntity = listEntity.begin(); itrEntity != listEntity.end() && uSize > uTarget; itrEntity++)
+				{
+					pEntity = *itrEntity;
+
+					if (pEntity->m_bReferenced)
+					{
+						pEntity->m_bReferenced = false;
+						continue;
+					}
+
+					if (!pEntity->IsEvictable())
+						continue;
+
+					pEntity->Evict();
+					lEvicted++;
+
+					if (m_pObjectArena)
+						uSize = m_pObjectArena->GetBytesInUse();
+					else
+						uSize -= std::min(uSize, EstimateInstanceSize(pME));
+				}
+
+				// Continue with this MetaEntity next time if we stopped half way
+				if (uSize <= uTarget)
+					break;
+			}
+
+			m_uEvictionHand++;
+		}
+
+		return lEvicted;
+	}
+
+
+
+	// Collects the resident instances of a MetaEntity whose rows a scan returns
+	class ResidentKeyCollector : public RowVisitor
+	{
+		protected:
+			DatabasePtr						m_pDatabase;
+			MetaKeyPtr						m_pMetaKey;
+			TemporaryKey					m_tmpKey;
+			std::vector<int>			m_vectIdx;				// The RowView index of each key column
+
+		public:
+			std::set<EntityPtr>		m_setEntity;
+
+			ResidentKeyCollector(DatabasePtr pDB, MetaKeyPtr pMK) : m_pDatabase(pDB), m_pMetaKey(pMK), m_tmpKey(*pMK) {}
+
+			bool									On_Row(const RowView & row)
+			{
+				KeyColumnArrayItr		itrColumn;
+				unsigned int				idx = 0;
+				InstanceKeyPtr			pKey;
+
+
+				if (m_vectIdx.empty())
+				{
+					for (itrColumn = m_tmpKey.GetColumns().begin(); itrColumn != m_tmpKey.GetColumns().end(); itrColumn++)
+						m_vectIdx.push_back(row.GetColumnIndex((*itrColumn)->GetMetaColumn()->GetName()));
+				}
+
+				for (itrColumn = m_tmpKey.GetColumns().begin(); itrColumn != m_tmpKey.GetColumns().end(); itrColumn++, idx++)
+				{
+					if (m_vectIdx[idx] < 0 || !row.AssignTo(*itrColumn, m_vectIdx[idx]))
+						throw Exception(__FILE__, __LINE__, Exception_error, "ResidentKeyCollector::On_Row(): Failed to set key column %s.", (*itrColumn)->GetMetaColumn()->GetFullName().c_str());
+				}
+
+				pKey = m_pMetaKey->FindInstanceKey(&m_tmpKey, m_pDatabase);
+
+				if (pKey && pKey->GetEntity())
+					m_setEntity.insert(pKey->GetEntity());
+
+				return true;
+			}
+	};
+
+
+
+	long Database::RefreshCachedEntity(MetaEntityPtr pME)
+	{
+		MetaColumnPtr							pMC = pME->GetChangeTrackingMetaColumn();
+		MetaKeyPtr								pMK = pME->GetPrimaryMetaKey();
+		InstanceKeyPtrSetPtr			pSet;
+		InstanceKeyPtrSetItr			itrKey;
+		EntityPtr									pEntity;
+		EntityPtrList							listResident;
+		EntityPtrListItr					itrEntity;
+		EntityPtrListPtr					pEL;
+		ColumnPtr									pCol, pMax = NULL;
+		std::string								strWhere, strSQL;
+		unsigned long							lCount = 0;
+		long											lRows;
+
+
+		assert(pME && m_pMetaDatabase == pME->GetMetaDatabase());
+
+		// Find the high-water mark
+		pSet = pMK->GetInstanceKeySet(this);
+
+		if (pSet)
+		{
+			for (itrKey = pSet->begin(); itrKey != pSet->end(); itrKey++)
+			{
+				pEntity = ((InstanceKeyPtr) *itrKey)->GetEntity();
+
+				if (!pEntity || pEntity->IsNew() || !pMC)
+					continue;
+
+				pCol = pEntity->GetColumn(pMC);
+
+				if (pCol->IsFetched() && !pCol->IsNull() && (!pMax || pCol->Compare(pMax) > 0))
+					pMax = pCol;
+			}
+		}
+
+		if (!pMax)
+			return pME->LoadAll(this, true);
+
+		// Rows at the mark are refetched too, so rows sharing a last modified time aren't missed
+		strWhere = pMC->GetName();
+		strWhere += " >= ";
+		strWhere += pMax->AsSQLString();
+
+		pEL = LoadObjectsThroughQuery(pME, strWhere, "", true);
+
+		if (!pEL)
+			return -1;
+
+		lRows = pEL->size();
+		delete pEL;
+
+		// The delta may have made new rows resident, so count what is resident now
+		pSet = pMK->GetInstanceKeySet(this);
+
+		if (pSet)
+		{
+			for (itrKey = pSet->begin(); itrKey != pSet->end(); itrKey++)
+			{
+				pEntity = ((InstanceKeyPtr) *itrKey)->GetEntity();
+
+				if (pEntity && !pEntity->IsNew())
+					listResident.push_back(pEntity);
+			}
+		}
+
+		// If fewer rows exist than are resident, some were deleted
+		strSQL = "SELECT COUNT(*) FROM ";
+		strSQL += pME->GetName();
+
+		ExecuteSingletonSQLCommand(strSQL, lCount);
+
+		if (lCount < listResident.size())
+		{
+			ResidentKeyCollector		collector(this, pMK);
+			EntityPtrList						listDeleted;
+
+			VisitKeys(pMK, "", collector);
+
+			for (itrEntity = listResident.begin(); itrEntity != listResident.end(); itrEntity++)
+			{
+				if (collector.m_setEntity.find(*itrEntity) == collector.m_setEntity.end())
+					listDeleted.push_back(*itrEntity);
+			}
+
+			DeleteResidentInstances(this, listDeleted);
+		}
+
+		return lRows;
+	}
+
+
+
+	long Database::RefreshCache()
+	{
+		MetaEntityPtrList &			listME = m_pMetaDatabase->GetDependencyOrderedMetaEntities();
+		MetaEntityPtrListItr		itrME;
+		long										lRows, lTotal = 0;
+
+
+		for (itrME = listME.begin(); itrME != listME.end(); itrME++)
+		{
+			if (!(*itrME)->IsCached() || !(*itrME)->GetChangeTrackingMetaColumn())
+				continue;
+
+			lRows = RefreshCachedEntity(*itrME);
+
+			if (lRows < 0)
+				return lRows;
+
+			lTotal += lRows;
+		}
+
+		return lTotal;
 	}
 
 
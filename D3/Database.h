@@ -51,6 +51,9 @@
 #include "Key.h"
 #include "D3Date.h"
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/shared_ptr.hpp>
 #include <set>
 #include <list>
 
@@ -171,6 +174,9 @@ namespace D3
 
 	typedef void (*DatabaseAlertListenerFunc)(DatabaseAlertPtr pDBAlert);
 
+	//! Returns a WHERE clause selecting the rows of pME changed since strWatermark, or an empty string if none have changed (see MetaDatabase::SetCacheSnapshot())
+	typedef std::string (*CacheDeltaFilterFunc)(MetaEntityPtr pME, const std::string & strWatermark);
+
 
 
 
@@ -350,6 +356,10 @@ namespace D3
 				specify the same name. The reason is that teh SQLQNSerice uses this name to identify
 				which listener should receive the notification.
 
+			- a MetaEntity (optional): The name of the MetaEntity whose table the alert monitors
+				(<MetaEntity> element). If omitted, GetMetaEntity() uses the table named in the FROM
+				clause of the query. The CacheCoherenceListener relies on this mapping.
+
 	*/
 	class D3_API MetaDatabaseAlert
 	{
@@ -361,16 +371,20 @@ namespace D3
 			MetaDatabasePtr				m_pMetaDatabase;	//!< The MetaDatabase this belongs to
 			std::string						m_strName;				//!< The name to look out for (see class spec for details)
 			std::string						m_strSQL;					//!< The SQL query (see class spec for details)
+			std::string						m_strMetaEntity;	//!< The name of the MetaEntity the alert monitors (see class spec for details)
+			MetaEntityPtr					m_pMetaEntity;		//!< The MetaEntity the alert monitors (resolved by GetMetaEntity())
 			DatabaseAlertPtrList	m_listAlerts;			//!< All actual instances of this (not currently used for anything)
 
 			//! Only MetaDatabase::InitialiseMetaAlert create instances
-			MetaDatabaseAlert(MetaDatabasePtr pMetaDatabase, const std::string& strName, const std::string& strSQL);
+			MetaDatabaseAlert(MetaDatabasePtr pMetaDatabase, const std::string& strName, const std::string& strSQL, const std::string& strMetaEntity = "");
 			//! Only MetaDatabase objects delete these
 			~MetaDatabaseAlert();
 
 		public:
 			//! Get the name
 			const std::string&		GetName() const { return m_strName; }
+			//! Get the MetaEntity whose table this monitors (NULL if it can't be determined)
+			MetaEntityPtr					GetMetaEntity();
 
 		protected:
 			//! Get the SELECT statement to watch
@@ -470,6 +484,8 @@ namespace D3
 			const std::string&		GetMessage() const { return m_strMessage; };
 			//! Get the status (useful only when processing an alert notification)
 			int										GetStatus() const { return m_iStatus; };
+			//! Get the MetaEntity whose table this monitors (NULL if it can't be determined)
+			MetaEntityPtr					GetMetaEntity()		{ return m_pMetaDatabaseAlert->GetMetaEntity(); }
 
 		protected:
 			//! Get the name
@@ -524,6 +540,86 @@ namespace D3
 
 
 
+	//! CacheCoherenceListener keeps cached MetaEntities in the global databases in sync with alerts
+	/*! Register the listener with a DatabaseAlertManager for each alert monitoring a
+			cached table:
+
+			\code
+			CacheCoherenceListener::Listen(pDAM, "CustomerChanged");
+			\endcode
+
+			The listener runs in the thread that calls DatabaseAlertManager::MonitorDatabaseAlerts().
+			It doesn't touch the global database. It only records which MetaEntity (see
+			MetaDatabaseAlert::GetMetaEntity()) and, if known, which rows are out of date.
+			The thread owning the global databases must call ProcessPending() periodically to apply
+			the changes.
+
+			The alert message determines what is refreshed:
+			- "<Operation>:<Key>" (e.g. an Oracle trigger calling dbms_alert.signal('CustomerChanged', 'Update:' || :new.ID))
+				refreshes only the row with the given primary key, or removes it from memory if it
+				no longer exists. Separate the values of multi-column keys with '|'.
+			- anything else (e.g. the Insert, Update, Delete or Truncate messages SQL Server sends)
+				refreshes the whole entity through Database::RefreshCachedEntity()
+
+			Bursts of notifications are coalesced: an entity is only refreshed once no new alert for
+			it arrived for the settle time, or once its oldest pending alert exceeds the maximum
+			delay. If more rows than the key limit are pending, the whole entity is refreshed instead.
+	*/
+	class D3_API CacheCoherenceListener
+	{
+		protected:
+			//! Describes the outstanding refresh of a single MetaEntity
+			struct PendingRefresh
+			{
+				bool														bAll;					//!< If true, refresh all rows
+				std::set<std::string>						setKeys;			//!< The primary keys (as received) of the rows to refresh if !bAll
+				boost::posix_time::ptime				tmFirst;			//!< When the first pending alert was received
+				boost::posix_time::ptime				tmLast;				//!< When the last pending alert was received
+
+				PendingRefresh() : bAll(false) {}
+			};
+
+			typedef std::map<MetaEntityPtr, PendingRefresh>		PendingRefreshMap;
+			typedef PendingRefreshMap::iterator								PendingRefreshMapItr;
+
+			static boost::mutex								M_mtxPending;			//!< Protects the static members
+			static PendingRefreshMap					M_mapPending;			//!< The pending refreshes
+			static unsigned long							M_uSettleMS;			//!< Only refresh an entity if no alert was received for this many milliseconds
+			static unsigned long							M_uMaxDelayMS;		//!< But refresh an entity at the latest this many milliseconds after the first alert
+			static unsigned long							M_uMaxKeys;				//!< Refresh the whole entity if more keys than this are pending
+
+		public:
+			//! Adds On_DatabaseAlert() as a recurring listener for the alert named strAlertName
+			static void												Listen(DatabaseAlertManagerPtr pDAM, const std::string & strAlertName, int iTimeout = 0);
+			//! Removes On_DatabaseAlert() as a listener for the alert named strAlertName
+			static void												StopListening(DatabaseAlertManagerPtr pDAM, const std::string & strAlertName);
+
+			//! Sets the coalescing parameters (the defaults are 500ms, 5000ms and 100 keys)
+			static void												SetCoalescing(unsigned long uSettleMS, unsigned long uMaxDelayMS, unsigned long uMaxKeys);
+
+			//! The DatabaseAlertListenerFunc that records pending refreshes
+			static void												On_DatabaseAlert(DatabaseAlertPtr pDBAlert);
+
+			//! Returns true if any refresh is pending
+			static bool												HasPending();
+
+			//! Applies the pending refreshes which are due (or all of them if bForce is true)
+			/*! Call this from the thread owning the global databases. Refreshes which fail are
+					queued again as full refreshes of the MetaEntity.
+					@return	long	The number of MetaEntities refreshed
+			*/
+			static long												ProcessPending(bool bForce = false);
+
+		protected:
+			//! Refreshes the rows of pME in pDB with the keys in setKeys and removes those that no longer exist from memory. Returns false if a key doesn't match the primary key or the rows couldn't be fetched
+			static bool												RefreshRows(DatabasePtr pDB, MetaEntityPtr pME, const std::set<std::string> & setKeys);
+	};
+
+
+
+
+
+
 	//! Each object of this class describes all the elements of a physical database they provide access to.
 	/*! One instance of this class is generated automatically at startup: the MetaDictionary. However, the
 			MetaDictionary must be initialised explicitly by an application by calling:
@@ -829,6 +925,9 @@ namespace D3
 
 			MetaDatabaseAlertPtrMap						m_mapMetaDatabaseAlert;	//!< This map stores database alert templates by name
 
+			std::string												m_strCacheSnapshotFile;	//!< The file the global database's cache is restored from (see SetCacheSnapshot())
+			CacheDeltaFilterFunc							m_pfnCacheDeltaFilter;	//!< Selects the rows changed since the snapshot was taken (see SetCacheSnapshot())
+
 			boost::recursive_mutex						m_mtxExclusive;					//!< This Mutex is used to serialise modifications to m_listDatabase
 
 			TransactionManager								m_TransactionManager;		//!< Use to serialise transactions between m_listDatabase members (use GetTransactionManager to access this)
@@ -1214,6 +1313,24 @@ namespace D3
 			bool												VersionChecked()																					{ return HasVersionInfo() ? m_bVersionChecked : true; }
 			//@}
 
+			//! Makes the global database restore its cache from a snapshot file
+			/*! If strFileName names a snapshot written by Database::SaveCacheSnapshot() for this
+					version of this, Database::LoadCache() makes the instances stored in the file
+					resident instead of fetching all cached entities. It then reconciles each cached
+					MetaEntity with the database: if pfnDeltaFilter is not NULL, it refreshes the rows
+					the returned WHERE clause selects, otherwise it calls Database::RefreshCachedEntity()
+					(which only fetches changed rows if the entity has a change tracking column).
+					Rows deleted since the snapshot was taken are not detected by pfnDeltaFilter.
+
+					If the file is missing or doesn't match, LoadCache() loads the cache from the
+					database as usual.
+			*/
+			void												SetCacheSnapshot(const std::string & strFileName, CacheDeltaFilterFunc pfnDeltaFilter = NULL)	{ m_strCacheSnapshotFile = strFileName; m_pfnCacheDeltaFilter = pfnDeltaFilter; }
+			//! Returns the file set by SetCacheSnapshot()
+			const std::string &					GetCacheSnapshotFile() const															{ return m_strCacheSnapshotFile; }
+			//! Returns the delta filter set by SetCacheSnapshot()
+			CacheDeltaFilterFunc				GetCacheDeltaFilter() const																{ return m_pfnCacheDeltaFilter; }
+
 			//! Returns this' target database type
 			const TargetRDBMS &					GetTargetRDBMS() const																		{ return m_eTargetRDBMS; }
 
@@ -1353,6 +1470,181 @@ namespace D3
 
 
 
+	//! A read-only view of the current row of a scan started with Database::VisitObjects()
+	/*! Columns are addressed by their index in MetaEntity::GetMetaColumnsInFetchOrder()
+			(derived columns are not available). The view and its buffers are reused from one
+			row to the next, so references returned by GetString(), GetBinary() and GetDate()
+			are only valid until the visitor returns.
+
+			No Entity objects are created, so the values are not subject to any permissions
+			or custom column logic.
+	*/
+	class D3_API RowView
+	{
+		friend class Database;
+		friend class ODBCDatabase;
+		friend class AsyncLoadResult;
+		friend class SnapshotReader;
+
+		protected:
+			//! Holds the value of a single column
+			struct Value
+			{
+				bool							bNull;				//!< True if the value is NULL
+				bool							bFetched;			//!< False if the column is lazy fetch and the scan didn't fetch its value
+				long							lValue;				//!< Used for dbfChar, dbfShort, dbfBool, dbfInt and dbfLong columns
+				float							fValue;				//!< Used for dbfFloat columns
+				std::string				strValue;			//!< Used for dbfString, dbfBinary and dbfBlob columns
+				D3Date						dtValue;			//!< Used for dbfDate columns
+
+				Value() : bNull(true), bFetched(false), lValue(0), fValue(0.0) {}
+			};
+
+			typedef std::vector<Value>		ValueVect;
+
+			MetaEntityPtr						m_pMetaEntity;			//!< The MetaEntity whose instances are scanned
+			MetaColumnPtrVect				m_vectMetaColumn;		//!< The columns in the sequence they are fetched
+			ValueVect								m_vectValue;				//!< The values of the current row
+			bool										m_bLazyFetch;				//!< If true, lazy fetch columns only report whether or not they are NULL
+
+		public:
+			RowView(MetaEntityPtr pMetaEntity, bool bLazyFetch);
+			//! Creates a view over the columns of pMetaKey only (see Database::VisitKeys())
+			RowView(MetaKeyPtr pMetaKey);
+
+			MetaEntityPtr						GetMetaEntity() const									{ return m_pMetaEntity; }
+			unsigned int						GetColumnCount() const								{ return m_vectMetaColumn.size(); }
+			MetaColumnPtr						GetMetaColumn(unsigned int idx) const	{ return m_vectMetaColumn[idx]; }
+			//! Returns the index of the column with the given name or -1 if there is no such column
+			int											GetColumnIndex(const std::string & strName) const;
+
+			bool										IsNull(unsigned int idx) const				{ return m_vectValue[idx].bNull; }
+			//! Returns false for lazy fetch columns if the scan was started with bLazyFetch true (only IsNull() is meaningful then)
+			bool										IsFetched(unsigned int idx) const			{ return m_vectValue[idx].bFetched; }
+
+			//@{ Value accessors (the accessor must match the column's type)
+			char										GetChar(unsigned int idx) const				{ return (char) m_vectValue[idx].lValue; }
+			short										GetShort(unsigned int idx) const			{ return (short) m_vectValue[idx].lValue; }
+			bool										GetBool(unsigned int idx) const				{ return m_vectValue[idx].lValue != 0; }
+			int											GetInt(unsigned int idx) const				{ return (int) m_vectValue[idx].lValue; }
+			long										GetLong(unsigned int idx) const				{ return m_vectValue[idx].lValue; }
+			float										GetFloat(unsigned int idx) const			{ return m_vectValue[idx].fValue; }
+			const std::string &			GetString(unsigned int idx) const			{ return m_vectValue[idx].strValue; }
+			const std::string &			GetBinary(unsigned int idx) const			{ return m_vectValue[idx].strValue; }
+			const D3Date &					GetDate(unsigned int idx) const				{ return m_vectValue[idx].dtValue; }
+			//@}
+
+			//! Sets pCol to the value of column idx (pCol must be of the same type as the column)
+			bool										AssignTo(ColumnPtr pCol, unsigned int idx) const;
+	};
+
+
+
+
+	//! Implement this interface to scan rows with Database::VisitObjects()
+	class D3_API RowVisitor
+	{
+		public:
+			virtual ~RowVisitor() {}
+
+			//! Called for each row in turn. Return false to stop the scan.
+			virtual bool						On_Row(const RowView & row) = 0;
+	};
+
+
+
+
+	//! The base class for results of operations started with one of the Database::...Async() methods
+	/*! The operation runs on a worker thread while the thread that started it carries on.
+			Call Wait() or IsReady() to synchronise, and the subclass' Get() to retrieve the
+			result. Results are reference counted so it is safe to drop a result before the
+			operation completes.
+	*/
+	class D3_API AsyncResult
+	{
+		protected:
+			boost::mutex									m_mtxExclusive;				//!< Protects m_bReady and m_strError
+			boost::condition_variable			m_condReady;					//!< Signalled when the operation completes
+			bool													m_bReady;							//!< True once the operation completed
+			std::string										m_strError;						//!< Describes the error if the operation failed
+
+		public:
+			AsyncResult() : m_bReady(false) {}
+			virtual ~AsyncResult() {}
+
+			//! Returns true if the operation has completed (successfully or not)
+			bool													IsReady();
+			//! Blocks until the operation has completed
+			void													Wait();
+			//! Blocks until the operation has completed and throws an Exception if it failed
+			void													Check();
+
+			//! Sent by the worker when it's done. strError must be empty if the operation succeeded.
+			void													SetReady(const std::string & strError = "");
+	};
+
+	typedef boost::shared_ptr<AsyncResult>					AsyncResultPtr;
+
+
+
+
+	//! The result of Database::LoadObjectsAsync()
+	/*! Workers only fetch the rows. The objects are made resident in the Database that
+			started the operation when the thread which owns that Database calls Get().
+	*/
+	class D3_API AsyncLoadResult : public AsyncResult
+	{
+		friend class Database;
+		friend class ODBCDatabase;
+
+		protected:
+			typedef std::list<RowView::ValueVect>		RowList;
+
+			DatabasePtr										m_pDatabase;					//!< The Database the objects are made resident in
+			MetaEntityPtr									m_pMetaEntity;				//!< The type of objects loaded
+			bool													m_bRefresh;						//!< If true, resident objects are refreshed
+			bool													m_bLazyFetch;					//!< If true, lazy fetch columns were not fetched
+			RowList												m_listRows;						//!< The rows fetched by the worker
+			EntityPtrListPtr							m_pListEntity;				//!< Set if the objects were loaded synchronously
+
+		public:
+			AsyncLoadResult(DatabasePtr pDB, MetaEntityPtr pME, bool bRefresh, bool bLazyFetch)
+				: m_pDatabase(pDB), m_pMetaEntity(pME), m_bRefresh(bRefresh), m_bLazyFetch(bLazyFetch), m_pListEntity(NULL) {}
+			~AsyncLoadResult()												{ delete m_pListEntity; }
+
+			//! Waits for the operation and returns the objects loaded
+			/*! This method must be called by the thread that owns the Database which started the
+					operation. The caller owns the list returned and subsequent calls return NULL.
+
+					\note This method throws if the operation failed.
+			*/
+			EntityPtrListPtr							Get();
+	};
+
+	typedef boost::shared_ptr<AsyncLoadResult>			AsyncLoadResultPtr;
+
+
+
+
+	//! The result of Database::ExecuteQueryAsJSONAsync()
+	class D3_API AsyncJSONResult : public AsyncResult
+	{
+		friend class Database;
+		friend class ODBCDatabase;
+
+		protected:
+			std::string										m_strJSON;						//!< The JSON produced by the query
+
+		public:
+			//! Waits for the operation and returns the JSON (see Database::ExecuteQueryAsJSON()). Throws if the operation failed.
+			const std::string &						Get()													{ Check(); return m_strJSON; }
+	};
+
+	typedef boost::shared_ptr<AsyncJSONResult>			AsyncJSONResultPtr;
+
+
+
+
 	//! The Database class provides a common interface for any type of database.
 	/*! A Database object is an instance of a MetaDatabase object. and belongs to
 			a DatabaseWorkspace. It is an abstarct class which provides a generic
@@ -1371,6 +1663,8 @@ namespace D3
 	*/
 	class D3_API Database : public Object
 	{
+		friend class AsyncLoadResult;
+
 		public:
 			typedef void (*CreateStoredProcedureFunc)(DatabasePtr pDatabase);
 
@@ -1401,9 +1695,13 @@ namespace D3
 			bool											m_bTraceUpdates;					//!< If true, INSERT, DELETE and UPDATE statements are logged
 			unsigned int							m_uTrace;									//!< The trace level (see TraceXXX() methods)
 			unsigned long							m_lNextRsltSetID;					//!< The next result set ID this will assign to a ResultSet that belongs to this
+			ObjectArenaPtr						m_pObjectArena;						//!< Entity, InstanceKey and Relation objects belonging to this are allocated from here (NULL if Settings::UseObjectArena() was false when this was created)
+			bool											m_bBulkDeleting;					//!< True while DeleteAllObjects() is in progress
+			size_t										m_uMemoryBudget;					//!< The number of bytes resident entities may occupy before EnforceMemoryBudget() evicts some (0 means no budget)
+			unsigned int							m_uEvictionHand;					//!< The index of the MetaEntity EnforceMemoryBudget() continues sweeping from
 
 			//! Constructor called by MetaObject::CreateInstance()
-			Database() : m_pMetaDatabase(NULL), m_pDatabaseWorkspace(NULL), m_bInitialised(false), m_plistResultSet(NULL), m_uTrace(D3DB_TRACE_NONE), m_lNextRsltSetID(1) {};
+			Database() : m_pMetaDatabase(NULL), m_pDatabaseWorkspace(NULL), m_bInitialised(false), m_plistResultSet(NULL), m_uTrace(D3DB_TRACE_NONE), m_lNextRsltSetID(1), m_pObjectArena(NULL), m_bBulkDeleting(false), m_uMemoryBudget(0), m_uEvictionHand(0) {};
 			//! Destructor removes this from DatabaseWorkspace and the MetaDatabase's list of instance databases.
 			~Database();
 
@@ -1414,6 +1712,38 @@ namespace D3
 			//! Return the DatabaseWorkspace object.
 			DatabaseWorkspacePtr			GetDatabaseWorkspace()		{ return m_pDatabaseWorkspace; }
 
+			//! Return the ObjectArena from which objects belonging to this are allocated (may be NULL).
+			ObjectArenaPtr						GetObjectArena()					{ return m_pObjectArena; }
+
+			//! Returns true while DeleteAllObjects() is in progress.
+			bool											IsBulkDeleting()					{ return m_bBulkDeleting; }
+
+			//! Sets the number of bytes resident entities may occupy (0, the default, means unlimited)
+			void											SetMemoryBudget(size_t uBytes)	{ m_uMemoryBudget = uBytes; }
+			//! Returns the memory budget (see SetMemoryBudget())
+			size_t										GetMemoryBudget()					{ return m_uMemoryBudget; }
+			//! Returns the number of bytes resident entities occupy
+			/*! If this has an ObjectArena, this is the number of bytes allocated from it. Otherwise
+					it is estimated from the number of resident instances and their row sizes.
+			*/
+			size_t										GetResidentSize();
+
+			//! Evicts entities from memory until GetResidentSize() is 10% below GetMemoryBudget()
+			/*! The method does nothing if no budget is set or it isn't exceeded. It sweeps
+					the resident instances of non-cached MetaEntities CLOCK-style: instances whose
+					columns were accessed since the last sweep are passed over once, others are
+					evicted if Entity::IsEvictable() (i.e. clean, not a member of a ResultSet and
+					without children in memory). Relations the evicted entities were children of
+					are marked as not navigated so that they are navigated again when accessed.
+
+					Pointers to evicted entities become invalid. Therefore D3 never calls this
+					method itself. Long-lived workspaces should call it between units of work when
+					they hold no EntityPtr from this.
+
+					@return long		The number of entities evicted
+			*/
+			long											EnforceMemoryBudget();
+
 			//! Physical disconnect from the physical store.
 			virtual bool							Disconnect() = 0;
 			//! Physical connect to the physical store.
@@ -1491,6 +1821,20 @@ namespace D3
 			*/
 			virtual ColumnPtr					LoadColumn(ColumnPtr pColumn) = 0;
 
+			//! Load the lazy fetch column pMC for all entities in listEntity which haven't fetched it yet
+			/*! Subclasses may fetch the values for many entities with a single query. This
+					implementation simply calls LoadColumn() for each column not yet fetched.
+					Entities which are not instances of pMC's MetaEntity or don't belong to this
+					are ignored.
+
+					@return long			The number of columns loaded or a negative value if the
+														operation failed.
+			*/
+			virtual long							LoadColumns(MetaColumnPtr pMC, EntityPtrList & listEntity);
+
+			//! Load all lazy fetch columns of all entities in listEntity (see LoadColumns())
+			long											LoadLazyColumns(EntityPtrList & listEntity);
+
 			//! Load the object matching the specified key
 			/*! @param	pKey			The key to search for. This can be an InstanceKey or
 														a temporary key. The object returned will be an instance
@@ -1525,6 +1869,21 @@ namespace D3
 			*/
 			virtual long							LoadObjects(RelationPtr pRelation, bool bRefresh = false, bool bLazyFetch = true) = 0;
 
+			//! Loads all children from several relationships
+			/*! This method has the same effect as calling LoadObjects(RelationPtr) for each
+					Relation in listRelation. Subclasses may load the children of all relations
+					which are instances of the same MetaRelation with a few queries rather than
+					one query per relation. All relations must have their children in this.
+					This implementation simply calls LoadObjects(RelationPtr) for each relation.
+
+					@return long			The method returns the number of objects loaded or
+														a negative value if the operation failed.
+
+					\note Use Relation::LoadAll(RelationPtrList&) which also marks the relations
+					as navigated.
+			*/
+			virtual long							LoadObjects(RelationPtrList & listRelation, bool bRefresh = false, bool bLazyFetch = true);
+
 			//! Loads objects where the values of the instance of the MetaKey passed matches the values of the key passed in.
 			/*! This method checks the cache first and if found, returns the cached key.
 			/*! @param pMetaKey		The MetaKey we lookup.
@@ -1605,6 +1964,68 @@ namespace D3
 			*/
 			virtual EntityPtrListPtr	LoadObjectsThroughQuery(MetaEntityPtr pME, const std::string & strWhere, const std::string & strOrderBy, bool bRefresh = false, bool bLazyFetch = true);
 
+			//! Loads the object graphs hanging off the entities in listEntity
+			/*! strPaths is a comma separated list of relation paths where each path is a dot
+					separated list of child MetaRelation names, e.g. "Locations.Pallets.Items,Locations.Manager".
+					Each hop is loaded for all parents at this level at once using
+					Relation::LoadAll(MetaRelationPtr, EntityPtrList&) so that the number of queries
+					depends on the number of relations in strPaths rather than the number of objects.
+					Paths sharing a prefix load the common relations only once. All Relations loaded
+					are marked as navigated. The paths are resolved against the MetaEntity of
+					the first entity in listEntity and entities of any other type are ignored.
+
+					@return long			The number of objects loaded or a negative value if the
+														operation failed.
+
+					\note This method throws if a path contains an unknown relation name.
+			*/
+			long											Prefetch(EntityPtrList & listEntity, const std::string & strPaths, bool bRefresh = false, bool bLazyFetch = true);
+
+			//! Scans instances of pME without making them resident
+			/*! This method is intended for reports and exports which need to read many rows.
+					It runs a forward-only query with the optional WHERE predicate and ORDER BY
+					clause given (without the keywords) and passes each row to visitor.On_Row()
+					as a RowView. No Entity, key or relation objects are created, so memory
+					consumption doesn't grow with the number of rows.
+
+					@return long			The number of rows visited.
+
+					\note This method may throw!
+			*/
+			long											VisitObjects(MetaEntityPtr pME, const std::string & strWhere, const std::string & strOrderBy, RowVisitor & visitor, bool bLazyFetch = true);
+
+			//! Like VisitObjects() but selects only the columns of pMK, so the RowView passed to visitor holds just those
+			long											VisitKeys(MetaKeyPtr pMK, const std::string & strWhere, RowVisitor & visitor);
+
+			/** @name Asynchronous Queries
+					These methods return immediately and run the query on a worker thread. Subclasses
+					run queries on their own connections so they don't see changes made by a pending
+					transaction of this. Such requests and requests to databases which don't support
+					asynchronous queries are executed synchronously and return a result which is ready.
+			*/
+			//@{
+			//! Starts LoadObjects(pME, strSQL, bRefresh, bLazyFetch). Use AsyncLoadResult::Get() in this' thread to retrieve the objects.
+			virtual AsyncLoadResultPtr	LoadObjectsAsync(MetaEntityPtr pME, const std::string & strSQL, bool bRefresh = false, bool bLazyFetch = true);
+			//! Starts LoadObjectsThroughQuery(pME, strWhere, strOrderBy, bRefresh, bLazyFetch)
+			AsyncLoadResultPtr				LoadObjectsThroughQueryAsync(MetaEntityPtr pME, const std::string & strWhere, const std::string & strOrderBy, bool bRefresh = false, bool bLazyFetch = true);
+			//! Starts loading all instances of pME (the asynchronous equivalent of LoadObjects(pME, bRefresh, bLazyFetch))
+			virtual AsyncLoadResultPtr	LoadAllAsync(MetaEntityPtr pME, bool bRefresh = false, bool bLazyFetch = true)		{ return LoadObjectsThroughQueryAsync(pME, "", "", bRefresh, bLazyFetch); }
+			//! Starts ExecuteQueryAsJSON(strSQL)
+			virtual AsyncJSONResultPtr	ExecuteQueryAsJSONAsync(const std::string & strSQL);
+			//@}
+
+			//! Runs strSQL which must return the columns pME->AsSQLSelectList(bLazyFetch) returns and passes each row to visitor (see VisitObjects())
+			virtual long							VisitRows(MetaEntityPtr pME, const std::string & strSQL, RowVisitor & visitor, bool bLazyFetch = true)
+			{
+				throw std::runtime_error("Database::VisitRows() not implemented");
+			}
+
+			//! Runs strSQL which must return the columns of row and passes each row to visitor
+			virtual long							VisitRows(RowView & row, const std::string & strSQL, RowVisitor & visitor)
+			{
+				throw std::runtime_error("Database::VisitRows() not implemented");
+			}
+
 			//! Loads objects by calling the stored procedure specified
 			/*! This method allows you to call a stored procedure to retrieve multiple records from multiple resultsets in a single call.
 
@@ -1829,6 +2250,22 @@ namespace D3
 			*/
 			virtual bool							UpdateObject(EntityPtr pObj) = 0;
 
+			//! Update several Objects.
+			/*! This method has the same effect as calling UpdateObject() for each object
+					in listEntity in the sequence given. Subclasses may send consecutive objects
+					sharing the same MetaEntity and update type to the physical store in batches,
+					so the list must be in dependency order (e.g. parents to be inserted before
+					their children). This implementation simply calls UpdateObject() for each
+					object.
+
+					Objects which are deleted are also deleted from memory, so the list must not
+					be dereferenced once the method returns. See Entity::UpdateBatch() which
+					also sends the update notifications.
+
+					\note For this method to succeed, you must have a pending transaction.
+			*/
+			virtual bool							UpdateObjects(EntityPtrList & listEntity);
+
 
 			//@{
 			/** Just for backwards compatibility */
@@ -1843,6 +2280,10 @@ namespace D3
 					period of time but wish to discard all objects which it contains so that
 					you have a clear starting point before you load new objects from the
 					physical store.
+
+					Since all objects go, only the primary key collections are maintained while
+					objects are deleted. All other key collections for this are simply emptied
+					beforehand (see MetaKey::On_BeforeDeleteAllObjects()).
 			*/
 			void											DeleteAllObjects();
 
@@ -1939,6 +2380,9 @@ namespace D3
 			*/
 			virtual int								ExecuteSQLCommand(const std::string & strSQL, bool bReadOnly) = 0;
 
+			//! Makes the row passed in resident (creating or, if bRefresh is true, refreshing the object) and returns the object
+			EntityPtr									MakeResident(const RowView & row, bool bRefresh);
+
 			//! Initialise DatabaseAlertResources
 			/*! This method throws an error at this level, though it is only called if you try to use alert notifications.
 					\note At this level, the method retruns with success (assuming nothing needs to be done to enable DatabaseAlerts for this type of database)
@@ -1968,8 +2412,56 @@ namespace D3
 			virtual void							UnRegisterDatabaseAlert(DatabaseAlertPtr pDBAlert);
 
 			//! If this is the global database, it loads all entities marked as cached once a connection has been obtained.
+			/*! Cached entities are grouped into dependency levels (an entity's level is one higher
+					than the highest level of its parents in the same MetaDatabase). The entities of a
+					level are fetched concurrently through LoadAllAsync() and then made resident one
+					after the other in this' thread before the next level is started.
+			*/
 			void											LoadCache();
 
+		public:
+			//! Writes all resident instances of cached MetaEntities of this to a binary snapshot file
+			/*! The file records this' MetaDatabase version, the layout of each cached MetaEntity
+					(its non-derived columns, see RowView) and strWatermark, an application defined marker of the data version the snapshot
+					reflects (e.g. a rowversion high-water mark). It is written to a temporary file
+					first and then renamed, so readers never see a partially written snapshot.
+
+					\note Values are stored in the byte order of the machine writing the snapshot.
+			*/
+			void											SaveCacheSnapshot(const std::string & strFileName, const std::string & strWatermark);
+
+			//! Maps a file written by SaveCacheSnapshot() into memory and makes the instances it contains resident
+			/*! Returns false without making anything resident if the file doesn't exist, if it
+					doesn't match this' MetaDatabase version or the layout of its cached entities or
+					if the rows of any entity don't decode to exactly the number of rows and bytes
+					recorded for it. On success, strWatermark receives the watermark passed to
+					SaveCacheSnapshot().
+			*/
+			bool											LoadCacheSnapshot(const std::string & strFileName, std::string & strWatermark);
+
+			//! Brings the resident instances of pME up to date with the database
+			/*! If pME has a change tracking column (see MetaColumn::Flags::ChangeTracking), the
+					method refreshes only the rows whose change tracking value is at or above the
+					highest value of any resident instance (the high-water mark) and loads new rows.
+					If the database then holds fewer rows than are resident, the primary keys of all
+					rows are scanned and resident instances which no longer exist are removed from
+					memory (but not from the database).
+
+					Without a change tracking column, or if no instance is resident, all instances
+					are reloaded with LoadAll(this, true).
+
+					@return long		The number of rows fetched (refreshed or new) or a negative value
+													if the operation failed.
+			*/
+			long											RefreshCachedEntity(MetaEntityPtr pME);
+
+			//! Calls RefreshCachedEntity() for each cached MetaEntity that has a change tracking column
+			/*! Call this periodically from the thread that owns this (usually the global
+					database) to keep large cached entities fresh without full reloads.
+			*/
+			long											RefreshCache();
+
+		protected:
 			//! Returns true if this is the Global database for it's MetaDatabase
 			bool											IsGlobalDatabase();
 
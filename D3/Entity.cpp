@@ -95,7 +95,8 @@ namespace D3
 		m_uEntityIdx(D3_UNDEFINED_ID),
 		m_uPrimaryKeyIdx(D3_UNDEFINED_ID),
 		m_uConceptualKeyIdx(D3_UNDEFINED_ID),
-		m_sAssociative(-1)
+		m_sAssociative(-1),
+		m_uRowSize(0)
 	{
 	}
 
@@ -113,7 +114,8 @@ namespace D3
 		m_uEntityIdx(D3_UNDEFINED_ID),
 		m_uPrimaryKeyIdx(D3_UNDEFINED_ID),
 		m_uConceptualKeyIdx(D3_UNDEFINED_ID),
-		m_sAssociative(-1)
+		m_sAssociative(-1),
+		m_uRowSize(0)
 	{
 		Init(strInstanceClassName);
 	}
@@ -382,7 +384,7 @@ namespace D3
 		{
 			// Create the object
 			//
-			pEntity = (EntityPtr) m_pInstanceClass->CreateInstance();
+			pEntity = (EntityPtr) ObjectArena::CreateInstance(pDatabase->GetObjectArena(), *m_pInstanceClass);
 			pEntity->MarkConstructing();
 			pEntity->m_pMetaEntity = this;
 			pEntity->m_pDatabase = pDatabase;
@@ -440,6 +442,17 @@ namespace D3
 
 
 
+	MetaColumnPtr MetaEntity::GetChangeTrackingMetaColumn()
+	{
+		for (unsigned int idx = 0; idx < m_vectMetaColumn.size(); idx++)
+			if (m_vectMetaColumn[idx] && m_vectMetaColumn[idx]->IsChangeTracking() && !m_vectMetaColumn[idx]->IsDerived())
+				return m_vectMetaColumn[idx];
+
+		return NULL;
+	}
+
+
+
 	MetaColumnPtr MetaEntity::GetMetaColumn(const std::string & strColumnName)
 	{
 		for (unsigned int idx = 0; idx < m_vectMetaColumn.size(); idx++)
@@ -531,6 +544,39 @@ namespace D3
 
 
 
+	long MetaEntity::Prefetch(DatabasePtr pDB, const std::string & strPaths, bool bRefresh, bool bLazyFetch)
+	{
+		EntityPtrListPtr		pEL;
+		long								lCount;
+
+
+		assert(pDB);
+
+		pEL = pDB->LoadObjectsThroughQuery(this, "", "", bRefresh, bLazyFetch);
+
+		if (!pEL)
+			return -1;
+
+		try
+		{
+			lCount = pDB->Prefetch(*pEL, strPaths, bRefresh, bLazyFetch);
+		}
+		catch (...)
+		{
+			delete pEL;
+			throw;
+		}
+
+		if (lCount >= 0)
+			lCount += pEL->size();
+
+		delete pEL;
+
+		return lCount;
+	}
+
+
+
 	void MetaEntity::DeleteAllObjects(DatabasePtr pDatabase)
 	{
 		GetPrimaryMetaKey()->DeleteAllObjects(pDatabase);
@@ -2994,6 +3040,46 @@ namespace D3
 		{
 			m_vectMetaColumn[idx]->SetDefaultDescription();
 		}
+
+		BuildRowLayout();
+	}
+
+
+
+	// Column objects are placed in the row buffer at offsets which are a multiple of this
+	//
+	#define D3_ROW_BUFFER_ALIGNMENT		16
+
+	void MetaEntity::BuildRowLayout()
+	{
+		unsigned int		idx, uOffset = 0, uSize;
+		MetaColumnPtr		pMC;
+
+
+		m_vectRowOffset.clear();
+		m_uRowSize = 0;
+
+		m_vectRowOffset.reserve(m_vectMetaColumn.size());
+
+		for (idx = 0; idx < m_vectMetaColumn.size(); idx++)
+		{
+			pMC = m_vectMetaColumn[idx];
+
+			// Fall back to individually allocated columns if we can't place all of them
+			//
+			if (!pMC || !pMC->m_pInstanceClass || !pMC->m_pInstanceClass->CanCreateInstanceInPlace())
+			{
+				m_vectRowOffset.clear();
+				return;
+			}
+
+			uSize = (pMC->m_pInstanceClass->Size() + D3_ROW_BUFFER_ALIGNMENT - 1) & ~(D3_ROW_BUFFER_ALIGNMENT - 1);
+
+			m_vectRowOffset.push_back(uOffset);
+			uOffset += uSize;
+		}
+
+		m_uRowSize = uOffset;
 	}
 
 
@@ -3816,7 +3902,7 @@ namespace D3
 				if (pMK->IsUnique() && !pMK->IsAutoNum())
 				{
 					D3::TemporaryKey			tempKey(*pMK);
-					D3::ColumnPtrListItr	itr;
+					D3::KeyColumnArrayItr	itr;
 
 					for (	itr =  tempKey.GetColumns().begin();
 								itr != tempKey.GetColumns().end();
@@ -3867,6 +3953,159 @@ namespace D3
 
 
 
+	// ==========================================================================
+	// RelationSlot implementation
+	//
+
+	RelationSlot::RelationSlot(const RelationSlot & aSlot)
+	 : m_pDatabase(aSlot.m_pDatabase),
+		 m_pRelation(aSlot.m_pRelation),
+		 m_pMapRelation(aSlot.m_pMapRelation ? new RelationPtrMap(*aSlot.m_pMapRelation) : NULL)
+	{
+	}
+
+
+
+	RelationSlot & RelationSlot::operator=(const RelationSlot & aSlot)
+	{
+		if (this != &aSlot)
+		{
+			delete m_pMapRelation;
+
+			m_pDatabase = aSlot.m_pDatabase;
+			m_pRelation = aSlot.m_pRelation;
+			m_pMapRelation = aSlot.m_pMapRelation ? new RelationPtrMap(*aSlot.m_pMapRelation) : NULL;
+		}
+
+		return *this;
+	}
+
+
+
+	void RelationSlot::Insert(DatabasePtr pDatabase, RelationPtr pRelation)
+	{
+		assert(pDatabase);
+		assert(!Find(pDatabase));
+
+		if (!m_pMapRelation)
+		{
+			if (!m_pDatabase)
+			{
+				m_pDatabase = pDatabase;
+				m_pRelation = pRelation;
+				return;
+			}
+
+			// Spill the inline relation into a map
+			//
+			m_pMapRelation = new RelationPtrMap();
+			m_pMapRelation->insert(RelationPtrMap::value_type(m_pDatabase, m_pRelation));
+			m_pDatabase = NULL;
+			m_pRelation = NULL;
+		}
+
+		m_pMapRelation->insert(RelationPtrMap::value_type(pDatabase, pRelation));
+	}
+
+
+
+	bool RelationSlot::Erase(DatabasePtr pDatabase)
+	{
+		RelationPtrMapItr		itrRelationMap;
+
+
+		if (!m_pMapRelation)
+		{
+			if (!m_pDatabase || m_pDatabase != pDatabase)
+				return false;
+
+			m_pDatabase = NULL;
+			m_pRelation = NULL;
+			return true;
+		}
+
+		itrRelationMap = m_pMapRelation->find(pDatabase);
+
+		if (itrRelationMap == m_pMapRelation->end())
+			return false;
+
+		m_pMapRelation->erase(itrRelationMap);
+
+		// Collapse back to the inline representation
+		//
+		if (m_pMapRelation->size() < 2)
+		{
+			if (!m_pMapRelation->empty())
+			{
+				m_pDatabase = m_pMapRelation->begin()->first;
+				m_pRelation = m_pMapRelation->begin()->second;
+			}
+
+			delete m_pMapRelation;
+			m_pMapRelation = NULL;
+		}
+
+		return true;
+	}
+
+
+
+	DatabasePtr RelationSlot::GetDatabase(unsigned int idx) const
+	{
+		RelationPtrMapItr		itrRelationMap;
+
+
+		assert(idx < size());
+
+		if (!m_pMapRelation)
+			return m_pDatabase;
+
+		itrRelationMap = m_pMapRelation->begin();
+		std::advance(itrRelationMap, idx);
+
+		return itrRelationMap->first;
+	}
+
+
+
+	RelationPtr RelationSlot::GetRelation(unsigned int idx) const
+	{
+		RelationPtrMapItr		itrRelationMap;
+
+
+		assert(idx < size());
+
+		if (!m_pMapRelation)
+			return m_pRelation;
+
+		itrRelationMap = m_pMapRelation->begin();
+		std::advance(itrRelationMap, idx);
+
+		return itrRelationMap->second;
+	}
+
+
+
+	RelationPtr RelationSlot::FindInMap(DatabasePtr pDatabase) const
+	{
+		RelationPtrMapItr		itrRelationMap = m_pMapRelation->find(pDatabase);
+
+		if (itrRelationMap == m_pMapRelation->end())
+			return NULL;
+
+		return itrRelationMap->second;
+	}
+
+
+
+
+
+
+
+
+
+
+
 	// ==========================================================================
 	// Entity implementation
 	//
@@ -3897,8 +4136,6 @@ namespace D3
 		ColumnPtr						pCol;
 		InstanceKeyPtr			pKey;
 		unsigned int				idx;
-		RelationPtrMapPtr		pRelationMap;
-		RelationPtrMapItr		itrRelationMap;
 		RelationPtr					pRelation;
 
 
@@ -3945,54 +4182,35 @@ namespace D3
 		//
 		for (idx = 0; idx < m_vectParentRelation.size(); idx++)
 		{
-			pRelationMap = m_vectParentRelation[idx];
+			RelationSlot &				slotRelation = m_vectParentRelation[idx];
 
-			while (pRelationMap && !pRelationMap->empty())
+			while (!slotRelation.empty())
 			{
-				itrRelationMap = pRelationMap->begin();
-				pRelation = itrRelationMap->second;
+				pRelation = slotRelation.GetRelation(0);
 				pRelation->RemoveChild(this);
 			}
-
-			delete m_vectParentRelation[idx];
-			m_vectParentRelation[idx] = NULL;
 		}
 
 		// Delete all child relations and child relation maps
 		//
 		for (idx = 0; idx < m_vectChildRelation.size(); idx++)
 		{
-			pRelationMap = m_vectChildRelation[idx];
-
-
-			if (pRelationMap && !pRelationMap->empty())
+			if (!m_vectChildRelation[idx].empty())
 			{
 				// In order to ensure correct destruction of objects even if cyclic relations are in place
-				// we copy the relation map and iterate over it. We then just use the key (the DatabasePtr)
-				// and try and access it from the actual map and if it still exists, we'll delete the
-				// relation.
+				// we copy the relation slot and iterate over it. We then just use the DatabasePtr and try
+				// and access it from the actual slot and if it still exists, we'll delete the relation.
 				//
-				RelationPtrMap			mapRelation(*pRelationMap);
-				RelationPtrMapItr		itrRelationMap, itrRelationMapCopy;
+				RelationSlot			slotRelation(m_vectChildRelation[idx]);
 
-				for ( itrRelationMapCopy =  mapRelation.begin();
-							itrRelationMapCopy != mapRelation.end();
-							itrRelationMapCopy++)
+				for (unsigned int idx2 = 0; idx2 < slotRelation.size(); idx2++)
 				{
-					itrRelationMap = pRelationMap->find(itrRelationMapCopy->first);
-
-					if (itrRelationMap != pRelationMap->end())
-					{
-						pRelation = itrRelationMap->second;
+					pRelation = m_vectChildRelation[idx].Find(slotRelation.GetDatabase(idx2));
 
-						if (pRelation && !pRelation->IsDestroying())
-							delete pRelation;
-					}
+					if (pRelation && !pRelation->IsDestroying())
+						delete pRelation;
 				}
 			}
-
-			delete m_vectChildRelation[idx];
-			m_vectChildRelation[idx] = NULL;
 		}
 
 		// Delete all InstanceKey objects
@@ -4003,14 +4221,21 @@ namespace D3
 			delete pKey;
 		}
 
-		// Delete all Column objects
+		// Delete all Column objects (those living in the row buffer are destroyed in place)
 		//
 		for (idx = 0; idx < m_vectColumn.size(); idx++)
 		{
 			pCol = m_vectColumn[idx];
-			delete pCol;
+
+			if (pCol && IsInRowBuffer(pCol))
+				pCol->~Column();
+			else
+				delete pCol;
 		}
 
+		ObjectArena::FreeObject(m_pRowBuffer);
+		m_pRowBuffer = NULL;
+
 		m_pMetaEntity->On_InstanceDeleted(this);
 
 		if (m_uFlags & D3_ENTITY_TRACE_DELETE)
@@ -4071,8 +4296,6 @@ namespace D3
 
 	void Entity::TraceDelete(bool bDeep)
 	{
-		RelationPtrMapPtr			pRelationMap;
-		RelationPtrMapItr			itrRelationMap;
 		RelationPtr						pRelation;
 		InstanceKeyPtrSetItr	itrKeySet;
 		InstanceKeyPtr				pKey;
@@ -4086,23 +4309,16 @@ namespace D3
 			// Propagate method to children
 			for (std::size_t idx = 0; idx < m_vectChildRelation.size(); idx++)
 			{
-				pRelationMap = m_vectChildRelation[idx];
-
-				if (pRelationMap && !pRelationMap->empty())
+				for (unsigned int idx2 = 0; idx2 < m_vectChildRelation[idx].size(); idx2++)
 				{
-					for ( itrRelationMap =  pRelationMap->begin();
-								itrRelationMap != pRelationMap->end();
-								itrRelationMap++)
-					{
-						pRelation = itrRelationMap->second;
+					pRelation = m_vectChildRelation[idx].GetRelation(idx2);
 
-						for ( itrKeySet =  pRelation->GetChildKeys().begin();
-									itrKeySet != pRelation->GetChildKeys().end();
-									itrKeySet++)
-						{
-							pKey = (InstanceKeyPtr) *itrKeySet;
-							pKey->GetEntity()->TraceDelete(bDeep);
-						}
+					for ( itrKeySet =  pRelation->GetChildKeys().begin();
+								itrKeySet != pRelation->GetChildKeys().end();
+								itrKeySet++)
+					{
+						pKey = (InstanceKeyPtr) *itrKeySet;
+						pKey->GetEntity()->TraceDelete(bDeep);
 					}
 				}
 			}
@@ -4326,6 +4542,71 @@ namespace D3
 
 
 
+	/* static */
+	bool Entity::UpdateBatch(DatabasePtr pDB, EntityPtrList & listEntity)
+	{
+		EntityPtrList									listUpdate;
+		EntityPtrListItr							itrEntity;
+		std::vector<UpdateType>				vectUpdateType;
+		EntityPtr											pEntity;
+		UpdateType										eUT;
+		unsigned int									idx, idxKey;
+		InstanceKeyPtr								pKey;
+
+
+		// Notify the objects and drop those with nothing to do
+		//
+		for ( itrEntity =  listEntity.begin();
+					itrEntity != listEntity.end();
+					itrEntity++)
+		{
+			pEntity = *itrEntity;
+			eUT = pEntity->GetUpdateType();
+
+			if (eUT == SQL_None || (eUT == SQL_Delete && pEntity->IsNew()))
+				continue;
+
+			if (!pEntity->On_BeforeUpdate(eUT))
+				return false;
+
+			listUpdate.push_back(pEntity);
+			vectUpdateType.push_back(eUT);
+		}
+
+		if (listUpdate.empty())
+			return true;
+
+		if (!pDB->UpdateObjects(listUpdate))
+			return false;
+
+		// Deleted objects are gone, the others get the same notifications Update() sends
+		//
+		for ( idx = 0,	itrEntity =  listUpdate.begin();
+										itrEntity != listUpdate.end();
+					idx++,		itrEntity++)
+		{
+			if (vectUpdateType[idx] == SQL_Delete)
+				continue;
+
+			pEntity = *itrEntity;
+
+			if (!pEntity->On_AfterUpdate(vectUpdateType[idx]))
+				return false;
+
+			for (idxKey = 0; idxKey < pEntity->m_vectInstanceKey.size(); idxKey++)
+			{
+				pKey = pEntity->m_vectInstanceKey[idxKey];
+
+				if (pKey)
+					pKey->On_AfterUpdateEntity();
+			}
+		}
+
+		return true;
+	}
+
+
+
 	bool Entity::IsValid()
 	{
 		return true;
@@ -4612,6 +4893,57 @@ namespace D3
 	}
 
 
+	bool Entity::IsEvictable()
+	{
+		unsigned int		idx, idx2;
+
+
+		if (m_uFlags & (D3_ENTITY_NEW | D3_ENTITY_DELETE | D3_ENTITY_POPULATING | D3_ENTITY_DESTROYING | D3_ENTITY_MARKED | D3_ENTITY_CONSTRUCTING))
+			return false;
+
+		if (m_pListResultSet && !m_pListResultSet->empty())
+			return false;
+
+		if (m_pOriginalKey || IsDirty())
+			return false;
+
+		for (idx = 0; idx < m_vectChildRelation.size(); idx++)
+		{
+			RelationSlot &				slotRelation = m_vectChildRelation[idx];
+
+			for (idx2 = 0; idx2 < slotRelation.size(); idx2++)
+			{
+				if (!slotRelation.GetRelation(idx2)->empty())
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+
+
+	void Entity::Evict()
+	{
+		unsigned int		idx, idx2;
+
+
+		assert(IsEvictable());
+
+		// The parents no longer hold all their children, so they must navigate again
+		for (idx = 0; idx < m_vectParentRelation.size(); idx++)
+		{
+			RelationSlot &				slotRelation = m_vectParentRelation[idx];
+
+			for (idx2 = 0; idx2 < slotRelation.size(); idx2++)
+				slotRelation.GetRelation(idx2)->UnMarkNavigated();
+		}
+
+		delete this;
+	}
+
+
+
 	void Entity::UnMarkDirty()
 	{
 		ColumnPtr			pCol;
@@ -4685,10 +5017,13 @@ namespace D3
 		unsigned int				idx;
 
 
-		// Initialize Column vector
+		// Initialize Column vector and the row buffer which will hold the Column objects
 		//
 		m_vectColumn.reserve(m_pMetaEntity->GetMetaColumnCount());
 
+		if (m_pMetaEntity->GetRowSize() > 0)
+			m_pRowBuffer = (char*) ObjectArena::AllocateObject(m_pDatabase->GetObjectArena(), m_pMetaEntity->GetRowSize());
+
 //		for (idx = 0; idx < m_vectColumn.size(); idx++)
 //			m_vectColumn.push_back(NULL);
 
@@ -4702,22 +5037,12 @@ namespace D3
 		// Initialize parent Relation vector
 		//
 		if (m_pMetaEntity->GetParentMetaRelationCount() > 0)
-		{
-			m_vectParentRelation.reserve(m_pMetaEntity->GetParentMetaRelationCount());
-
-			for (idx = 0; idx < m_pMetaEntity->GetParentMetaRelationCount(); idx++)
-				m_vectParentRelation.push_back(new RelationPtrMap());
-		}
+			m_vectParentRelation.resize(m_pMetaEntity->GetParentMetaRelationCount());
 
 		// Initialize child Relation vector
 		//
 		if (m_pMetaEntity->GetChildMetaRelationCount() > 0)
-		{
-			m_vectChildRelation.reserve(m_pMetaEntity->GetChildMetaRelationCount());
-
-			for (idx = 0; idx < m_pMetaEntity->GetChildMetaRelationCount(); idx++)
-				m_vectChildRelation.push_back(new RelationPtrMap());
-		}
+			m_vectChildRelation.resize(m_pMetaEntity->GetChildMetaRelationCount());
 
 		// Create Column instances
 		//
@@ -4742,6 +5067,21 @@ namespace D3
 
 
 
+	// Only hand out a slot if the layout covers pMC and the slot hasn't been used yet
+	//
+	void* Entity::GetColumnSlot(MetaColumnPtr pMC)
+	{
+		if (!m_pRowBuffer || pMC->GetMetaEntity() != m_pMetaEntity)
+			return NULL;
+
+		if (pMC->GetColumnIdx() != m_vectColumn.size() || pMC->GetColumnIdx() >= m_pMetaEntity->GetMetaColumnCount())
+			return NULL;
+
+		return m_pRowBuffer + m_pMetaEntity->GetRowOffset(pMC->GetColumnIdx());
+	}
+
+
+
 	// A column belonging to this has been constructed, add it to the vector
 	//
 	void Entity::On_ColumnCreated(ColumnPtr pColumn)
@@ -4795,8 +5135,6 @@ namespace D3
 
 	void Entity::On_ParentRelationCreated(RelationPtr pRelation)
 	{
-		RelationPtrMapPtr		pRelationMap;
-		RelationPtrMapItr		itrRelationMap;
 		std::auto_ptr<boost::recursive_mutex::scoped_lock>		lk;
 
 
@@ -4804,26 +5142,16 @@ namespace D3
 		assert(pRelation->GetParentDatabase());
 		assert(pRelation->GetMetaRelation()->GetChildIdx() < m_vectParentRelation.size());
 
-		pRelationMap = m_vectParentRelation[pRelation->GetMetaRelation()->GetChildIdx()];
-
-		assert(pRelationMap);
-
 		if (pRelation->GetParentKey()->GetEntity()->GetMetaEntity()->IsCached())
 			lk = std::auto_ptr<boost::recursive_mutex::scoped_lock>(new boost::recursive_mutex::scoped_lock(G_mtxEntity));
 
-		itrRelationMap = pRelationMap->find(pRelation->GetParentDatabase());
-
-		assert(itrRelationMap == pRelationMap->end());
-
-		pRelationMap->insert(RelationPtrMap::value_type(pRelation->GetParentDatabase(), pRelation));
+		m_vectParentRelation[pRelation->GetMetaRelation()->GetChildIdx()].Insert(pRelation->GetParentDatabase(), pRelation);
 	}
 
 
 
 	void Entity::On_ParentRelationDeleted(RelationPtr pRelation)
 	{
-		RelationPtrMapPtr		pRelationMap;
-		RelationPtrMapItr		itrRelationMap;
 		std::auto_ptr<boost::recursive_mutex::scoped_lock>		lk;
 
 
@@ -4831,26 +5159,18 @@ namespace D3
 		assert(pRelation->GetParentDatabase());
 		assert(pRelation->GetMetaRelation()->GetChildIdx() < m_vectParentRelation.size());
 
-		pRelationMap = m_vectParentRelation[pRelation->GetMetaRelation()->GetChildIdx()];
-
-		assert(pRelationMap);
-
 		if (pRelation->GetParentKey()->GetEntity()->GetMetaEntity()->IsCached())
 			lk = std::auto_ptr<boost::recursive_mutex::scoped_lock>(new boost::recursive_mutex::scoped_lock(G_mtxEntity));
 
-		itrRelationMap = pRelationMap->find(pRelation->GetParentDatabase());
+		assert(m_vectParentRelation[pRelation->GetMetaRelation()->GetChildIdx()].Find(pRelation->GetParentDatabase()) == pRelation);
 
-		assert(itrRelationMap != pRelationMap->end());
-
-		pRelationMap->erase(itrRelationMap);
+		m_vectParentRelation[pRelation->GetMetaRelation()->GetChildIdx()].Erase(pRelation->GetParentDatabase());
 	}
 
 
 
 	void Entity::On_ChildRelationCreated(RelationPtr pRelation)
 	{
-		RelationPtrMapPtr		pRelationMap;
-		RelationPtrMapItr		itrRelationMap;
 		std::auto_ptr<boost::recursive_mutex::scoped_lock>		lk;
 
 
@@ -4858,26 +5178,16 @@ namespace D3
 		assert(pRelation->GetChildDatabase());
 		assert(pRelation->GetMetaRelation()->GetParentIdx() < m_vectChildRelation.size());
 
-		pRelationMap = m_vectChildRelation[pRelation->GetMetaRelation()->GetParentIdx()];
-
-		assert(pRelationMap);
-
 		if (m_pMetaEntity->IsCached())
 			lk = std::auto_ptr<boost::recursive_mutex::scoped_lock>(new boost::recursive_mutex::scoped_lock(G_mtxEntity));
 
-		itrRelationMap = pRelationMap->find(pRelation->GetChildDatabase());
-
-		assert(itrRelationMap == pRelationMap->end());
-
-		pRelationMap->insert(RelationPtrMap::value_type(pRelation->GetChildDatabase(), pRelation));
+		m_vectChildRelation[pRelation->GetMetaRelation()->GetParentIdx()].Insert(pRelation->GetChildDatabase(), pRelation);
 	}
 
 
 
 	void Entity::On_ChildRelationDeleted(RelationPtr pRelation)
 	{
-		RelationPtrMapPtr		pRelationMap;
-		RelationPtrMapItr		itrRelationMap;
 		std::auto_ptr<boost::recursive_mutex::scoped_lock>		lk;
 
 
@@ -4885,18 +5195,12 @@ namespace D3
 		assert(pRelation->GetChildDatabase());
 		assert(pRelation->GetMetaRelation()->GetParentIdx() < m_vectChildRelation.size());
 
-		pRelationMap = m_vectChildRelation[pRelation->GetMetaRelation()->GetParentIdx()];
-
-		assert(pRelationMap);
-
 		if (m_pMetaEntity->IsCached())
 			lk = std::auto_ptr<boost::recursive_mutex::scoped_lock>(new boost::recursive_mutex::scoped_lock(G_mtxEntity));
 
-		itrRelationMap = pRelationMap->find(pRelation->GetChildDatabase());
+		assert(m_vectChildRelation[pRelation->GetMetaRelation()->GetParentIdx()].Find(pRelation->GetChildDatabase()) == pRelation);
 
-		assert(itrRelationMap != pRelationMap->end());
-
-		pRelationMap->erase(itrRelationMap);
+		m_vectChildRelation[pRelation->GetMetaRelation()->GetParentIdx()].Erase(pRelation->GetChildDatabase());
 	}
 
 
@@ -4991,8 +5295,6 @@ namespace D3
 	//
 	RelationPtr Entity::GetChildRelation(MetaRelationPtr pMetaRelation, DatabasePtr	pChildDB)
 	{
-		RelationPtrMapPtr		pRelationMap;
-		RelationPtrMapItr		itrRelation;
 		RelationPtr					pRelation = NULL;
 		DatabasePtr					pDB = pChildDB;
 
@@ -5023,25 +5325,16 @@ namespace D3
 			}
 		}
 
-		// Get the correct RelationPtrMap
-		//
-		pRelationMap = m_vectChildRelation[pMetaRelation->GetParentIdx()];
-		assert(pRelationMap);
-
-		// Find the RelationPtr
+		// Find the RelationPtr in the correct slot
 		//
-		itrRelation = pRelationMap->find(pDB);
+		pRelation = m_vectChildRelation[pMetaRelation->GetParentIdx()].Find(pDB);
 
-		if (itrRelation == pRelationMap->end())
+		if (!pRelation)
 		{
-			// Create a new Relation and add it to the map
+			// Create a new Relation (it adds itself to the slot)
 			//
 			pRelation = pMetaRelation->CreateInstance(this, pDB);
 		}
-		else
-		{
-			pRelation = itrRelation->second;
-		}
 
 		return pRelation;
 	}
@@ -5052,8 +5345,6 @@ namespace D3
 	//
 	RelationPtr Entity::GetParentRelation(MetaRelationPtr pMetaRelation, DatabasePtr pParentDB)
 	{
-		RelationPtrMapPtr		pRelationMap;
-		RelationPtrMapItr		itrRelation;
 		RelationPtr					pRelation = NULL;
 		DatabasePtr					pDB = pParentDB;
 
@@ -5085,16 +5376,11 @@ namespace D3
 
 		}
 
-		// Get the correct RelationPtrMap
-		//
-		pRelationMap = m_vectParentRelation[pMetaRelation->GetChildIdx()];
-		assert(pRelationMap);
-
-		// Find the RelationPtr
+		// Find the RelationPtr in the correct slot
 		//
-		itrRelation = pRelationMap->find(pDB);
+		pRelation = m_vectParentRelation[pMetaRelation->GetChildIdx()].Find(pDB);
 
-		if (itrRelation == pRelationMap->end())
+		if (!pRelation)
 		{
 			InstanceKeyPtr	pChildKey, pParentKey;
 
@@ -5114,17 +5400,11 @@ namespace D3
 				{
 					pRelation = pParentKey->GetEntity()->GetChildRelation(pMetaRelation, m_pDatabase);
 					pRelation->AddChild(this);
-					itrRelation = pRelationMap->find(pDB);
+					pRelation = m_vectParentRelation[pMetaRelation->GetChildIdx()].Find(pDB);
 				}
 			}
 		}
 
-		if (itrRelation == pRelationMap->end())
-			return NULL;
-
-		pRelation = itrRelation->second;
-
-
 		return pRelation;
 	}
 
@@ -188,6 +188,10 @@ namespace D3
 			short										m_sAssociative;						//!< indicator whether or not this is an associative entity. Innitially -1, but when a call to IsAssociative() is made, will be set to 0 (not associative) or 1 (associative) and future calls to IsAssociative() simply return this value.
 			std::string							m_strHSTopicsJSON;				//!< JSON string containing an array of help topics associated with this
 
+			//! Row buffer layout: m_vectRowOffset[idx] is the offset of the Column instance for GetMetaColumn(idx) within an Entity's row buffer
+			std::vector<unsigned int>	m_vectRowOffset;
+			unsigned int						m_uRowSize;								//!< Size of the row buffer each instance allocates (0 if instances allocate their columns individually)
+
 			//! ctor() used to instantiate ako MetaEntity objects via the class factory from the meta dictionary entries
 			MetaEntity();
 			//! The ctor used to initialise meta dictionary accessor MetaEntity objects
@@ -239,6 +243,8 @@ namespace D3
 			//@{
 			//! Returns the MetaColumn object which is an autonum (aka IDENTITY column) or NULL if there is none.
 			MetaColumnPtr						GetAutoNumMetaColumn();
+			//! Returns the MetaColumn object marked MetaColumn::Flags::ChangeTracking or NULL if there is none.
+			MetaColumnPtr						GetChangeTrackingMetaColumn();
 			//! Returns the MetaColumn object with the specified name.
 			MetaColumnPtr						GetMetaColumn(const std::string & strColumnName);
 			//! Returns the MetaColumn object with the specified index.
@@ -251,6 +257,10 @@ namespace D3
 			MetaColumnPtrVectPtr		GetMetaColumnsInFetchOrder()				{ return &m_vectMetaColumnFetchOrder; }
 			//! Returns the number of MetaColumn objects this has.
 			unsigned int						GetMetaColumnCount()								{ return m_vectMetaColumn.size(); }
+			//! Returns the size of the row buffer instances of this use to hold all their Column objects (0 if columns are allocated individually)
+			unsigned int						GetRowSize() const									{ return m_uRowSize; }
+			//! Returns the offset of the Column for the MetaColumn with the specified index within an instance's row buffer
+			unsigned int						GetRowOffset(ColumnIndex idx) const	{ assert(idx < m_vectRowOffset.size()); return m_vectRowOffset[idx]; }
 
 
 			//! Returns the MetaKey object with the specified name.
@@ -370,6 +380,9 @@ namespace D3
 			//* \todo This method needs to be implemented */
 			long										LoadAll(DatabasePtr pDB, bool bRefresh = false, bool bLazyFetch = true);
 
+			//! Retrieve all objects of this type and the objects related to these through strPaths (see Database::Prefetch()).
+			long										Prefetch(DatabasePtr pDB, const std::string & strPaths, bool bRefresh = false, bool bLazyFetch = true);
+
 			//! Deletes all Entity objects of this type belonging to the specified database.
 			/*! A database object should send this message to each MetaEntity
 					before it is being destroyed to ensure that all	D3 resources associated
@@ -928,6 +941,14 @@ namespace D3
 			*/
 			void										On_AfterConstructingMetaEntity();
 
+			//! Computes m_vectRowOffset and m_uRowSize from m_vectMetaColumn (invoked by On_AfterConstructingMetaEntity())
+			/*! Instances of this allocate a single row buffer large enough to hold all their Column
+					objects and construct these in place rather than allocating each on the heap. If any
+					MetaColumn uses an instance class that can't be constructed in place, m_uRowSize is
+					left at 0 and instances allocate their columns individually.
+			*/
+			void										BuildRowLayout();
+
 
 			//! An MetaColumn has been created. The MetaColumn receives its unique ID and is added to the vector of MetaColumn objects this maintains.
 			void										On_MetaColumnCreated(MetaColumnPtr pMetaColumn);
@@ -1105,6 +1126,54 @@ namespace D3
 
 
 
+	//! A RelationSlot holds the Relation objects an Entity has for one MetaRelation, one per database.
+	/*! Almost always there is exactly one database involved, so the slot holds a single
+			database/relation pair inline. Only if a second database is added (which happens
+			for relations between cached and non-cached entities) does the slot spill into a
+			RelationPtrMap, and it collapses back to the inline pair once only one relation is left.
+
+			Relations are accessed by index rather than through iterators so that callers can
+			walk the slot regardless of its representation.
+	*/
+	class D3_API RelationSlot
+	{
+		protected:
+			DatabasePtr							m_pDatabase;					//!< The database of the inline relation (NULL if empty or spilled)
+			RelationPtr							m_pRelation;					//!< The inline relation
+			RelationPtrMapPtr				m_pMapRelation;				//!< Holds all relations if this spilled (NULL otherwise)
+
+		public:
+			RelationSlot() : m_pDatabase(NULL), m_pRelation(NULL), m_pMapRelation(NULL) {}
+			RelationSlot(const RelationSlot & aSlot);
+			~RelationSlot()																				{ delete m_pMapRelation; }
+
+			RelationSlot &					operator=(const RelationSlot & aSlot);
+
+			//! Returns true if this holds no relation
+			bool										empty() const													{ return m_pMapRelation ? m_pMapRelation->empty() : m_pDatabase == NULL; }
+			//! Returns the number of relations in this
+			unsigned int						size() const													{ return m_pMapRelation ? m_pMapRelation->size() : (m_pDatabase ? 1 : 0); }
+
+			//! Returns the relation for the specified database or NULL if there is none
+			RelationPtr							Find(DatabasePtr pDatabase) const			{ if (!m_pMapRelation) return pDatabase == m_pDatabase ? m_pRelation : NULL; return FindInMap(pDatabase); }
+			//! Adds pRelation for pDatabase (there must not yet be a relation for pDatabase)
+			void										Insert(DatabasePtr pDatabase, RelationPtr pRelation);
+			//! Removes the relation for pDatabase and returns true if there was one
+			bool										Erase(DatabasePtr pDatabase);
+
+			//! Returns the database of the idx'th relation (0 <= idx < size())
+			DatabasePtr							GetDatabase(unsigned int idx) const;
+			//! Returns the idx'th relation (0 <= idx < size())
+			RelationPtr							GetRelation(unsigned int idx) const;
+
+		protected:
+			RelationPtr							FindInMap(DatabasePtr pDatabase) const;
+	};
+
+
+
+
+
 	//! The Entity class is an instance of a MetaEntity and provides the basic features required by all instances of a MetaEntity.
 	/*! You never create an instance of this nor any of its subclasses explicitly.
 			Instead, you create an Entity object through its MetaEntity object's CreateInstance()
@@ -1136,6 +1205,7 @@ namespace D3
 		friend class ColumnLong;
 		friend class ColumnFloat;
 		friend class ColumnDate;
+		friend class MetaColumn;
 		friend class InstanceKey;
 		friend class Relation;
 		friend class ResultSet;
@@ -1143,6 +1213,7 @@ namespace D3
 		// Standard D3 stuff
 		//
 		D3_CLASS_DECL(Entity);
+		D3_ARENA_OPERATORS;
 
 		// 12/03/03 - R2 - Hugp
 		public:
@@ -1168,15 +1239,22 @@ namespace D3
 			MetaEntityPtr						m_pMetaEntity;				//!< The meta entity of which this is an instance
 			DatabasePtr							m_pDatabase;					//!< This object belongs to this database
 			unsigned short					m_uFlags;							//!< Status indicator (see #defines above)
+			bool										m_bReferenced;				//!< Set when a column is accessed and cleared by Database::EnforceMemoryBudget() (kept apart from m_uFlags so that setting it never races with state changes)
 			ColumnPtrVect						m_vectColumn;					//!< A vector holding ako ColumnPtr objects
 			InstanceKeyPtrVect			m_vectInstanceKey;		//!< A vector holding ako InstanceKeyPtr objects
 			DatabaseRelationVect		m_vectParentRelation;	//!< Relations where this is the parent key (this owns the relations in this list)
 			DatabaseRelationVect		m_vectChildRelation;	//!< Relations where this is the child key (this does NOT own the relations in this list)
 			ResultSetPtrListPtr			m_pListResultSet;			//!< If this is a member of a ResultSet this list contains all the result sets
 			TemporaryKeyPtr					m_pOriginalKey;				//!< Normally NULL, but will be set to hold the original primary key if a primary key column was modified
+			char*										m_pRowBuffer;					//!< If not NULL, holds the Column objects in m_vectColumn (see MetaEntity::BuildRowLayout())
 
 			//! Invoked by MetaEntity::CreateInstance(DatabasePtr)
-			Entity ()	: m_pMetaEntity(NULL), m_pDatabase(NULL), m_uFlags(D3_ENTITY_NEW), m_pListResultSet(NULL), m_pOriginalKey(NULL) {}
+			Entity ()	: m_pMetaEntity(NULL), m_pDatabase(NULL), m_uFlags(D3_ENTITY_NEW), m_bReferenced(true), m_pListResultSet(NULL), m_pOriginalKey(NULL), m_pRowBuffer(NULL) {}
+
+			//! Returns the memory in m_pRowBuffer reserved for the instance of pMC or NULL if this has no row buffer
+			void*										GetColumnSlot(MetaColumnPtr pMC);
+			//! Returns true if pCol was constructed in m_pRowBuffer
+			bool										IsInRowBuffer(ColumnPtr pCol)		{ return m_pRowBuffer && (char*) pCol >= m_pRowBuffer && (char*) pCol < m_pRowBuffer + m_pMetaEntity->GetRowSize(); }
 
 		public:
 			//! Ensures related objects are removed from memory
@@ -1197,7 +1275,7 @@ namespace D3
 			//! Returns the Column object with the specified name.
 			ColumnPtr								GetColumn(const std::string & strColumnName);
 			//! Returns the Column object with the specified index.
-			ColumnPtr								GetColumn(unsigned int idx)			{ if (idx >= m_vectColumn.size()) return NULL; return m_vectColumn[idx]; }
+			ColumnPtr								GetColumn(unsigned int idx)			{ if (idx >= m_vectColumn.size()) return NULL; m_bReferenced = true; return m_vectColumn[idx]; }
 			//! Returns a vector of this' Column objects.
 			ColumnPtrVectPtr				GetColumns()										{ return &m_vectColumn; }
 			//! Returns the number of Column objects this has.
@@ -1314,6 +1392,12 @@ namespace D3
 			virtual bool 						Update(DatabasePtr pDB, bool bCascade = false);
 			//! Update this and if (bCascade is true also all it's children). this->m_pDatabase->HasTransaction() must be true!
 			virtual bool 						Update(bool bCascade = false)	{ return Update(m_pDatabase, bCascade); }
+			//! Update all objects in listEntity through pDB->UpdateObjects() which may send them to the database in batches. pDB->HasTransaction() must be true!
+			/*! Unlike Update(), this neither updates dirty parents nor children, so listEntity must
+					hold the objects in dependency order. Each object receives the same notifications
+					it receives when updated through Update().
+			*/
+			static bool							UpdateBatch(DatabasePtr pDB, EntityPtrList & listEntity);
 			//! Delete this from the database and from memory. pDB->HasTransaction() must be true!
 			virtual bool 						Delete(DatabasePtr pDB);
 			//! Delete this from the database and from memory. this->m_pDatabase->HasTransaction() must be true!
@@ -1481,6 +1565,14 @@ namespace D3
 			void										UnMarkDestroying()			{ m_uFlags &= ~D3_ENTITY_DESTROYING; }	//!< Clear destroying flag
 			void										UnMarkConstructing()		{ m_uFlags &= ~D3_ENTITY_CONSTRUCTING; }//!< Clear constructing flag
 
+			//! Returns true if Evict() may remove this from memory
+			/*! This must be clean, not new, not marked, must not be a member of a ResultSet and must
+					not have children in memory (deleting this would delete them too).
+			*/
+			bool										IsEvictable();
+			//! Marks the relations this is a child of as not navigated and deletes this (see Database::EnforceMemoryBudget())
+			void										Evict();
+
 			/** @name Notifications
 			*/
 			//@{
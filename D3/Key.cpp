@@ -48,6 +48,8 @@
 
 #include <Codec.h>
 
+#include <boost/functional/hash.hpp>
+
 namespace D3
 {
 
@@ -272,7 +274,7 @@ namespace D3
 		if (!m_pInstanceClass)
 			throw Exception(__FILE__, __LINE__, Exception_error, "MetaKey::CreateInstance(): Can't create instance of key %s because class factory is missing!", GetFullName().c_str());
 
-		pKey = (InstanceKeyPtr) m_pInstanceClass->CreateInstance();
+		pKey = (InstanceKeyPtr) ObjectArena::CreateInstance(pEntity ? pEntity->GetDatabase()->GetObjectArena() : NULL, *m_pInstanceClass);
 
 		if (!pKey)
 			throw Exception(__FILE__, __LINE__, Exception_error, "MetaKey::CreateInstance(): Class factory %s failed to create instance of key %s!", m_pInstanceClass->Name().c_str(), GetFullName().c_str());
@@ -308,6 +310,7 @@ namespace D3
 		InstanceKeyPtrSetPtr				pKeySet;
 		InstanceKeyPtrSetItr				itrKeySet;
 		DatabasePtr									pDB = pDatabase;;
+		InstanceKeyPtr							pIK;
 
 
 		// Sanity checks
@@ -322,6 +325,11 @@ namespace D3
 
 		assert(pDB);
 
+		// Unique keys maintain a hash index which is much cheaper to probe than the multiset
+		//
+		if (FindInstanceKeyInIndex(pKey, pDB, pIK))
+			return pIK;
+
 		// Locate the correct recordset
 		//
 		pKeySet = GetInstanceKeySet(pDB);
@@ -345,6 +353,62 @@ namespace D3
 
 
 
+	// Return the Entity who's key matches the values in the probe passed in
+	//
+	InstanceKeyPtr MetaKey::FindInstanceKey(const KeyProbe & keyProbe, DatabasePtr pDatabase)
+	{
+		InstanceKeyHashIndexPtr														pIndex;
+		std::pair<InstanceKeyHashIndexItr, InstanceKeyHashIndexItr>	range;
+		InstanceKeyHashIndexItr														itrIndex;
+
+
+		// Sanity checks
+		//
+		assert(pDatabase);
+		assert(keyProbe.GetMetaKey() == this);
+
+		if (!keyProbe.IsComplete())
+		{
+			ReportError("MetaKey::FindInstanceKey(): Incomplete key probe passed for key %s.", GetFullName().c_str());
+			return NULL;
+		}
+
+		// The hash index holds no NULL keys
+		//
+		if (HasHashIndex() && !keyProbe.IsNull())
+		{
+			boost::recursive_mutex::scoped_lock		lk(m_mtxExclusive);
+
+			pIndex = GetInstanceKeyIndex(pDatabase);
+
+			if (pIndex)
+			{
+				range = pIndex->equal_range(keyProbe.GetHashValue());
+
+				for ( itrIndex =  range.first;
+							itrIndex != range.second;
+							itrIndex++)
+				{
+					if (itrIndex->second->Matches(keyProbe))
+						return itrIndex->second;
+				}
+
+				return NULL;
+			}
+		}
+
+		// No index to probe, search the multiset using a temporary key
+		//
+		TemporaryKey		tmpKey(*this);
+
+		keyProbe.AssignTo(tmpKey);
+
+		return FindInstanceKey(&tmpKey, pDatabase);
+	}
+
+
+
+
 	// FindObject calls FindInstanceKey but instead of returning the key it returns the object that onws the key (method may return NULL)
 	EntityPtr MetaKey::FindObject(KeyPtr pKey, DatabasePtr pDatabase)
 	{
@@ -526,6 +590,158 @@ namespace D3
 
 
 
+	// Return the hash index for the database object passed in
+	//
+	InstanceKeyHashIndexPtr MetaKey::GetInstanceKeyIndex(DatabasePtr pDatabase)
+	{
+		boost::recursive_mutex::scoped_lock		lk(m_mtxExclusive);
+
+		InstanceKeyHashIndexPtrMapItr	itrIndexMap;
+		DatabasePtr										pDB = pDatabase;
+
+
+		// Sanity checks
+		//
+		assert(pDatabase);
+
+		if (!HasHashIndex())
+			return NULL;
+
+		// The meta database passed in can be different if this request originates
+		// from a relation accross databases
+		//
+		if (pDatabase->GetMetaDatabase() != GetMetaEntity()->GetMetaDatabase())
+		{
+			pDB = pDatabase->GetDatabaseWorkspace()->GetDatabase(GetMetaEntity()->GetMetaDatabase());
+			assert(pDB);
+		}
+
+		// Key's from cached entities only maintain one index for the global database
+		//
+		if (m_pMetaEntity->IsCached())
+			pDB = m_pMetaEntity->GetMetaDatabase()->GetGlobalDatabase();
+
+		itrIndexMap = m_mapInstanceKeyIndex.find(pDB);
+
+		if (itrIndexMap == m_mapInstanceKeyIndex.end())
+			return NULL;
+
+		return itrIndexMap->second;
+	}
+
+
+
+	// Probe the hash index. The method returns false if the index can't answer the
+	// question in which case the caller must search the multiset instead.
+	//
+	bool MetaKey::FindInstanceKeyInIndex(KeyPtr pKey, DatabasePtr pDatabase, InstanceKeyPtr & pIK)
+	{
+		boost::recursive_mutex::scoped_lock		lk(m_mtxExclusive);
+
+		InstanceKeyHashIndexPtr														pIndex;
+		std::pair<InstanceKeyHashIndexItr, InstanceKeyHashIndexItr>	range;
+		InstanceKeyHashIndexItr														itrIndex;
+
+
+		pIK = NULL;
+
+		// The index holds no NULL keys and can't match partially defined keys
+		//
+		if (!HasHashIndex() || !pKey->IsHashCompatible(this) || pKey->IsNull())
+			return false;
+
+		pIndex = GetInstanceKeyIndex(pDatabase);
+
+		if (!pIndex)
+			return false;
+
+		// Different values may share a hash so verify each candidate
+		//
+		range = pIndex->equal_range(pKey->GetHashValue());
+
+		for ( itrIndex =  range.first;
+					itrIndex != range.second;
+					itrIndex++)
+		{
+			if (itrIndex->second->Compare(pKey) == 0)
+			{
+				pIK = itrIndex->second;
+				break;
+			}
+		}
+
+		return true;
+	}
+
+
+
+	void MetaKey::AddToIndex(InstanceKeyPtr pKey)
+	{
+		boost::recursive_mutex::scoped_lock		lk(m_mtxExclusive);
+
+		InstanceKeyHashIndexPtr		pIndex;
+
+
+		if (!HasHashIndex())
+			return;
+
+		assert(pKey);
+		assert(pKey->GetEntity());
+
+		// The key may still be indexed under a previous value
+		//
+		RemoveFromIndex(pKey);
+
+		if (pKey->IsNull())
+			return;
+
+		pIndex = GetInstanceKeyIndex(pKey->GetEntity()->GetDatabase());
+		assert(pIndex);
+
+		pKey->m_uIndexHash = pKey->GetHashValue();
+		pIndex->insert(InstanceKeyHashIndex::value_type(pKey->m_uIndexHash, pKey));
+		pKey->m_bIndexed = true;
+	}
+
+
+
+	void MetaKey::RemoveFromIndex(InstanceKeyPtr pKey)
+	{
+		boost::recursive_mutex::scoped_lock		lk(m_mtxExclusive);
+
+		InstanceKeyHashIndexPtr														pIndex;
+		std::pair<InstanceKeyHashIndexItr, InstanceKeyHashIndexItr>	range;
+		InstanceKeyHashIndexItr														itrIndex;
+
+
+		if (!HasHashIndex() || !pKey->m_bIndexed)
+			return;
+
+		assert(pKey->GetEntity());
+
+		pIndex = GetInstanceKeyIndex(pKey->GetEntity()->GetDatabase());
+		assert(pIndex);
+
+		// We use the hash the key was stored under since its values may have changed since
+		//
+		range = pIndex->equal_range(pKey->m_uIndexHash);
+
+		for ( itrIndex =  range.first;
+					itrIndex != range.second;
+					itrIndex++)
+		{
+			if (itrIndex->second == pKey)
+			{
+				pIndex->erase(itrIndex);
+				break;
+			}
+		}
+
+		pKey->m_bIndexed = false;
+	}
+
+
+
 	void MetaKey::CollectAllInstances(DatabasePtr pDatabase, EntityPtrList& el)
 	{
 		boost::recursive_mutex::scoped_lock		lk(m_mtxExclusive);
@@ -941,6 +1157,8 @@ namespace D3
 		assert(pMC);
 
 		m_listColumn.push_back(pMC);
+		m_vectColumnType.push_back((unsigned char) pMC->GetType());
+		m_vectColumnMaxLength.push_back(pMC->GetMaxLength());
 		pMC->On_AddedToMetaKey(this);
 	}
 
@@ -974,6 +1192,8 @@ namespace D3
 		pKeySet = GetInstanceKeySet(pDB);
 		assert(pKeySet);
 		pKeySet->insert(pKey);
+
+		AddToIndex(pKey);
 	}
 
 
@@ -999,6 +1219,13 @@ namespace D3
 		pDB = pKey->GetEntity()->GetDatabase();
 		assert(pDB);
 
+		// The collections were emptied by On_BeforeDeleteAllObjects()
+		//
+		if (!IsPrimary() && pDB->IsBulkDeleting())
+			return;
+
+		RemoveFromIndex(pKey);
+
 		// Find the key in our multiset
 		//
 		pKeySet = GetInstanceKeySet(pDB);
@@ -1085,6 +1312,10 @@ namespace D3
 		if (m_pMetaEntity->IsCached())
 			pDB = m_pMetaEntity->GetMetaDatabase()->GetGlobalDatabase();
 
+		// The hash index tracks the hash the key was stored under so this is always safe
+		//
+		RemoveFromIndex(pKey);
+
 		// Locate the correct recordset
 		//
 		pKeySet = GetInstanceKeySet(pDB);
@@ -1150,6 +1381,8 @@ namespace D3
 	{
 		InstanceKeyPtrSetPtr				pKeySet;
 		DatabasePtr									pDB;
+		InstanceKeyPtr							pExistingKey;
+		bool												bDuplicate;
 
 
 		// Some sanity checks
@@ -1178,9 +1411,17 @@ namespace D3
 
 		if (IsUnique() && !pKey->IsNull())
 		{
-			// Let's see if we already have a key with the new value
+			// Let's see if we already have a key with the new value (if this missed
+			// On_BeforeUpdateInstance() it may still be indexed under its old value)
 			//
-			if (pKeySet->find(pKey) != pKeySet->end())
+			RemoveFromIndex(pKey);
+
+			if (FindInstanceKeyInIndex(pKey, pDB, pExistingKey))
+				bDuplicate = pExistingKey != NULL;
+			else
+				bDuplicate = pKeySet->find(pKey) != pKeySet->end();
+
+			if (bDuplicate)
 			{
 				// A key with the same value already exists so throw an error
 				//
@@ -1189,6 +1430,8 @@ namespace D3
 		}
 
 		pKeySet->insert(pKey);
+
+		AddToIndex(pKey);
 	}
 
 
@@ -1329,6 +1572,11 @@ namespace D3
 			pKeySet = new InstanceKeyPtrSet();
 			m_mapInstanceKeySet.insert(InstanceKeyPtrSetPtrMap::value_type(pDB, pKeySet));
 		}
+
+		// Unique keys also get a hash index
+		//
+		if (HasHashIndex() && m_mapInstanceKeyIndex.find(pDB) == m_mapInstanceKeyIndex.end())
+			m_mapInstanceKeyIndex.insert(InstanceKeyHashIndexPtrMap::value_type(pDB, new InstanceKeyHashIndex()));
 	}
 
 
@@ -1339,6 +1587,7 @@ namespace D3
 
 		InstanceKeyPtrSetPtrMapItr						itrKeySetMap;
 		InstanceKeyPtrSetPtr									pKeySet;
+		InstanceKeyHashIndexPtrMapItr					itrIndexMap;
 
 
 		// Some sanity checks
@@ -1362,6 +1611,45 @@ namespace D3
 			delete pKeySet;
 			m_mapInstanceKeySet.erase(itrKeySetMap);
 		}
+
+		// Delete the hash index we maintained for the dying database
+		//
+		itrIndexMap = m_mapInstanceKeyIndex.find(pDatabase);
+
+		if (itrIndexMap != m_mapInstanceKeyIndex.end())
+		{
+			assert(itrIndexMap->second->empty());
+			delete itrIndexMap->second;
+			m_mapInstanceKeyIndex.erase(itrIndexMap);
+		}
+	}
+
+
+
+	void MetaKey::On_BeforeDeleteAllObjects(DatabasePtr pDatabase)
+	{
+		boost::recursive_mutex::scoped_lock		lk(m_mtxExclusive);
+
+		InstanceKeyPtrSetPtrMapItr						itrKeySetMap;
+		InstanceKeyHashIndexPtrMapItr					itrIndexMap;
+
+
+		assert(pDatabase);
+
+		// The primary key drives MetaKey::DeleteAllObjects() so it must be maintained
+		//
+		if (!IsSearchable() || IsPrimary())
+			return;
+
+		itrKeySetMap = m_mapInstanceKeySet.find(pDatabase);
+
+		if (itrKeySetMap != m_mapInstanceKeySet.end() && itrKeySetMap->second)
+			itrKeySetMap->second->clear();
+
+		itrIndexMap = m_mapInstanceKeyIndex.find(pDatabase);
+
+		if (itrIndexMap != m_mapInstanceKeyIndex.end() && itrIndexMap->second)
+			itrIndexMap->second->clear();
 	}
 
 
@@ -1527,110 +1815,368 @@ namespace D3
 	D3_CLASS_IMPL_PV(Key, Object);
 
 
-	int Key::Compare(ObjectPtr pObj)
+	// Three-way compare of two values of the same type
+	//
+	template<class T>
+	static inline int CompareValues(const T & a, const T & b)
 	{
-		ColumnPtrListItr	itrSrceColumn;
-		ColumnPtrListItr	itrTrgtColumn;
-		ColumnPtr					pSrce;
-		ColumnPtr					pTrgt;
-		KeyPtr						pKey = (KeyPtr) pObj;
+		if (a < b)
+			return -1;
 
+		if (b < a)
+			return 1;
 
-		assert(pObj);
-		assert(pObj->IsKindOf(Key::ClassObject()));
+		return 0;
+	}
 
-		for ( itrSrceColumn =  m_listColumn.begin(),    itrTrgtColumn =  pKey->m_listColumn.begin();
-					itrSrceColumn != m_listColumn.end()    && itrTrgtColumn != pKey->m_listColumn.end();
-					itrSrceColumn++, itrTrgtColumn++)
+
+
+	// Compares the values of two none NULL columns which the comparator plan says are both
+	// of type uType. Types without a direct comparison go through Column::Compare().
+	//
+	/* static */
+	int Key::CompareColumnValues(unsigned char uType, ColumnPtr pSrce, ColumnPtr pTrgt)
+	{
+		switch (uType)
 		{
-			pSrce = *itrSrceColumn;
-			pTrgt = *itrTrgtColumn;
+			case MetaColumn::dbfString:
+			{
+				int iResult = ((ColumnStringPtr) pSrce)->m_strValue.compare(((ColumnStringPtr) pTrgt)->m_strValue);
+				return iResult < 0 ? -1 : (iResult > 0 ? 1 : 0);
+			}
 
-			if (pSrce->IsUndefined() || pTrgt->IsUndefined())
-				break;
+			case MetaColumn::dbfChar:
+				return CompareValues(((ColumnCharPtr) pSrce)->m_cValue, ((ColumnCharPtr) pTrgt)->m_cValue);
 
-			if (pSrce->IsNull() && pTrgt->IsNull())
-				continue;
+			case MetaColumn::dbfShort:
+				return CompareValues(((ColumnShortPtr) pSrce)->m_sValue, ((ColumnShortPtr) pTrgt)->m_sValue);
 
-			if (!pSrce->IsNull() && pTrgt->IsNull())
-				return 1;
+			case MetaColumn::dbfBool:
+				return CompareValues(((ColumnBoolPtr) pSrce)->m_bValue, ((ColumnBoolPtr) pTrgt)->m_bValue);
 
-			if (pSrce->IsNull() && !pTrgt->IsNull())
-				return -1;
+			case MetaColumn::dbfInt:
+				return CompareValues(((ColumnIntPtr) pSrce)->m_iValue, ((ColumnIntPtr) pTrgt)->m_iValue);
 
-			if (*pSrce > *pTrgt)
-				return 1;
+			case MetaColumn::dbfLong:
+				return CompareValues(((ColumnLongPtr) pSrce)->m_lValue, ((ColumnLongPtr) pTrgt)->m_lValue);
 
-			if (*pSrce < *pTrgt)
-				return -1;
+			case MetaColumn::dbfFloat:
+				return CompareValues(((ColumnFloatPtr) pSrce)->m_fValue, ((ColumnFloatPtr) pTrgt)->m_fValue);
 
-			// So far equal, continue
+			case MetaColumn::dbfDate:
+				return CompareValues(((ColumnDatePtr) pSrce)->m_dtValue, ((ColumnDatePtr) pTrgt)->m_dtValue);
 		}
 
-		return 0;
+		return pSrce->Compare(pTrgt);
 	}
 
 
 
-	bool Key::IsNull()
+	int Key::Compare(ObjectPtr pObj)
 	{
-		ColumnPtrListItr	itrSrceColumn;
+		KeyColumnArrayItr	itrSrceColumn;
+		KeyColumnArrayItr	itrTrgtColumn;
 		ColumnPtr					pSrce;
-		bool							bAllNull = true;
+		ColumnPtr					pTrgt;
+		KeyPtr						pKey = (KeyPtr) pObj;
+		unsigned int			idx;
+		int								iResult;
 
 
-		// A key is NULL if it has no columns
+		assert(pObj);
+		assert(pObj->IsKindOf(Key::ClassObject()));
+
+		// Both keys' comparator plans tell us the column types without asking the columns
 		//
-		if (m_listColumn.empty())
-			return true;
+		const std::vector<unsigned char> &	vectSrceType = m_pMetaKey->GetColumnTypes();
+		const std::vector<unsigned char> &	vectTrgtType = pKey->m_pMetaKey->GetColumnTypes();
 
-		for ( itrSrceColumn =  m_listColumn.begin();
-					itrSrceColumn != m_listColumn.end();
-					itrSrceColumn++)
+		for ( itrSrceColumn =  m_listColumn.begin(),    itrTrgtColumn =  pKey->m_listColumn.begin(),		idx = 0;
+					itrSrceColumn != m_listColumn.end()    && itrTrgtColumn != pKey->m_listColumn.end();
+					itrSrceColumn++, itrTrgtColumn++, idx++)
 		{
 			pSrce = *itrSrceColumn;
+			pTrgt = *itrTrgtColumn;
 
+			if (pSrce->IsUndefined() || pTrgt->IsUndefined())
+				break;
 
-			// A key is NULL if a mandatory column is NULL
-			//
-			if (pSrce->IsNull())
+			if (pSrce->IsNull() || pTrgt->IsNull())
 			{
-				if (pSrce->GetMetaColumn()->IsMandatory())
-					return true;
+				if (pSrce->IsNull() && pTrgt->IsNull())
+					continue;
+
+				return pSrce->IsNull() ? -1 : 1;
+			}
+
+			if (idx < vectSrceType.size() && idx < vectTrgtType.size() && vectSrceType[idx] == vectTrgtType[idx])
+			{
+				iResult = CompareColumnValues(vectSrceType[idx], pSrce, pTrgt);
 			}
 			else
 			{
-				// Remember that we have a column that is NOT null
+				// Columns of different types need conversion
 				//
-				bAllNull = false;
+				if (*pSrce > *pTrgt)
+					iResult = 1;
+				else if (*pSrce < *pTrgt)
+					iResult = -1;
+				else
+					iResult = 0;
 			}
-		}
 
+			if (iResult)
+				return iResult;
 
-		return bAllNull;
+			// So far equal, continue
+		}
+
+		return 0;
 	}
 
 
 
-	bool Key::SetNull()
+	std::size_t Key::GetHashValue()
 	{
-		ColumnPtrListItr	itrSrceColumn;
-		ColumnPtr					pSrce;
+		KeyColumnArrayItr	itrColumn;
+		ColumnPtr					pCol;
+		std::size_t				uHash = 0;
 
 
-		for ( itrSrceColumn =  m_listColumn.begin();
-					itrSrceColumn != m_listColumn.end();
-					itrSrceColumn++)
+		for ( itrColumn =  m_listColumn.begin();
+					itrColumn != m_listColumn.end();
+					itrColumn++)
 		{
-			pSrce = *itrSrceColumn;
+			pCol = *itrColumn;
 
-			if (!pSrce->SetNull())
-				return false;
-		}
+			if (pCol->IsNull())
+			{
+				boost::hash_combine(uHash, 0);
+				continue;
+			}
 
+			switch (pCol->GetMetaColumn()->GetType())
+			{
+				case MetaColumn::dbfString:
+				{
+					// Hash the characters so that KeyProbe::GetHashValue() can do the same without a std::string
+					const std::string &	strVal = pCol->GetString();
+					boost::hash_combine(uHash, boost::hash_range(strVal.begin(), strVal.end()));
+					break;
+				}
 
-		return true;
-	}
+				case MetaColumn::dbfChar:
+					boost::hash_combine(uHash, pCol->GetChar());
+					break;
+
+				case MetaColumn::dbfShort:
+					boost::hash_combine(uHash, pCol->GetShort());
+					break;
+
+				case MetaColumn::dbfBool:
+					boost::hash_combine(uHash, pCol->GetBool());
+					break;
+
+				case MetaColumn::dbfInt:
+					boost::hash_combine(uHash, pCol->GetInt());
+					break;
+
+				case MetaColumn::dbfLong:
+					boost::hash_combine(uHash, pCol->GetLong());
+					break;
+
+				case MetaColumn::dbfFloat:
+					boost::hash_combine(uHash, pCol->GetFloat());
+					break;
+
+				case MetaColumn::dbfDate:
+				{
+					// Dates compare by UTC so hash the UTC value
+					boost::posix_time::ptime	tmUTC = pCol->GetDate().utc_time();
+					boost::hash_combine(uHash, tmUTC.date().day_number());
+					boost::hash_combine(uHash, tmUTC.time_of_day().ticks());
+					break;
+				}
+
+				default:
+					boost::hash_combine(uHash, pCol->AsString(false));
+			}
+		}
+
+		return uHash;
+	}
+
+
+
+	bool Key::Matches(const KeyProbe & keyProbe)
+	{
+		KeyColumnArrayItr						itrColumn;
+		ColumnPtr										pCol;
+		const KeyProbe::Value*			pVal;
+		unsigned int								idx;
+
+
+		assert(keyProbe.IsComplete());
+
+		if (m_listColumn.size() != keyProbe.m_uSize)
+			return false;
+
+		for ( itrColumn =  m_listColumn.begin(),	idx = 0;
+					itrColumn != m_listColumn.end();
+					itrColumn++,											idx++)
+		{
+			pCol = *itrColumn;
+			pVal = &(keyProbe.m_arrValue[idx]);
+
+			if (pCol->IsNull() || pVal->bNull)
+			{
+				if (pCol->IsNull() && pVal->bNull)
+					continue;
+
+				return false;
+			}
+
+			switch (pVal->uType)
+			{
+				case MetaColumn::dbfString:
+				{
+					const std::string &	strVal = ((ColumnStringPtr) pCol)->m_strValue;
+
+					if (strVal.size() != pVal->uLen || strVal.compare(0, strVal.size(), pVal->pszVal, pVal->uLen) != 0)
+						return false;
+
+					break;
+				}
+
+				case MetaColumn::dbfChar:
+					if (((ColumnCharPtr) pCol)->m_cValue != pVal->cVal)
+						return false;
+					break;
+
+				case MetaColumn::dbfShort:
+					if (((ColumnShortPtr) pCol)->m_sValue != pVal->sVal)
+						return false;
+					break;
+
+				case MetaColumn::dbfBool:
+					if (((ColumnBoolPtr) pCol)->m_bValue != pVal->bVal)
+						return false;
+					break;
+
+				case MetaColumn::dbfInt:
+					if (((ColumnIntPtr) pCol)->m_iValue != pVal->iVal)
+						return false;
+					break;
+
+				case MetaColumn::dbfLong:
+					if (((ColumnLongPtr) pCol)->m_lValue != pVal->lVal)
+						return false;
+					break;
+
+				case MetaColumn::dbfFloat:
+					if (((ColumnFloatPtr) pCol)->m_fValue != pVal->fVal)
+						return false;
+					break;
+
+				case MetaColumn::dbfDate:
+					if (((ColumnDatePtr) pCol)->m_dtValue.utc_time() != pVal->tmUTC)
+						return false;
+					break;
+
+				default:
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+
+
+	bool Key::IsHashCompatible(MetaKeyPtr pMK)
+	{
+		KeyColumnArrayItr			itrColumn;
+		MetaColumnPtrListItr	itrMC;
+		ColumnPtr							pCol;
+
+
+		if (!pMK || m_listColumn.size() != pMK->GetColumnCount())
+			return false;
+
+		for ( itrColumn =  m_listColumn.begin(),    itrMC =  pMK->GetMetaColumns()->begin();
+					itrColumn != m_listColumn.end()    && itrMC != pMK->GetMetaColumns()->end();
+					itrColumn++,                           itrMC++)
+		{
+			pCol = *itrColumn;
+
+			if (pCol->IsUndefined() || pCol->GetMetaColumn()->GetType() != (*itrMC)->GetType())
+				return false;
+		}
+
+		return true;
+	}
+
+
+
+	bool Key::IsNull()
+	{
+		KeyColumnArrayItr	itrSrceColumn;
+		ColumnPtr					pSrce;
+		bool							bAllNull = true;
+
+
+		// A key is NULL if it has no columns
+		//
+		if (m_listColumn.empty())
+			return true;
+
+		for ( itrSrceColumn =  m_listColumn.begin();
+					itrSrceColumn != m_listColumn.end();
+					itrSrceColumn++)
+		{
+			pSrce = *itrSrceColumn;
+
+
+			// A key is NULL if a mandatory column is NULL
+			//
+			if (pSrce->IsNull())
+			{
+				if (pSrce->GetMetaColumn()->IsMandatory())
+					return true;
+			}
+			else
+			{
+				// Remember that we have a column that is NOT null
+				//
+				bAllNull = false;
+			}
+		}
+
+
+		return bAllNull;
+	}
+
+
+
+	bool Key::SetNull()
+	{
+		KeyColumnArrayItr	itrSrceColumn;
+		ColumnPtr					pSrce;
+
+
+		for ( itrSrceColumn =  m_listColumn.begin();
+					itrSrceColumn != m_listColumn.end();
+					itrSrceColumn++)
+		{
+			pSrce = *itrSrceColumn;
+
+			if (!pSrce->SetNull())
+				return false;
+		}
+
+
+		return true;
+	}
 
 
 
@@ -1646,7 +2192,7 @@ namespace D3
 	bool Key::IsKeyPartNull(MetaKeyPtr pMK)
 	{
 		unsigned int					idx;
-		ColumnPtrListItr			itrSrceColumn;
+		KeyColumnArrayItr			itrSrceColumn;
 		ColumnPtr							pSrce;
 
 
@@ -1667,8 +2213,8 @@ namespace D3
 
 	Key & Key::Assign(Key & aKey)
 	{
-		ColumnPtrListItr	itrTrgtColumn;
-		ColumnPtrListItr	itrSrceColumn;
+		KeyColumnArrayItr	itrTrgtColumn;
+		KeyColumnArrayItr	itrSrceColumn;
 		ColumnPtr					pTrgt;
 		ColumnPtr					pSrce;
 
@@ -1692,7 +2238,7 @@ namespace D3
 
 	ColumnPtr Key::GetColumn(MetaColumnPtr pMC)
 	{
-		ColumnPtrListItr	itrColumn;
+		KeyColumnArrayItr	itrColumn;
 		ColumnPtr					pColumn;
 
 
@@ -1728,7 +2274,7 @@ namespace D3
 
 	void Key::Dump(int nIndentSize)
 	{
-		ColumnPtrListItr	itrCol;
+		KeyColumnArrayItr	itrCol;
 		ColumnPtr					pCol;
 		unsigned int			iLabelWidth = 0;
 
@@ -1779,7 +2325,7 @@ namespace D3
 	std::string Key::AsString()
 	{
 		std::string				strValue;
-		ColumnPtrListItr	itrCol;
+		KeyColumnArrayItr	itrCol;
 		ColumnPtr					pCol;
 
 
@@ -1806,7 +2352,7 @@ namespace D3
 
 		if (!pRole || pRole->CanRead(m_pMetaKey))
 		{
-			ColumnPtrListItr	itr;
+			KeyColumnArrayItr	itr;
 			ColumnPtr					pCol;
 			bool							bFirst = true;
 
@@ -1876,6 +2422,359 @@ namespace D3
 
 
 
+	// ===========================================================
+	// KeyProbe class: Holds the values of a key without creating Column objects
+	//
+
+	/* static */
+	bool KeyProbe::IsSupported(MetaKeyPtr pMetaKey)
+	{
+		unsigned int	idx;
+
+
+		if (!pMetaKey || pMetaKey->GetColumnCount() > D3_KEY_PROBE_MAX_COLUMNS)
+			return false;
+
+		for (idx = 0; idx < pMetaKey->GetColumnTypes().size(); idx++)
+		{
+			switch (pMetaKey->GetColumnTypes()[idx])
+			{
+				case MetaColumn::dbfBlob:
+				case MetaColumn::dbfBinary:
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+
+
+	KeyProbe::Value* KeyProbe::Next(unsigned char uType)
+	{
+		Value*		pVal;
+
+
+		if (m_uSize >= D3_KEY_PROBE_MAX_COLUMNS)
+		{
+			m_bOverflow = true;
+			return NULL;
+		}
+
+		pVal = &(m_arrValue[m_uSize++]);
+		pVal->uType = uType;
+		pVal->bNull = false;
+		pVal->uLen = 0;
+
+		return pVal;
+	}
+
+
+
+	void KeyProbe::AddNull()
+	{
+		const std::vector<unsigned char> &	vectType = m_pMetaKey->GetColumnTypes();
+		Value*															pVal;
+
+
+		// A NULL value matches NULL columns of any type so simply assume the expected type
+		//
+		pVal = Next(m_uSize < vectType.size() ? vectType[m_uSize] : 0);
+
+		if (pVal)
+			pVal->bNull = true;
+	}
+
+
+
+	void KeyProbe::Add(const char* pszVal, unsigned int uLen)
+	{
+		const std::vector<unsigned int> &		vectMaxLen = m_pMetaKey->GetColumnMaxLengths();
+		unsigned int												uTrimmed = uLen;
+		Value*															pVal;
+
+
+		// Normalise like ColumnString::SetValue() so that we find keys stored through it:
+		// trailing blanks go (unless the value is all blanks), empty is NULL, long values are truncated
+		while (uTrimmed > 0 && pszVal[uTrimmed - 1] == ' ')
+			uTrimmed--;
+
+		if (uTrimmed > 0)
+			uLen = uTrimmed;
+
+		if (uLen == 0)
+		{
+			AddNull();
+			return;
+		}
+
+		if (m_uSize < vectMaxLen.size() && uLen > vectMaxLen[m_uSize])
+			uLen = vectMaxLen[m_uSize];
+
+		pVal = Next(MetaColumn::dbfString);
+
+		if (pVal)
+		{
+			pVal->pszVal = pszVal;
+			pVal->uLen = uLen;
+		}
+	}
+
+
+
+	void KeyProbe::Add(char cVal)
+	{
+		Value*	pVal = Next(MetaColumn::dbfChar);
+
+		if (pVal)
+			pVal->cVal = cVal;
+	}
+
+
+
+	void KeyProbe::Add(short sVal)
+	{
+		Value*	pVal = Next(MetaColumn::dbfShort);
+
+		if (pVal)
+			pVal->sVal = sVal;
+	}
+
+
+
+	void KeyProbe::Add(bool bVal)
+	{
+		Value*	pVal = Next(MetaColumn::dbfBool);
+
+		if (pVal)
+			pVal->bVal = bVal;
+	}
+
+
+
+	void KeyProbe::Add(int iVal)
+	{
+		Value*	pVal = Next(MetaColumn::dbfInt);
+
+		if (pVal)
+			pVal->iVal = iVal;
+	}
+
+
+
+	void KeyProbe::Add(long lVal)
+	{
+		Value*	pVal = Next(MetaColumn::dbfLong);
+
+		if (pVal)
+			pVal->lVal = lVal;
+	}
+
+
+
+	void KeyProbe::Add(float fVal)
+	{
+		Value*	pVal = Next(MetaColumn::dbfFloat);
+
+		if (pVal)
+			pVal->fVal = fVal;
+	}
+
+
+
+	void KeyProbe::Add(const D3Date & dtVal)
+	{
+		Value*	pVal = Next(MetaColumn::dbfDate);
+
+		// Dates compare by UTC so that's all we need to keep
+		//
+		if (pVal)
+			pVal->tmUTC = dtVal.utc_time();
+	}
+
+
+
+	bool KeyProbe::IsComplete() const
+	{
+		const std::vector<unsigned char> &	vectType = m_pMetaKey->GetColumnTypes();
+		unsigned int												idx;
+
+
+		if (m_bOverflow || m_uSize != vectType.size())
+			return false;
+
+		for (idx = 0; idx < m_uSize; idx++)
+		{
+			if (m_arrValue[idx].uType != vectType[idx])
+				return false;
+		}
+
+		return true;
+	}
+
+
+
+	bool KeyProbe::IsNull() const
+	{
+		MetaColumnPtrListItr	itrMC;
+		unsigned int					idx;
+		bool									bAllNull = true;
+
+
+		// A probe is NULL for the same reasons a key is NULL (see Key::IsNull())
+		//
+		if (m_uSize == 0)
+			return true;
+
+		for ( itrMC =  m_pMetaKey->GetMetaColumns()->begin(),	idx = 0;
+					itrMC != m_pMetaKey->GetMetaColumns()->end()		&& idx < m_uSize;
+					itrMC++,																				idx++)
+		{
+			if (m_arrValue[idx].bNull)
+			{
+				if ((*itrMC)->IsMandatory())
+					return true;
+			}
+			else
+			{
+				bAllNull = false;
+			}
+		}
+
+		return bAllNull;
+	}
+
+
+
+	std::size_t KeyProbe::GetHashValue() const
+	{
+		const Value*		pVal;
+		unsigned int		idx;
+		std::size_t			uHash = 0;
+
+
+		// This must produce the same hash as Key::GetHashValue() for the same values
+		//
+		for (idx = 0; idx < m_uSize; idx++)
+		{
+			pVal = &(m_arrValue[idx]);
+
+			if (pVal->bNull)
+			{
+				boost::hash_combine(uHash, 0);
+				continue;
+			}
+
+			switch (pVal->uType)
+			{
+				case MetaColumn::dbfString:
+					boost::hash_combine(uHash, boost::hash_range(pVal->pszVal, pVal->pszVal + pVal->uLen));
+					break;
+
+				case MetaColumn::dbfChar:
+					boost::hash_combine(uHash, pVal->cVal);
+					break;
+
+				case MetaColumn::dbfShort:
+					boost::hash_combine(uHash, pVal->sVal);
+					break;
+
+				case MetaColumn::dbfBool:
+					boost::hash_combine(uHash, pVal->bVal);
+					break;
+
+				case MetaColumn::dbfInt:
+					boost::hash_combine(uHash, pVal->iVal);
+					break;
+
+				case MetaColumn::dbfLong:
+					boost::hash_combine(uHash, pVal->lVal);
+					break;
+
+				case MetaColumn::dbfFloat:
+					boost::hash_combine(uHash, pVal->fVal);
+					break;
+
+				case MetaColumn::dbfDate:
+					boost::hash_combine(uHash, pVal->tmUTC.date().day_number());
+					boost::hash_combine(uHash, pVal->tmUTC.time_of_day().ticks());
+					break;
+			}
+		}
+
+		return uHash;
+	}
+
+
+
+	void KeyProbe::AssignTo(Key & aKey) const
+	{
+		KeyColumnArrayItr			itrColumn;
+		ColumnPtr							pCol;
+		const Value*					pVal;
+		unsigned int					idx;
+
+
+		assert(IsComplete());
+
+		for ( itrColumn =  aKey.GetColumns().begin(),	idx = 0;
+					itrColumn != aKey.GetColumns().end()		&& idx < m_uSize;
+					itrColumn++,															idx++)
+		{
+			pCol = *itrColumn;
+			pVal = &(m_arrValue[idx]);
+
+			if (pVal->bNull)
+			{
+				pCol->SetNull();
+				continue;
+			}
+
+			switch (pVal->uType)
+			{
+				case MetaColumn::dbfString:
+					pCol->SetValue(std::string(pVal->pszVal, pVal->uLen));
+					break;
+
+				case MetaColumn::dbfChar:
+					pCol->SetValue(pVal->cVal);
+					break;
+
+				case MetaColumn::dbfShort:
+					pCol->SetValue(pVal->sVal);
+					break;
+
+				case MetaColumn::dbfBool:
+					pCol->SetValue(pVal->bVal);
+					break;
+
+				case MetaColumn::dbfInt:
+					pCol->SetValue(pVal->iVal);
+					break;
+
+				case MetaColumn::dbfLong:
+					pCol->SetValue(pVal->lVal);
+					break;
+
+				case MetaColumn::dbfFloat:
+					pCol->SetValue(pVal->fVal);
+					break;
+
+				case MetaColumn::dbfDate:
+					pCol->SetValue(D3Date(pVal->tmUTC, m_pMetaKey->GetMetaEntity()->GetMetaDatabase()->GetTimeZone()));
+					break;
+			}
+		}
+	}
+
+
+
+
+
+
+
+
+
 	// ===========================================================
 	// InstanceKey class: Instances of this class are associated with an entity object
 	//
@@ -1887,7 +2786,7 @@ namespace D3
 
 	InstanceKey::~InstanceKey()
 	{
-		ColumnPtrListItr		itrColumn;
+		KeyColumnArrayItr		itrColumn;
 		ColumnPtr						pCol;
 
 
@@ -1932,6 +2831,8 @@ namespace D3
 
 		// Add the key columns from the entity
 		//
+		m_listColumn.reserve(m_pMetaKey->GetColumnCount());
+
 		for (	itrMC =  m_pMetaKey->GetMetaColumns()->begin();
 					itrMC != m_pMetaKey->GetMetaColumns()->end();
 					itrMC++)
@@ -2118,11 +3019,9 @@ namespace D3
 	//
 	bool InstanceKey::NotifyRelationsBeforeUpdate()
 	{
-		unsigned int				idx;
-		RelationPtrMapPtr		pRelationMap;
-		RelationPtrMapItr		itrRelationMap;
+		unsigned int				idx, idx2;
 		RelationPtr					pRelation;
-		RelationPtrMap			mapTempRelation;
+		RelationSlot				slotTempRelation;
 
 
 		// Deal with relations where this' entity is the child
@@ -2134,23 +3033,18 @@ namespace D3
 			if (m_pEntity->GetMetaEntity()->GetParentMetaRelation(idx)->GetChildMetaKey() != m_pMetaKey)
 				continue;
 
-			// Take a copy of the existing parent relation map (the purpose of the map is to
+			// Take a copy of the existing parent relation slot (the purpose of the slot is to
 			// enable multiple parent relations if this' entity is cached but the parent is not)
 			//
-			pRelationMap = m_pEntity->m_vectParentRelation[idx];
-
-			mapTempRelation.clear();
-			mapTempRelation = *pRelationMap;
+			slotTempRelation = m_pEntity->m_vectParentRelation[idx];
 
 			// Now use the copy of the collection to send each relation the On_BeforeUpdateChildKey()
-			// notification. The copy of the map is essential as the original map can change during
+			// notification. The copy of the slot is essential as the original slot can change during
 			// this operation
 			//
-			for ( itrRelationMap =  mapTempRelation.begin();
-						itrRelationMap != mapTempRelation.end();
-						itrRelationMap++)
+			for (idx2 = 0; idx2 < slotTempRelation.size(); idx2++)
 			{
-				pRelation = itrRelationMap->second;
+				pRelation = slotTempRelation.GetRelation(idx2);
 
 				if (pRelation)
 					pRelation->On_BeforeUpdateChildKey(this);
@@ -2166,18 +3060,16 @@ namespace D3
 			if (m_pEntity->GetMetaEntity()->GetChildMetaRelation(idx)->GetParentMetaKey() != m_pMetaKey)
 				continue;
 
-			// Get the appropriate relation map (the purpose of the map is to enable multiple
+			// Get the appropriate relation slot (the purpose of the slot is to enable multiple
 			// relations if this' entity is cached but the child entity is not)
 			//
-			pRelationMap = m_pEntity->m_vectChildRelation[idx];
+			RelationSlot &		slotRelation = m_pEntity->m_vectChildRelation[idx];
 
 			// Now send each relation the On_BeforeUpdateParentKey() notification.
 			//
-			for ( itrRelationMap =  pRelationMap->begin();
-						itrRelationMap != pRelationMap->end();
-						itrRelationMap++)
+			for (idx2 = 0; idx2 < slotRelation.size(); idx2++)
 			{
-				pRelation = itrRelationMap->second;
+				pRelation = slotRelation.GetRelation(idx2);
 
 				if (pRelation)
 					pRelation->On_BeforeUpdateParentKey(this);
@@ -2194,9 +3086,7 @@ namespace D3
 	//
 	bool InstanceKey::NotifyRelationsAfterUpdate()
 	{
-		unsigned int				idx;
-		RelationPtrMapPtr		pRelationMap;
-		RelationPtrMapItr		itrRelationMap;
+		unsigned int				idx, idx2;
 		MetaRelationPtr			pMetaRelation;
 		RelationPtr					pRelation;
 
@@ -2212,18 +3102,16 @@ namespace D3
 			if (pMetaRelation->GetChildMetaKey() != m_pMetaKey)
 				continue;
 
-			// Get the appropriate relation map (the purpose of the map is to enable multiple
+			// Get the appropriate relation slot (the purpose of the slot is to enable multiple
 			// relations if this' entity is cached but the parent entity is not)
 			//
-			pRelationMap = m_pEntity->m_vectParentRelation[idx];
+			RelationSlot &		slotRelation = m_pEntity->m_vectParentRelation[idx];
 
 			// Now send each relation the On_AfterUpdateChildKey() notification.
 			//
-			for ( itrRelationMap =  pRelationMap->begin();
-						itrRelationMap != pRelationMap->end();
-						itrRelationMap++)
+			for (idx2 = 0; idx2 < slotRelation.size(); idx2++)
 			{
-				pRelation = itrRelationMap->second;
+				pRelation = slotRelation.GetRelation(idx2);
 
 				if (pRelation)
 					pRelation->On_AfterUpdateChildKey(this);
@@ -2231,7 +3119,7 @@ namespace D3
 
 			// Ensure parents are resolved
 			//
-			if (pRelationMap->find(m_pEntity->GetDatabase()) == pRelationMap->end())
+			if (!slotRelation.Find(m_pEntity->GetDatabase()))
 			{
 				if (!IsKeyPartNull(pMetaRelation->GetParentMetaKey()))
 				{
@@ -2296,13 +3184,11 @@ namespace D3
 			if (pMetaRelation->GetParentMetaKey() != m_pMetaKey)
 				continue;
 
-			pRelationMap = m_pEntity->m_vectChildRelation[idx];
+			RelationSlot &		slotRelation = m_pEntity->m_vectChildRelation[idx];
 
-			for ( itrRelationMap =  pRelationMap->begin();
-						itrRelationMap != pRelationMap->end();
-						itrRelationMap++)
+			for (idx2 = 0; idx2 < slotRelation.size(); idx2++)
 			{
-				pRelation = itrRelationMap->second;
+				pRelation = slotRelation.GetRelation(idx2);
 
 				if (pRelation)
 					pRelation->On_AfterUpdateParentKey(this);
@@ -2415,6 +3301,8 @@ namespace D3
 		// Create a copy of each of the columns of the input key
 		// and add each to this' list of columns
 		//
+		m_listColumn.reserve(m_pMetaKey->GetColumnCount());
+
 		for ( itrSrceColumn =  m_pMetaKey->GetMetaColumns()->begin();
 					itrSrceColumn != m_pMetaKey->GetMetaColumns()->end();
 					itrSrceColumn++)
@@ -2429,14 +3317,19 @@ namespace D3
 
 	void TemporaryKey::DeleteColumns()
 	{
+		KeyColumnArrayItr	itrColumn;
 		ColumnPtr					pCol;
 
-		while (!m_listColumn.empty())
+
+		for ( itrColumn =  m_listColumn.begin();
+					itrColumn != m_listColumn.end();
+					itrColumn++)
 		{
-			pCol = m_listColumn.front();
-			m_listColumn.pop_front();
+			pCol = *itrColumn;
 			delete pCol;
 		}
+
+		m_listColumn.clear();
 	}
 
 
@@ -2486,7 +3379,7 @@ namespace D3
 		Json::Value&						nMetaKeyID	= jsonID["KeyID"];
 		Json::Value&						nKeyColumns	= jsonID["Columns"];
 		ColumnPtr								pCol;
-		ColumnPtrListItr				itrKeyColumn;
+		KeyColumnArrayItr				itrKeyColumn;
 		int											idx;
 
 
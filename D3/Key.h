@@ -34,7 +34,9 @@
 #include "D3.h"
 #include "D3MDDB.h"
 #include "D3BitMask.h"
+#include "D3Date.h"
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/unordered_map.hpp>
 
 // Needs JSON
 #include <json/json.h>
@@ -48,6 +50,8 @@ extern const char szMetaKeyFlags[];					// solely used to ensure type safety (no
 
 namespace D3
 {
+	class KeyProbe;
+
 	//! This template is required to sort keys
 	/*! Key objects are typically stored in std::multiset<> collections.
 	    The structure can be used as the Less predicate in the mutliset
@@ -67,9 +71,11 @@ namespace D3
 		/*! The method simply translates the call to:
 
 		\code
-		return ((*x) < (*y));
+		return x->Key::Compare(y) < 0;
 		\endcode
 
+				The call is bound statically so that it runs the MetaKey's comparator plan
+				without going through Object::operator<().
 		*/
 		bool operator()(const KeyPtr x, const KeyPtr y) const;
 	};
@@ -97,6 +103,23 @@ namespace D3
 
 
 
+	/** @name Key-Hash-Indexes
+			Unique searchable MetaKey objects maintain a hash index per database in addition to
+			the ordered InstanceKeyPtrSet. The index maps the hash of a key's column values to
+			the InstanceKey objects with that hash. Since different values can produce the same
+			hash, candidates found through the index must always be verified using Key::Compare().
+			The index only holds keys which are not NULL.
+	*/
+  //@{
+	typedef boost::unordered_multimap<std::size_t, InstanceKeyPtr>	InstanceKeyHashIndex;
+	typedef InstanceKeyHashIndex*																		InstanceKeyHashIndexPtr;
+	typedef InstanceKeyHashIndex::iterator													InstanceKeyHashIndexItr;
+	typedef std::map<DatabasePtr, InstanceKeyHashIndexPtr>					InstanceKeyHashIndexPtrMap;
+	typedef InstanceKeyHashIndexPtrMap::iterator										InstanceKeyHashIndexPtrMapItr;
+  //@}
+
+
+
 
 	//! We store all MetaKey objects in a map keyed by ID
 	/*! Note that objects which are not stored in the meta dictionary (e.g. MetaKey objects
@@ -202,8 +225,11 @@ namespace D3
 			std::string								m_strJSInstanceClass;			//!< The name of the JavaScript instance class representing this in the browser
 			std::string								m_strJSViewClass;					//!< The name of the JavaScript widget that knows how to render instances of this type as a APALUI widget in the browser (full)
 			MetaColumnPtrList					m_listColumn;							//!< A list holding MetaColumnPtr objects making up the key
+			std::vector<unsigned char>	m_vectColumnType;				//!< The comparator plan: holds the MetaColumn::Type of each column in m_listColumn (built by AddMetaColumn())
+			std::vector<unsigned int>	m_vectColumnMaxLength;	//!< Holds the MetaColumn::GetMaxLength() of each column in m_listColumn (built by AddMetaColumn())
 			MetaRelationPtrVect				m_vectMetaRelation;				//!< This vector holds all meta relation objects this has. If this is a foreign key, these should be parent relations.
 			InstanceKeyPtrSetPtrMap		m_mapInstanceKeySet;			//!< Holds a map keyed by DatabasePtr containing a multiset of InstanceKeyPtr objects
+			InstanceKeyHashIndexPtrMap	m_mapInstanceKeyIndex;	//!< Unique keys only: holds a map keyed by DatabasePtr containing a hash index of the none NULL InstanceKeyPtr objects in m_mapInstanceKeySet
 			MetaKeyPtrList						m_listOverlappedKeys;			//!< Holds all MetaKey objects belonging to m_pMetaEntity which share one or more MetaColumn objects with this
   		boost::recursive_mutex		m_mtxExclusive;						//!< This Mutex is used to serialise modifications to m_mapInstanceKeySet
 			std::string								m_strHSTopicsJSON;				//!< JSON string containing an array of help topics associated with this
@@ -261,6 +287,10 @@ namespace D3
 			MetaEntityPtr							GetMetaEntity()											{ return m_pMetaEntity; }
 			//! Returns a pointer to an ordered std::list<MetaColumnPtr> objects making up the key
 			MetaColumnPtrListPtr			GetMetaColumns()										{ return &m_listColumn; }
+			//! Returns the comparator plan, a vector holding the MetaColumn::Type of each column in the same order as GetMetaColumns()
+			const std::vector<unsigned char> &	GetColumnTypes() const		{ return m_vectColumnType; }
+			//! Returns a vector holding the maximum length of each column in the same order as GetMetaColumns()
+			const std::vector<unsigned int> &		GetColumnMaxLengths() const	{ return m_vectColumnMaxLength; }
 			//! Returns a reference to a std::vect<MetaRelationPtr> containing all relations where this is either the parent or child key.
 			MetaRelationPtrVect&			GetMetaRelations()									{ return m_vectMetaRelation; }
 			//! Returns a reference to a std::vect<MetaRelationPtr> containing all relations where this is either the parent or child key.
@@ -348,6 +378,15 @@ namespace D3
 			*/
 			InstanceKeyPtr						FindInstanceKey(KeyPtr pKey, DatabasePtr pDatabase = 0);
 
+			//! Same as above but searches for the values held by a KeyProbe.
+			/*! If this has a hash index, the method does not allocate any memory. Otherwise it
+					falls back to searching a TemporaryKey initialised from the probe.
+					@param keyProbe		A complete KeyProbe for this (i.e. keyProbe.GetMetaKey() == this && keyProbe.IsComplete())
+					@param pDatabase	The database within which we search the key (mandatory).
+					@return If successful, returns an InstanceKey based on this which matches the probe, else NULL is returned.
+			*/
+			InstanceKeyPtr						FindInstanceKey(const KeyProbe & keyProbe, DatabasePtr pDatabase);
+
 			//! FindObject calls FindInstanceKey but instead of returning the key it returns the object that onws the key (method may return NULL)
 			EntityPtr									FindObject(KeyPtr pKey, DatabasePtr pDatabase = 0);
 
@@ -436,6 +475,21 @@ namespace D3
 			//! Returns true if this collects InstanceKey objects (true for Primary, Secondary and Foreign keys).
 			bool											IsSearchable() const								{ return (m_Flags & Flags::Searchable); }
 
+			//! Returns true if this maintains a hash index in addition to the InstanceKey multiset (true for searchable unique keys).
+			bool											HasHashIndex() const								{ return IsSearchable() && IsUnique(); }
+
+			//! Returns the hash index for the database passed in (resolves the database the same way GetInstanceKeySet() does)
+			InstanceKeyHashIndexPtr		GetInstanceKeyIndex(DatabasePtr pDatabase);
+
+			//! Searches the hash index for a key matching pKey. Returns false if the index can't be used for pKey in which case pIK is undefined.
+			bool											FindInstanceKeyInIndex(KeyPtr pKey, DatabasePtr pDatabase, InstanceKeyPtr & pIK);
+
+			//@{
+			//! Helpers maintaining the hash index, they do nothing if HasHashIndex() is false
+			void											AddToIndex(InstanceKeyPtr pKey);
+			void											RemoveFromIndex(InstanceKeyPtr pKey);
+			//@}
+
 			//! Used during meta model initialisation
 			void											AddMetaColumn(MetaColumnPtr	pMC);
 
@@ -495,6 +549,14 @@ namespace D3
 					in is not the global database, no action is taken.
 			*/
 			void											On_DatabaseDeleted(DatabasePtr pDatabase);
+
+			//! Notification that all objects of a database are about to be deleted.
+			/*! If this is a searchable key other than the primary key, the key multiset and
+					hash index for the database are emptied in one go. Until the database completes
+					Database::DeleteAllObjects(), On_InstanceDeleted() will not search these
+					collections for each dying key.
+			*/
+			void											On_BeforeDeleteAllObjects(DatabasePtr pDatabase);
 			//@}
 
 			//! Returns the index of the MetaRelationPtr requested.
@@ -535,6 +597,209 @@ namespace D3
 
 
 
+	#define D3_KEY_INLINE_COLUMNS		4
+
+	//! The KeyColumnArray class holds the columns making up a Key
+	/*! Most keys have very few columns. This container stores up to D3_KEY_INLINE_COLUMNS
+			column pointers inside the object itself and only allocates a buffer from the heap
+			for keys with more columns. Use reserve() with the MetaKey's column count before
+			adding columns so that at most one allocation occurs.
+
+			The class supports the subset of the std::list interface Key objects used to
+			expose, so iterating key columns looks the same as before:
+
+			\code
+			KeyColumnArrayItr		itrColumn;
+
+			for ( itrColumn =  pKey->GetColumns().begin();
+						itrColumn != pKey->GetColumns().end();
+						itrColumn++)
+			{
+				ColumnPtr pCol = *itrColumn;
+				...
+			}
+			\endcode
+
+			\note The container only holds pointers, it never deletes the columns it refers to.
+	*/
+	class D3_API KeyColumnArray
+	{
+		public:
+			typedef ColumnPtr*				iterator;
+			typedef const ColumnPtr*	const_iterator;
+
+		protected:
+			ColumnPtr								m_arrInline[D3_KEY_INLINE_COLUMNS];		//!< Inline storage used while the key has no more than D3_KEY_INLINE_COLUMNS columns
+			ColumnPtr*							m_pColumns;														//!< Points to m_arrInline or to a heap buffer holding m_uCapacity elements
+			unsigned short					m_uSize;															//!< The number of columns stored
+			unsigned short					m_uCapacity;													//!< The number of columns that fit into m_pColumns
+
+		public:
+			KeyColumnArray() : m_pColumns(m_arrInline), m_uSize(0), m_uCapacity(D3_KEY_INLINE_COLUMNS) {}
+			KeyColumnArray(const KeyColumnArray & aColumns) : m_pColumns(m_arrInline), m_uSize(0), m_uCapacity(D3_KEY_INLINE_COLUMNS) { *this = aColumns; }
+			~KeyColumnArray()																								{ if (m_pColumns != m_arrInline) delete [] m_pColumns; }
+
+			//! Copies the column pointers (not the columns) from aColumns
+			KeyColumnArray &				operator=(const KeyColumnArray & aColumns)
+			{
+				if (this != &aColumns)
+				{
+					clear();
+					reserve(aColumns.m_uSize);
+
+					for (unsigned int idx = 0; idx < aColumns.m_uSize; idx++)
+						m_pColumns[idx] = aColumns.m_pColumns[idx];
+
+					m_uSize = aColumns.m_uSize;
+				}
+
+				return *this;
+			}
+
+			//! Make sure the container can hold n columns without further allocations
+			void										reserve(unsigned int n)
+			{
+				if (n <= m_uCapacity)
+					return;
+
+				ColumnPtr*	pNew = new ColumnPtr[n];
+
+				for (unsigned int idx = 0; idx < m_uSize; idx++)
+					pNew[idx] = m_pColumns[idx];
+
+				if (m_pColumns != m_arrInline)
+					delete [] m_pColumns;
+
+				m_pColumns = pNew;
+				m_uCapacity = (unsigned short) n;
+			}
+
+			void										push_back(ColumnPtr pCol)								{ if (m_uSize == m_uCapacity) reserve(2 * m_uCapacity); m_pColumns[m_uSize++] = pCol; }
+			void										clear()																	{ m_uSize = 0; }
+
+			iterator								begin()																	{ return m_pColumns; }
+			iterator								end()																		{ return m_pColumns + m_uSize; }
+			const_iterator					begin() const														{ return m_pColumns; }
+			const_iterator					end() const															{ return m_pColumns + m_uSize; }
+
+			ColumnPtr								front() const														{ assert(m_uSize); return m_pColumns[0]; }
+			ColumnPtr								back() const														{ assert(m_uSize); return m_pColumns[m_uSize - 1]; }
+			ColumnPtr								operator[](unsigned int idx) const			{ assert(idx < m_uSize); return m_pColumns[idx]; }
+
+			unsigned int						size() const														{ return m_uSize; }
+			bool										empty() const														{ return m_uSize == 0; }
+	};
+
+	typedef KeyColumnArray::iterator				KeyColumnArrayItr;
+
+
+
+
+
+	//! A KeyProbe holds the values of a key without creating Column objects
+	/*! KeyProbe objects are meant to live on the stack. They allow you to check whether
+			a key is resident through MetaKey::FindInstanceKey(const KeyProbe&, DatabasePtr)
+			without building a TemporaryKey, i.e. without allocating columns, copying strings
+			or constructing D3Date objects on the heap.
+
+			You add one value per column of the MetaKey in the order in which the columns appear
+			in the key:
+
+			\code
+			KeyProbe					keyProbe(pMetaEntity->GetPrimaryMetaKey());
+
+			keyProbe.Add(iCompanyID);
+			keyProbe.Add(strCode);
+
+			InstanceKeyPtr		pIK = pMetaEntity->GetPrimaryMetaKey()->FindInstanceKey(keyProbe, pDB);
+			\endcode
+
+			\note String values are not copied, the probe merely points at the characters
+			passed in. These must remain valid until you are done with the probe.
+
+			Keys with more than D3_KEY_PROBE_MAX_COLUMNS columns or with BLOB or binary columns
+			can't be probed. Use IsSupported() to check a MetaKey up front.
+	*/
+	class D3_API KeyProbe
+	{
+		friend class Key;
+		friend class MetaKey;
+
+		public:
+			#define D3_KEY_PROBE_MAX_COLUMNS		8
+
+		protected:
+			//! A view on a single column value, uType is the MetaColumn::Type of the value
+			struct Value
+			{
+				unsigned char							uType;
+				bool											bNull;
+				unsigned int							uLen;					//!< The length of pszVal (only valid for strings)
+				boost::posix_time::ptime	tmUTC;				//!< The UTC value (only valid for dates)
+
+				union
+				{
+					const char*							pszVal;
+					char										cVal;
+					short										sVal;
+					bool										bVal;
+					int											iVal;
+					long										lVal;
+					float										fVal;
+				};
+			};
+
+			MetaKeyPtr								m_pMetaKey;															//!< The MetaKey this probes
+			Value											m_arrValue[D3_KEY_PROBE_MAX_COLUMNS];		//!< The column values
+			unsigned int							m_uSize;																//!< The number of values added so far
+			bool											m_bOverflow;														//!< True if more than D3_KEY_PROBE_MAX_COLUMNS values were added
+
+			//! Returns the next free slot (or NULL if all slots are taken)
+			Value*										Next(unsigned char uType);
+
+		public:
+			KeyProbe(MetaKeyPtr pMetaKey) : m_pMetaKey(pMetaKey), m_uSize(0), m_bOverflow(false) { assert(m_pMetaKey); }
+
+			//! Returns true if keys of type pMetaKey can be probed
+			static bool								IsSupported(MetaKeyPtr pMetaKey);
+
+			//! Returns the MetaKey this probes
+			MetaKeyPtr								GetMetaKey() const																{ return m_pMetaKey; }
+
+			//! Discards all values added so that this can be reused
+			void											Clear()																						{ m_uSize = 0; m_bOverflow = false; }
+
+			//@{
+			//! Add the value for the next column (strings are trimmed, truncated and turned into NULL like ColumnString::SetValue() does)
+			void											AddNull();
+			void											Add(const char* pszVal, unsigned int uLen);
+			void											Add(const std::string & strVal)										{ Add(strVal.data(), strVal.size()); }
+			void											Add(char cVal);
+			void											Add(short sVal);
+			void											Add(bool bVal);
+			void											Add(int iVal);
+			void											Add(long lVal);
+			void											Add(float fVal);
+			void											Add(const D3Date & dtVal);
+			//@}
+
+			//! Returns true if this holds a value for each column of the MetaKey and each value has the type of its MetaColumn
+			bool											IsComplete() const;
+
+			//! Returns true if this represents a NULL key (same rules as Key::IsNull())
+			bool											IsNull() const;
+
+			//! Returns the same hash value as Key::GetHashValue() returns for a key with the same values
+			std::size_t								GetHashValue() const;
+
+			//! Assigns the values of this to the columns of the key passed in (this must be complete)
+			void											AssignTo(Key & aKey) const;
+	};
+
+
+
+
+
 	//! This class provides a common base for InstanceKey and TemporaryKey.
 	/** The Key class implements basics features common to any sub-class based on Key.
 			Such common features are:
@@ -552,12 +817,13 @@ namespace D3
 	{
 		friend class MetaKey;
 		friend class Relation;
+		friend struct KeyLessPredicate;
 
 		D3_CLASS_DECL_PV(Key);
 
 		protected:
 			MetaKeyPtr							m_pMetaKey;				//!< The meta key
-			ColumnPtrList						m_listColumn;			//!< List of columns making up the key, most important column is in the front, least important is at the back
+			KeyColumnArray					m_listColumn;			//!< Columns making up the key, most important column is in the front, least important is at the back
 
 			//@{
 			//! Ctor indirectly invoked through sub-class ctor's
@@ -623,8 +889,23 @@ namespace D3
 			//! Return the number of columns which make up this key
 			unsigned int						GetColumnCount() 								{ return m_listColumn.size(); };
 
-			//! Return the stl list containing the key columns
-			ColumnPtrList&					GetColumns() 										{ return m_listColumn; };
+			//! Return the container holding the key columns (see KeyColumnArray)
+			KeyColumnArray&					GetColumns() 										{ return m_listColumn; };
+
+			//! Returns a hash value computed from the values of this' columns
+			/*! Two keys which are equal according to Compare() and are HashCompatible() return
+					the same hash value. NULL columns contribute a constant to the hash.
+			*/
+			std::size_t							GetHashValue();
+
+			//! Returns true if this' column values equal the values in the probe (the probe must be complete)
+			bool										Matches(const KeyProbe & keyProbe);
+
+			//! Returns true if this can be looked up in a hash index maintained by pMK
+			/*! This is the case if this has the same number and types of columns as pMK and
+					none of this' columns is undefined.
+			*/
+			bool										IsHashCompatible(MetaKeyPtr pMK);
 
 			//@{
 			//! Column accessor
@@ -696,6 +977,9 @@ namespace D3
 											1  : This is greater than pObj
 
 					@note				Comparing keys is comparing their columns from front to back.
+										Where both keys' MetaKey comparator plans (see MetaKey::GetColumnTypes())
+										agree on a column's type, the values are compared directly. Only
+										columns of differing types go through the virtual Column::Compare().
 											If the columns at a given index are of different types, conversion is
 											attempted but can fail and throw a D3::Exception.
 											The method only compares the smaller number of columns in the two keys.
@@ -706,6 +990,9 @@ namespace D3
 			*/
 			int											Compare(ObjectPtr pObj);
 
+			//! Helper for Compare() which compares two none NULL columns of type uType (a MetaColumn::Type) without virtual dispatch
+			static int							CompareColumnValues(unsigned char uType, ColumnPtr pSrce, ColumnPtr pTrgt);
+
 	};
 
 
@@ -814,6 +1101,7 @@ namespace D3
 		friend class OTLDatabase;
 
 		D3_CLASS_DECL(InstanceKey);
+		D3_ARENA_OPERATORS;
 
 		protected:
 			//! The entity of which this is a key
@@ -825,8 +1113,14 @@ namespace D3
 			//! Member is set to true on BeforeUpdate() and false on AfterUpdate()
 			TemporaryKeyPtr				m_pOriginalKey;
 
+			//! True if this is currently a member of its MetaKey's hash index
+			bool									m_bIndexed;
+
+			//! The hash value under which this is stored in its MetaKey's hash index (only meaningful if m_bIndexed is true)
+			std::size_t						m_uIndexHash;
+
 			//! The common ctor used by MetaKey::CreateInstance()
-			InstanceKey() : m_pEntity(NULL), m_bUpdating(false), m_pOriginalKey(NULL) {}
+			InstanceKey() : m_pEntity(NULL), m_bUpdating(false), m_pOriginalKey(NULL), m_bIndexed(false), m_uIndexHash(0) {}
 
 			//! The destructor deletes all source relations
 			~InstanceKey();
@@ -893,7 +1187,7 @@ namespace D3
 
 	inline bool KeyLessPredicate::operator()(const KeyPtr x, const KeyPtr y) const
 	{
-		return ((*x) < (*y));
+		return x->Key::Compare(y) < 0;
 	}
 
 
@@ -41,6 +41,7 @@
 #include "HSTopic.h"
 
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/bind.hpp>
 
 // Module uses XML DOM
 //
@@ -135,17 +136,23 @@ namespace D3
 		protected:
 			ODBCDatabasePtr										m_pDB;
 			ODBCDatabase::ODBCConnectionPtr		m_pTempConnection;
+			bool															m_bBusy;						// true once connection() has been called
 
-			ConnectionManager(ODBCDatabasePtr pDB) : m_pDB(pDB), m_pTempConnection(NULL) {};
+			ConnectionManager(ODBCDatabasePtr pDB) : m_pDB(pDB), m_pTempConnection(NULL), m_bBusy(false) {};
 			~ConnectionManager() { idle(); };
 
 			bool								isBusy()				{ return m_pDB->m_uConnectionBusyCount; }
 
 //			void								busy()					{ m_pDB->m_uConnectionBusyCount++; }
 
+			// Only managers which handed out a connection hold a busy count
 			void								idle()
 			{
-				m_pDB->m_uConnectionBusyCount--;
+				if (m_bBusy)
+				{
+					m_pDB->m_uConnectionBusyCount--;
+					m_bBusy = false;
+				}
 
 				if (m_pTempConnection)
 					ODBCDatabase::ReleaseODBCConnection(m_pDB->GetMetaDatabase(), m_pTempConnection);
@@ -153,15 +160,15 @@ namespace D3
 
 			ODBCDatabase::ODBCConnectionPtr		connection()
 			{
-				if (m_pDB->m_uConnectionBusyCount++)
+				if (!m_bBusy)
 				{
-					if (!m_pTempConnection)
-						m_pTempConnection = ODBCDatabase::CreateODBCConnection(m_pDB->GetMetaDatabase());
+					m_bBusy = true;
 
-					return m_pTempConnection;
+					if (m_pDB->m_uConnectionBusyCount++)
+						m_pTempConnection = ODBCDatabase::CreateODBCConnection(m_pDB->GetMetaDatabase(), true);
 				}
 
-				return m_pDB->m_pConnection;
+				return m_pTempConnection ? m_pTempConnection : m_pDB->m_pConnection;
 			}
 	};
 
@@ -972,32 +979,280 @@ namespace D3
 
 	boost::recursive_mutex											ODBCDatabase::M_Mutex;
 	boost::recursive_mutex											ODBCDatabase::M_CreateSPMutex;
-	ODBCDatabase::ODBCConnectionPtrListMap			ODBCDatabase::M_mapODBCConnectionPtrLists;
+	boost::mutex																ODBCDatabase::M_mtxConnectionPools;
+	ODBCDatabase::ConnectionPoolPtrMap					ODBCDatabase::M_mapConnectionPools;
+	ODBCDatabase::ConnectionPoolPtrByConnectionMap	ODBCDatabase::M_mapConnectionsInUse;
 	ODBCDatabase::NativeConnectionPtrListMap		ODBCDatabase::M_mapNativeConnectionPtrLists;
 	bool																				ODBCDatabase::M_bQNInitialised = false;
+	ODBCDatabase::StatementCacheMap							ODBCDatabase::M_mapStatementCaches;
+	ODBCDatabase::FetchPlanMap									ODBCDatabase::M_mapFetchPlans;
+	boost::mutex																ODBCDatabase::M_mtxAsync;
+	boost::condition_variable										ODBCDatabase::M_condAsync;
+	ODBCDatabase::AsyncTaskList									ODBCDatabase::M_listAsyncTasks;
+	ODBCDatabase::AsyncWorkerList								ODBCDatabase::M_listAsyncWorkers;
+	unsigned int																ODBCDatabase::M_uIdleAsyncWorkers = 0;
+	bool																				ODBCDatabase::M_bStopAsyncWorkers = false;
 
 
 
 	/* static */
-	ODBCDatabase::ODBCConnectionPtr ODBCDatabase::CreateODBCConnection(MetaDatabasePtr pMDB)
+	ODBCDatabase::ODBCConnectionPtr ODBCDatabase::CreateODBCConnection(MetaDatabasePtr pMDB, bool bNested)
 	{
-		boost::recursive_mutex::scoped_lock		lk(M_Mutex);
+		ConnectionPoolPtr						pPool;
+		ConnectionPoolSettings			settings;
+		ODBCConnectionPtr						pCon = NULL;
+		ODBCConnectionPtrList				listExpired;
+		ODBCConnectionPtrListItr		itr;
+		boost::posix_time::ptime		tNow = boost::get_system_time();
+		boost::posix_time::ptime		tIdleSince;
+		bool												bTimedOut = false;
+
+
+		{
+			boost::mutex::scoped_lock		lk(M_mtxConnectionPools);
+
+			pPool = GetConnectionPool(pMDB);
+			settings = pPool->settings;
+			pPool->stats.lAcquired++;
+
+			CollectExpiredConnections(pPool, tNow, listExpired);
+
+			// Queue up behind earlier requests so that waiters are served in order
+			if (!bNested && (!pPool->listWaiting.empty() || !pPool->HasCapacity()))
+			{
+				unsigned long							lTicket = pPool->lNextTicket++;
+				boost::posix_time::ptime	tDeadline = tNow + boost::posix_time::milliseconds(settings.uMaxWait);
+				unsigned long							lWaitMS;
+
+				pPool->listWaiting.push_back(lTicket);
+				pPool->stats.lWaits++;
+
+				while (pPool->listWaiting.front() != lTicket || !pPool->HasCapacity())
+				{
+					if (pPool->bAbandoned)
+						break;
+
+					if (!pPool->condAvailable.timed_wait(lk, tDeadline) && (pPool->listWaiting.front() != lTicket || !pPool->HasCapacity()))
+					{
+						bTimedOut = true;
+						break;
+					}
+				}
+
+				// DeleteConnectionPools() was called while we waited, the last request out deletes the pool
+				if (pPool->bAbandoned)
+				{
+					pPool->listWaiting.remove(lTicket);
+					pPool->condAvailable.notify_all();
+
+					if (pPool->IsUnreferenced())
+						delete pPool;
+
+					throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::CreateODBCConnection(): The connection pool for database %s was deleted while waiting for a connection.", pMDB->GetAlias().c_str());
+				}
+
+				if (bTimedOut)
+				{
+					pPool->listWaiting.remove(lTicket);
+					pPool->stats.lTimeouts++;
+				}
+				else
+				{
+					pPool->listWaiting.pop_front();
+				}
+
+				// The next waiter may now be at the front
+				pPool->condAvailable.notify_all();
+
+				lWaitMS = (unsigned long) (boost::get_system_time() - tNow).total_milliseconds();
+				pPool->stats.lTotalWaitMS += lWaitMS;
+
+				if (lWaitMS > pPool->stats.lMaxWaitMS)
+					pPool->stats.lMaxWaitMS = lWaitMS;
+			}
+
+			if (!bTimedOut)
+			{
+				if (!pPool->listIdle.empty())
+				{
+					pCon = pPool->listIdle.front().pCon;
+					tIdleSince = pPool->listIdle.front().tReleased;
+					pPool->listIdle.pop_front();
+				}
+
+				// Reserve the slot now even if we still have to open the connection
+				pPool->stats.uInUse++;
+				pPool->uOpening++;
+
+				if (pPool->stats.uInUse > pPool->stats.uPeakInUse)
+					pPool->stats.uPeakInUse = pPool->stats.uInUse;
+			}
+		}
+
+		for (itr = listExpired.begin(); itr != listExpired.end(); itr++)
+			CloseODBCConnection(*itr);
+
+		if (bTimedOut)
+			throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::CreateODBCConnection(): Timed out after %u ms waiting for one of the %u connections to database %s.", settings.uMaxWait, settings.uMaxSize, pMDB->GetAlias().c_str());
+
+		try
+		{
+			// Connections which have been idle for a while may have been dropped by the server
+			if (pCon && settings.uValidateAfter && (tNow - tIdleSince).total_seconds() >= (long) settings.uValidateAfter && !ValidateODBCConnection(pMDB, pCon))
+			{
+				ReportWarning("ODBCDatabase::CreateODBCConnection(): Discarding broken idle connection to database %s.", pMDB->GetAlias().c_str());
+				CloseODBCConnection(pCon);
+
+				boost::mutex::scoped_lock		lk(M_mtxConnectionPools);
+
+				pPool->stats.lValidationFailures++;
+				pPool->stats.lClosed++;
+			}
+
+			if (!pCon)
+			{
+				pCon = OpenODBCConnection(pMDB);
+
+				boost::mutex::scoped_lock		lk(M_mtxConnectionPools);
+
+				pPool->stats.lCreated++;
+			}
+		}
+		catch (...)
+		{
+			boost::mutex::scoped_lock		lk(M_mtxConnectionPools);
+
+			pPool->stats.uInUse--;
+			pPool->uOpening--;
+			pPool->condAvailable.notify_all();
+
+			if (pPool->bAbandoned && pPool->IsUnreferenced())
+				delete pPool;
+
+			throw;
+		}
 
-		ODBCConnectionPtrListMapItr		itr;
-		ODBCConnectionPtr							pCon = NULL;
+		{
+			boost::mutex::scoped_lock		lk(M_mtxConnectionPools);
+
+			pPool->uOpening--;
+
+			// If the pool was deleted meanwhile, the connection is closed when it is released
+			if (!pPool->bAbandoned)
+				M_mapConnectionsInUse[pCon] = pPool;
+			else if (pPool->IsUnreferenced())
+				delete pPool;
+		}
+
+		return pCon;
+	}
+
+
+
+
+
+	/* static */
+	void ODBCDatabase::ReleaseODBCConnection(MetaDatabasePtr pMDB, ODBCDatabase::ODBCConnectionPtr & pODBCConnection)
+	{
+		ConnectionPoolPtrByConnectionMapItr		itrInUse;
+		ConnectionPoolPtr										pPool;
+		ODBCConnectionPtrList								listExpired;
+		ODBCConnectionPtrListItr						itr;
+		boost::posix_time::ptime						tNow = boost::get_system_time();
+
+
+		if (!pODBCConnection)
+			return;
+
+		{
+			boost::mutex::scoped_lock		lk(M_mtxConnectionPools);
+
+			itrInUse = M_mapConnectionsInUse.find(pODBCConnection);
+
+			if (itrInUse != M_mapConnectionsInUse.end())
+			{
+				pPool = itrInUse->second;
+				M_mapConnectionsInUse.erase(itrInUse);
+				pPool->stats.uInUse--;
+
+				// Keep the connection unless the pool has shrunk below the number of open connections
+				if (!pPool->settings.uMaxSize || pPool->stats.uInUse + pPool->listIdle.size() < pPool->settings.uMaxSize)
+				{
+					pPool->listIdle.push_front(IdleConnection(pODBCConnection, tNow));
+					pODBCConnection = NULL;
+				}
+				else
+				{
+					pPool->stats.lClosed++;
+				}
+
+				CollectExpiredConnections(pPool, tNow, listExpired);
+				pPool->condAvailable.notify_all();
+			}
+		}
 
-		itr = M_mapODBCConnectionPtrLists.find(pMDB);
+		// Connections we don't know about (e.g. handed out before DeleteConnectionPools()) or don't keep are closed
+		if (pODBCConnection)
+			CloseODBCConnection(pODBCConnection);
 
-		if (itr == M_mapODBCConnectionPtrLists.end() || itr->second.empty())
+		for (itr = listExpired.begin(); itr != listExpired.end(); itr++)
+			CloseODBCConnection(*itr);
+	}
+
+
+
+
+
+	/* static */
+	ODBCDatabase::ConnectionPoolPtr ODBCDatabase::GetConnectionPool(MetaDatabasePtr pMDB)
+	{
+		ConnectionPoolPtrMapItr		itr = M_mapConnectionPools.find(pMDB);
+
+		if (itr != M_mapConnectionPools.end())
+			return itr->second;
+
+		return M_mapConnectionPools[pMDB] = new ConnectionPool();
+	}
+
+
+
+
+
+	/* static */
+	void ODBCDatabase::CollectExpiredConnections(ODBCDatabase::ConnectionPoolPtr pPool, const boost::posix_time::ptime & tNow, ODBCDatabase::ODBCConnectionPtrList & listExpired)
+	{
+		if (!pPool->settings.uIdleTimeout)
+			return;
+
+		// listIdle is ordered most recently released first, so the oldest are at the back
+		while (!pPool->listIdle.empty() &&
+					 pPool->listIdle.size() + pPool->stats.uInUse > pPool->settings.uMinSize &&
+					 (tNow - pPool->listIdle.back().tReleased).total_seconds() >= (long) pPool->settings.uIdleTimeout)
+		{
+			listExpired.push_back(pPool->listIdle.back().pCon);
+			pPool->listIdle.pop_back();
+			pPool->stats.lClosed++;
+		}
+	}
+
+
+
+
+
+	/* static */
+	ODBCDatabase::ODBCConnectionPtr ODBCDatabase::OpenODBCConnection(MetaDatabasePtr pMDB)
+	{
+		ODBCConnectionPtr		pCon = odbc::DriverManager::getConnection(pMDB->GetConnectionString());
+
+		try
 		{
-			pCon = odbc::DriverManager::getConnection(pMDB->GetConnectionString());
 			pCon->setTransactionIsolation(odbc::Connection::TRANSACTION_READ_COMMITTED);
 			pCon->setAutoCommit(true);
 		}
-		else
+		catch (...)
 		{
-			pCon = itr->second.front();
-			itr->second.pop_front();
+			delete pCon;
+			throw;
 		}
 
 		return pCon;
@@ -1008,30 +1263,170 @@ namespace D3
 
 
 	/* static */
-	void ODBCDatabase::ReleaseODBCConnection(MetaDatabasePtr pMDB, ODBCDatabase::ODBCConnectionPtr & pODBCConnection)
+	bool ODBCDatabase::ValidateODBCConnection(MetaDatabasePtr pMDB, ODBCDatabase::ODBCConnectionPtr pCon)
 	{
-		boost::recursive_mutex::scoped_lock		lk(M_Mutex);
+		try
+		{
+			std::auto_ptr<odbc::Statement>	pStmnt(pCon->createStatement());
+			std::auto_ptr<odbc::ResultSet>	pRslts(pStmnt->executeQuery(pMDB->GetTargetRDBMS() == Oracle ? "SELECT 1 FROM DUAL" : "SELECT 1"));
+
+			pRslts->next();
+		}
+		catch (odbc::SQLException&)
+		{
+			return false;
+		}
+
+		return true;
+	}
+
 
-		ODBCConnectionPtrListMapItr	itr;
 
-		itr = M_mapODBCConnectionPtrLists.find(pMDB);
 
-		if (itr == M_mapODBCConnectionPtrLists.end())
+
+	/* static */
+	void ODBCDatabase::WarmUpConnection(MetaDatabasePtr pMDB)
+	{
+		ConnectionPoolPtr		pPool;
+		ODBCConnectionPtr		pCon = NULL;
+
+
 		{
-			M_mapODBCConnectionPtrLists[pMDB] = ODBCConnectionPtrList();
-			itr = M_mapODBCConnectionPtrLists.find(pMDB);
+			boost::mutex::scoped_lock		lk(M_mtxConnectionPools);
+
+			pPool = GetConnectionPool(pMDB);
+			pPool->stats.uInUse++;
+			pPool->uOpening++;
 		}
 
-		if (itr->second.size() < ODBC_DATABASE_MAX_POOLSIZE)
+		try
 		{
-			M_mapODBCConnectionPtrLists[pMDB].push_back(pODBCConnection);
+			pCon = OpenODBCConnection(pMDB);
 		}
-		else
+		catch (...)
 		{
-			delete pODBCConnection;
+			ReportWarning("ODBCDatabase::WarmUpConnection(): Failed to open a connection to database %s. %s", pMDB->GetAlias().c_str(), ShortGenericExceptionHandler().c_str());
+		}
+
+		{
+			boost::mutex::scoped_lock		lk(M_mtxConnectionPools);
+
+			pPool->stats.uInUse--;
+			pPool->uOpening--;
+
+			if (pPool->bAbandoned)
+			{
+				// DeleteConnectionPools() was called meanwhile, the last request out deletes the pool
+				if (pPool->IsUnreferenced())
+					delete pPool;
+			}
+			else
+			{
+				if (pCon)
+				{
+					pPool->listIdle.push_back(IdleConnection(pCon, boost::get_system_time()));
+					pPool->stats.lCreated++;
+					pCon = NULL;
+				}
+
+				pPool->condAvailable.notify_all();
+			}
+		}
+
+		if (pCon)
+			CloseODBCConnection(pCon);
+	}
+
+
+
+
+
+	/* static */
+	void ODBCDatabase::ConfigureConnectionPool(MetaDatabasePtr pMDB, const ConnectionPoolSettings & settings)
+	{
+		boost::thread_group		threads;
+		unsigned int					uOpen, idx;
+
+
+		if (settings.uMaxSize && settings.uMinSize > settings.uMaxSize)
+			throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::ConfigureConnectionPool(): The minimum size %u exceeds the maximum size %u of the connection pool for database %s.", settings.uMinSize, settings.uMaxSize, pMDB->GetAlias().c_str());
+
+		{
+			boost::mutex::scoped_lock		lk(M_mtxConnectionPools);
+
+			ConnectionPoolPtr		pPool = GetConnectionPool(pMDB);
+
+			pPool->settings = settings;
+			uOpen = pPool->stats.uInUse + pPool->listIdle.size();
+
+			// A larger uMaxSize may let waiters proceed
+			pPool->condAvailable.notify_all();
+		}
+
+		// Open the missing connections concurrently
+		for (idx = uOpen; idx < settings.uMinSize; idx++)
+			threads.create_thread(boost::bind(&ODBCDatabase::WarmUpConnection, pMDB));
+
+		threads.join_all();
+
+		ConnectionPoolStatistics		stats = GetConnectionPoolStatistics(pMDB);
+
+		ReportInfo("ODBCDatabase::ConfigureConnectionPool(): Connection pool for database %s configured (min %u, max %u, %u connections open).", pMDB->GetAlias().c_str(), settings.uMinSize, settings.uMaxSize, stats.uIdle + stats.uInUse);
+	}
+
+
+
+
+
+	/* static */
+	ODBCDatabase::ConnectionPoolSettings ODBCDatabase::GetConnectionPoolSettings(MetaDatabasePtr pMDB)
+	{
+		boost::mutex::scoped_lock		lk(M_mtxConnectionPools);
+
+		return GetConnectionPool(pMDB)->settings;
+	}
+
+
+
+
+
+	/* static */
+	ODBCDatabase::ConnectionPoolStatistics ODBCDatabase::GetConnectionPoolStatistics(MetaDatabasePtr pMDB)
+	{
+		boost::mutex::scoped_lock		lk(M_mtxConnectionPools);
+
+		ConnectionPoolPtr						pPool = GetConnectionPool(pMDB);
+		ConnectionPoolStatistics		stats = pPool->stats;
+
+		stats.uIdle = pPool->listIdle.size();
+		stats.uWaiting = pPool->listWaiting.size();
+
+		return stats;
+	}
+
+
+
+
+
+	/* static */
+	void ODBCDatabase::TrimConnectionPools()
+	{
+		ODBCConnectionPtrList				listExpired;
+		ODBCConnectionPtrListItr		itr;
+		boost::posix_time::ptime		tNow = boost::get_system_time();
+
+
+		{
+			boost::mutex::scoped_lock		lk(M_mtxConnectionPools);
+
+			ConnectionPoolPtrMapItr			itrPool;
+
+			for (itrPool = M_mapConnectionPools.begin(); itrPool != M_mapConnectionPools.end(); itrPool++)
+				CollectExpiredConnections(itrPool->second, tNow, listExpired);
 		}
 
-		pODBCConnection = NULL;
+		for (itr = listExpired.begin(); itr != listExpired.end(); itr++)
+			CloseODBCConnection(*itr);
 	}
 
 
@@ -1163,25 +1558,46 @@ namespace D3
 	/* static */
 	void ODBCDatabase::DeleteConnectionPools()
 	{
-		boost::recursive_mutex::scoped_lock		lk(M_Mutex);
+		ODBCConnectionPtrList					listIdle;
+		ODBCConnectionPtrListItr			itrIdle;
 
-		ODBCConnectionPtrListMapItr		itrODBC;
-		NativeConnectionPtrListMapItr	itrNative;
-
-		// Discard all queued ODBCConnections
-		while (!M_mapODBCConnectionPtrLists.empty())
+		// Discard all pooled ODBCConnections (connections still in use are closed when they are released)
 		{
-			itrODBC = M_mapODBCConnectionPtrLists.begin();
+			boost::mutex::scoped_lock		lkPools(M_mtxConnectionPools);
 
-			while (!itrODBC->second.empty())
+			ConnectionPoolPtrMapItr			itrPool;
+
+			for (itrPool = M_mapConnectionPools.begin(); itrPool != M_mapConnectionPools.end(); itrPool++)
 			{
-				delete itrODBC->second.front();
-				itrODBC->second.pop_front();
+				while (!itrPool->second->listIdle.empty())
+				{
+					listIdle.push_back(itrPool->second->listIdle.front().pCon);
+					itrPool->second->listIdle.pop_front();
+				}
+
+				// Requests still referencing the pool delete it when they're done
+				if (itrPool->second->IsUnreferenced())
+				{
+					delete itrPool->second;
+				}
+				else
+				{
+					itrPool->second->bAbandoned = true;
+					itrPool->second->condAvailable.notify_all();
+				}
 			}
 
-			M_mapODBCConnectionPtrLists.erase(M_mapODBCConnectionPtrLists.begin());
+			M_mapConnectionPools.clear();
+			M_mapConnectionsInUse.clear();
 		}
 
+		for (itrIdle = listIdle.begin(); itrIdle != listIdle.end(); itrIdle++)
+			CloseODBCConnection(*itrIdle);
+
+		boost::recursive_mutex::scoped_lock		lk(M_Mutex);
+
+		NativeConnectionPtrListMapItr	itrNative;
+
 		// Discard all queued NativeConnections
 		while (!M_mapNativeConnectionPtrLists.empty())
 		{
@@ -1217,14 +1633,130 @@ namespace D3
 
 
 
-	ODBCDatabase::ODBCDatabase()
-	 : m_pConnection(NULL), m_bIsConnected(false), m_uConnectionBusyCount(0)
+	// Closes an ODBC connection handed out by CreateODBCConnection() and frees its slot in the pool
+	/* static */
+	void ODBCDatabase::DeleteODBCConnection(ODBCDatabase::ODBCConnectionPtr & pODBCConnection)
 	{
+		if (!pODBCConnection)
+			return;
+
+		{
+			boost::mutex::scoped_lock		lk(M_mtxConnectionPools);
+
+			ConnectionPoolPtrByConnectionMapItr		itrInUse = M_mapConnectionsInUse.find(pODBCConnection);
+
+			if (itrInUse != M_mapConnectionsInUse.end())
+			{
+				itrInUse->second->stats.uInUse--;
+				itrInUse->second->stats.lClosed++;
+				itrInUse->second->condAvailable.notify_all();
+				M_mapConnectionsInUse.erase(itrInUse);
+			}
+		}
+
+		CloseODBCConnection(pODBCConnection);
 	}
 
 
 
-	ODBCDatabase::~ODBCDatabase ()
+
+
+	// Deletes an ODBC connection along with all statements prepared on it
+	/* static */
+	void ODBCDatabase::CloseODBCConnection(ODBCDatabase::ODBCConnectionPtr & pODBCConnection)
+	{
+		if (pODBCConnection)
+		{
+			DeleteStatementCache(pODBCConnection);
+			delete pODBCConnection;
+			pODBCConnection = NULL;
+		}
+	}
+
+
+
+
+
+	/* static */
+	void ODBCDatabase::DeleteStatementCache(ODBCDatabase::ODBCConnectionPtr pODBCConnection)
+	{
+		boost::recursive_mutex::scoped_lock		lk(M_Mutex);
+
+		StatementCacheMapItr		itrCache;
+		StatementCacheItr				itrStmnt;
+
+		itrCache = M_mapStatementCaches.find(pODBCConnection);
+
+		if (itrCache == M_mapStatementCaches.end())
+			return;
+
+		for ( itrStmnt =  itrCache->second.begin();
+					itrStmnt != itrCache->second.end();
+					itrStmnt++)
+		{
+			try
+			{
+				delete itrStmnt->second.pStmnt;
+			}
+			catch (...)
+			{
+				// The connection might be broken already, which is fine as we're discarding it anyhow
+			}
+		}
+
+		M_mapStatementCaches.erase(itrCache);
+	}
+
+
+
+
+
+	bool ODBCDatabase::StatementKey::operator<(const ODBCDatabase::StatementKey & key) const
+	{
+		if (pMeta != key.pMeta)						return pMeta < key.pMeta;
+		if (eType != key.eType)						return eType < key.eType;
+		if (bLazyFetch != key.bLazyFetch)	return bLazyFetch < key.bLazyFetch;
+		if (uNulls != key.uNulls)					return uNulls < key.uNulls;
+		if (uRows != key.uRows)						return uRows < key.uRows;
+		if (uColumns[0] != key.uColumns[0])	return uColumns[0] < key.uColumns[0];
+		return uColumns[1] < key.uColumns[1];
+	}
+
+
+
+
+
+	ODBCDatabase::ParameterStreams::~ParameterStreams()
+	{
+		while (!m_listStreams.empty())
+		{
+			delete m_listStreams.front();
+			m_listStreams.pop_front();
+		}
+	}
+
+
+
+
+
+	std::stringstream* ODBCDatabase::ParameterStreams::Create()
+	{
+		m_listStreams.push_back(new std::stringstream(std::ios_base::in | std::ios_base::out));
+		return m_listStreams.back();
+	}
+
+
+
+
+
+	ODBCDatabase::ODBCDatabase()
+	 : m_pConnection(NULL), m_bIsConnected(false), m_uConnectionBusyCount(0)
+	{
+	}
+
+
+
+	ODBCDatabase::~ODBCDatabase ()
 	{
 		try
 		{
@@ -1288,10 +1820,7 @@ namespace D3
 			{
 				// If we have a connection object, we try and recover from the previous error
 				if (m_pConnection)
-				{
-					delete m_pConnection;
-					m_pConnection = NULL;
-				}
+					DeleteODBCConnection(m_pConnection);
 
 				m_pConnection = CreateODBCConnection(m_pMetaDatabase);
 
@@ -1313,15 +1842,13 @@ namespace D3
 			catch(odbc::SQLException& e)
 			{
 				// Translate exception to D3::Exception
-				delete m_pConnection;
-				m_pConnection = NULL;
+				DeleteODBCConnection(m_pConnection);
 				throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::Connect(): An odbc++ error occurred connecting to %s. %s", m_pMetaDatabase->GetName().c_str(), e.getMessage().c_str());
 			}
 			catch(...)
 			{
 				// Translate exception to D3::Exception
-				delete m_pConnection;
-				m_pConnection = NULL;
+				DeleteODBCConnection(m_pConnection);
 				throw;
 			}
 		}
@@ -1355,8 +1882,7 @@ namespace D3
 				}
 				else
 				{
-					delete m_pConnection;
-					m_pConnection = NULL;
+					DeleteODBCConnection(m_pConnection);
 				}
 			}
 			catch (odbc::SQLException& e)
@@ -1612,6 +2138,14 @@ namespace D3
 
 
 
+	// The number of value sets of pMK's columns AppendKeyListPredicate() is asked to match per statement
+	static inline unsigned int GetKeyListBatchRows(MetaKeyPtr pMK)
+	{
+		return std::max(1, std::min(ODBC_DATABASE_MAX_RELATION_BATCH, (int) (ODBC_DATABASE_MAX_BATCH_PARAMETERS / (pMK->GetMetaColumns()->size() + 1))));
+	}
+
+
+
 	ColumnPtr ODBCDatabase::LoadColumn(ColumnPtr pColumn)
 	{
 		ConnectionManager		conMgr(this);
@@ -1621,7 +2155,7 @@ namespace D3
 		std::string							strSQL;
 		EntityPtrList						listEntity;
 		bool										bFirst, bResult;
-		ColumnPtrListItr				itrKeyCol;
+		KeyColumnArrayItr				itrKeyCol;
 		ColumnPtr								pCol;
 		KeyPtr									pKey;
 
@@ -1672,129 +2206,7 @@ namespace D3
 			{
 				while (!pRslts->isAfterLast())
 				{
-					bResult = false;
-
-					switch (pColumn->GetMetaColumn()->GetType())
-					{
-						case MetaColumn::dbfString:
-							bResult = pColumn->SetValue(pRslts->getString(1));
-							break;
-
-						case MetaColumn::dbfChar:
-							bResult = pColumn->SetValue((char) pRslts->getByte(1));
-							break;
-
-						case MetaColumn::dbfShort:
-							bResult = pColumn->SetValue((short) pRslts->getShort(1));
-							break;
-
-						case MetaColumn::dbfBool:
-							bResult = pColumn->SetValue((bool) pRslts->getBoolean(1));
-							break;
-
-						case MetaColumn::dbfInt:
-							bResult = pColumn->SetValue((int) pRslts->getInt(1));
-							break;
-
-						case MetaColumn::dbfLong:
-							bResult = pColumn->SetValue((long) pRslts->getLong(1));
-							break;
-
-						case MetaColumn::dbfFloat:
-							bResult = pColumn->SetValue((float) pRslts->getFloat(1));
-							break;
-
-						case MetaColumn::dbfDate:
-						{
-							odbc::Timestamp		odbcTimestamp;
-
-							odbcTimestamp = pRslts->getTimestamp(1);
-
-							if (!pRslts->wasNull())
-							{
-  							try
-  							{
-									D3Date		dt(odbcTimestamp, m_pMetaDatabase->GetTimeZone());
-									dt.AdjustToTimeZone(D3TimeZone::GetLocalServerTimeZone());
-    							bResult = pColumn->SetValue(dt);
-    						}
-         				catch (...)
-			       		{
-									bResult = false;
-									throw;
-  							}
-							}
-
-							break;
-						}
-						case MetaColumn::dbfBlob:
-						{
-							try
-							{
-								std::istream*			pStrm = pRslts->getBinaryStream(1);
-
-								if (!pRslts->wasNull())
-								{
-  								try
-  								{
-										((ColumnBlobPtr) pColumn)->FromStream(*pStrm);
-    								bResult = true;
-    							}
-         					catch (...)
-			       			{
-										bResult = false;
-										throw;
-  								}
-								}
-  						}
-							catch (...)
-							{
-								bResult = false;
-								throw;
-							}
-							break;
-						}
-						case MetaColumn::dbfBinary:
-						{
-							try
-							{
-								odbc::Bytes		bytes = pRslts->getBytes(1);
-
-								if (!pRslts->wasNull())
-								{
-  								try
-  								{
-										((ColumnBinaryPtr) pColumn)->SetValue((const unsigned char*) bytes.getData(), bytes.getSize());
-    								bResult = true;
-    							}
-         					catch (...)
-			       			{
-										bResult = false;
-										throw;
-  								}
-								}
-  						}
-							catch (...)
-							{
-								bResult = false;
-								throw;
-							}
-							break;
-						}
-					}
-
-					// Deal with errors and nulls
-					if (!bResult)
-					{
-						pColumn->MarkUnfetched();
-					}
-					else
-					{
-						pColumn->MarkFetched();
-
-						if (pRslts->wasNull())
-							pColumn->SetNull();
-					}
+					bResult = FetchColumnValue(pColumn, pRslts.get(), 1);
 
 					assert(!pRslts->next()); // this loop must only be traversed once!
 					break;
@@ -1813,250 +2225,385 @@ namespace D3
 
 
 
-	EntityPtr ODBCDatabase::LoadObject(KeyPtr pKey, bool bRefresh, bool bLazyFetch)
+	long ODBCDatabase::LoadColumns(MetaColumnPtr pMC, EntityPtrList & listEntity)
 	{
-		InstanceKeyPtr		pIK;
-
+		EntityPtrList					listPending;
+		EntityPtrListItr			itrEntity, itrFirst;
+		EntityPtr							pEntity;
+		ColumnPtr							pCol;
+		unsigned int					uMaxRows, uRows;
+		long									lCount = 0;
 
-		// The key must exist and be unique
-		//
-		if (!pKey || !pKey->GetMetaKey()->IsUnique())
-			return NULL;
 
-		// Real simple if this is an instance key and no refresh required
-		//
-		if (!bRefresh && pKey->IsKindOf(InstanceKey::ClassObject()))
-			return pKey->GetEntity();
+		assert(pMC);
+		assert(pMC->GetMetaEntity()->GetMetaDatabase() == this->GetMetaDatabase());
 
-		// Search the cache first
+		// Only columns which haven't been fetched yet are of interest
 		//
-		if (!bRefresh && (pIK = pKey->GetMetaKey()->FindInstanceKey(pKey, this)) != NULL)
+		for ( itrEntity =  listEntity.begin();
+					itrEntity != listEntity.end();
+					itrEntity++)
 		{
-			return pIK->GetEntity();
-		}
-		else
-		{
-			std::string							strSQL;
-			EntityPtrList						listEntity;
-			bool										bFirst;
-			ColumnPtrListItr				itrKeyCol;
-			ColumnPtr								pCol;
+			pEntity = *itrEntity;
 
+			if (!pEntity || pEntity->GetMetaEntity() != pMC->GetMetaEntity() || pEntity->GetDatabase() != this || pEntity->IsNew())
+				continue;
 
-			// Build SQL
-			//
-			strSQL  = "SELECT ";
-			strSQL += pKey->GetMetaKey()->GetMetaEntity()->AsSQLSelectList(bLazyFetch);
-			strSQL += " FROM ";
-			strSQL += pKey->GetMetaKey()->GetMetaEntity()->GetName();
+			pCol = pEntity->GetColumn(pMC);
 
-			switch (GetMetaDatabase()->GetTargetRDBMS())
-			{
-				case SQLServer:
-					strSQL += " WITH(NOLOCK) WHERE ";
-					break;
+			if (pCol && !pCol->IsFetched())
+				listPending.push_back(pEntity);
+		}
 
-				case Oracle:
-					strSQL += " WHERE ";
-					break;
-			}
+		if (listPending.empty())
+			return 0;
 
-			bFirst = true;
+		uMaxRows = GetKeyListBatchRows(pMC->GetMetaEntity()->GetPrimaryMetaKey());
 
-			for ( itrKeyCol =  pKey->GetColumns().begin();
-						itrKeyCol != pKey->GetColumns().end();
-						itrKeyCol++)
+		try
+		{
+			for (itrEntity = listPending.begin(); itrEntity != listPending.end();)
 			{
-				pCol = *itrKeyCol;
+				for (itrFirst = itrEntity, uRows = 0; itrEntity != listPending.end() && uRows < uMaxRows; itrEntity++, uRows++);
 
-				if (!bFirst)
-					strSQL += " AND ";
-				else
-					bFirst =  false;
-
-				strSQL += pCol->GetMetaColumn()->GetName();
-				strSQL += "=";
-				strSQL += pCol->AsSQLString();
+				LoadColumnBatch(pMC, itrFirst, uRows);
 			}
-
-			assert(!bFirst); // we must have at least one argument in the WHERE predicate
-
-			LoadObjects(pKey->GetMetaKey()->GetMetaEntity(), &listEntity, strSQL, bRefresh, bLazyFetch);
-
-			assert(listEntity.size() < 2);
-
-			if (listEntity.size() == 1)
-				return listEntity.front();
+		}
+		catch (Exception & e)
+		{
+			e.LogError();
+			return -1;
 		}
 
+		for ( itrEntity =  listPending.begin();
+					itrEntity != listPending.end();
+					itrEntity++)
+		{
+			if ((*itrEntity)->GetColumn(pMC)->IsFetched())
+				lCount++;
+		}
 
-		return NULL;
+		return lCount;
 	}
 
 
 
-	long ODBCDatabase::LoadObjects(RelationPtr pRelation, bool bRefresh, bool bLazyFetch)
+	void ODBCDatabase::LoadColumnBatch(MetaColumnPtr pMC, EntityPtrListItr itrFirst, unsigned int uRows)
 	{
-		MetaRelationPtr					pMR;
-		MetaKeyPtr							pMetaKey;
-		KeyPtr									pKey;
-		ColumnPtrListItr				itrSrceColumn;
-		MetaColumnPtrListItr		itrTrgtColumn;
-		ColumnPtr								pSrce;
-		MetaColumnPtr						pTrgt;
-		std::string							strSQL;
-		std::string							strWHERE;
-		EntityPtrList						listEntity;
+		ConnectionManager												conMgr(this);
+
+		MetaEntityPtr														pMetaEntity = pMC->GetMetaEntity();
+		MetaColumnPtrListPtr										pListKey = pMetaEntity->GetPrimaryMetaKey()->GetMetaColumns();
+		StatementKey														key(StatementKey::SelectColumn, pMC);
+		ODBCConnectionPtr												pCon = NULL;
+		CachedStatement													uncached;
+		CachedStatement*												pCS = NULL;
+		std::auto_ptr<odbc::PreparedStatement>	pUncached;
+		std::auto_ptr<odbc::ResultSet>					pRslts;
+		ParameterStreams												streams;
+		EntityPtrListItr												itrEntity;
+		KeyColumnArrayItr												itrSrceColumn;
+		MetaColumnPtrListItr										itrKeyColumn;
+		EntityPtr																pEntity;
+		ColumnPtr																pCol;
+		unsigned int														idxRow;
+		int																			iParam = 0;
 
 
-		pMetaKey	= pRelation->GetMetaRelation()->GetChildMetaKey();
-		pKey			= pRelation->GetParentKey();
+		// Only full batches are likely to recur
+		key.uRows				= uRows;
+		key.bCacheable	= uRows == GetKeyListBatchRows(pMetaEntity->GetPrimaryMetaKey());
 
-		assert(pMetaKey);;
-		assert(pKey);
-		assert(m_pMetaDatabase == pMetaKey->GetMetaEntity()->GetMetaDatabase());
+		try
+		{
+			Reconnect();
 
-		// Build SQL
-		//
-		strSQL  = "SELECT ";
-		strSQL += pMetaKey->GetMetaEntity()->AsSQLSelectList(bLazyFetch);
-		strSQL += " FROM ";
-		strSQL += pMetaKey->GetMetaEntity()->GetName();
+			pCon	= conMgr.connection();
+			pCS		= FindCachedStatement(pCon, key);
 
-		switch (GetMetaDatabase()->GetTargetRDBMS())
-		{
-			case SQLServer:
-				strSQL += " WITH(NOLOCK) WHERE ";
-				break;
+			if (!pCS)
+			{
+				std::string			strSQL;
 
-			case Oracle:
-				strSQL += " WHERE ";
-				break;
-		}
+				// Build SQL (the primary key columns identify the entity each row belongs to)
+				//
+				strSQL  = "SELECT ";
 
-		// Build the SQL where clause
-		//
-		for ( itrTrgtColumn =  pMetaKey->GetMetaColumns()->begin(),			itrSrceColumn =  pKey->GetColumns().begin();
-					itrTrgtColumn != pMetaKey->GetMetaColumns()->end()    &&	itrSrceColumn != pKey->GetColumns().end();
-					itrTrgtColumn++,																					itrSrceColumn++)
-		{
-			pTrgt = *itrTrgtColumn;
-			pSrce = *itrSrceColumn;
+				for ( itrKeyColumn =  pListKey->begin();
+							itrKeyColumn != pListKey->end();
+							itrKeyColumn++)
+				{
+					strSQL += (*itrKeyColumn)->GetName();
+					strSQL += ", ";
+				}
 
-			if (!strWHERE.empty())
-				strWHERE += " AND ";
+				strSQL += pMC->GetName();
+				strSQL += " FROM ";
+				strSQL += pMetaEntity->GetName();
+				strSQL += " WHERE ";
 
-			strWHERE += pTrgt->GetName();
+				AppendKeyListPredicate(strSQL, pListKey, uRows);
 
-			if (pSrce->IsNull())
-			{
-				strWHERE += " IS NULL";
+				pCS = PrepareStatement(pCon, key, strSQL, odbc::ResultSet::TYPE_FORWARD_ONLY, uncached);
+
+				if (pCS == &uncached)
+					pUncached.reset(uncached.pStmnt);
 			}
-			else
+
+			// Bind the values
+			//
+			for ( idxRow = 0,	itrEntity = itrFirst;
+						idxRow < uRows;
+						idxRow++,	itrEntity++)
 			{
-				strWHERE += " = ";
-				strWHERE += pSrce->AsSQLString();
+				for ( itrSrceColumn =  (*itrEntity)->GetPrimaryKey()->GetColumns().begin();
+							itrSrceColumn != (*itrEntity)->GetPrimaryKey()->GetColumns().end();
+							itrSrceColumn++)
+				{
+					BindParameter(pCS->pStmnt, ++iParam, *itrSrceColumn, streams);
+				}
 			}
-		}
 
-		if (strWHERE.empty())
-			return -1;
+			if (m_uTrace & D3DB_TRACE_SELECT)
+				ReportInfo("ODBCDatabase::LoadColumnBatch().............................: Database " PRINTF_POINTER_MASK ". %u entities. SQL: %s", this, uRows, pCS->strSQL.c_str());
 
-		strSQL += strWHERE;
+			pCS->pStmnt->setFetchSize(LIBODBC_FETCH_SIZE);
+			pRslts.reset(pCS->pStmnt->executeQuery());
 
-		// Special attention for switched relations
-		//
-		pMR = pRelation->GetMetaRelation();
+			while (pRslts->next())
+			{
+				pEntity = FindEntity(pMetaEntity, pRslts.get());
 
-		if (pMR->IsChildSwitch() && pMR->GetSwitchColumn())
-		{
-			strSQL += " AND ";
-			strSQL += pMR->GetSwitchColumn()->GetMetaColumn()->GetName();
-			strSQL += " = ";
-			strSQL += pMR->GetSwitchColumn()->AsSQLString();
-		}
+				if (!pEntity)
+					continue;
 
-		try
-		{
-			LoadObjects(pMetaKey->GetMetaEntity(), &listEntity, strSQL, bRefresh, bLazyFetch);
+				pCol = pEntity->GetColumn(pMC);
+
+				if (!pCol->IsFetched())
+					FetchColumnValue(pCol, pRslts.get(), pListKey->size() + 1);
+			}
 		}
-		catch (Exception & e)
+		catch(odbc::SQLException& e)
 		{
-			e.LogError();
-			return -1;
-		}
+			pRslts.reset();
+			CheckConnection(e);
 
-		return listEntity.size();
+			if (pCS && pCS != &uncached)
+				DiscardCachedStatement(pCon, key);
+
+			throw;
+		}
 	}
 
 
 
-	long ODBCDatabase::LoadObjects(MetaKeyPtr pMetaKey, KeyPtr pKey, bool bRefresh, bool bLazyFetch)
+	bool ODBCDatabase::FetchColumnValue(ColumnPtr pColumn, odbc::ResultSet* pRslts, int iIdx)
 	{
-		ColumnPtrListItr				itrSrceColumn;
-		MetaColumnPtrListItr		itrTrgtColumn;
-		ColumnPtr								pSrce;
-		MetaColumnPtr						pTrgt;
-		std::string							strSQL;
-		std::string							strWHERE;
-		EntityPtrList						listEntity;
+		bool			bResult = false;
 
 
-		assert(pMetaKey);;
-		assert(pKey);
-		assert(m_pMetaDatabase == pMetaKey->GetMetaEntity()->GetMetaDatabase());
+		switch (pColumn->GetMetaColumn()->GetType())
+		{
+			case MetaColumn::dbfString:
+				bResult = pColumn->SetValue(pRslts->getString(iIdx));
+				break;
 
-		// Build SQL
-		//
-		strSQL  = "SELECT ";
-		strSQL += pMetaKey->GetMetaEntity()->AsSQLSelectList(bLazyFetch);
-		strSQL += " FROM ";
-		strSQL += pMetaKey->GetMetaEntity()->GetName();
+			case MetaColumn::dbfChar:
+				bResult = pColumn->SetValue((char) pRslts->getByte(iIdx));
+				break;
 
- 		switch (GetMetaDatabase()->GetTargetRDBMS())
-		{
-			case SQLServer:
-				strSQL += " WITH(NOLOCK) WHERE ";
+			case MetaColumn::dbfShort:
+				bResult = pColumn->SetValue((short) pRslts->getShort(iIdx));
 				break;
 
-			case Oracle:
-				strSQL += " WHERE ";
+			case MetaColumn::dbfBool:
+				bResult = pColumn->SetValue((bool) pRslts->getBoolean(iIdx));
 				break;
-		}
 
-		// Build the SQL where clause
-		//
-		for ( itrTrgtColumn =  pMetaKey->GetMetaColumns()->begin(),			itrSrceColumn =  pKey->GetColumns().begin();
-					itrTrgtColumn != pMetaKey->GetMetaColumns()->end()    &&	itrSrceColumn != pKey->GetColumns().end();
-					itrTrgtColumn++,																					itrSrceColumn++)
-		{
-			pTrgt = *itrTrgtColumn;
-			pSrce = *itrSrceColumn;
+			case MetaColumn::dbfInt:
+				bResult = pColumn->SetValue((int) pRslts->getInt(iIdx));
+				break;
 
-			if (!strWHERE.empty())
-				strWHERE += " AND ";
+			case MetaColumn::dbfLong:
+				bResult = pColumn->SetValue((long) pRslts->getLong(iIdx));
+				break;
 
-			strWHERE += pTrgt->GetName();
+			case MetaColumn::dbfFloat:
+				bResult = pColumn->SetValue((float) pRslts->getFloat(iIdx));
+				break;
 
-			if (pSrce->IsNull())
+			case MetaColumn::dbfDate:
 			{
-				strWHERE += " IS NULL";
+				odbc::Timestamp		odbcTimestamp;
+
+				odbcTimestamp = pRslts->getTimestamp(iIdx);
+
+				if (!pRslts->wasNull())
+				{
+  				try
+  				{
+						D3Date		dt(odbcTimestamp, m_pMetaDatabase->GetTimeZone());
+						dt.AdjustToTimeZone(D3TimeZone::GetLocalServerTimeZone());
+    				bResult = pColumn->SetValue(dt);
+    			}
+         	catch (...)
+       		{
+						bResult = false;
+						throw;
+  				}
+				}
+
+				break;
 			}
-			else
+			case MetaColumn::dbfBlob:
+			{
+				try
+				{
+					std::istream*			pStrm = pRslts->getBinaryStream(iIdx);
+
+					if (!pRslts->wasNull())
+					{
+  					try
+  					{
+							((ColumnBlobPtr) pColumn)->FromStream(*pStrm);
+    					bResult = true;
+    				}
+         		catch (...)
+       			{
+							bResult = false;
+							throw;
+  					}
+					}
+  			}
+				catch (...)
+				{
+					bResult = false;
+					throw;
+				}
+				break;
+			}
+			case MetaColumn::dbfBinary:
 			{
-				strWHERE += " = ";
-				strWHERE += pSrce->AsSQLString();
+				try
+				{
+					odbc::Bytes		bytes = pRslts->getBytes(iIdx);
+
+					if (!pRslts->wasNull())
+					{
+  					try
+  					{
+							((ColumnBinaryPtr) pColumn)->SetValue((const unsigned char*) bytes.getData(), bytes.getSize());
+    					bResult = true;
+    				}
+         		catch (...)
+       			{
+							bResult = false;
+							throw;
+  					}
+					}
+  			}
+				catch (...)
+				{
+					bResult = false;
+					throw;
+				}
+				break;
 			}
 		}
 
-		if (strWHERE.empty())
+		// Deal with errors and nulls
+		if (!bResult)
+		{
+			pColumn->MarkUnfetched();
+		}
+		else
+		{
+			pColumn->MarkFetched();
+
+			if (pRslts->wasNull())
+				pColumn->SetNull();
+		}
+
+		return bResult;
+	}
+
+
+
+
+	EntityPtr ODBCDatabase::LoadObject(KeyPtr pKey, bool bRefresh, bool bLazyFetch)
+	{
+		InstanceKeyPtr		pIK;
+
+
+		// The key must exist and be unique
+		//
+		if (!pKey || !pKey->GetMetaKey()->IsUnique())
+			return NULL;
+
+		// Real simple if this is an instance key and no refresh required
+		//
+		if (!bRefresh && pKey->IsKindOf(InstanceKey::ClassObject()))
+			return pKey->GetEntity();
+
+		// Search the cache first
+		//
+		if (!bRefresh && (pIK = pKey->GetMetaKey()->FindInstanceKey(pKey, this)) != NULL)
+		{
+			return pIK->GetEntity();
+		}
+		else
+		{
+			MetaKeyPtr							pMetaKey = pKey->GetMetaKey();
+			StatementKey						key(StatementKey::SelectByKey, pMetaKey, bLazyFetch);
+			EntityPtrList						listEntity;
+
+
+			assert(!pKey->GetColumns().empty()); // we must have at least one argument in the WHERE predicate
+
+			LoadObjectsByKey(key, pMetaKey->GetMetaEntity(), pMetaKey->GetMetaColumns(), pKey->GetColumns(), NULL, listEntity, bRefresh, bLazyFetch);
+
+			assert(listEntity.size() < 2);
+
+			if (listEntity.size() == 1)
+				return listEntity.front();
+		}
+
+
+		return NULL;
+	}
+
+
+
+	long ODBCDatabase::LoadObjects(RelationPtr pRelation, bool bRefresh, bool bLazyFetch)
+	{
+		MetaRelationPtr					pMR;
+		MetaKeyPtr							pMetaKey;
+		KeyPtr									pKey;
+		ColumnPtr								pSwitch = NULL;
+		EntityPtrList						listEntity;
+
+
+		pMR				= pRelation->GetMetaRelation();
+		pMetaKey	= pMR->GetChildMetaKey();
+		pKey			= pRelation->GetParentKey();
+
+		assert(pMetaKey);;
+		assert(pKey);
+		assert(m_pMetaDatabase == pMetaKey->GetMetaEntity()->GetMetaDatabase());
+
+		if (pKey->GetColumns().empty() || pMetaKey->GetMetaColumns()->empty())
 			return -1;
 
-		strSQL += strWHERE;
+		// Special attention for switched relations
+		//
+		if (pMR->IsChildSwitch() && pMR->GetSwitchColumn())
+			pSwitch = pMR->GetSwitchColumn();
 
 		try
 		{
-			LoadObjects(pMetaKey->GetMetaEntity(), &listEntity, strSQL, bRefresh, bLazyFetch);
+			StatementKey					key(StatementKey::SelectByRelation, pMR, bLazyFetch);
+
+			LoadObjectsByKey(key, pMetaKey->GetMetaEntity(), pMetaKey->GetMetaColumns(), pKey->GetColumns(), pSwitch, listEntity, bRefresh, bLazyFetch);
 		}
 		catch (Exception & e)
 		{
@@ -2069,360 +2616,2094 @@ namespace D3
 
 
 
-	long ODBCDatabase::LoadObjects(MetaEntityPtr pME, bool bRefresh, bool bLazyFetch)
+	long ODBCDatabase::LoadObjects(RelationPtrList & listRelation, bool bRefresh, bool bLazyFetch)
 	{
-		std::string							strSQL;
-		EntityPtrList						listEntity;
+		typedef std::map<MetaRelationPtr, RelationPtrList>		MetaRelationRelationsMap;
 
+		MetaRelationRelationsMap						mapMRRelations;
+		MetaRelationRelationsMap::iterator	itrMRRelations;
+		RelationPtrListItr									itrRelation, itrFirst;
+		RelationPtr													pRelation;
+		KeyColumnArrayItr										itrSrceColumn;
+		EntityPtrList												listEntity;
+		unsigned int												uMaxRows, uRows;
+		long																lCount = 0;
 
-		// Build SQL
-		//
-		strSQL = "SELECT ";
-		strSQL += pME->AsSQLSelectList(bLazyFetch);
-		strSQL += " FROM ";
-		strSQL += pME->GetName();
 
-		switch (GetMetaDatabase()->GetTargetRDBMS())
+		// Group relations by MetaRelation. Relations with partially NULL parent keys
+		// need IS NULL predicates and go through the single relation path.
+		//
+		for ( itrRelation =  listRelation.begin();
+					itrRelation != listRelation.end();
+					itrRelation++)
 		{
-			case SQLServer:
-				strSQL += " WITH(NOLOCK)";
-				break;
+			pRelation = *itrRelation;
 
-			case Oracle:
-				break;
+			if (!pRelation || !pRelation->GetParentKey() || pRelation->GetParentKey()->IsNull())
+				continue;
+
+			assert(m_pMetaDatabase == pRelation->GetMetaRelation()->GetChildMetaKey()->GetMetaEntity()->GetMetaDatabase());
+
+			for ( itrSrceColumn =  pRelation->GetParentKey()->GetColumns().begin();
+						itrSrceColumn != pRelation->GetParentKey()->GetColumns().end() && !(*itrSrceColumn)->IsNull();
+						itrSrceColumn++);
+
+			if (itrSrceColumn == pRelation->GetParentKey()->GetColumns().end())
+			{
+				mapMRRelations[pRelation->GetMetaRelation()].push_back(pRelation);
+			}
+			else
+			{
+				long		lLoaded = LoadObjects(pRelation, bRefresh, bLazyFetch);
+
+				if (lLoaded < 0)
+					return lLoaded;
+
+				lCount += lLoaded;
+			}
 		}
 
-		LoadObjects(pME, &listEntity, strSQL, bRefresh, bLazyFetch);
+		try
+		{
+			for ( itrMRRelations =  mapMRRelations.begin();
+						itrMRRelations != mapMRRelations.end();
+						itrMRRelations++)
+			{
+				RelationPtrList&	listMRRelation = itrMRRelations->second;
+
+				if (itrMRRelations->first->GetChildMetaKey()->GetMetaColumns()->empty())
+					return -1;
 
-		return listEntity.size();
+				uMaxRows = GetKeyListBatchRows(itrMRRelations->first->GetChildMetaKey());
+
+				for (itrRelation = listMRRelation.begin(); itrRelation != listMRRelation.end();)
+				{
+					for (itrFirst = itrRelation, uRows = 0; itrRelation != listMRRelation.end() && uRows < uMaxRows; itrRelation++, uRows++);
+
+					LoadObjectsByRelations(itrMRRelations->first, itrFirst, uRows, listEntity, bRefresh, bLazyFetch);
+				}
+			}
+		}
+		catch (Exception & e)
+		{
+			e.LogError();
+			return -1;
+		}
+
+		return lCount + listEntity.size();
 	}
 
 
 
-	EntityPtrListPtr ODBCDatabase::LoadObjects(MetaEntityPtr pMetaEntity, EntityPtrListPtr pEntityList, const std::string & strSQL, bool bRefresh, bool bLazyFetch)
+	void ODBCDatabase::AppendKeyListPredicate(std::string & strSQL, MetaColumnPtrListPtr pListColumn, unsigned int uRows)
 	{
-		ConnectionManager		conMgr(this);
+		MetaColumnPtrListItr		itrColumn;
+		unsigned int						idx, idxRow;
 
-		std::auto_ptr<odbc::Statement>	pStmnt;
-		std::auto_ptr<odbc::ResultSet>	pRslts;
-		EntityPtr								pObject;
-		EntityPtrListPtr				pEL = pEntityList;
-		bool										bFreeEL = false;
-		bool										bSuccess = false;
 
- 		// Build the query std::string
-		if (!pMetaEntity)
+		if (pListColumn->size() == 1)
 		{
-			GetExceptionContext()->ReportErrorX(__FILE__, __LINE__, "ODBCDatabase::LoadObjects(): Received request to load data from unknown table.");
-			return NULL;
+			strSQL += pListColumn->front()->GetName();
+			strSQL += " IN (";
+
+			for (idxRow = 0; idxRow < uRows; idxRow++)
+				strSQL += idxRow ? ", ?" : "?";
+
+			strSQL += ")";
+			return;
+		}
+
+		strSQL += "(";
+
+		for (idxRow = 0; idxRow < uRows; idxRow++)
+		{
+			strSQL += idxRow ? " OR (" : "(";
+
+			for ( idx = 0,	itrColumn =  pListColumn->begin();
+											itrColumn != pListColumn->end();
+						idx++,		itrColumn++)
+			{
+				if (idx)
+					strSQL += " AND ";
+
+				strSQL += (*itrColumn)->GetName();
+				strSQL += " = ?";
+			}
+
+			strSQL += ")";
 		}
 
+		strSQL += ")";
+	}
+
+
+
+	void ODBCDatabase::LoadObjectsByRelations(MetaRelationPtr pMR, RelationPtrListItr itrFirst, unsigned int uRows, EntityPtrList & listEntity, bool bRefresh, bool bLazyFetch)
+	{
+		ConnectionManager												conMgr(this);
+
+		MetaKeyPtr															pMetaKey = pMR->GetChildMetaKey();
+		MetaEntityPtr														pMetaEntity = pMetaKey->GetMetaEntity();
+		MetaColumnPtrListPtr										pListTarget = pMetaKey->GetMetaColumns();
+		ColumnPtr																pSwitch = NULL;
+		StatementKey														key(StatementKey::SelectByRelation, pMR, bLazyFetch);
+		ODBCConnectionPtr												pCon = NULL;
+		CachedStatement													uncached;
+		CachedStatement*												pCS = NULL;
+		std::auto_ptr<odbc::PreparedStatement>	pUncached;
+		std::auto_ptr<odbc::ResultSet>					pRslts;
+		ParameterStreams												streams;
+		RelationPtrListItr											itrRelation;
+		KeyColumnArrayItr												itrSrceColumn;
+		MetaColumnPtrListItr										itrTrgtColumn;
+		unsigned int														idxRow;
+		int																			iParam = 0;
+		size_t																	uListSize = listEntity.size();
+
+
+		// Special attention for switched relations
+		//
+		if (pMR->IsChildSwitch() && pMR->GetSwitchColumn())
+			pSwitch = pMR->GetSwitchColumn();
+
+		// Batches of a single row would clash with the statement LoadObjects(RelationPtr) caches
+		// and only full batches are likely to recur
+		key.uRows				= uRows + 1;
+		key.bCacheable	= uRows == GetKeyListBatchRows(pMetaKey);
+
 		try
 		{
 			Reconnect();
 
-			if (!pEL)
+			pCon	= conMgr.connection();
+			pCS		= FindCachedStatement(pCon, key);
+
+			if (!pCS)
 			{
-				pEL = new EntityPtrList();
-				bFreeEL = true;
+				std::string			strSQL;
+
+				// Build SQL
+				//
+				strSQL  = "SELECT ";
+				strSQL += pMetaEntity->AsSQLSelectList(bLazyFetch);
+				strSQL += " FROM ";
+				strSQL += pMetaEntity->GetName();
+
+				switch (GetMetaDatabase()->GetTargetRDBMS())
+				{
+					case SQLServer:
+						strSQL += " WITH(NOLOCK) WHERE ";
+						break;
+
+					case Oracle:
+						strSQL += " WHERE ";
+						break;
+				}
+
+				AppendKeyListPredicate(strSQL, pListTarget, uRows);
+
+				if (pSwitch)
+				{
+					strSQL += " AND ";
+					strSQL += pSwitch->GetMetaColumn()->GetName();
+					strSQL += " = ?";
+				}
+
+				pCS = PrepareStatement(pCon, key, strSQL, odbc::ResultSet::TYPE_SCROLL_INSENSITIVE, uncached);
+
+				if (pCS == &uncached)
+					pUncached.reset(uncached.pStmnt);
+			}
+
+			// Bind the values
+			//
+			for ( idxRow = 0,	itrRelation = itrFirst;
+						idxRow < uRows;
+						idxRow++,	itrRelation++)
+			{
+				for ( itrTrgtColumn =  pListTarget->begin(),	itrSrceColumn =  (*itrRelation)->GetParentKey()->GetColumns().begin();
+							itrTrgtColumn != pListTarget->end()   &&	itrSrceColumn != (*itrRelation)->GetParentKey()->GetColumns().end();
+							itrTrgtColumn++,												itrSrceColumn++)
+				{
+					BindParameter(pCS->pStmnt, ++iParam, *itrSrceColumn, streams);
+				}
 			}
 
+			if (pSwitch)
+				BindParameter(pCS->pStmnt, ++iParam, pSwitch, streams);
+
 			if (m_uTrace & D3DB_TRACE_SELECT)
-				ReportInfo("ODBCDatabase::LoadObjects()................................: Database " PRINTF_POINTER_MASK ". SQL: %s", this, strSQL.c_str());
+				ReportInfo("ODBCDatabase::LoadObjectsByRelations()......................: Database " PRINTF_POINTER_MASK ". %u parents. SQL: %s", this, uRows, pCS->strSQL.c_str());
 
-			pStmnt.reset(conMgr.connection()->createStatement(odbc::ResultSet::TYPE_SCROLL_INSENSITIVE, odbc::ResultSet::CONCUR_READ_ONLY));
-			pStmnt->setFetchSize(LIBODBC_FETCH_SIZE);
-			pRslts.reset(pStmnt->executeQuery(strSQL));
+			pCS->pStmnt->setFetchSize(LIBODBC_FETCH_SIZE);
+			pRslts.reset(pCS->pStmnt->executeQuery());
 
 			if (pRslts->first())
 			{
 				while (!pRslts->isAfterLast())
 				{
-					pObject = PopulateObject(pMetaEntity, pRslts.get(), bRefresh, bLazyFetch);
-					pEL->push_back(pObject);
+					listEntity.push_back(PopulateObject(pMetaEntity, pRslts.get(), bRefresh, bLazyFetch));
 					pRslts->next();
 				}
 			}
 
 			if (m_uTrace & D3DB_TRACE_STATS)
-				ReportInfo("ODBCDatabase::LoadObjects().........: Database " PRINTF_POINTER_MASK ". %d for SQL: %s", this, pEL->size(), strSQL.c_str());
-
-			bSuccess = true;
+				ReportInfo("ODBCDatabase::LoadObjectsByRelations()..: Database " PRINTF_POINTER_MASK ". %u for %u parents of %s", this, (unsigned int) (listEntity.size() - uListSize), uRows, pMR->GetFullName().c_str());
 		}
 		catch(odbc::SQLException& e)
 		{
+			pRslts.reset();
 			CheckConnection(e);
-			if (bFreeEL) delete pEL;
-			throw;
-		}
-		catch(...)
-		{
-			if (bFreeEL) delete pEL;
+
+			if (pCS && pCS != &uncached)
+				DiscardCachedStatement(pCon, key);
+
 			throw;
 		}
+	}
+
+
+
+	long ODBCDatabase::LoadObjects(MetaKeyPtr pMetaKey, KeyPtr pKey, bool bRefresh, bool bLazyFetch)
+	{
+		EntityPtrList						listEntity;
+
+
+		assert(pMetaKey);;
+		assert(pKey);
+		assert(m_pMetaDatabase == pMetaKey->GetMetaEntity()->GetMetaDatabase());
+
+		if (pKey->GetColumns().empty() || pMetaKey->GetMetaColumns()->empty())
+			return -1;
+
+		try
+		{
+			StatementKey					key(StatementKey::SelectByKey, pMetaKey, bLazyFetch);
+
+			LoadObjectsByKey(key, pMetaKey->GetMetaEntity(), pMetaKey->GetMetaColumns(), pKey->GetColumns(), NULL, listEntity, bRefresh, bLazyFetch);
+		}
+		catch (Exception & e)
+		{
+			e.LogError();
+			return -1;
+		}
+
+		return listEntity.size();
+	}
+
+
+
+	long ODBCDatabase::LoadObjects(MetaEntityPtr pME, bool bRefresh, bool bLazyFetch)
+	{
+		EntityPtrList						listEntity;
+
+
+		LoadObjects(pME, &listEntity, GetLoadAllSQL(pME, bLazyFetch), bRefresh, bLazyFetch);
+
+		return listEntity.size();
+	}
+
+
+
+	std::string ODBCDatabase::GetLoadAllSQL(MetaEntityPtr pME, bool bLazyFetch)
+	{
+		std::string							strSQL;
+
+
+		// Build SQL
+		//
+		strSQL = "SELECT ";
+		strSQL += pME->AsSQLSelectList(bLazyFetch);
+		strSQL += " FROM ";
+		strSQL += pME->GetName();
+
+		switch (GetMetaDatabase()->GetTargetRDBMS())
+		{
+			case SQLServer:
+				strSQL += " WITH(NOLOCK)";
+				break;
+
+			case Oracle:
+				break;
+		}
+
+		return strSQL;
+	}
+
+
+
+	EntityPtrListPtr ODBCDatabase::LoadObjects(MetaEntityPtr pMetaEntity, EntityPtrListPtr pEntityList, const std::string & strSQL, bool bRefresh, bool bLazyFetch)
+	{
+		ConnectionManager		conMgr(this);
+
+		std::auto_ptr<odbc::Statement>	pStmnt;
+		std::auto_ptr<odbc::ResultSet>	pRslts;
+		EntityPtr								pObject;
+		EntityPtrListPtr				pEL = pEntityList;
+		bool										bFreeEL = false;
+		bool										bSuccess = false;
+
+ 		// Build the query std::string
+		if (!pMetaEntity)
+		{
+			GetExceptionContext()->ReportErrorX(__FILE__, __LINE__, "ODBCDatabase::LoadObjects(): Received request to load data from unknown table.");
+			return NULL;
+		}
+
+		try
+		{
+			Reconnect();
+
+			if (!pEL)
+			{
+				pEL = new EntityPtrList();
+				bFreeEL = true;
+			}
+
+			// A native connection can't see changes made in our pending transaction
+			if (!HasTransaction() && LoadObjectsNative(pMetaEntity, *pEL, strSQL, bRefresh, bLazyFetch))
+				return pEL;
+
+			if (m_uTrace & D3DB_TRACE_SELECT)
+				ReportInfo("ODBCDatabase::LoadObjects()................................: Database " PRINTF_POINTER_MASK ". SQL: %s", this, strSQL.c_str());
+
+			pStmnt.reset(conMgr.connection()->createStatement(odbc::ResultSet::TYPE_SCROLL_INSENSITIVE, odbc::ResultSet::CONCUR_READ_ONLY));
+			pStmnt->setFetchSize(LIBODBC_FETCH_SIZE);
+			pRslts.reset(pStmnt->executeQuery(strSQL));
+
+			if (pRslts->first())
+			{
+				while (!pRslts->isAfterLast())
+				{
+					pObject = PopulateObject(pMetaEntity, pRslts.get(), bRefresh, bLazyFetch);
+					pEL->push_back(pObject);
+					pRslts->next();
+				}
+			}
+
+			if (m_uTrace & D3DB_TRACE_STATS)
+				ReportInfo("ODBCDatabase::LoadObjects().........: Database " PRINTF_POINTER_MASK ". %d for SQL: %s", this, pEL->size(), strSQL.c_str());
+
+			bSuccess = true;
+		}
+		catch(odbc::SQLException& e)
+		{
+			CheckConnection(e);
+			if (bFreeEL) delete pEL;
+			throw;
+		}
+		catch(...)
+		{
+			if (bFreeEL) delete pEL;
+			throw;
+		}
+
+		if (!bSuccess)
+		{
+			if (bFreeEL) delete pEL;
+			return NULL;
+		}
+
+		return pEL;
+	}
+
+
+
+	long ODBCDatabase::VisitRows(MetaEntityPtr pME, const std::string & strSQL, RowVisitor & visitor, bool bLazyFetch)
+	{
+		RowView									row(pME, bLazyFetch);
+
+		return VisitRows(row, strSQL, visitor);
+	}
+
+
+
+	long ODBCDatabase::VisitRows(RowView & row, const std::string & strSQL, RowVisitor & visitor)
+	{
+		ConnectionManager		conMgr(this);
+
+		std::auto_ptr<odbc::Statement>	pStmnt;
+		std::auto_ptr<odbc::ResultSet>	pRslts;
+		long										lCount = 0;
+
+
+		assert(row.GetMetaEntity() && m_pMetaDatabase == row.GetMetaEntity()->GetMetaDatabase());
+
+		try
+		{
+			Reconnect();
+
+			if (m_uTrace & D3DB_TRACE_SELECT)
+				ReportInfo("ODBCDatabase::VisitRows()..................................: Database " PRINTF_POINTER_MASK ". SQL: %s", this, strSQL.c_str());
+
+			pStmnt.reset(conMgr.connection()->createStatement(odbc::ResultSet::TYPE_FORWARD_ONLY, odbc::ResultSet::CONCUR_READ_ONLY));
+			pStmnt->setFetchSize(LIBODBC_FETCH_SIZE);
+			pRslts.reset(pStmnt->executeQuery(strSQL));
+
+			while (pRslts->next())
+			{
+				PopulateRowView(m_pMetaDatabase, row, pRslts.get());
+				lCount++;
+
+				if (!visitor.On_Row(row))
+					break;
+			}
+
+			if (m_uTrace & D3DB_TRACE_STATS)
+				ReportInfo("ODBCDatabase::VisitRows()...........: Database " PRINTF_POINTER_MASK ". %ld for SQL: %s", this, lCount, strSQL.c_str());
+		}
+		catch(odbc::SQLException& e)
+		{
+			pRslts.reset();
+			CheckConnection(e);
+			throw;
+		}
+
+		return lCount;
+	}
+
+
+
+	/* static */
+	void ODBCDatabase::PopulateRowView(MetaDatabasePtr pMDB, RowView & row, odbc::ResultSet* pRslts)
+	{
+		MetaColumnPtr					pMC;
+		unsigned int					idx;
+		int										iColIdx;
+
+
+		for (idx = 0; idx < row.m_vectMetaColumn.size(); idx++)
+		{
+			RowView::Value&			val = row.m_vectValue[idx];
+
+			pMC = row.m_vectMetaColumn[idx];
+			iColIdx = idx + 1;
+
+			// For lazy fetch columns we retrieve the NOT NULL indicator only
+			if (row.m_bLazyFetch && pMC->IsLazyFetch())
+			{
+				val.bNull = !pRslts->getBoolean(iColIdx);
+				val.bFetched = val.bNull;
+				val.strValue.clear();
+				continue;
+			}
+
+			val.bFetched = true;
+
+			switch (pMC->GetType())
+			{
+				case MetaColumn::dbfString:
+				{
+					std::string::size_type	posLastNonBlank;
+
+					val.strValue = pRslts->getString(iColIdx);
+
+					if (pRslts->wasNull())
+						break;
+
+					// Normalise like ColumnString::SetValue() so that visitors see what an Entity would hold
+					posLastNonBlank = val.strValue.find_last_not_of(' ');
+
+					if (posLastNonBlank != std::string::npos)
+						val.strValue.erase(posLastNonBlank + 1);
+
+					if (val.strValue.size() > pMC->GetMaxLength())
+						val.strValue.resize(pMC->GetMaxLength());
+
+					if (val.strValue.empty())
+					{
+						val.bNull = true;
+						continue;
+					}
+
+					break;
+				}
+
+				case MetaColumn::dbfChar:
+					val.lValue = pRslts->getByte(iColIdx);
+					break;
+
+				case MetaColumn::dbfShort:
+					val.lValue = pRslts->getShort(iColIdx);
+					break;
+
+				case MetaColumn::dbfBool:
+					val.lValue = pRslts->getBoolean(iColIdx) ? 1 : 0;
+					break;
+
+				case MetaColumn::dbfInt:
+					val.lValue = pRslts->getInt(iColIdx);
+					break;
+
+				case MetaColumn::dbfLong:
+					val.lValue = (long) pRslts->getLong(iColIdx);
+					break;
+
+				case MetaColumn::dbfFloat:
+					val.fValue = pRslts->getFloat(iColIdx);
+					break;
+
+				case MetaColumn::dbfDate:
+				{
+					odbc::Timestamp		odbcTimestamp;
+
+					odbcTimestamp = pRslts->getTimestamp(iColIdx);
+
+					if (!pRslts->wasNull())
+						val.dtValue = D3Date(odbcTimestamp, pMDB->GetTimeZone());
+
+					break;
+				}
+
+				case MetaColumn::dbfBlob:
+				{
+					std::istream*			pStrm = pRslts->getBinaryStream(iColIdx);
+
+					val.strValue.clear();
+
+					if (!pRslts->wasNull() && pStrm)
+						val.strValue.assign(std::istreambuf_iterator<char>(*pStrm), std::istreambuf_iterator<char>());
+
+					break;
+				}
+
+				case MetaColumn::dbfBinary:
+				{
+					odbc::Bytes	bytes;
+
+					bytes = pRslts->getBytes(iColIdx);
+					val.strValue.assign((const char*) bytes.getData(), bytes.getSize());
+					break;
+				}
+			}
+
+			val.bNull = pRslts->wasNull();
+		}
+	}
+
+
+
+	AsyncLoadResultPtr ODBCDatabase::LoadObjectsAsync(MetaEntityPtr pME, const std::string & strSQL, bool bRefresh, bool bLazyFetch)
+	{
+		assert(pME && m_pMetaDatabase == pME->GetMetaDatabase());
+
+		// Rows changed by our pending transaction are only visible through our own connection
+		if (HasTransaction())
+			return Database::LoadObjectsAsync(pME, strSQL, bRefresh, bLazyFetch);
+
+		AsyncLoadResultPtr		pResult(new AsyncLoadResult(this, pME, bRefresh, bLazyFetch));
+
+		QueueAsyncTask(boost::bind(&ODBCDatabase::LoadRowsAsync, m_pMetaDatabase, strSQL, m_uTrace, pResult));
+
+		return pResult;
+	}
+
+
+
+	AsyncJSONResultPtr ODBCDatabase::ExecuteQueryAsJSONAsync(const std::string & strSQL)
+	{
+		// Rows changed by our pending transaction are only visible through our own connection
+		if (HasTransaction())
+			return Database::ExecuteQueryAsJSONAsync(strSQL);
+
+		AsyncJSONResultPtr		pResult(new AsyncJSONResult());
+
+		QueueAsyncTask(boost::bind(&ODBCDatabase::QueryAsJSONAsync, m_pMetaDatabase, strSQL, m_uTrace, pResult));
+
+		return pResult;
+	}
+
+
+
+	/* static */
+	void ODBCDatabase::QueueAsyncTask(const AsyncTask & task)
+	{
+		boost::mutex::scoped_lock		lk(M_mtxAsync);
+
+		if (M_bStopAsyncWorkers)
+			throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::QueueAsyncTask(): Can't queue asynchronous tasks while UnInitialise() is in progress.");
+
+		M_listAsyncTasks.push_back(task);
+
+		// Start another worker if all are busy
+		if (M_uIdleAsyncWorkers < M_listAsyncTasks.size() && M_listAsyncWorkers.size() < ODBC_DATABASE_MAX_ASYNC_WORKERS)
+			M_listAsyncWorkers.push_back(new boost::thread(&ODBCDatabase::AsyncWorker));
+		else
+			M_condAsync.notify_one();
+	}
+
+
+
+	/* static */
+	void ODBCDatabase::AsyncWorker()
+	{
+		AsyncTask			task;
+
+
+		while (true)
+		{
+			{
+				boost::mutex::scoped_lock		lk(M_mtxAsync);
+
+				while (M_listAsyncTasks.empty() && !M_bStopAsyncWorkers)
+				{
+					M_uIdleAsyncWorkers++;
+					M_condAsync.wait(lk);
+					M_uIdleAsyncWorkers--;
+				}
+
+				if (M_listAsyncTasks.empty())
+					return;
+
+				task = M_listAsyncTasks.front();
+				M_listAsyncTasks.pop_front();
+			}
+
+			// Tasks report their own errors through the result they complete
+			task();
+			task.clear();
+		}
+	}
+
+
+
+	/* static */
+	void ODBCDatabase::StopAsyncWorkers()
+	{
+		AsyncWorkerList			listWorkers;
+		AsyncWorkerListItr	itr;
+
+
+		{
+			boost::mutex::scoped_lock		lk(M_mtxAsync);
+
+			M_bStopAsyncWorkers = true;
+			listWorkers.swap(M_listAsyncWorkers);
+		}
+
+		M_condAsync.notify_all();
+
+		// Workers complete the tasks still queued before they exit
+		for (itr = listWorkers.begin(); itr != listWorkers.end(); itr++)
+		{
+			(*itr)->join();
+			delete *itr;
+		}
+
+		// All workers are gone, so QueueAsyncTask() may start new ones if the system is initialised again
+		{
+			boost::mutex::scoped_lock		lk(M_mtxAsync);
+
+			M_bStopAsyncWorkers = false;
+		}
+	}
+
+
+
+	/* static */
+	void ODBCDatabase::LoadRowsAsync(MetaDatabasePtr pMDB, const std::string & strSQL, unsigned int uTrace, AsyncLoadResultPtr pResult)
+	{
+		ODBCConnectionPtr								pCon = NULL;
+		std::auto_ptr<odbc::Statement>	pStmnt;
+		std::auto_ptr<odbc::ResultSet>	pRslts;
+		RowView													row(pResult->m_pMetaEntity, pResult->m_bLazyFetch);
+
+
+		try
+		{
+			pCon = CreateODBCConnection(pMDB);
+
+			if (uTrace & D3DB_TRACE_SELECT)
+				ReportInfo("ODBCDatabase::LoadRowsAsync()..............................: MetaDatabase %s. SQL: %s", pMDB->GetAlias().c_str(), strSQL.c_str());
+
+			pStmnt.reset(pCon->createStatement(odbc::ResultSet::TYPE_FORWARD_ONLY, odbc::ResultSet::CONCUR_READ_ONLY));
+			pStmnt->setFetchSize(LIBODBC_FETCH_SIZE);
+			pRslts.reset(pStmnt->executeQuery(strSQL));
+
+			while (pRslts->next())
+			{
+				PopulateRowView(pMDB, row, pRslts.get());
+				pResult->m_listRows.push_back(row.m_vectValue);
+			}
+
+			if (uTrace & D3DB_TRACE_STATS)
+				ReportInfo("ODBCDatabase::LoadRowsAsync()........: MetaDatabase %s. %u rows for SQL: %s", pMDB->GetAlias().c_str(), (unsigned int) pResult->m_listRows.size(), strSQL.c_str());
+
+			pRslts.reset();
+			pStmnt.reset();
+			ReleaseODBCConnection(pMDB, pCon);
+		}
+		catch(odbc::SQLException&)
+		{
+			std::string			strError = ShortGenericExceptionHandler();
+
+			pRslts.reset();
+			pStmnt.reset();
+
+			// The connection may be broken, so don't return it to the pool
+			if (pCon)
+				DeleteODBCConnection(pCon);
+
+			pResult->m_listRows.clear();
+			pResult->SetReady(strError);
+			return;
+		}
+		catch(...)
+		{
+			std::string			strError = ShortGenericExceptionHandler();
+
+			pRslts.reset();
+			pStmnt.reset();
+
+			if (pCon)
+				ReleaseODBCConnection(pMDB, pCon);
+
+			pResult->m_listRows.clear();
+			pResult->SetReady(strError);
+			return;
+		}
+
+		pResult->SetReady();
+	}
+
+
+
+	/* static */
+	void ODBCDatabase::QueryAsJSONAsync(MetaDatabasePtr pMDB, const std::string & strSQL, unsigned int uTrace, AsyncJSONResultPtr pResult)
+	{
+		ODBCConnectionPtr									pCon = NULL;
+		std::auto_ptr<odbc::PreparedStatement>	pStmnt;
+		odbc::ResultSet*									pRslts = NULL;
+		std::ostringstream								oResultSets;
+		bool															bFirst = true;
+
+
+		try
+		{
+			pCon = CreateODBCConnection(pMDB);
+
+			if (uTrace)
+				ReportInfo("ODBCDatabase::QueryAsJSONAsync()...........................: MetaDatabase %s. SQL: %s", pMDB->GetAlias().c_str(), strSQL.c_str());
+
+			pStmnt.reset(pCon->prepareStatement(strSQL));
+			pRslts = pStmnt->executeQuery();
+
+			oResultSets << '[';
+
+			while(true)
+			{
+				// filter messages (which are returned as NULL results)
+				while (!pRslts && pStmnt->getMoreResults())
+					pRslts = pStmnt->getResultSet();
+
+				if (!pRslts)
+					break;
+
+				if (bFirst)
+					bFirst = false;
+				else
+					oResultSets << ',';
+
+				oResultSets << '[';
+
+				WriteJSONToStream(pMDB, oResultSets, pRslts);
+
+				delete pRslts;
+				pRslts = NULL;
+				oResultSets << ']';
+			}
+
+			oResultSets << ']';
+
+			pStmnt.reset();
+			ReleaseODBCConnection(pMDB, pCon);
+		}
+		catch(odbc::SQLException&)
+		{
+			std::string			strError = ShortGenericExceptionHandler();
+
+			delete pRslts;
+			pStmnt.reset();
+
+			// The connection may be broken, so don't return it to the pool
+			if (pCon)
+				DeleteODBCConnection(pCon);
+
+			pResult->SetReady(strError);
+			return;
+		}
+		catch(...)
+		{
+			std::string			strError = ShortGenericExceptionHandler();
+
+			delete pRslts;
+			pStmnt.reset();
+
+			if (pCon)
+				ReleaseODBCConnection(pMDB, pCon);
+
+			pResult->SetReady(strError);
+			return;
+		}
+
+		pResult->m_strJSON = oResultSets.str();
+		pResult->SetReady();
+	}
+
+
+
+	void ODBCDatabase::LoadObjectsByKey(StatementKey & key, MetaEntityPtr pMetaEntity, MetaColumnPtrListPtr pListTarget, KeyColumnArray & aSource, ColumnPtr pSwitch, EntityPtrList & listEntity, bool bRefresh, bool bLazyFetch)
+	{
+		ConnectionManager												conMgr(this);
+
+		ODBCConnectionPtr												pCon = NULL;
+		CachedStatement													uncached;
+		CachedStatement*												pCS = NULL;
+		std::auto_ptr<odbc::PreparedStatement>	pUncached;
+		std::auto_ptr<odbc::ResultSet>					pRslts;
+		ParameterStreams												streams;
+		KeyColumnArrayItr												itrSrceColumn;
+		MetaColumnPtrListItr										itrTrgtColumn;
+		unsigned int														idx;
+		int																			iParam = 0;
+
+
+		// NULL values change the shape of the statement (IS NULL instead of = ?)
+		for ( idx = 0,	itrSrceColumn =  aSource.begin();
+										itrSrceColumn != aSource.end();
+					idx++,		itrSrceColumn++)
+		{
+			if ((*itrSrceColumn)->IsNull())
+				key.SetNull(idx);
+		}
+
+		try
+		{
+			Reconnect();
+
+			pCon	= conMgr.connection();
+			pCS		= FindCachedStatement(pCon, key);
+
+			if (!pCS)
+			{
+				std::string			strSQL;
+
+				// Build SQL
+				//
+				strSQL  = "SELECT ";
+				strSQL += pMetaEntity->AsSQLSelectList(bLazyFetch);
+				strSQL += " FROM ";
+				strSQL += pMetaEntity->GetName();
+
+				switch (GetMetaDatabase()->GetTargetRDBMS())
+				{
+					case SQLServer:
+						strSQL += " WITH(NOLOCK) WHERE ";
+						break;
+
+					case Oracle:
+						strSQL += " WHERE ";
+						break;
+				}
+
+				for ( idx = 0,	itrTrgtColumn =  pListTarget->begin(),	itrSrceColumn =  aSource.begin();
+												itrTrgtColumn != pListTarget->end()   &&	itrSrceColumn != aSource.end();
+							idx++,		itrTrgtColumn++,												itrSrceColumn++)
+				{
+					if (idx)
+						strSQL += " AND ";
+
+					strSQL += (*itrTrgtColumn)->GetName();
+					strSQL += (*itrSrceColumn)->IsNull() ? " IS NULL" : " = ?";
+				}
+
+				if (pSwitch)
+				{
+					strSQL += " AND ";
+					strSQL += pSwitch->GetMetaColumn()->GetName();
+					strSQL += " = ?";
+				}
+
+				pCS = PrepareStatement(pCon, key, strSQL, odbc::ResultSet::TYPE_SCROLL_INSENSITIVE, uncached);
+
+				if (pCS == &uncached)
+					pUncached.reset(uncached.pStmnt);
+			}
+
+			// Bind the values
+			//
+			for ( itrTrgtColumn =  pListTarget->begin(),	itrSrceColumn =  aSource.begin();
+						itrTrgtColumn != pListTarget->end()   &&	itrSrceColumn != aSource.end();
+						itrTrgtColumn++,												itrSrceColumn++)
+			{
+				if (!(*itrSrceColumn)->IsNull())
+					BindParameter(pCS->pStmnt, ++iParam, *itrSrceColumn, streams);
+			}
+
+			if (pSwitch)
+				BindParameter(pCS->pStmnt, ++iParam, pSwitch, streams);
+
+			if (m_uTrace & D3DB_TRACE_SELECT)
+				ReportInfo("ODBCDatabase::LoadObjectsByKey()...........................: Database " PRINTF_POINTER_MASK ". SQL: %s", this, pCS->strSQL.c_str());
+
+			pCS->pStmnt->setFetchSize(LIBODBC_FETCH_SIZE);
+			pRslts.reset(pCS->pStmnt->executeQuery());
+
+			if (pRslts->first())
+			{
+				while (!pRslts->isAfterLast())
+				{
+					listEntity.push_back(PopulateObject(pMetaEntity, pRslts.get(), bRefresh, bLazyFetch));
+					pRslts->next();
+				}
+			}
+
+			if (m_uTrace & D3DB_TRACE_STATS)
+				ReportInfo("ODBCDatabase::LoadObjectsByKey()....: Database " PRINTF_POINTER_MASK ". %d for SQL: %s", this, listEntity.size(), pCS->strSQL.c_str());
+		}
+		catch(odbc::SQLException& e)
+		{
+			pRslts.reset();
+			CheckConnection(e);
+
+			if (pCS && pCS != &uncached)
+				DiscardCachedStatement(pCon, key);
+
+			throw;
+		}
+	}
+
+
+
+	ODBCDatabase::CachedStatement* ODBCDatabase::FindCachedStatement(ODBCConnectionPtr pCon, const StatementKey & key)
+	{
+		if (!key.bCacheable)
+			return NULL;
+
+		boost::recursive_mutex::scoped_lock		lk(M_Mutex);
+
+		StatementCacheMapItr		itrCache;
+		StatementCacheItr				itrStmnt;
+
+		itrCache = M_mapStatementCaches.find(pCon);
+
+		if (itrCache == M_mapStatementCaches.end())
+			return NULL;
+
+		itrStmnt = itrCache->second.find(key);
+
+		if (itrStmnt == itrCache->second.end())
+			return NULL;
+
+		return &(itrStmnt->second);
+	}
+
+
+
+	ODBCDatabase::CachedStatement* ODBCDatabase::PrepareStatement(ODBCConnectionPtr pCon, const StatementKey & key, const std::string & strSQL, int iResultSetType, CachedStatement & uncached)
+	{
+		uncached.pStmnt = pCon->prepareStatement(strSQL, iResultSetType, odbc::ResultSet::CONCUR_READ_ONLY);
+		uncached.strSQL = strSQL;
+
+		if (!key.bCacheable)
+			return &uncached;
+
+		boost::recursive_mutex::scoped_lock		lk(M_Mutex);
+
+		StatementCache&				cache = M_mapStatementCaches[pCon];
+		StatementCacheItr			itrStmnt;
+		CachedStatement*			pCS;
+
+
+		// A connection is only ever used by one thread at a time and statements are never
+		// executed re-entrantly on the same connection, so it is safe to start afresh
+		if (cache.size() >= ODBC_DATABASE_MAX_CACHED_STATEMENTS)
+		{
+			if (m_uTrace & D3DB_TRACE_STATS)
+				ReportInfo("ODBCDatabase::PrepareStatement()....: Database " PRINTF_POINTER_MASK ". Statement cache full, discarding %u statements.", this, cache.size());
+
+			for ( itrStmnt =  cache.begin();
+						itrStmnt != cache.end();
+						itrStmnt++)
+			{
+				delete itrStmnt->second.pStmnt;
+			}
+
+			cache.clear();
+		}
+
+		pCS = &(cache[key]);
+		*pCS = uncached;
+		uncached.pStmnt = NULL;
+
+		return pCS;
+	}
+
+
+
+	void ODBCDatabase::DiscardCachedStatement(ODBCConnectionPtr pCon, const StatementKey & key)
+	{
+		boost::recursive_mutex::scoped_lock		lk(M_Mutex);
+
+		StatementCacheMapItr		itrCache;
+		StatementCacheItr				itrStmnt;
+
+		itrCache = M_mapStatementCaches.find(pCon);
+
+		if (itrCache == M_mapStatementCaches.end())
+			return;
+
+		itrStmnt = itrCache->second.find(key);
+
+		if (itrStmnt == itrCache->second.end())
+			return;
+
+		try
+		{
+			delete itrStmnt->second.pStmnt;
+		}
+		catch (...)
+		{
+			// The statement has failed already, we simply don't want to use it again
+		}
+
+		itrCache->second.erase(itrStmnt);
+	}
+
+
+
+	void ODBCDatabase::BindParameter(odbc::PreparedStatement* pStmnt, int idx, ColumnPtr pCol, ParameterStreams & streams)
+	{
+		MetaColumnPtr		pMC = pCol->GetMetaColumn();
+
+
+		if (pCol->IsNull())
+		{
+			switch (pMC->GetType())
+			{
+				case MetaColumn::dbfString:
+					pStmnt->setNull(idx, pMC->IsStreamed() ? odbc::Types::LONGVARCHAR : odbc::Types::VARCHAR);
+					break;
+
+				case MetaColumn::dbfChar:
+					pStmnt->setNull(idx, odbc::Types::TINYINT);
+					break;
+
+				case MetaColumn::dbfShort:
+					pStmnt->setNull(idx, odbc::Types::SMALLINT);
+					break;
+
+				case MetaColumn::dbfBool:
+					pStmnt->setNull(idx, odbc::Types::BIT);
+					break;
+
+				case MetaColumn::dbfInt:
+				case MetaColumn::dbfLong:
+					pStmnt->setNull(idx, odbc::Types::INTEGER);
+					break;
+
+				case MetaColumn::dbfFloat:
+					pStmnt->setNull(idx, GetMetaDatabase()->GetTargetRDBMS() == Oracle ? odbc::Types::REAL : odbc::Types::FLOAT);
+					break;
+
+				case MetaColumn::dbfDate:
+					pStmnt->setNull(idx, GetMetaDatabase()->GetTargetRDBMS() == Oracle ? odbc::Types::DATE : odbc::Types::TIMESTAMP);
+					break;
+
+				case MetaColumn::dbfBlob:
+					pStmnt->setNull(idx, odbc::Types::LONGVARBINARY);
+					break;
+
+				case MetaColumn::dbfBinary:
+					pStmnt->setNull(idx, odbc::Types::VARBINARY);
+					break;
+
+				default:
+					throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::BindParameter(): The datatype of column %s can't be bound as a parameter", pMC->GetFullName().c_str());
+			}
+
+			return;
+		}
+
+		switch (pMC->GetType())
+		{
+			case MetaColumn::dbfString:
+				if (pMC->IsStreamed())
+				{
+					std::stringstream*		pStrm = streams.Create();
+
+					*pStrm << pCol->GetString();
+					pStmnt->setAsciiStream(idx, pStrm, pCol->GetString().size());
+				}
+				else
+				{
+					pStmnt->setString(idx, pCol->GetString());
+				}
+
+				break;
+
+			case MetaColumn::dbfChar:
+				pStmnt->setByte(idx, pCol->GetChar());
+				break;
+
+			case MetaColumn::dbfShort:
+				pStmnt->setShort(idx, pCol->GetShort());
+				break;
+
+			case MetaColumn::dbfBool:
+				pStmnt->setBoolean(idx, pCol->GetBool());
+				break;
+
+			case MetaColumn::dbfInt:
+				pStmnt->setInt(idx, pCol->GetInt());
+				break;
+
+			case MetaColumn::dbfLong:
+				pStmnt->setLong(idx, pCol->GetLong());
+				break;
+
+			case MetaColumn::dbfFloat:
+				pStmnt->setFloat(idx, pCol->GetFloat());
+				break;
+
+			case MetaColumn::dbfDate:
+			{
+				D3Date				dt(pCol->GetDate());
+
+				dt.AdjustToTimeZone(GetMetaDatabase()->GetTimeZone());
+
+				switch (GetMetaDatabase()->GetTargetRDBMS())
+				{
+					case Oracle:
+						pStmnt->setTimestamp(idx, dt.AsString());
+						break;
+
+					case SQLServer:
+						pStmnt->setString(idx, dt.AsString(3));
+						break;
+
+					default:
+						pStmnt->setString(idx, dt.AsString());
+						break;
+				}
+
+				break;
+			}
+
+			case MetaColumn::dbfBlob:
+			{
+				ColumnBlobPtr									pBlob = (ColumnBlobPtr) pCol;
+				std::stringstream::pos_type		pos = pBlob->m_Stream.tellg();
+
+				pStmnt->setBinaryStream(idx, (std::istream*) &(pBlob->m_Stream), pBlob->m_Stream.str().length());
+				pBlob->m_Stream.clear();
+				pBlob->m_Stream.seekg(pos);
+				break;
+			}
+
+			case MetaColumn::dbfBinary:
+			{
+				const Data&		data = pCol->GetData();
+
+				pStmnt->setBytes(idx, odbc::Bytes((const signed char*) (const unsigned char*) data, data.length()));
+				break;
+			}
+
+			default:
+				throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::BindParameter(): The datatype of column %s can't be bound as a parameter", pMC->GetFullName().c_str());
+		}
+	}
+
+
+
+	EntityPtr ODBCDatabase::FindEntity(MetaEntityPtr pMetaEntity, odbc::ResultSet* pRslts)
+	{
+		MetaKeyPtr				pMK = pMetaEntity->GetPrimaryMetaKey();
+		InstanceKeyPtr		pInstanceKey;
+
+
+		// Most primary keys can be probed without building a TemporaryKey
+		//
+		if (KeyProbe::IsSupported(pMK))
+		{
+			KeyProbe								keyProbe(pMK);
+			std::string							arrStrValue[D3_KEY_PROBE_MAX_COLUMNS];
+			MetaColumnPtrListItr		itrMC;
+			MetaColumnPtr						pMC;
+			unsigned int						idx;
+
+
+			for (	itrMC =  pMK->GetMetaColumns()->begin(),	idx = 0;
+						itrMC != pMK->GetMetaColumns()->end();
+						itrMC++,																		idx++)
+			{
+				pMC = *itrMC;
+
+				switch (pMC->GetType())
+				{
+					case MetaColumn::dbfString:
+						arrStrValue[idx] = pRslts->getString(pMC->GetName());
+						pRslts->wasNull() ? keyProbe.AddNull() : keyProbe.Add(arrStrValue[idx]);
+						break;
+
+					case MetaColumn::dbfChar:
+					{
+						char cVal = (char) pRslts->getByte(pMC->GetName());
+						pRslts->wasNull() ? keyProbe.AddNull() : keyProbe.Add(cVal);
+						break;
+					}
+
+					case MetaColumn::dbfShort:
+					{
+						short sVal = (short) pRslts->getShort(pMC->GetName());
+						pRslts->wasNull() ? keyProbe.AddNull() : keyProbe.Add(sVal);
+						break;
+					}
+
+					case MetaColumn::dbfBool:
+					{
+						bool bVal = (bool) pRslts->getBoolean(pMC->GetName());
+						pRslts->wasNull() ? keyProbe.AddNull() : keyProbe.Add(bVal);
+						break;
+					}
+
+					case MetaColumn::dbfInt:
+					{
+						int iVal = (int) pRslts->getInt(pMC->GetName());
+						pRslts->wasNull() ? keyProbe.AddNull() : keyProbe.Add(iVal);
+						break;
+					}
+
+					case MetaColumn::dbfLong:
+					{
+						long lVal = (long) pRslts->getLong(pMC->GetName());
+						pRslts->wasNull() ? keyProbe.AddNull() : keyProbe.Add(lVal);
+						break;
+					}
+
+					case MetaColumn::dbfFloat:
+					{
+						float fVal = (float) pRslts->getFloat(pMC->GetName());
+						pRslts->wasNull() ? keyProbe.AddNull() : keyProbe.Add(fVal);
+						break;
+					}
+
+					case MetaColumn::dbfDate:
+					{
+						odbc::Timestamp		odbcTimestamp;
+
+						odbcTimestamp = pRslts->getTimestamp(pMC->GetName());
+
+						if (pRslts->wasNull())
+						{
+							keyProbe.AddNull();
+						}
+						else
+						{
+							try
+							{
+								keyProbe.Add(D3Date(odbcTimestamp, m_pMetaDatabase->GetTimeZone()));
+							}
+							catch (...)
+							{
+								keyProbe.AddNull();
+							}
+						}
+
+						break;
+					}
+				}
+			}
+
+			pInstanceKey = pMK->FindInstanceKey(keyProbe, this);
+
+			return pInstanceKey ? pInstanceKey->GetEntity() : NULL;
+		}
+
+		TemporaryKey			tmpKey = *pMK;
+		KeyColumnArrayItr	itrColumn;
+		ColumnPtr					pCol;
+		bool							bResult = false;
+
+
+		for (	itrColumn =  tmpKey.GetColumns().begin();
+					itrColumn != tmpKey.GetColumns().end();
+					itrColumn++)
+		{
+
+			pCol = *itrColumn;
+
+			switch (pCol->GetMetaColumn()->GetType())
+			{
+				case MetaColumn::dbfString:
+					bResult = pCol->SetValue(pRslts->getString(pCol->GetMetaColumn()->GetName()));
+					break;
+
+				case MetaColumn::dbfChar:
+					bResult = pCol->SetValue((char) pRslts->getByte(pCol->GetMetaColumn()->GetName()));
+					break;
+
+				case MetaColumn::dbfShort:
+					bResult = pCol->SetValue((short) pRslts->getShort(pCol->GetMetaColumn()->GetName()));
+					break;
+
+				case MetaColumn::dbfBool:
+					bResult = pCol->SetValue((bool) pRslts->getBoolean(pCol->GetMetaColumn()->GetName()));
+					break;
+
+				case MetaColumn::dbfInt:
+					bResult = pCol->SetValue((int) pRslts->getInt(pCol->GetMetaColumn()->GetName()));
+					break;
+
+				case MetaColumn::dbfLong:
+					bResult = pCol->SetValue((long) pRslts->getLong(pCol->GetMetaColumn()->GetName()));
+					break;
+
+				case MetaColumn::dbfFloat:
+					bResult = pCol->SetValue((float) pRslts->getFloat(pCol->GetMetaColumn()->GetName()));
+					break;
+
+				case MetaColumn::dbfDate:
+				{
+					odbc::Timestamp		odbcTimestamp;
+
+					odbcTimestamp = pRslts->getTimestamp(pCol->GetMetaColumn()->GetName());
+
+					if (!pRslts->wasNull())
+					{
+						try
+						{
+  						bResult = pCol->SetValue(D3Date(odbcTimestamp, m_pMetaDatabase->GetTimeZone()));
+  					}
+       			catch (...)
+          	{
+							pCol->SetNull();
+						}
+					}
+
+					break;
+				}
+
+				case MetaColumn::dbfBinary:
+				{
+					odbc::Bytes bytes = pRslts->getBytes(pCol->GetMetaColumn()->GetName());
+					bResult = pCol->SetValue((const unsigned char*) bytes.getData(), bytes.getSize());
+					break;
+				}
+
+				default:
+					bResult = false;
+			}
+
+			if (!bResult)
+				break;
+
+			if (pRslts->wasNull())
+				pCol->SetNull();
+		}
+
+		if (bResult)
+		{
+			pInstanceKey = pMK->FindInstanceKey(&tmpKey, this);
+
+			if (pInstanceKey)
+				return pInstanceKey->GetEntity();
+		}
+
+		return NULL;
+	}
+
+
+
+	EntityPtr ODBCDatabase::PopulateObject(MetaEntityPtr pMetaEntity, odbc::ResultSet* pRslts, bool bRefresh, bool bLazyFetch)
+	{
+		unsigned int							i, iColIdx;
+		ColumnPtr									pCol;
+		MetaColumnPtr							pMetaCol;
+		bool											bResult = false;
+		bool											bDeletObject = false;
+		bool											bDoAfterPopulate = false;
+		EntityPtr									pObject = NULL;
+
+
+		try
+		{
+			// See if the object exists
+			//
+			pObject = FindEntity(pMetaEntity, pRslts);
+
+			if (!pObject)
+			{
+				bDeletObject = true;
+				pObject = pMetaEntity->CreateInstance(this);
+			}
+			else
+			{
+				if (!bRefresh)
+					return pObject;
+			}
+
+			if (!pObject)
+				return NULL;
+
+			bDoAfterPopulate = true;
+			pObject->On_BeforePopulatingObject();
+
+			iColIdx = 0;
+			for (i = 0; i < pMetaEntity->GetMetaColumnsInFetchOrder()->size(); i++)
+			{
+				pMetaCol = (*(pMetaEntity->GetMetaColumnsInFetchOrder()))[i];
+				pCol = pObject->GetColumn(pMetaCol);
+
+				// Derived columns must be at the end
+				//
+				if (pMetaCol->IsDerived())
+					break;
+
+				iColIdx++;
+
+				// For lazy fetch columns we retrieve the NOT NULL indicator only
+				if (bLazyFetch && pMetaCol->IsLazyFetch())
+				{
+					bool bHasBLOB = pRslts->getBoolean(iColIdx);
+
+					if (!bHasBLOB)
+					{
+						pCol->SetNull();
+						pCol->MarkFetched();
+					}
+					else
+					{
+						pCol->MarkUnfetched();
+					}
+
+					continue;
+				}
+
+				switch (pMetaCol->GetType())
+				{
+					case MetaColumn::dbfString:
+						bResult = pCol->SetValue(pRslts->getString(iColIdx));
+						break;
+
+					case MetaColumn::dbfChar:
+						bResult = pCol->SetValue((char) pRslts->getByte(iColIdx));
+						break;
+
+					case MetaColumn::dbfShort:
+						bResult = pCol->SetValue((short) pRslts->getShort(iColIdx));
+						break;
+
+					case MetaColumn::dbfBool:
+						bResult = pCol->SetValue((bool) pRslts->getBoolean(iColIdx));
+						break;
+
+					case MetaColumn::dbfInt:
+						bResult = pCol->SetValue((int) pRslts->getInt(iColIdx));
+						break;
+
+					case MetaColumn::dbfLong:
+						bResult = pCol->SetValue((long) pRslts->getLong(iColIdx));
+						break;
+
+					case MetaColumn::dbfFloat:
+						bResult = pCol->SetValue((float) pRslts->getFloat(iColIdx));
+						break;
+
+					case MetaColumn::dbfDate:
+					{
+						odbc::Timestamp		odbcTimestamp;
+
+						odbcTimestamp = pRslts->getTimestamp(iColIdx);
+
+						if (!pRslts->wasNull())
+						{
+  						try
+  						{
+    						bResult = pCol->SetValue(D3Date(odbcTimestamp, m_pMetaDatabase->GetTimeZone()));
+    					}
+         			catch (...)
+			       	{
+  							pCol->MarkUnfetched();
+								throw;
+  						}
+						}
+
+						break;
+					}
+					case MetaColumn::dbfBlob:
+					{
+						try
+						{
+							assert(pCol->GetMetaColumn()->GetType() == MetaColumn::dbfBlob);
+							((ColumnBlobPtr) pCol)->FromStream( *(pRslts->getBinaryStream(iColIdx)));
+  						bResult = true;
+  					}
+         		catch (...)
+			      {
+ 							pCol->MarkUnfetched();
+							throw;
+						}
+
+						break;
+					}
+					case MetaColumn::dbfBinary:
+					{
+						odbc::Bytes	bytes;
+						bytes = pRslts->getBytes(iColIdx);
+						bResult = pCol->SetValue((const unsigned char*) bytes.getData(), bytes.getSize());
+						break;
+					}
+				}
+
+				if (!bResult)
+				{
+					pCol->MarkUnfetched();
+					throw Exception(__FILE__, __LINE__, Exception_error, "Failed to populate column %s.", pCol->GetMetaColumn()->GetFullName().c_str());
+				}
+				else
+				{
+					if (pRslts->wasNull())
+						pCol->SetNull();
+
+					pCol->MarkFetched();
+				}
+			}
+		}
+		catch(...)
+		{
+ 			if (bDoAfterPopulate)
+ 				pObject->On_AfterPopulatingObject();
+
+			if (bDeletObject)
+				delete pObject;
+
+			throw;		// re-throw the exception
+		}
+
+		pObject->On_AfterPopulatingObject();
+
+
+		return pObject;
+	}
+
+
+
+
+
+	// Row buffer offsets are kept 8 byte aligned
+	static inline size_t AlignFetchOffset(size_t uOffset)
+	{
+		return (uOffset + 7) & ~((size_t) 7);
+	}
+
+
+
+	/* static */
+	const ODBCDatabase::FetchPlan* ODBCDatabase::GetFetchPlan(MetaEntityPtr pME, bool bLazyFetch)
+	{
+		boost::recursive_mutex::scoped_lock		lk(M_Mutex);
+
+		FetchPlanKey						key(pME, bLazyFetch);
+		FetchPlanMapItr					itr;
+		FetchPlan*							pPlan;
+		FetchColumn							fc;
+		MetaColumnPtr						pMC;
+		MetaColumnPtrListItr		itrKeyMC;
+		unsigned int						idx, idxKey;
+
+
+		itr = M_mapFetchPlans.find(key);
+
+		if (itr != M_mapFetchPlans.end())
+			return itr->second;
+
+		pPlan = new FetchPlan();
+		pPlan->uRowSize = 0;
+		pPlan->uRows = 1;
+		pPlan->bSupported = true;
+
+		for (idx = 0; idx < pME->GetMetaColumnsInFetchOrder()->size() && pPlan->bSupported; idx++)
+		{
+			pMC = (*(pME->GetMetaColumnsInFetchOrder()))[idx];
+
+			// Derived columns must be at the end
+			//
+			if (pMC->IsDerived())
+				break;
+
+			fc.pMC = pMC;
+			fc.bNullIndicator = bLazyFetch && pMC->IsLazyFetch();
+
+			if (fc.bNullIndicator)
+			{
+				fc.iCType					= SQL_C_BIT;
+				fc.iBufferLength	= sizeof(unsigned char);
+			}
+			else
+			{
+				switch (pMC->GetType())
+				{
+					case MetaColumn::dbfString:
+						pPlan->bSupported	= !pMC->IsStreamed();
+						fc.iCType					= SQL_C_CHAR;
+						fc.iBufferLength	= pMC->GetMaxLength() + 1;
+						break;
+
+					case MetaColumn::dbfChar:
+						fc.iCType					= SQL_C_STINYINT;
+						fc.iBufferLength	= sizeof(signed char);
+						break;
+
+					case MetaColumn::dbfShort:
+						fc.iCType					= SQL_C_SSHORT;
+						fc.iBufferLength	= sizeof(SQLSMALLINT);
+						break;
+
+					case MetaColumn::dbfBool:
+						fc.iCType					= SQL_C_BIT;
+						fc.iBufferLength	= sizeof(unsigned char);
+						break;
+
+					case MetaColumn::dbfInt:
+						fc.iCType					= SQL_C_SLONG;
+						fc.iBufferLength	= sizeof(SQLINTEGER);
+						break;
+
+					case MetaColumn::dbfLong:
+						fc.iCType					= SQL_C_SBIGINT;
+						fc.iBufferLength	= sizeof(SQLBIGINT);
+						break;
+
+					case MetaColumn::dbfFloat:
+						fc.iCType					= SQL_C_FLOAT;
+						fc.iBufferLength	= sizeof(SQLREAL);
+						break;
+
+					case MetaColumn::dbfDate:
+						fc.iCType					= SQL_C_TYPE_TIMESTAMP;
+						fc.iBufferLength	= sizeof(SQL_TIMESTAMP_STRUCT);
+						break;
+
+					case MetaColumn::dbfBinary:
+						fc.iCType					= SQL_C_BINARY;
+						fc.iBufferLength	= std::max(1, (int) pMC->GetMaxLength());
+						break;
+
+					default:
+						// BLOBs can't be bound to fixed size buffers
+						pPlan->bSupported	= false;
+						fc.iCType					= SQL_C_BINARY;
+						fc.iBufferLength	= 0;
+				}
+			}
+
+			fc.uValueOffset		= pPlan->uRowSize;
+			fc.uIndOffset			= AlignFetchOffset(fc.uValueOffset + fc.iBufferLength);
+			pPlan->uRowSize		= AlignFetchOffset(fc.uIndOffset + sizeof(SQLLEN));
+
+			pPlan->vectColumn.push_back(fc);
+		}
+
+		// Locate the primary key columns so that FindEntity() can probe without populating an object
+		//
+		for ( itrKeyMC =  pME->GetPrimaryMetaKey()->GetMetaColumns()->begin();
+					itrKeyMC != pME->GetPrimaryMetaKey()->GetMetaColumns()->end() && pPlan->bSupported;
+					itrKeyMC++)
+		{
+			for (idxKey = 0; idxKey < pPlan->vectColumn.size() && pPlan->vectColumn[idxKey].pMC != *itrKeyMC; idxKey++);
+
+			if (idxKey == pPlan->vectColumn.size() || pPlan->vectColumn[idxKey].bNullIndicator)
+				pPlan->bSupported = false;
+			else
+				pPlan->vectKeyColumn.push_back(idxKey);
+		}
+
+		if (pPlan->uRowSize)
+			pPlan->uRows = std::max((size_t) 1, std::min((size_t) ODBC_NATIVE_FETCH_ROWS, (size_t) ODBC_NATIVE_FETCH_BUFFER_SIZE / pPlan->uRowSize));
+
+		M_mapFetchPlans[key] = pPlan;
+
+		return pPlan;
+	}
+
+
+
+	/* static */
+	void ODBCDatabase::DeleteFetchPlans()
+	{
+		boost::recursive_mutex::scoped_lock		lk(M_Mutex);
 
-		if (!bSuccess)
+		FetchPlanMapItr		itr;
+
+
+		for ( itr =  M_mapFetchPlans.begin();
+					itr != M_mapFetchPlans.end();
+					itr++)
 		{
-			if (bFreeEL) delete pEL;
-			return NULL;
+			delete itr->second;
 		}
 
-		return pEL;
+		M_mapFetchPlans.clear();
 	}
 
 
 
-	EntityPtr ODBCDatabase::FindEntity(MetaEntityPtr pMetaEntity, odbc::ResultSet* pRslts)
+	bool ODBCDatabase::LoadObjectsNative(MetaEntityPtr pMetaEntity, EntityPtrList & listEntity, const std::string & strSQL, bool bRefresh, bool bLazyFetch)
 	{
-		TemporaryKey			tmpKey = *(pMetaEntity->GetPrimaryMetaKey());
-		ColumnPtrListItr	itrColumn;
-		ColumnPtr					pCol;
-		InstanceKeyPtr		pInstanceKey;
-		bool							bResult = false;
+		const FetchPlan*						pPlan = GetFetchPlan(pMetaEntity, bLazyFetch);
 
+		if (!pPlan->bSupported)
+			return false;
 
-		for (	itrColumn =  tmpKey.GetColumns().begin();
-					itrColumn != tmpKey.GetColumns().end();
-					itrColumn++)
+		NativeConnectionPtr					pCon = NULL;
+		SQLHANDLE										hStmnt = NULL;
+		SQLRETURN										ret;
+		SQLULEN											uRowsFetched = 0;
+		std::vector<char>						vectBuffer(pPlan->uRowSize * pPlan->uRows);
+		std::vector<SQLUSMALLINT>		vectRowStatus(pPlan->uRows);
+		size_t											uListSize = listEntity.size();
+		unsigned int								idx, idxRow;
+		const char*									pRow;
+		SQLLEN											iInd;
+		bool												bTruncated = false;
+		std::string									strErrPrefix("ODBCDatabase::LoadObjectsNative(): ");
+
+
+		try
 		{
+			pCon = CreateNativeConnection(m_pMetaDatabase);
+		}
+		catch (Exception & e)
+		{
+			e.LogError();
+			return false;
+		}
 
-			pCol = *itrColumn;
+		try
+		{
+			// Allocate a statement handle
+			ret = SQLAllocHandle(SQL_HANDLE_STMT, pCon->hCon, &hStmnt);
 
-			switch (pCol->GetMetaColumn()->GetType())
+			if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO)
+				throw GetODBCError(SQL_HANDLE_DBC, pCon->hCon, strErrPrefix + "Failed to allocate a statement handle. ");
+
+			// Row-wise binding of uRows rows per fetch
+			SQLSetStmtAttr(hStmnt, SQL_ATTR_ROW_BIND_TYPE, (SQLPOINTER) pPlan->uRowSize, 0);
+			SQLSetStmtAttr(hStmnt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER) (SQLULEN) pPlan->uRows, 0);
+			SQLSetStmtAttr(hStmnt, SQL_ATTR_ROW_STATUS_PTR, (SQLPOINTER) &vectRowStatus[0], 0);
+			SQLSetStmtAttr(hStmnt, SQL_ATTR_ROWS_FETCHED_PTR, (SQLPOINTER) &uRowsFetched, 0);
+
+			for (idx = 0; idx < pPlan->vectColumn.size(); idx++)
 			{
-				case MetaColumn::dbfString:
-					bResult = pCol->SetValue(pRslts->getString(pCol->GetMetaColumn()->GetName()));
-					break;
+				const FetchColumn&		fc = pPlan->vectColumn[idx];
 
-				case MetaColumn::dbfChar:
-					bResult = pCol->SetValue((char) pRslts->getByte(pCol->GetMetaColumn()->GetName()));
-					break;
+				ret = SQLBindCol(hStmnt, (SQLUSMALLINT) (idx + 1), fc.iCType, (SQLPOINTER) &vectBuffer[fc.uValueOffset], fc.iBufferLength, (SQLLEN*) &vectBuffer[fc.uIndOffset]);
 
-				case MetaColumn::dbfShort:
-					bResult = pCol->SetValue((short) pRslts->getShort(pCol->GetMetaColumn()->GetName()));
-					break;
+				if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO)
+					throw GetODBCError(SQL_HANDLE_STMT, hStmnt, strErrPrefix + "Failed to bind column " + fc.pMC->GetName() + ". ");
+			}
 
-				case MetaColumn::dbfBool:
-					bResult = pCol->SetValue((bool) pRslts->getBoolean(pCol->GetMetaColumn()->GetName()));
-					break;
+			if (m_uTrace & D3DB_TRACE_SELECT)
+				ReportInfo("ODBCDatabase::LoadObjectsNative()..........................: Database " PRINTF_POINTER_MASK ". %u rows per fetch. SQL: %s", this, pPlan->uRows, strSQL.c_str());
 
-				case MetaColumn::dbfInt:
-					bResult = pCol->SetValue((int) pRslts->getInt(pCol->GetMetaColumn()->GetName()));
-					break;
+			ret = SQLExecDirect(hStmnt, (SQLCHAR*) strSQL.c_str(), SQL_NTS);
 
-				case MetaColumn::dbfLong:
-					bResult = pCol->SetValue((long) pRslts->getLong(pCol->GetMetaColumn()->GetName()));
-					break;
+			if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO && ret != SQL_NO_DATA)
+				throw GetODBCError(SQL_HANDLE_STMT, hStmnt, strErrPrefix + "Failed to execute query. ");
 
-				case MetaColumn::dbfFloat:
-					bResult = pCol->SetValue((float) pRslts->getFloat(pCol->GetMetaColumn()->GetName()));
-					break;
+			while (ret != SQL_NO_DATA && (ret = SQLFetch(hStmnt)) != SQL_NO_DATA)
+			{
+				if (ret != SQL_SUCCESS && ret != SQL_SUCCESS_WITH_INFO)
+					throw GetODBCError(SQL_HANDLE_STMT, hStmnt, strErrPrefix + "Failed to fetch rows. ");
 
-				case MetaColumn::dbfDate:
+				for (idxRow = 0; idxRow < uRowsFetched; idxRow++)
 				{
-					odbc::Timestamp		odbcTimestamp;
+					if (vectRowStatus[idxRow] != SQL_ROW_SUCCESS && vectRowStatus[idxRow] != SQL_ROW_SUCCESS_WITH_INFO)
+						throw strErrPrefix + "Failed to fetch a row. ";
 
-					odbcTimestamp = pRslts->getTimestamp(pCol->GetMetaColumn()->GetName());
+					pRow = &vectBuffer[idxRow * pPlan->uRowSize];
 
-					if (!pRslts->wasNull())
+					// Values which didn't fit their buffer can only be read through odbc++
+					for (idx = 0; idx < pPlan->vectColumn.size(); idx++)
 					{
-						try
+						const FetchColumn&		fc = pPlan->vectColumn[idx];
+
+						iInd = *((const SQLLEN*) (pRow + fc.uIndOffset));
+
+						if (iInd == SQL_NO_TOTAL || (fc.iCType == SQL_C_CHAR ? iInd >= fc.iBufferLength : iInd > fc.iBufferLength))
 						{
-  						bResult = pCol->SetValue(D3Date(odbcTimestamp, m_pMetaDatabase->GetTimeZone()));
-  					}
-       			catch (...)
-          	{
-							pCol->SetNull();
+							bTruncated = true;
+							throw strErrPrefix + "Value of column " + fc.pMC->GetName() + " exceeds its buffer. ";
 						}
 					}
 
-					break;
-				}
-
-				case MetaColumn::dbfBinary:
-				{
-					odbc::Bytes bytes = pRslts->getBytes(pCol->GetMetaColumn()->GetName());
-					bResult = pCol->SetValue((const unsigned char*) bytes.getData(), bytes.getSize());
-					break;
+					listEntity.push_back(PopulateObject(pMetaEntity, *pPlan, pRow, bRefresh, bLazyFetch));
 				}
-
-				default:
-					bResult = false;
 			}
+		}
+		catch (std::string & e)
+		{
+			if (hStmnt) SQLFreeHandle(SQL_HANDLE_STMT, hStmnt);
+			ReleaseNativeConnection(m_pMetaDatabase, pCon);
+			listEntity.resize(uListSize);
 
-			if (!bResult)
-				break;
+			if (!bTruncated)
+				ReportWarning("%sFalling back to odbc++. %s", e.c_str(), strSQL.c_str());
+			else if (m_uTrace & D3DB_TRACE_SELECT)
+				ReportInfo("%sFalling back to odbc++.", e.c_str());
 
-			if (pRslts->wasNull())
-				pCol->SetNull();
+			return false;
 		}
-
-		if (bResult)
+		catch (...)
 		{
-			pInstanceKey = pMetaEntity->GetPrimaryMetaKey()->FindInstanceKey(&tmpKey, this);
-
-			if (pInstanceKey)
-				return pInstanceKey->GetEntity();
+			if (hStmnt) SQLFreeHandle(SQL_HANDLE_STMT, hStmnt);
+			ReleaseNativeConnection(m_pMetaDatabase, pCon);
+			throw;
 		}
 
-		return NULL;
+		if (hStmnt) SQLFreeHandle(SQL_HANDLE_STMT, hStmnt);
+		ReleaseNativeConnection(m_pMetaDatabase, pCon);
+
+		if (m_uTrace & D3DB_TRACE_STATS)
+			ReportInfo("ODBCDatabase::LoadObjectsNative()...: Database " PRINTF_POINTER_MASK ". %u for SQL: %s", this, (unsigned int) (listEntity.size() - uListSize), strSQL.c_str());
+
+		return true;
 	}
 
 
 
-	EntityPtr ODBCDatabase::PopulateObject(MetaEntityPtr pMetaEntity, odbc::ResultSet* pRslts, bool bRefresh, bool bLazyFetch)
+	bool ODBCDatabase::SetColumnFromRow(ColumnPtr pCol, const FetchColumn & fc, const char* pRow)
 	{
-		unsigned int							i, iColIdx;
-		ColumnPtr									pCol;
-		MetaColumnPtr							pMetaCol;
-		bool											bResult = false;
-		bool											bDeletObject = false;
-		bool											bDoAfterPopulate = false;
-		EntityPtr									pObject = NULL;
+		const char*		pValue = pRow + fc.uValueOffset;
+		SQLLEN				iInd = *((const SQLLEN*) (pRow + fc.uIndOffset));
 
 
-		try
+		if (iInd == SQL_NULL_DATA)
+			return pCol->SetNull();
+
+		switch (fc.pMC->GetType())
 		{
-			// See if the object exists
-			//
-			pObject = FindEntity(pMetaEntity, pRslts);
+			case MetaColumn::dbfString:
+				return pCol->SetValue(std::string(pValue, (size_t) iInd));
 
-			if (!pObject)
-			{
-				bDeletObject = true;
-				pObject = pMetaEntity->CreateInstance(this);
-			}
-			else
+			case MetaColumn::dbfChar:
+				return pCol->SetValue((char) *((const signed char*) pValue));
+
+			case MetaColumn::dbfShort:
+				return pCol->SetValue((short) *((const SQLSMALLINT*) pValue));
+
+			case MetaColumn::dbfBool:
+				return pCol->SetValue((bool) (*((const unsigned char*) pValue) != 0));
+
+			case MetaColumn::dbfInt:
+				return pCol->SetValue((int) *((const SQLINTEGER*) pValue));
+
+			case MetaColumn::dbfLong:
+				return pCol->SetValue((long) *((const SQLBIGINT*) pValue));
+
+			case MetaColumn::dbfFloat:
+				return pCol->SetValue((float) *((const SQLREAL*) pValue));
+
+			case MetaColumn::dbfDate:
 			{
-				if (!bRefresh)
-					return pObject;
+				const SQL_TIMESTAMP_STRUCT*		pTS = (const SQL_TIMESTAMP_STRUCT*) pValue;
+
+				return pCol->SetValue(D3Date(odbc::Timestamp(pTS->year, pTS->month, pTS->day, pTS->hour, pTS->minute, pTS->second, pTS->fraction), m_pMetaDatabase->GetTimeZone()));
 			}
 
-			if (!pObject)
-				return NULL;
+			case MetaColumn::dbfBinary:
+				return pCol->SetValue((const unsigned char*) pValue, (unsigned int) iInd);
+		}
 
-			bDoAfterPopulate = true;
-			pObject->On_BeforePopulatingObject();
+		return false;
+	}
 
-			iColIdx = 0;
-			for (i = 0; i < pMetaEntity->GetMetaColumnsInFetchOrder()->size(); i++)
-			{
-				pMetaCol = (*(pMetaEntity->GetMetaColumnsInFetchOrder()))[i];
-				pCol = pObject->GetColumn(pMetaCol);
 
-				// Derived columns must be at the end
-				//
-				if (pMetaCol->IsDerived())
-					break;
 
-				iColIdx++;
+	EntityPtr ODBCDatabase::FindEntity(MetaEntityPtr pMetaEntity, const FetchPlan & plan, const char* pRow)
+	{
+		MetaKeyPtr				pMK = pMetaEntity->GetPrimaryMetaKey();
+		InstanceKeyPtr		pInstanceKey;
+		unsigned int			idx;
 
-				// For lazy fetch columns we retrieve the NOT NULL indicator only
-				if (bLazyFetch && pMetaCol->IsLazyFetch())
-				{
-					bool bHasBLOB = pRslts->getBoolean(iColIdx);
 
-					if (!bHasBLOB)
-					{
-						pCol->SetNull();
-						pCol->MarkFetched();
-					}
-					else
-					{
-						pCol->MarkUnfetched();
-					}
+		// Most primary keys can be probed straight from the row buffer
+		//
+		if (KeyProbe::IsSupported(pMK))
+		{
+			KeyProbe								keyProbe(pMK);
+
+
+			for (idx = 0; idx < plan.vectKeyColumn.size(); idx++)
+			{
+				const FetchColumn&		fc = plan.vectColumn[plan.vectKeyColumn[idx]];
+				const char*						pValue = pRow + fc.uValueOffset;
+				SQLLEN								iInd = *((const SQLLEN*) (pRow + fc.uIndOffset));
 
+				if (iInd == SQL_NULL_DATA)
+				{
+					keyProbe.AddNull();
 					continue;
 				}
 
-				switch (pMetaCol->GetType())
+				switch (fc.pMC->GetType())
 				{
 					case MetaColumn::dbfString:
-						bResult = pCol->SetValue(pRslts->getString(iColIdx));
+					{
+						// CHAR(n) values arrive blank padded; KeyProbe::Add() trims and truncates them
+						// like ColumnString::SetValue() does so that they match the keys of resident objects
+						SQLLEN							iLen = iInd;
+
+						if (iLen < 0 || iLen >= fc.iBufferLength)
+							iLen = (SQLLEN) strnlen(pValue, fc.iBufferLength > 0 ? (size_t) fc.iBufferLength - 1 : 0);
+
+						keyProbe.Add(pValue, (unsigned int) iLen);
 						break;
+					}
 
 					case MetaColumn::dbfChar:
-						bResult = pCol->SetValue((char) pRslts->getByte(iColIdx));
+						keyProbe.Add((char) *((const signed char*) pValue));
 						break;
 
 					case MetaColumn::dbfShort:
-						bResult = pCol->SetValue((short) pRslts->getShort(iColIdx));
+						keyProbe.Add((short) *((const SQLSMALLINT*) pValue));
 						break;
 
 					case MetaColumn::dbfBool:
-						bResult = pCol->SetValue((bool) pRslts->getBoolean(iColIdx));
+						keyProbe.Add((bool) (*((const unsigned char*) pValue) != 0));
 						break;
 
 					case MetaColumn::dbfInt:
-						bResult = pCol->SetValue((int) pRslts->getInt(iColIdx));
+						keyProbe.Add((int) *((const SQLINTEGER*) pValue));
 						break;
 
 					case MetaColumn::dbfLong:
-						bResult = pCol->SetValue((long) pRslts->getLong(iColIdx));
+						keyProbe.Add((long) *((const SQLBIGINT*) pValue));
 						break;
 
 					case MetaColumn::dbfFloat:
-						bResult = pCol->SetValue((float) pRslts->getFloat(iColIdx));
+						keyProbe.Add((float) *((const SQLREAL*) pValue));
 						break;
 
 					case MetaColumn::dbfDate:
 					{
-						odbc::Timestamp		odbcTimestamp;
-
-						odbcTimestamp = pRslts->getTimestamp(iColIdx);
+						const SQL_TIMESTAMP_STRUCT*		pTS = (const SQL_TIMESTAMP_STRUCT*) pValue;
 
-						if (!pRslts->wasNull())
+						try
 						{
-  						try
-  						{
-    						bResult = pCol->SetValue(D3Date(odbcTimestamp, m_pMetaDatabase->GetTimeZone()));
-    					}
-         			catch (...)
-			       	{
-  							pCol->MarkUnfetched();
-								throw;
-  						}
+							keyProbe.Add(D3Date(odbc::Timestamp(pTS->year, pTS->month, pTS->day, pTS->hour, pTS->minute, pTS->second, pTS->fraction), m_pMetaDatabase->GetTimeZone()));
 						}
+						catch (...)
+						{
+							keyProbe.AddNull();
+						}
+
+						break;
+					}
+				}
+			}
+
+			pInstanceKey = pMK->FindInstanceKey(keyProbe, this);
+
+			return pInstanceKey ? pInstanceKey->GetEntity() : NULL;
+		}
+
+		TemporaryKey			tmpKey = *pMK;
+		KeyColumnArrayItr	itrColumn;
+
+
+		for (	idx = 0,	itrColumn =  tmpKey.GetColumns().begin();
+									itrColumn != tmpKey.GetColumns().end() && idx < plan.vectKeyColumn.size();
+					idx++,		itrColumn++)
+		{
+			try
+			{
+				if (!SetColumnFromRow(*itrColumn, plan.vectColumn[plan.vectKeyColumn[idx]], pRow))
+					return NULL;
+			}
+			catch (...)
+			{
+				(*itrColumn)->SetNull();
+			}
+		}
+
+		pInstanceKey = pMK->FindInstanceKey(&tmpKey, this);
+
+		return pInstanceKey ? pInstanceKey->GetEntity() : NULL;
+	}
+
+
+
+	EntityPtr ODBCDatabase::PopulateObject(MetaEntityPtr pMetaEntity, const FetchPlan & plan, const char* pRow, bool bRefresh, bool bLazyFetch)
+	{
+		unsigned int							idx;
+		ColumnPtr									pCol;
+		bool											bDeletObject = false;
+		bool											bDoAfterPopulate = false;
+		EntityPtr									pObject = NULL;
+
+
+		try
+		{
+			// See if the object exists
+			//
+			pObject = FindEntity(pMetaEntity, plan, pRow);
+
+			if (!pObject)
+			{
+				bDeletObject = true;
+				pObject = pMetaEntity->CreateInstance(this);
+			}
+			else
+			{
+				if (!bRefresh)
+					return pObject;
+			}
+
+			if (!pObject)
+				return NULL;
 
-						break;
-					}
-					case MetaColumn::dbfBlob:
-					{
-						try
-						{
-							assert(pCol->GetMetaColumn()->GetType() == MetaColumn::dbfBlob);
-							((ColumnBlobPtr) pCol)->FromStream( *(pRslts->getBinaryStream(iColIdx)));
-  						bResult = true;
-  					}
-         		catch (...)
-			      {
- 							pCol->MarkUnfetched();
-							throw;
-						}
+			bDoAfterPopulate = true;
+			pObject->On_BeforePopulatingObject();
 
-						break;
+			for (idx = 0; idx < plan.vectColumn.size(); idx++)
+			{
+				const FetchColumn&		fc = plan.vectColumn[idx];
+
+				pCol = pObject->GetColumn(fc.pMC);
+
+				// For lazy fetch columns we retrieve the NOT NULL indicator only
+				if (fc.bNullIndicator)
+				{
+					SQLLEN		iInd = *((const SQLLEN*) (pRow + fc.uIndOffset));
+					bool			bHasBLOB = iInd != SQL_NULL_DATA && *((const unsigned char*) (pRow + fc.uValueOffset)) != 0;
+
+					if (!bHasBLOB)
+					{
+						pCol->SetNull();
+						pCol->MarkFetched();
 					}
-					case MetaColumn::dbfBinary:
+					else
 					{
-						odbc::Bytes	bytes;
-						bytes = pRslts->getBytes(iColIdx);
-						bResult = pCol->SetValue((const unsigned char*) bytes.getData(), bytes.getSize());
-						break;
+						pCol->MarkUnfetched();
 					}
+
+					continue;
 				}
 
-				if (!bResult)
+				try
 				{
-					pCol->MarkUnfetched();
-					throw Exception(__FILE__, __LINE__, Exception_error, "Failed to populate column %s.", pCol->GetMetaColumn()->GetFullName().c_str());
+					if (!SetColumnFromRow(pCol, fc, pRow))
+						throw Exception(__FILE__, __LINE__, Exception_error, "Failed to populate column %s.", pCol->GetMetaColumn()->GetFullName().c_str());
 				}
-				else
+				catch (...)
 				{
-					if (pRslts->wasNull())
-						pCol->SetNull();
-
-					pCol->MarkFetched();
+					pCol->MarkUnfetched();
+					throw;
 				}
+
+				pCol->MarkFetched();
 			}
 		}
 		catch(...)
@@ -2564,7 +4845,7 @@ namespace D3
 
 				oResultSets << '[';
 
-				WriteJSONToStream(oResultSets, pRslts);
+				WriteJSONToStream(m_pMetaDatabase, oResultSets, pRslts);
 
 				delete pRslts;
 				pRslts = NULL;
@@ -2743,7 +5024,13 @@ namespace D3
 							case odbc::Types::TIMESTAMP:
 							{
 								D3Date			dt(pRslts->getTimestamp(idx+1), m_pMetaDatabase->GetTimeZone());
-								ovalue << '"' << dt.AsUTCISOString(3) << '"';
+								char				szDate[D3_DATE_FORMAT_BUFFER_SIZE];
+								size_t			uLen = dt.FormatUTCISOString(szDate, sizeof(szDate), 3);
+
+								if (uLen)
+									ovalue << '"' << szDate << '"';
+								else
+									ovalue << '"' << dt.AsUTCISOString(3) << '"';
 								break;
 							}
 
@@ -2774,376 +5061,654 @@ namespace D3
 					ostrm << ']';
 				}
 
-				delete pRslts;
-				pRslts = NULL;
-				ostrm << "]}";
+				delete pRslts;
+				pRslts = NULL;
+				ostrm << "]}";
+			}
+
+			ostrm << ']';
+		}
+		catch(odbc::SQLException& e)
+		{
+			CheckConnection(e);
+			delete pRslts;
+			delete pStmnt;
+			throw;
+		}
+		catch(...)
+		{
+			delete pRslts;
+			delete pStmnt;
+			throw;
+		}
+
+		delete pRslts;
+		delete pStmnt;
+
+		return ostrm;
+	}
+
+
+
+
+	bool ODBCDatabase::UpdateObject(EntityPtr pObj)
+	{
+		MONITORFUNC("ODBCDatabase::UpdateObject()", this);
+
+		std::auto_ptr<boost::recursive_mutex::scoped_lock>	lk(m_pMetaDatabase->m_TransactionManager.UseTransaction(this));
+
+		if (lk.get() == NULL)
+			throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::UpdateObject(): Method invoked without a pending transaction.");
+
+		std::string								strSQL;
+		int												iRowCount = 0, iParam = 0;
+		long											lNewID = 0;
+		CachedStatement						uncached;
+		CachedStatement*					pCS = NULL;
+		ParameterStreams					streams;
+
+
+		if (!pObj)
+			return false;
+
+		StatementKey							key(StatementKey::Insert, pObj->GetMetaEntity());
+
+		// Update
+		try
+		{
+			// Determine the shape of the statement, nothing to do if there is no shape
+			//
+			if (!GetUpdateStatementKey(pObj, key))
+				return true;
+
+			// Reconnect if necessary
+			Reconnect();
+
+			pCS = FindCachedStatement(m_pConnection, key);
+
+			if (!pCS)
+				pCS = PrepareStatement(m_pConnection, key, BuildUpdateSQL(pObj, key), odbc::ResultSet::TYPE_FORWARD_ONLY, uncached);
+
+			std::auto_ptr<odbc::PreparedStatement>	pUncached(pCS == &uncached ? uncached.pStmnt : NULL);
+			std::auto_ptr<odbc::ResultSet>					pRslts;
+
+			BindUpdateParameters(pCS->pStmnt, iParam, pObj, key, streams);
+
+			if (m_uTrace & (D3DB_TRACE_UPDATE | D3DB_TRACE_DELETE | D3DB_TRACE_INSERT))
+				ReportInfo("ODBCDatabase::UpdateObject()........: Database " PRINTF_POINTER_MASK ". SQL: %s", this, pCS->strSQL.c_str());
+
+			// Do the actual update
+			//
+			pCS->pStmnt->executeQuery();
+
+			// We must process all resultsets as otherwise the update may fail. Only the last
+			// resultset contains the actual records deleted from the immediate target table.
+			//
+			while (true)
+			{
+				pRslts.reset(pCS->pStmnt->getResultSet());
+
+				// Typically, update statements produce NULL result sets from which we get the update count. If
+				// there are mutliple updates (via triggers for example), the last NULL result set returned will
+				// contain the rows affected by the original query.
+				// INSERT statements on tables with an IDENTITY column will also fetch the new IDENTITY value
+				// which will be returned as a none-NULL result set
+				if (!pRslts.get())
+					iRowCount = pCS->pStmnt->getUpdateCount();
+				else
+				{
+					pRslts->next();
+					lNewID = pRslts->getLong(1);
+				}
+
+				if (!pCS->pStmnt->getMoreResults())
+					break;
+			}
+
+			pRslts.reset();
+
+			if (iRowCount != 1)
+				ReportWarning("ODBCDatabase::UpdateObject(): The SQL %s affected %i rows but method expected 1 row.", pCS->strSQL.c_str(), iRowCount);
+
+			ApplyUpdate(pObj, key, lNewID);
+		}
+		catch(odbc:: SQLException& e)
+		{
+			if (pCS)
+				strSQL = pCS->strSQL;
+
+			CheckConnection(e);
+
+			if (pCS && pCS != &uncached)
+				DiscardCachedStatement(m_pConnection, key);
+
+			throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::UpdateObject(): ODBC error occurred executing statement %s. %s", (void*) strSQL.c_str(), (void*) e.getMessage().c_str());
+		}
+		catch(Exception &)
+		{
+			throw;
+		}
+
+
+		return true;
+	}
+
+
+
+	// Returns true if pObj is the child of an entity in setBatch (only self-referencing relations can qualify since a batch holds a single MetaEntity)
+	static bool HasParentInBatch(EntityPtr pObj, const std::set<EntityPtr> & setBatch)
+	{
+		MetaEntityPtr			pME = pObj->GetMetaEntity();
+		MetaRelationPtr		pMR;
+		RelationPtr				pRelation;
+		unsigned int			idx;
+
+
+		for (idx = 0; (pMR = pME->GetParentMetaRelation(idx)) != NULL; idx++)
+		{
+			if (pMR->GetParentMetaKey()->GetMetaEntity() != pME)
+				continue;
+
+			pRelation = pObj->GetParentRelation(pMR);
+
+			if (pRelation && setBatch.find(pRelation->GetParent()) != setBatch.end())
+				return true;
+		}
+
+		return false;
+	}
+
+
+
+	bool ODBCDatabase::UpdateObjects(EntityPtrList & listEntity)
+	{
+		MONITORFUNC("ODBCDatabase::UpdateObjects()", this);
+
+		// Oracle doesn't accept multiple statements in a single request
+		if (GetMetaDatabase()->GetTargetRDBMS() != SQLServer)
+			return Database::UpdateObjects(listEntity);
+
+		std::auto_ptr<boost::recursive_mutex::scoped_lock>	lk(m_pMetaDatabase->m_TransactionManager.UseTransaction(this));
+
+		if (lk.get() == NULL)
+			throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::UpdateObjects(): Method invoked without a pending transaction.");
+
+		EntityPtrListItr					itrFirst, itrNext;
+		EntityPtr									pObj;
+		std::set<EntityPtr>				setBatch;
+		unsigned int							uRows, uMaxRows, uParams;
+		unsigned int							idx;
+
+
+		itrFirst = listEntity.begin();
+
+		while (itrFirst != listEntity.end())
+		{
+			pObj = *itrFirst;
+
+			StatementKey						key(StatementKey::Insert, NULL);
+
+			if (!pObj || !GetUpdateStatementKey(pObj, key))
+			{
+				itrFirst++;
+				continue;
+			}
+
+			// Limit the number of rows so that we stay within SQL Server's parameter limit
+			//
+			uParams = 0;
+
+			if (key.eType != StatementKey::Delete)
+			{
+				for (idx = 0; idx < pObj->GetColumnCount(); idx++)
+				{
+					if (pObj->GetColumn(idx)->GetMetaColumn()->IsDerived())
+						break;
+
+					if (key.eType == StatementKey::Insert ? !pObj->GetColumn(idx)->GetMetaColumn()->IsAutoNum() : pObj->GetColumn(idx)->IsDirty())
+						uParams++;
+				}
+			}
+
+			if (key.eType != StatementKey::Insert)
+				uParams += pObj->GetOriginalPrimaryKey()->GetColumns().size();
+
+			uMaxRows = std::max(1U, std::min((unsigned int) ODBC_DATABASE_MAX_BATCH_ROWS, ODBC_DATABASE_MAX_BATCH_PARAMETERS / std::max(1U, uParams)));
+
+			// Collect subsequent objects requiring a statement of the same shape
+			//
+			itrNext = itrFirst;
+			uRows = 1;
+			setBatch.clear();
+			setBatch.insert(pObj);
+
+			for (itrNext++; itrNext != listEntity.end() && uRows < uMaxRows; itrNext++, uRows++)
+			{
+				StatementKey					keyNext(StatementKey::Insert, NULL);
+
+				if (!*itrNext || !GetUpdateStatementKey(*itrNext, keyNext) || key < keyNext || keyNext < key)
+					break;
+
+				// The masks don't record every dirty column of such rows, so equal keys don't imply equal SET lists
+				if (!key.bCacheable || !keyNext.bCacheable)
+					break;
+
+				// A row must not be bound before a parent inserted in the same batch has its IDENTITY value
+				if (key.eType == StatementKey::Insert && HasParentInBatch(*itrNext, setBatch))
+					break;
+
+				setBatch.insert(*itrNext);
+			}
+
+			if (uRows == 1)
+			{
+				if (!UpdateObject(pObj))
+					return false;
+			}
+			else
+				UpdateObjectBatch(itrFirst, uRows, uMaxRows, key);
+
+			itrFirst = itrNext;
+		}
+
+		return true;
+	}
+
+
+
+	void ODBCDatabase::UpdateObjectBatch(EntityPtrListItr itrFirst, unsigned int uRows, unsigned int uMaxRows, StatementKey & key)
+	{
+		std::string										strSQL, strRowSQL;
+		std::vector<EntityPtr>				vectObj;
+		std::vector<long>							vectNewID;
+		EntityPtrListItr							itrObj;
+		unsigned int									idx;
+		int														iParam = 0;
+		CachedStatement								uncached;
+		CachedStatement*							pCS = NULL;
+		ParameterStreams							streams;
+
+
+		for (idx = 0, itrObj = itrFirst; idx < uRows; idx++, itrObj++)
+			vectObj.push_back(*itrObj);
+
+		key.uRows = uRows;
+
+		try
+		{
+			// Reconnect if necessary
+			Reconnect();
+
+			// Only cache full batches, the remainders vary too much to be worth it
+			if (uRows == uMaxRows)
+				pCS = FindCachedStatement(m_pConnection, key);
+			else
+				key.bCacheable = false;
+
+			if (!pCS)
+			{
+				strRowSQL = BuildUpdateSQL(vectObj.front(), key);
+
+				if (strRowSQL[strRowSQL.size() - 1] != ';')
+					strRowSQL += ';';
+
+				strSQL.reserve(strRowSQL.size() * uRows);
+
+				for (idx = 0; idx < uRows; idx++)
+					strSQL += strRowSQL;
+
+				pCS = PrepareStatement(m_pConnection, key, strSQL, odbc::ResultSet::TYPE_FORWARD_ONLY, uncached);
+			}
+
+			std::auto_ptr<odbc::PreparedStatement>	pUncached(pCS == &uncached ? uncached.pStmnt : NULL);
+			std::auto_ptr<odbc::ResultSet>					pRslts;
+
+			for (idx = 0; idx < uRows; idx++)
+				BindUpdateParameters(pCS->pStmnt, iParam, vectObj[idx], key, streams);
+
+			if (m_uTrace & (D3DB_TRACE_UPDATE | D3DB_TRACE_DELETE | D3DB_TRACE_INSERT))
+				ReportInfo("ODBCDatabase::UpdateObjectBatch()...: Database " PRINTF_POINTER_MASK ". %u rows. SQL: %s", this, uRows, strRowSQL.empty() ? pCS->strSQL.c_str() : strRowSQL.c_str());
+
+			pCS->pStmnt->executeQuery();
+
+			// As in UpdateObject(), we must process all resultsets. Each INSERT into a table with an
+			// IDENTITY column returns its new value as a none-NULL result set in statement sequence.
+			//
+			while (true)
+			{
+				pRslts.reset(pCS->pStmnt->getResultSet());
+
+				if (pRslts.get())
+				{
+					pRslts->next();
+					vectNewID.push_back(pRslts->getLong(1));
+				}
+
+				if (!pCS->pStmnt->getMoreResults())
+					break;
 			}
 
-			ostrm << ']';
+			pRslts.reset();
+
+			if (key.eType == StatementKey::Insert && GetIdentityColumn(vectObj.front()) && vectNewID.size() != uRows)
+				throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::UpdateObjectBatch(): Expected %u new IDENTITY values for %s but received %u.", uRows, vectObj.front()->GetMetaEntity()->GetName().c_str(), vectNewID.size());
+
+			for (idx = 0; idx < uRows; idx++)
+				ApplyUpdate(vectObj[idx], key, idx < vectNewID.size() ? vectNewID[idx] : 0);
 		}
-		catch(odbc::SQLException& e)
+		catch(odbc:: SQLException& e)
 		{
+			if (pCS)
+				strSQL = pCS->strSQL;
+
 			CheckConnection(e);
-			delete pRslts;
-			delete pStmnt;
-			throw;
-		}
-		catch(...)
-		{
-			delete pRslts;
-			delete pStmnt;
-			throw;
-		}
 
-		delete pRslts;
-		delete pStmnt;
+			if (pCS && pCS != &uncached)
+				DiscardCachedStatement(m_pConnection, key);
 
-		return ostrm;
+			throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::UpdateObjectBatch(): ODBC error occurred executing statement %s. %s", (void*) strSQL.c_str(), (void*) e.getMessage().c_str());
+		}
 	}
 
 
 
-
-	bool ODBCDatabase::UpdateObject(EntityPtr pObj)
+	bool ODBCDatabase::GetUpdateStatementKey(EntityPtr pObj, StatementKey & key)
 	{
-		MONITORFUNC("ODBCDatabase::UpdateObject()", this);
-
-		std::auto_ptr<boost::recursive_mutex::scoped_lock>	lk(m_pMetaDatabase->m_TransactionManager.UseTransaction(this));
-
-		if (lk.get() == NULL)
-			throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::UpdateObject(): Method invoked without a pending transaction.");
-
-		std::string								strSQL, strTemp, strWHERE;
-		bool											bFirst = true;
 		unsigned int							idx;
-		bool											bDelete = false, bHasBlob = false;
-		Entity::UpdateType				iUpdateType;
-		ColumnPtrListItr					itrKeyCol;
-		ColumnPtr									pCol, pColIDENTITY = NULL;
-		InstanceKeyPtr						pPrimaryKey;
-		int												iRowCount = 0;
+		KeyColumnArrayItr					itrKeyCol;
+		ColumnPtr									pCol;
+		bool											bDirty = false;
 
 
-		// Update
-		try
+		key = StatementKey(StatementKey::Insert, pObj->GetMetaEntity());
+
+		switch (pObj->GetUpdateType())
 		{
-			if (!pObj)
-				return false;
+			case Entity::SQL_Delete:
+				key.eType = StatementKey::Delete;
+				break;
 
-			iUpdateType = pObj->GetUpdateType();
+			case Entity::SQL_Insert:
+				key.eType = StatementKey::Insert;
+				return true;
 
-			if (iUpdateType == Entity::SQL_Update || iUpdateType == Entity::SQL_Delete)
+			case Entity::SQL_Update:
 			{
-				// Build WHERE predicate based on primary key
-				//
-				bFirst = true;
-				strWHERE = "";
+				key.eType = StatementKey::Update;
 
-				for ( itrKeyCol =  pObj->GetOriginalPrimaryKey()->GetColumns().begin();
-							itrKeyCol != pObj->GetOriginalPrimaryKey()->GetColumns().end();
-							itrKeyCol++)
+				for (idx = 0; idx < pObj->GetColumnCount(); idx++)
 				{
-					pCol = *itrKeyCol;
+					pCol = pObj->GetColumn(idx);
 
-					if (!bFirst)
-						strWHERE += " AND ";
+					if (pCol->GetMetaColumn()->IsDerived())
+						break;
 
-					bFirst =  false;
+					if (pCol->IsDirty())
+					{
+						assert(!pCol->GetMetaColumn()->IsAutoNum());
 
- 					strWHERE += pCol->GetMetaColumn()->GetName();
+						if (pCol->GetMetaColumn()->IsMandatory() && pCol->IsNull())
+							throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::Update(): Can't update column %s with NULL value.", pCol->GetMetaColumn()->GetFullName().c_str());
 
-					if (pCol->IsNull())
-					{
-						strWHERE += " IS NULL";
+						key.SetColumn(idx);
+						bDirty = true;
 					}
-					else
-					{
-  					strWHERE += "=";
-  					strWHERE += pCol->AsSQLString();
-       		}
 				}
 
-				assert(!strWHERE.empty());
+				// If we have not changed any columns, there is nothing to do
+				//
+				if (!bDirty)
+					return false;
+
+				break;
 			}
 
-			// Build SQL std::string depending on update type
+			default:			// No work if default type is none of the above
+				return false;
+		}
+
+		// NULL primary key values are tested with IS NULL
+		//
+		for ( idx = 0,	itrKeyCol =  pObj->GetOriginalPrimaryKey()->GetColumns().begin();
+										itrKeyCol != pObj->GetOriginalPrimaryKey()->GetColumns().end();
+					idx++,		itrKeyCol++)
+		{
+			if ((*itrKeyCol)->IsNull())
+				key.SetNull(idx);
+		}
+
+		return true;
+	}
+
+
+
+	std::string ODBCDatabase::BuildUpdateSQL(EntityPtr pObj, const StatementKey & key)
+	{
+		std::string								strSQL, strTemp, strWHERE;
+		bool											bFirst;
+		unsigned int							idx;
+		KeyColumnArrayItr					itrKeyCol;
+		ColumnPtr									pCol, pColIDENTITY;
+
+
+		if (key.eType == StatementKey::Update || key.eType == StatementKey::Delete)
+		{
+			// Build WHERE predicate based on primary key
 			//
-			switch (iUpdateType)
-			{
-				case Entity::SQL_Delete:
-				{
-					strSQL  = "DELETE FROM ";
-					strSQL += pObj->GetMetaEntity()->GetName();
-					strSQL += " WHERE ";
-					strSQL += strWHERE;
-					bDelete = true;
+			bFirst = true;
 
-					break;
-				}
+			for ( itrKeyCol =  pObj->GetOriginalPrimaryKey()->GetColumns().begin();
+						itrKeyCol != pObj->GetOriginalPrimaryKey()->GetColumns().end();
+						itrKeyCol++)
+			{
+				pCol = *itrKeyCol;
 
-				case Entity::SQL_Insert:
-				{
-					strSQL  = "INSERT INTO ";
-					strSQL += pObj->GetMetaEntity()->GetName();
-					strSQL += " (";
+				if (!bFirst)
+					strWHERE += " AND ";
 
-					strTemp = "";
-					bFirst = true;
-					for (idx = 0; idx < pObj->GetColumnCount(); idx++)
-					{
-						pCol = pObj->GetColumn(idx);
+				bFirst =  false;
 
-						if (pCol->GetMetaColumn()->IsDerived())
-							break;
+				strWHERE += pCol->GetMetaColumn()->GetName();
+				strWHERE += pCol->IsNull() ? " IS NULL" : "=?";
+			}
 
-						if (!pCol->GetMetaColumn()->IsAutoNum())
-						{
-							// Parameterize blobs
-							if (pCol->GetMetaColumn()->GetType() == MetaColumn::dbfBlob)
-							{
-								if(!bFirst)
-								{
-									strSQL  += ',';
-									strTemp += ',';
-								}
+			assert(!strWHERE.empty());
+		}
 
-								if (pCol->IsNull())
-								{
-									strTemp += "NULL";
-								}
-								else
-								{
-									strTemp += '?';
-									bHasBlob = true;
-								}
+		// Build SQL std::string depending on update type
+		//
+		switch (key.eType)
+		{
+			case StatementKey::Delete:
+			{
+				strSQL  = "DELETE FROM ";
+				strSQL += pObj->GetMetaEntity()->GetName();
+				strSQL += " WHERE ";
+				strSQL += strWHERE;
 
-								strSQL  += pCol->GetMetaColumn()->GetName();
-								bFirst = false;
-							}
-							else
-							{
-								if(!bFirst)
-								{
-									strSQL  += ',';
-									strTemp += ',';
-								}
+				break;
+			}
 
-								strTemp += pCol->AsSQLString();
-								strSQL  += pCol->GetMetaColumn()->GetName();
-								bFirst = false;
-							}
-						}
-					}
+			case StatementKey::Insert:
+			{
+				strSQL  = "INSERT INTO ";
+				strSQL += pObj->GetMetaEntity()->GetName();
+				strSQL += " (";
 
-					strSQL += ") VALUES (";
-					strSQL += strTemp;
-					strSQL += ");";
+				bFirst = true;
+				for (idx = 0; idx < pObj->GetColumnCount(); idx++)
+				{
+					pCol = pObj->GetColumn(idx);
 
-					// Also get new value for IDENTITY column if there is one
-					pPrimaryKey = pObj->GetPrimaryKey();
+					if (pCol->GetMetaColumn()->IsDerived())
+						break;
 
-					if (pPrimaryKey->GetMetaKey()->IsAutoNum())
+					if (!pCol->GetMetaColumn()->IsAutoNum())
 					{
-						// The first column in the primary key MUST be the AutoNum column
-						pColIDENTITY = pPrimaryKey->GetColumns().front();
-
-						switch (GetMetaDatabase()->GetTargetRDBMS())
+						if(!bFirst)
 						{
-							case SQLServer:
-							{
-								strSQL += "SELECT SCOPE_IDENTITY();";
-								break;
-							}
-							case Oracle:
-							{
-								strSQL +=  "SELECT seq_";
-								strSQL += pCol->GetEntity()->GetMetaEntity()->GetName().c_str();
-								strSQL += "_";
-								strSQL += pCol->GetMetaColumn()->GetName().c_str();
-								strSQL += ".CURRVAL FROM DUAL;";
-								break;
-							}
+							strSQL  += ',';
+							strTemp += ',';
 						}
+
+						strTemp += '?';
+						strSQL  += pCol->GetMetaColumn()->GetName();
+						bFirst = false;
 					}
-					break;
 				}
 
-				case Entity::SQL_Update:
-				{
-					strSQL  = "UPDATE ";
-					strSQL += pObj->GetMetaEntity()->GetName();
-					strSQL += " ";
+				strSQL += ") VALUES (";
+				strSQL += strTemp;
+				strSQL += ");";
 
-					bFirst = true;
-					for (idx = 0; idx < pObj->GetColumnCount(); idx++)
+				// Also get new value for IDENTITY column if there is one
+				if ((pColIDENTITY = GetIdentityColumn(pObj)) != NULL)
+				{
+					switch (GetMetaDatabase()->GetTargetRDBMS())
 					{
-						pCol = pObj->GetColumn(idx);
-
-						if (pCol->GetMetaColumn()->IsDerived())
+						case SQLServer:
+						{
+							strSQL += "SELECT SCOPE_IDENTITY();";
 							break;
-
-						if (pCol->IsDirty())
+						}
+						case Oracle:
 						{
-							assert(!pCol->GetMetaColumn()->IsAutoNum());
-
-							if (pCol->GetMetaColumn()->IsMandatory() && pCol->IsNull())
-								throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::Update(): Can't update column %s with NULL value.", pCol->GetMetaColumn()->GetFullName().c_str());
-
-							if (bFirst)
-							{
-								bFirst = false;
-								strSQL += "SET ";
-							}
-							else
-							{
-								strSQL += ',';
-							}
-
-							strSQL += pCol->GetMetaColumn()->GetName();
-							strSQL += '=';
-
-							// blob type has different handling
-							if(pCol->GetMetaColumn()->GetType() == MetaColumn::dbfBlob)
-							{
-								if (pCol->IsNull())
-								{
-									strSQL += "NULL";
-								}
-								else
-								{
-									strSQL += '?';
-									bHasBlob = true;
-								}
-							}
-							else
-							{
-								strSQL += pCol->AsSQLString();
-							}
+							strSQL +=  "SELECT seq_";
+							strSQL += pObj->GetMetaEntity()->GetName().c_str();
+							strSQL += "_";
+							strSQL += pColIDENTITY->GetMetaColumn()->GetName().c_str();
+							strSQL += ".CURRVAL FROM DUAL;";
+							break;
 						}
 					}
-
-					// If we have not changed any columns, return success
-					//
-					if (bFirst)
-						return true;
-
-					strSQL += " WHERE ";
-					strSQL += strWHERE;
-					break;
 				}
-
-				default:			// No work if default type is none of the above
-					return true;
+				break;
 			}
 
-			// Reconnect if necessary
-			Reconnect();
-
-			if (m_uTrace & (D3DB_TRACE_UPDATE | D3DB_TRACE_DELETE | D3DB_TRACE_INSERT))
-				ReportInfo("ODBCDatabase::UpdateObject()........: Database " PRINTF_POINTER_MASK ". SQL: %s", this, strSQL.c_str());
-
-			// Do the actual update
-			//
-			std::auto_ptr<odbc::PreparedStatement>	pPreparedStmnt(m_pConnection->prepareStatement(strSQL, odbc::ResultSet::TYPE_FORWARD_ONLY, odbc::ResultSet::CONCUR_READ_ONLY));
-			std::auto_ptr<odbc::ResultSet>					pRslts;
-			long																		lNewID;
-
-			if (bHasBlob)
+			case StatementKey::Update:
 			{
-				int idxBlob=0;
+				strSQL  = "UPDATE ";
+				strSQL += pObj->GetMetaEntity()->GetName();
+				strSQL += " SET ";
 
-				// let's find all columns which are blobs, not null and (if the update type is UPDATE) dirty
+				bFirst = true;
 				for (idx = 0; idx < pObj->GetColumnCount(); idx++)
 				{
 					pCol = pObj->GetColumn(idx);
 
-					// Don't bother with derived columns
 					if (pCol->GetMetaColumn()->IsDerived())
 						break;
 
-					// Is it a non-null blob?
-					if (pCol->GetMetaColumn()->GetType() == MetaColumn::dbfBlob && !pCol->IsNull())
+					if (pCol->IsDirty())
 					{
-						if (iUpdateType != Entity::SQL_Update || pCol->IsDirty())
-						{
-							ColumnBlobPtr									pBlob = (ColumnBlobPtr) pCol;
-							std::stringstream::pos_type		pos = pBlob->m_Stream.tellg();
-							pPreparedStmnt->setBinaryStream(++idxBlob, (std::istream*) &(pBlob->m_Stream), pBlob->m_Stream.str().length());
-							pBlob->m_Stream.clear();
-							pBlob->m_Stream.seekg(pos);
-						}
+						if (!bFirst)
+							strSQL += ',';
+
+						bFirst = false;
+
+						strSQL += pCol->GetMetaColumn()->GetName();
+						strSQL += "=?";
 					}
 				}
+
+				strSQL += " WHERE ";
+				strSQL += strWHERE;
+				break;
 			}
 
-			pPreparedStmnt->executeQuery();
+			default:
+				assert(false);
+		}
 
-			// We must process all resultsets as otherwise the update may fail. Only the last
-			// resultset contains the actual records deleted from the immediate target table.
-			//
-			while (true)
-			{
-				pRslts.reset(pPreparedStmnt->getResultSet());
+		return strSQL;
+	}
 
-				// Typically, update statements produce NULL result sets from which we get the update count. If
-				// there are mutliple updates (via triggers for example), the last NULL result set returned will
-				// contain the rows affected by the original query.
-				// INSERT statements on tables with an IDENTITY column will also fetch the new IDENTITY value
-				// which will be returned as a none-NULL result set
-				if (!pRslts.get())
-					iRowCount = pPreparedStmnt->getUpdateCount();
-				else
-				{
-					pRslts->next();
-					lNewID = pRslts->getLong(1);
-				}
 
-				if (!pPreparedStmnt->getMoreResults())
-					break;
-			}
 
-			if (iRowCount != 1)
-				ReportWarning("ODBCDatabase::UpdateObject(): The SQL %s affected %i rows but method expected 1 row.", strSQL.c_str(), iRowCount);
+	void ODBCDatabase::BindUpdateParameters(odbc::PreparedStatement* pStmnt, int & iParam, EntityPtr pObj, const StatementKey & key, ParameterStreams & streams)
+	{
+		unsigned int							idx;
+		KeyColumnArrayItr					itrKeyCol;
+		ColumnPtr									pCol;
 
-			switch (iUpdateType)
-			{
-				case Entity::SQL_Delete:
-					delete pObj;
-					break;
 
-				case Entity::SQL_Insert:
-					if (pColIDENTITY)
-					{
-						pPrimaryKey->On_BeforeUpdate();
-						pColIDENTITY->SetValue(lNewID);
-						pPrimaryKey->On_AfterUpdate();
-					}
+		if (key.eType != StatementKey::Delete)
+		{
+			for (idx = 0; idx < pObj->GetColumnCount(); idx++)
+			{
+				pCol = pObj->GetColumn(idx);
 
-					pObj->MarkClean();
+				// Don't bother with derived columns
+				if (pCol->GetMetaColumn()->IsDerived())
 					break;
 
-				case Entity::SQL_Update:
-					pObj->MarkClean();
-					break;
+				if (key.eType == StatementKey::Insert ? !pCol->GetMetaColumn()->IsAutoNum() : pCol->IsDirty())
+					BindParameter(pStmnt, ++iParam, pCol, streams);
 			}
 		}
-		catch(odbc:: SQLException& e)
+
+		if (key.eType != StatementKey::Insert)
 		{
-			CheckConnection(e);
-			throw Exception(__FILE__, __LINE__, Exception_error, "ODBCDatabase::UpdateObject(): ODBC error occurred executing statement %s. %s", (void*) strSQL.c_str(), (void*) e.getMessage().c_str());
+			for ( itrKeyCol =  pObj->GetOriginalPrimaryKey()->GetColumns().begin();
+						itrKeyCol != pObj->GetOriginalPrimaryKey()->GetColumns().end();
+						itrKeyCol++)
+			{
+				if (!(*itrKeyCol)->IsNull())
+					BindParameter(pStmnt, ++iParam, *itrKeyCol, streams);
+			}
 		}
-		catch(Exception &)
+	}
+
+
+
+	// The first column in the primary key MUST be the AutoNum column
+	ColumnPtr ODBCDatabase::GetIdentityColumn(EntityPtr pObj)
+	{
+		InstanceKeyPtr		pPrimaryKey = pObj->GetPrimaryKey();
+
+		if (pPrimaryKey->GetMetaKey()->IsAutoNum())
+			return pPrimaryKey->GetColumns().front();
+
+		return NULL;
+	}
+
+
+
+	void ODBCDatabase::ApplyUpdate(EntityPtr pObj, const StatementKey & key, long lNewID)
+	{
+		ColumnPtr				pColIDENTITY;
+
+
+		switch (key.eType)
 		{
-			throw;
-		}
+			case StatementKey::Delete:
+				delete pObj;
+				break;
 
+			case StatementKey::Insert:
+				if ((pColIDENTITY = GetIdentityColumn(pObj)) != NULL)
+				{
+					pObj->GetPrimaryKey()->On_BeforeUpdate();
+					pColIDENTITY->SetValue(lNewID);
+					pObj->GetPrimaryKey()->On_AfterUpdate();
+				}
 
-		return true;
+				pObj->MarkClean();
+				break;
+
+			case StatementKey::Update:
+				pObj->MarkClean();
+				break;
+
+			default:
+				break;
+		}
 	}
 
 
 
-	/* static */
+
+
 	bool ODBCDatabase::CreatePhysicalDatabase(MetaDatabasePtr pMD)
 	{
 		// This must be initialised
@@ -4098,7 +6663,9 @@ namespace D3
 	{
 		try
 		{
+			StopAsyncWorkers();
 			DeleteConnectionPools();
+			DeleteFetchPlans();
 			odbc::DriverManager::shutdown();
 		}
 		catch(odbc::SQLException& e)
@@ -5052,7 +7619,7 @@ namespace D3
 					ostrm << ',';
 
 				ostrm << '[';
-				WriteJSONToStream(ostrm, pRslts.get());
+				WriteJSONToStream(m_pMetaDatabase, ostrm, pRslts.get());
 				ostrm << ']';
 
 				pRslts.reset();
@@ -6290,7 +8857,8 @@ namespace D3
 
 
 	// helper that writes the current record in pRslts to ostrm
-	void ODBCDatabase::WriteJSONToStream(ostringstream & ostrm, odbc::ResultSet* pRslts)
+	/* static */
+	void ODBCDatabase::WriteJSONToStream(MetaDatabasePtr pMDB, ostringstream & ostrm, odbc::ResultSet* pRslts)
 	{
 		bool												bFirstRec = true;
 
@@ -6341,8 +8909,14 @@ namespace D3
 					/** An SQL TIMESTAMP */
 					case odbc::Types::TIMESTAMP:
 					{
-						D3Date			dt(pRslts->getTimestamp(idx+1), m_pMetaDatabase->GetTimeZone());
-						ovalue << '"' << dt.AsUTCISOString(3) << '"';
+						D3Date			dt(pRslts->getTimestamp(idx+1), pMDB->GetTimeZone());
+						char				szDate[D3_DATE_FORMAT_BUFFER_SIZE];
+						size_t			uLen = dt.FormatUTCISOString(szDate, sizeof(szDate), 3);
+
+						if (uLen)
+							ovalue << '"' << szDate << '"';
+						else
+							ovalue << '"' << dt.AsUTCISOString(3) << '"';
 						break;
 					}
 
@@ -32,6 +32,10 @@
 #include "D3.h"
 #include "Database.h"
 #include "D3Funcs.h"
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/thread_time.hpp>
 
 // Include ODBC stuff
 //
@@ -67,9 +71,42 @@ namespace D3
 
 		D3_CLASS_DECL(ODBCDatabase);
 
+		public:
+			//! The settings of the odbc++ connection pool of a MetaDatabase (see ConfigureConnectionPool())
+			struct ConnectionPoolSettings
+			{
+				unsigned int				uMinSize;					//!< Connections opened by ConfigureConnectionPool() and never closed for being idle
+				unsigned int				uMaxSize;					//!< The maximum number of open connections (0 means no limit)
+				unsigned int				uMaxWait;					//!< Milliseconds CreateODBCConnection() waits for a connection once uMaxSize connections are in use
+				unsigned int				uIdleTimeout;			//!< Seconds after which idle connections in excess of uMinSize are closed (0 means never)
+				unsigned int				uValidateAfter;		//!< Seconds after which an idle connection is tested before it is handed out (0 means never)
+
+				ConnectionPoolSettings() : uMinSize(0), uMaxSize(0), uMaxWait(30000), uIdleTimeout(300), uValidateAfter(60) {}
+			};
+
+			//! The counters of the odbc++ connection pool of a MetaDatabase (see GetConnectionPoolStatistics())
+			struct ConnectionPoolStatistics
+			{
+				unsigned int				uInUse;						//!< Connections currently handed out
+				unsigned int				uIdle;						//!< Connections currently waiting in the pool
+				unsigned int				uWaiting;					//!< Threads currently waiting for a connection
+				unsigned int				uPeakInUse;				//!< The highest value uInUse reached
+				unsigned long				lAcquired;				//!< Connections requested
+				unsigned long				lCreated;					//!< Connections opened
+				unsigned long				lClosed;					//!< Connections closed (idle, broken or in excess of uMaxSize)
+				unsigned long				lWaits;						//!< Requests which had to wait for a connection
+				unsigned long				lTimeouts;				//!< Requests which gave up waiting after uMaxWait milliseconds
+				unsigned long				lValidationFailures;	//!< Idle connections which failed the health check
+				unsigned long				lTotalWaitMS;			//!< Milliseconds spent waiting by all requests
+				unsigned long				lMaxWaitMS;				//!< The longest wait of any request in milliseconds
+
+				ConnectionPoolStatistics() : uInUse(0), uIdle(0), uWaiting(0), uPeakInUse(0), lAcquired(0), lCreated(0), lClosed(0), lWaits(0), lTimeouts(0), lValidationFailures(0), lTotalWaitMS(0), lMaxWaitMS(0) {}
+			};
+
 		protected:
 			// Connection Pooling >>>>>>>>>>>>>>>>
-			// We pool connections
+			// odbc++ connections are pooled per MetaDatabase (see ConnectionPoolSettings).
+			// Native connections are kept in a simple list of up to this many idle handles.
 			#define ODBC_DATABASE_MAX_POOLSIZE				20
 
 			// The native ODBC connection pool is used for native ODBC calls
@@ -84,8 +121,44 @@ namespace D3
 			typedef odbc::Connection*																		ODBCConnectionPtr;
 			typedef std::list<ODBCConnectionPtr>												ODBCConnectionPtrList;
 			typedef ODBCConnectionPtrList::iterator											ODBCConnectionPtrListItr;
-			typedef std::map<MetaDatabasePtr, ODBCConnectionPtrList>		ODBCConnectionPtrListMap;
-			typedef ODBCConnectionPtrListMap::iterator									ODBCConnectionPtrListMapItr;
+
+			//! An idle connection and the time it was returned to the pool
+			struct IdleConnection
+			{
+				ODBCConnectionPtr						pCon;
+				boost::posix_time::ptime		tReleased;
+
+				IdleConnection(ODBCConnectionPtr p, const boost::posix_time::ptime & t) : pCon(p), tReleased(t) {}
+			};
+
+			typedef std::list<IdleConnection>														IdleConnectionList;
+
+			//! The odbc++ connection pool of one MetaDatabase (protected by M_mtxConnectionPools)
+			struct ConnectionPool
+			{
+				ConnectionPoolSettings			settings;
+				ConnectionPoolStatistics		stats;						//!< uInUse counts connections being opened, uIdle and uWaiting are set by GetConnectionPoolStatistics()
+				IdleConnectionList					listIdle;					//!< Most recently released first
+				std::list<unsigned long>		listWaiting;			//!< Tickets of waiting requests, served first come first served
+				unsigned long								lNextTicket;
+				unsigned int								uOpening;					//!< Requests which reserved a slot but haven't registered their connection yet
+				bool												bAbandoned;				//!< Set by DeleteConnectionPools() if requests still referenced this, the last of them deletes this
+				boost::condition_variable		condAvailable;		//!< Signalled whenever a connection is returned or a waiter leaves
+
+				ConnectionPool() : lNextTicket(0), uOpening(0), bAbandoned(false) {}
+
+				//! Returns true if no request references this any longer
+				bool												IsUnreferenced() const	{ return listWaiting.empty() && !uOpening; }
+
+				//! Returns true if a request can be served without waiting
+				bool												HasCapacity() const		{ return !listIdle.empty() || !settings.uMaxSize || stats.uInUse < settings.uMaxSize; }
+			};
+
+			typedef ConnectionPool*																			ConnectionPoolPtr;
+			typedef std::map<MetaDatabasePtr, ConnectionPoolPtr>				ConnectionPoolPtrMap;
+			typedef ConnectionPoolPtrMap::iterator											ConnectionPoolPtrMapItr;
+			typedef std::map<ODBCConnectionPtr, ConnectionPoolPtr>			ConnectionPoolPtrByConnectionMap;
+			typedef ConnectionPoolPtrByConnectionMap::iterator					ConnectionPoolPtrByConnectionMapItr;
 
 			typedef NativeConnection*																		NativeConnectionPtr;
 			typedef std::list<NativeConnectionPtr>											NativeConnectionPtrList;
@@ -93,21 +166,190 @@ namespace D3
 			typedef std::map<MetaDatabasePtr, NativeConnectionPtrList>	NativeConnectionPtrListMap;
 			typedef NativeConnectionPtrListMap::iterator								NativeConnectionPtrListMapItr;
 
-			static boost::recursive_mutex					M_Mutex;													// Protects access to connection pools
+			static boost::recursive_mutex					M_Mutex;													// Protects access to the native connection pool and statement caches
 			static boost::recursive_mutex					M_CreateSPMutex;									// Prevents concurrent access to CreateProcedure
-			static ODBCConnectionPtrListMap				M_mapODBCConnectionPtrLists;			// ODBC Connection Pool
+			static boost::mutex										M_mtxConnectionPools;							// Protects the odbc++ connection pools
+			static ConnectionPoolPtrMap						M_mapConnectionPools;							// odbc++ Connection Pools
+			static ConnectionPoolPtrByConnectionMap	M_mapConnectionsInUse;					// The pool each odbc++ connection handed out belongs to
 			static NativeConnectionPtrListMap			M_mapNativeConnectionPtrLists;		// Native Connection Pool
 			static bool														M_bQNInitialised;									// If true, any obsolete Query Notification Services and Queues have already been removed during startup
 
-			static ODBCConnectionPtr							CreateODBCConnection(MetaDatabasePtr pMDB);
+			//! Hands out a pooled connection, opening one if none is idle. Waits for a connection if uMaxSize connections are in use and throws if none becomes available within uMaxWait milliseconds.
+			/*! Pass bNested = true when the caller already holds a connection and needs another
+					one to complete its work (e.g. the temporary connections of ConnectionManager).
+					Such requests never wait, even if this exceeds uMaxSize: otherwise uMaxSize
+					callers doing this at the same time would deadlock until uMaxWait expires.
+			*/
+			static ODBCConnectionPtr							CreateODBCConnection(MetaDatabasePtr pMDB, bool bNested = false);
+			//! Returns a connection obtained from CreateODBCConnection() to the pool
 			static void														ReleaseODBCConnection(MetaDatabasePtr pMDB, ODBCConnectionPtr & pODBCConnection);
 
+			//! Returns the pool for pMDB, creating it if needed (M_mtxConnectionPools must be locked)
+			static ConnectionPoolPtr							GetConnectionPool(MetaDatabasePtr pMDB);
+			//! Moves idle connections which exceeded uIdleTimeout from pPool to listExpired (M_mtxConnectionPools must be locked)
+			static void														CollectExpiredConnections(ConnectionPoolPtr pPool, const boost::posix_time::ptime & tNow, ODBCConnectionPtrList & listExpired);
+			//! Physically opens a new odbc++ connection
+			static ODBCConnectionPtr							OpenODBCConnection(MetaDatabasePtr pMDB);
+			//! Physically closes an odbc++ connection which is not in use
+			static void														CloseODBCConnection(ODBCConnectionPtr & pODBCConnection);
+			//! Returns true if pCon can still execute a trivial query
+			static bool														ValidateODBCConnection(MetaDatabasePtr pMDB, ODBCConnectionPtr pCon);
+			//! Opens a connection and adds it to pMDB's pool as idle (used by ConfigureConnectionPool())
+			static void														WarmUpConnection(MetaDatabasePtr pMDB);
+
 			static NativeConnectionPtr						CreateNativeConnection(MetaDatabasePtr pMDB);
 			static void														ReleaseNativeConnection(MetaDatabasePtr pMDB, NativeConnectionPtr & pNativeConnection);
 
 			static void														DeleteConnectionPools();
+			//! Closes a connection obtained from CreateODBCConnection() rather than returning it to the pool (use for broken connections)
+			static void														DeleteODBCConnection(ODBCConnectionPtr & pODBCConnection);
 			// <<<<<<<<<<<<<<<<<< Connection Pooling
 
+			// Asynchronous Queries >>>>>>>>>>>>>>>>
+			// LoadObjectsAsync() and ExecuteQueryAsJSONAsync() queue a task which a
+			// worker thread runs on a pooled connection. Workers are started on
+			// demand, up to this many, and stopped by UnInitialise().
+			#define ODBC_DATABASE_MAX_ASYNC_WORKERS		8
+
+			typedef boost::function<void ()>											AsyncTask;
+			typedef std::list<AsyncTask>													AsyncTaskList;
+			typedef std::list<boost::thread*>											AsyncWorkerList;
+			typedef AsyncWorkerList::iterator											AsyncWorkerListItr;
+
+			static boost::mutex										M_mtxAsync;												// Protects the members below
+			static boost::condition_variable			M_condAsync;											// Signalled when a task is queued or workers must stop
+			static AsyncTaskList									M_listAsyncTasks;									// Tasks waiting for a worker
+			static AsyncWorkerList								M_listAsyncWorkers;								// All worker threads started
+			static unsigned int										M_uIdleAsyncWorkers;							// Workers waiting for a task
+			static bool														M_bStopAsyncWorkers;							// If true, workers exit once the queue is empty (only set while StopAsyncWorkers() runs)
+
+			static void														QueueAsyncTask(const AsyncTask & task);
+			static void														AsyncWorker();
+			static void														StopAsyncWorkers();
+
+			//! Worker task: runs strSQL on a pooled connection and stores the rows in pResult
+			static void														LoadRowsAsync(MetaDatabasePtr pMDB, const std::string & strSQL, unsigned int uTrace, AsyncLoadResultPtr pResult);
+			//! Worker task: runs strSQL on a pooled connection and stores the JSON in pResult
+			static void														QueryAsJSONAsync(MetaDatabasePtr pMDB, const std::string & strSQL, unsigned int uTrace, AsyncJSONResultPtr pResult);
+			// <<<<<<<<<<<<<<<<<< Asynchronous Queries
+
+			// Prepared Statement Caching >>>>>>>>>>>>>>>>
+			// Each ODBC connection keeps the parameterised statements issued by
+			// LoadObject(), LoadObjects() and UpdateObject() so that a statement of
+			// a given shape is parsed and planned only once per connection.
+			#define ODBC_DATABASE_MAX_CACHED_STATEMENTS		256
+
+			// UpdateObjects() sends up to this many rows per round trip (SQL Server
+			// further limits a batch to ODBC_DATABASE_MAX_BATCH_PARAMETERS parameters)
+			#define ODBC_DATABASE_MAX_BATCH_ROWS					100
+			#define ODBC_DATABASE_MAX_BATCH_PARAMETERS		2000
+
+			// LoadObjects(RelationPtrList&) and LoadColumns() match up to this many
+			// keys per round trip (Oracle accepts at most 1000 IN list values)
+			#define ODBC_DATABASE_MAX_RELATION_BATCH			500
+
+			//! Identifies the shape of a parameterised statement
+			struct StatementKey
+			{
+				enum Type
+				{
+					SelectByKey,
+					SelectByRelation,
+					SelectColumn,
+					Insert,
+					Update,
+					Delete
+				};
+
+				Type								eType;
+				const void*					pMeta;						//!< The MetaKey, MetaRelation or MetaEntity the statement was built for
+				bool								bLazyFetch;				//!< The lazy fetch flag used to build the select list
+				boost::uint64_t			uColumns[2];			//!< Bit n is set if column n is dirty (Update only)
+				boost::uint64_t			uNulls;						//!< Bit n is set if key column n is NULL and must be tested with IS NULL
+				unsigned int				uRows;						//!< The number of rows a batched Insert, Update or Delete statement handles
+				bool								bCacheable;				//!< False if the shape can't be expressed by the masks above
+
+				StatementKey(Type eT, const void* pM, bool bLF = false) : eType(eT), pMeta(pM), bLazyFetch(bLF), uNulls(0), uRows(1), bCacheable(true)	{ uColumns[0] = uColumns[1] = 0; }
+
+				void								SetColumn(unsigned int idx)		{ if (idx < 128) uColumns[idx >> 6] |= ((boost::uint64_t) 1) << (idx & 63); else bCacheable = false; }
+				void								SetNull(unsigned int idx)			{ if (idx < 64) uNulls |= ((boost::uint64_t) 1) << idx; else bCacheable = false; }
+				bool								IsNull(unsigned int idx) const	{ return idx < 64 && (uNulls & (((boost::uint64_t) 1) << idx)); }
+
+				bool								operator<(const StatementKey & key) const;
+			};
+
+			//! A prepared statement together with the SQL it was prepared from (used for tracing)
+			struct CachedStatement
+			{
+				odbc::PreparedStatement*		pStmnt;
+				std::string									strSQL;
+
+				CachedStatement() : pStmnt(NULL) {}
+			};
+
+			typedef std::map<StatementKey, CachedStatement>							StatementCache;
+			typedef StatementCache::iterator														StatementCacheItr;
+			typedef std::map<ODBCConnectionPtr, StatementCache>					StatementCacheMap;
+			typedef StatementCacheMap::iterator													StatementCacheMapItr;
+
+			//! Owns the streams that back streamed parameters until the statement has executed
+			class ParameterStreams
+			{
+				protected:
+					std::list<std::stringstream*>		m_listStreams;
+
+				public:
+					~ParameterStreams();
+
+					std::stringstream*							Create();
+			};
+
+			static StatementCacheMap							M_mapStatementCaches;			// Prepared statements per ODBC connection (protected by M_Mutex)
+
+			static void														DeleteStatementCache(ODBCConnectionPtr pODBCConnection);
+			// <<<<<<<<<<<<<<<<<< Prepared Statement Caching
+
+			// Block Cursor Fetching >>>>>>>>>>>>>>>>
+			// Outside transactions, LoadObjects() fetches rows in blocks through a
+			// native ODBC statement. The columns are bound row-wise into a buffer
+			// laid out according to a FetchPlan computed once per MetaEntity.
+			#define ODBC_NATIVE_FETCH_ROWS							256
+			#define ODBC_NATIVE_FETCH_BUFFER_SIZE				(1024 * 1024)
+
+			//! Describes where a column of a row-wise bound result set lives within a row
+			struct FetchColumn
+			{
+				MetaColumnPtr					pMC;
+				SQLSMALLINT						iCType;						//!< The ODBC C data type the column is bound as
+				SQLLEN								iBufferLength;		//!< The size of the value buffer
+				size_t								uValueOffset;			//!< Offset of the value within a row
+				size_t								uIndOffset;				//!< Offset of the length/indicator within a row
+				bool									bNullIndicator;		//!< True if only the NOT NULL indicator of a lazy fetch column is fetched
+			};
+
+			typedef std::vector<FetchColumn>											FetchColumnVect;
+
+			//! The binding plan for instances of a MetaEntity
+			struct FetchPlan
+			{
+				FetchColumnVect								vectColumn;				//!< Bound columns in fetch order (derived columns excluded)
+				std::vector<unsigned int>			vectKeyColumn;		//!< The vectColumn index of each primary key column
+				size_t												uRowSize;					//!< The size of a row in the buffer
+				unsigned int									uRows;						//!< The number of rows fetched per SQLFetch()
+				bool													bSupported;				//!< False if the MetaEntity has columns which can't be bound to fixed size buffers (e.g. BLOBs)
+			};
+
+			typedef std::pair<MetaEntityPtr, bool>								FetchPlanKey;
+			typedef std::map<FetchPlanKey, FetchPlan*>						FetchPlanMap;
+			typedef FetchPlanMap::iterator												FetchPlanMapItr;
+
+			static FetchPlanMap										M_mapFetchPlans;					// Binding plans per MetaEntity and lazy fetch flag (protected by M_Mutex)
+
+			//! Returns the binding plan for pME (built on first use)
+			static const FetchPlan*								GetFetchPlan(MetaEntityPtr pME, bool bLazyFetch);
+			static void														DeleteFetchPlans();
+			// <<<<<<<<<<<<<<<<<< Block Cursor Fetching
+
 			bool																	m_bIsConnected;							// If true we have a valid connection
 			ODBCConnectionPtr											m_pConnection;							// ODBC connection
 			unsigned int													m_uConnectionBusyCount;			// >0 if the connection is currently processing result sets
@@ -134,6 +376,19 @@ namespace D3
 
 			static	void							UnInitialise();
 
+			//! Applies settings to pMDB's connection pool and opens uMinSize connections concurrently
+			/*! Call this at startup for each MetaDatabase so that the first requests don't pay
+					for opening connections. Until this is called, a pool uses the defaults of
+					ConnectionPoolSettings.
+			*/
+			static	void							ConfigureConnectionPool(MetaDatabasePtr pMDB, const ConnectionPoolSettings & settings);
+			//! Returns the current settings of pMDB's connection pool
+			static	ConnectionPoolSettings			GetConnectionPoolSettings(MetaDatabasePtr pMDB);
+			//! Returns a snapshot of the counters of pMDB's connection pool
+			static	ConnectionPoolStatistics		GetConnectionPoolStatistics(MetaDatabasePtr pMDB);
+			//! Closes idle connections which exceeded their pool's uIdleTimeout (the pools also do this whenever a connection is requested or returned)
+			static	void							TrimConnectionPools();
+
 			//! Load the specified column from the specified entity (primarily used for LazyFetch columns).
 			/*! @param	pColumn		The instance column to refresh.
 
@@ -143,6 +398,16 @@ namespace D3
 			*/
 			virtual ColumnPtr					LoadColumn(ColumnPtr pColumn);
 
+			//! Load the lazy fetch column pMC for all entities in listEntity which haven't fetched it yet
+			/*! The values for up to ODBC_DATABASE_MAX_RELATION_BATCH entities are fetched with one
+					query keyed by their primary keys. Entities which are not instances of pMC's MetaEntity
+					or which don't belong to this are ignored.
+
+					@return long			The number of columns loaded or a negative value if the
+														operation failed.
+			*/
+			virtual long							LoadColumns(MetaColumnPtr pMC, EntityPtrList & listEntity);
+
 			//! Load the object matching the specified key
 			/*! @param	pKey			The key to search for. This can be an InstanceKey or
 														a temporary key. The object returned will be an instance
@@ -177,6 +442,14 @@ namespace D3
 			*/
 			virtual long							LoadObjects(RelationPtr pRelation, bool bRefresh = false, bool bLazyFetch = true);
 
+			//! Loads all children from several relationships
+			/*! Relations are grouped by MetaRelation and the children of up to
+					ODBC_DATABASE_MAX_RELATION_BATCH parents are fetched with a single query
+					using an IN list (or OR'ed predicates for composite keys). Relations whose
+					parent key has NULL columns are loaded individually.
+			*/
+			virtual long							LoadObjects(RelationPtrList & listRelation, bool bRefresh = false, bool bLazyFetch = true);
+
 			//! Loads objects where the values of the instance of the MetaKey passed matches the values of the key passed in.
 			/*! This method checks the cache first and if found, returns the cached key.
 			/*! @param pMetaKey		The MetaKey we lookup.
@@ -237,6 +510,20 @@ namespace D3
 			*/
 			virtual EntityPtrListPtr	LoadObjects(MetaEntityPtr pMetaEntity, const std::string & strSQL, bool bRefresh = false, bool bLazyFetch = true)	{ return LoadObjects(pMetaEntity, NULL, strSQL, bRefresh, bLazyFetch); }
 
+			//! Runs strSQL through a forward-only cursor and passes each row to visitor without creating any objects (see Database::VisitObjects())
+			virtual long							VisitRows(MetaEntityPtr pME, const std::string & strSQL, RowVisitor & visitor, bool bLazyFetch = true);
+			//! Runs strSQL which must return the columns of row through a forward-only cursor and passes each row to visitor
+			virtual long							VisitRows(RowView & row, const std::string & strSQL, RowVisitor & visitor);
+
+			//! Runs strSQL on a worker thread unless this has a pending transaction (see Database::LoadObjectsAsync())
+			virtual AsyncLoadResultPtr	LoadObjectsAsync(MetaEntityPtr pME, const std::string & strSQL, bool bRefresh = false, bool bLazyFetch = true);
+
+			//! Starts loading all instances of pME using the same query as LoadObjects(pME, bRefresh, bLazyFetch)
+			virtual AsyncLoadResultPtr	LoadAllAsync(MetaEntityPtr pME, bool bRefresh = false, bool bLazyFetch = true)		{ return LoadObjectsAsync(pME, GetLoadAllSQL(pME, bLazyFetch), bRefresh, bLazyFetch); }
+
+			//! Runs strSQL on a worker thread unless this has a pending transaction (see Database::ExecuteQueryAsJSONAsync())
+			virtual AsyncJSONResultPtr	ExecuteQueryAsJSONAsync(const std::string & strSQL);
+
 			//! Loads objects by calling the stored procedure specified
 			/*! This method allows you to call a stored procedure to retrieve multiple records from multiple resultsets in a single call.
 
@@ -371,6 +658,19 @@ namespace D3
 			*/
 			bool											UpdateObject(EntityPtr pObj);
 
+			//! Update several objects.
+			/*! On SQL Server, consecutive objects with the same MetaEntity and update type
+					(and for UPDATEs, the same set of dirty columns) are sent in batches of up to
+					ODBC_DATABASE_MAX_BATCH_ROWS parameterised statements per round trip. New
+					IDENTITY values are read back from the batch in the same sequence.
+
+					Unlike UpdateObject(), batched UPDATEs and DELETEs don't warn if a statement
+					affects other than exactly one row as triggers make the counts ambiguous.
+
+					On Oracle, this simply calls UpdateObject() for each object.
+			*/
+			virtual bool							UpdateObjects(EntityPtrList & listEntity);
+
 			//! This method does a blocking call and does not return until an Alert fires
 			virtual DatabaseAlertPtr	MonitorDatabaseAlerts(DatabaseAlertManagerPtr pDBAlertMngr);
 
@@ -418,13 +718,76 @@ namespace D3
 			*/
 			EntityPtrListPtr					LoadObjects(MetaEntityPtr pMetaEntity, EntityPtrListPtr pEntityList, const std::string & strSQL, bool bRefresh, bool bLazyFetch = true);
 
+			//! Loads all instances of pMetaEntity whose pListTarget columns match the values in aSource
+			/*! The query is issued through a prepared statement cached with the connection.
+					NULL source columns are tested with IS NULL, all other values are bound as
+					parameters. If pSwitch is not NULL, the predicate is extended by
+					pSwitch's column = pSwitch's value (see MetaRelation::IsChildSwitch()).
+					Objects loaded are appended to listEntity.
+			*/
+			void											LoadObjectsByKey(StatementKey & key, MetaEntityPtr pMetaEntity, MetaColumnPtrListPtr pListTarget, KeyColumnArray & aSource, ColumnPtr pSwitch, EntityPtrList & listEntity, bool bRefresh, bool bLazyFetch);
+
+			//! Loads the children of uRows relations starting at itrFirst which must all be instances of pMR
+			void											LoadObjectsByRelations(MetaRelationPtr pMR, RelationPtrListItr itrFirst, unsigned int uRows, EntityPtrList & listEntity, bool bRefresh, bool bLazyFetch);
+
+			//! Loads column pMC for uRows entities starting at itrFirst (see LoadColumns())
+			void											LoadColumnBatch(MetaColumnPtr pMC, EntityPtrListItr itrFirst, unsigned int uRows);
+
+			//! Appends a predicate to strSQL which matches any of uRows parameterised value sets of the columns in pListColumn
+			void											AppendKeyListPredicate(std::string & strSQL, MetaColumnPtrListPtr pListColumn, unsigned int uRows);
+
+			//! Sets pColumn from column iIdx of the current row of pRslts and marks it fetched (or unfetched if this fails)
+			bool											FetchColumnValue(ColumnPtr pColumn, odbc::ResultSet* pRslts, int iIdx);
+
+			//! Returns the cached statement for key on pCon or NULL if it hasn't been prepared yet
+			CachedStatement*					FindCachedStatement(ODBCConnectionPtr pCon, const StatementKey & key);
+			//! Prepares strSQL on pCon and caches it under key (if the key is cacheable)
+			/*! If the key is not cacheable, the statement is prepared into uncached and the
+					method returns &uncached. In this case the caller owns uncached.pStmnt.
+			*/
+			CachedStatement*					PrepareStatement(ODBCConnectionPtr pCon, const StatementKey & key, const std::string & strSQL, int iResultSetType, CachedStatement & uncached);
+			//! Removes the statement cached for key on pCon (called after a statement failed)
+			void											DiscardCachedStatement(ODBCConnectionPtr pCon, const StatementKey & key);
+			//! UpdateObject() and UpdateObjects() helpers
+			/*! GetUpdateStatementKey() determines the shape of the statement required to update pObj
+					and returns false if pObj needs no update. BuildUpdateSQL() returns the SQL for a single
+					object of that shape, BindUpdateParameters() binds pObj's values starting with parameter
+					iParam + 1 and ApplyUpdate() brings pObj up to date once the statement has executed.
+			*/
+			bool											GetUpdateStatementKey(EntityPtr pObj, StatementKey & key);
+			std::string								BuildUpdateSQL(EntityPtr pObj, const StatementKey & key);
+			void											BindUpdateParameters(odbc::PreparedStatement* pStmnt, int & iParam, EntityPtr pObj, const StatementKey & key, ParameterStreams & streams);
+			ColumnPtr									GetIdentityColumn(EntityPtr pObj);
+			void											ApplyUpdate(EntityPtr pObj, const StatementKey & key, long lNewID);
+			//! Executes a batch of uRows objects of the same statement shape starting at itrFirst (the statement is cached if uRows == uMaxRows)
+			void											UpdateObjectBatch(EntityPtrListItr itrFirst, unsigned int uRows, unsigned int uMaxRows, StatementKey & key);
+			//! Binds the value of pCol to parameter idx of pStmnt
+			void											BindParameter(odbc::PreparedStatement* pStmnt, int idx, ColumnPtr pCol, ParameterStreams & streams);
+
 			void											ClearCache()											{}
 			virtual bool							CheckDatabaseVersion();
 
 			// LoadObjects() helpers
+			//! Returns the query which selects all instances of pME
+			std::string								GetLoadAllSQL(MetaEntityPtr pME, bool bLazyFetch);
 			EntityPtr									PopulateObject(MetaEntityPtr pMetaEntity, odbc::ResultSet* pRslts, bool bRefresh, bool bLazyFetch = true);
+			//! Reads the current row of pRslts into row
+			static void								PopulateRowView(MetaDatabasePtr pMDB, RowView & row, odbc::ResultSet* pRslts);
 			EntityPtr									FindEntity(MetaEntityPtr pMetaEntity, odbc::ResultSet* pRslts);
 
+			//! Executes strSQL through a native block cursor and appends the objects to listEntity
+			/*! Returns false without touching listEntity if the query could not be processed this
+					way (e.g. because pMetaEntity has BLOB columns or a value didn't fit its buffer), in
+					which case the caller is expected to use the odbc++ path instead.
+			*/
+			bool											LoadObjectsNative(MetaEntityPtr pMetaEntity, EntityPtrList & listEntity, const std::string & strSQL, bool bRefresh, bool bLazyFetch);
+			//! Same as the odbc++ based PopulateObject() but reads the values from a row bound according to plan
+			EntityPtr									PopulateObject(MetaEntityPtr pMetaEntity, const FetchPlan & plan, const char* pRow, bool bRefresh, bool bLazyFetch);
+			//! Same as the odbc++ based FindEntity() but reads the values from a row bound according to plan
+			EntityPtr									FindEntity(MetaEntityPtr pMetaEntity, const FetchPlan & plan, const char* pRow);
+			//! Sets pCol to the value of column fc in pRow, returns false if the value can't be assigned
+			bool											SetColumnFromRow(ColumnPtr pCol, const FetchColumn & fc, const char* pRow);
+
 			//! Create Physcial Database.
 			/*! Clients use MetaDictionary::CreatePhysicalDatabase() to create a
 					physical database. This method is called in turn in order to ensure
@@ -549,7 +912,7 @@ namespace D3
 			void											Reconnect();
 
 			//! Helper: writes the data from the current record in to the stream provided
-			void											WriteJSONToStream(std::ostringstream & ostrm, odbc::ResultSet* pRslts);
+			static void								WriteJSONToStream(MetaDatabasePtr pMDB, std::ostringstream & ostrm, odbc::ResultSet* pRslts);
 
 			// This notification is sent by the associated MetaDatabase object
 			// once the object has been constructed and initialised
@@ -2632,7 +2632,7 @@ namespace D3
 	{
 		OTLStreamPoolPtr									pStrmPool;
 		OTLStreamPool::OTLStreamPtr				pStrm;
-		ColumnPtrList::iterator						itrC;
+		KeyColumnArrayItr									itrC;
 		ColumnPtr													pColumn;
 		OTLRecord													otlRec;
 		EntityPtr													pObject = NULL;
@@ -2763,7 +2763,7 @@ namespace D3
 			std::string							strSQL;
 			EntityPtrList						listEntity;
 			bool										bFirst;
-			ColumnPtrListItr				itrKeyCol;
+			KeyColumnArrayItr				itrKeyCol;
 			ColumnPtr								pCol;
 
 
@@ -2813,7 +2813,7 @@ namespace D3
 		MetaRelationPtr					pMR;
 		MetaKeyPtr							pMetaKey;
 		KeyPtr									pKey;
-		ColumnPtrListItr				itrSrceColumn;
+		KeyColumnArrayItr				itrSrceColumn;
 		MetaColumnPtrListItr		itrTrgtColumn;
 		ColumnPtr								pSrce;
 		MetaColumnPtr						pTrgt;
@@ -2922,7 +2922,7 @@ namespace D3
 		}
 		else
 		{
-			ColumnPtrListItr				itrSrceColumn;
+			KeyColumnArrayItr				itrSrceColumn;
 			MetaColumnPtrListItr		itrTrgtColumn;
 			ColumnPtr								pSrce;
 			MetaColumnPtr						pTrgt;
@@ -3015,7 +3015,7 @@ namespace D3
 		std::string							strSQL;
 		EntityPtrList						listEntity;
 		bool										bFirst, bResult=false;
-		ColumnPtrListItr				itrKeyCol;
+		KeyColumnArrayItr				itrKeyCol;
 		ColumnPtr								pCol;
 		KeyPtr									pKey;
 
@@ -3170,9 +3170,64 @@ namespace D3
 
 	EntityPtr OTLDatabase::FindObject(MetaEntityPtr pMetaEntity, OTLRecord& otlRec)
 	{
-		TemporaryKey			tmpKey = *(pMetaEntity->GetPrimaryMetaKey());
+		MetaKeyPtr				pMK = pMetaEntity->GetPrimaryMetaKey();
 		InstanceKeyPtr		pInstanceKey;
-		ColumnPtrListItr	itrColumn;
+
+
+		// Probe the key straight from the OTL column buffers unless a value needs conversion
+		//
+		if (KeyProbe::IsSupported(pMK))
+		{
+			KeyProbe								keyProbe(pMK);
+			MetaColumnPtrListItr		itrMC;
+			MetaColumnPtr						pMC;
+			bool										bProbe = true;
+
+
+			for (	itrMC =  pMK->GetMetaColumns()->begin();
+						itrMC != pMK->GetMetaColumns()->end() && bProbe;
+						itrMC++)
+			{
+				pMC = *itrMC;
+
+				OTLColumn &	otlCol = otlRec[pMC->GetName()];
+
+				if (otlCol.IsNull())
+				{
+					keyProbe.AddNull();
+					continue;
+				}
+
+				if (otlCol.m_iType != pMC->GetType())
+				{
+					bProbe = false;
+					break;
+				}
+
+				switch (pMC->GetType())
+				{
+					case MetaColumn::dbfString:		keyProbe.Add(*(otlCol.m_Value.pstrVal));	break;
+					case MetaColumn::dbfChar:			keyProbe.Add(otlCol.m_Value.cVal);				break;
+					case MetaColumn::dbfShort:		keyProbe.Add(otlCol.m_Value.sVal);				break;
+					case MetaColumn::dbfBool:			keyProbe.Add(otlCol.m_Value.bVal);				break;
+					case MetaColumn::dbfInt:			keyProbe.Add(otlCol.m_Value.iVal);				break;
+					case MetaColumn::dbfLong:			keyProbe.Add(otlCol.m_Value.lVal);				break;
+					case MetaColumn::dbfFloat:		keyProbe.Add(otlCol.m_Value.fVal);				break;
+					case MetaColumn::dbfDate:			keyProbe.Add(*(otlCol.m_Value.pdtVal));		break;
+					default:											bProbe = false;
+				}
+			}
+
+			if (bProbe)
+			{
+				pInstanceKey = pMK->FindInstanceKey(keyProbe, this);
+
+				return pInstanceKey ? pInstanceKey->GetEntity() : NULL;
+			}
+		}
+
+		TemporaryKey			tmpKey = *pMK;
+		KeyColumnArrayItr	itrColumn;
 		ColumnPtr					pCol;
 
 
@@ -3184,7 +3239,7 @@ namespace D3
 			otlRec[pCol->GetMetaColumn()->GetName()].AssignToD3Column(pCol);
 		}
 
-		pInstanceKey = pMetaEntity->GetPrimaryMetaKey()->FindInstanceKey(&tmpKey, this);
+		pInstanceKey = pMK->FindInstanceKey(&tmpKey, this);
 
 		if (pInstanceKey)
 			return pInstanceKey->GetEntity();
@@ -3608,7 +3663,7 @@ namespace D3
 			std::string												strSQL, strTemp, strWHERE,strSEQ;
 			bool															bFirst = true;
 			bool															bDelete = false;
-			ColumnPtrListItr									itrKeyCol;
+			KeyColumnArrayItr									itrKeyCol;
 			ColumnPtr													pCol;
 			InstanceKeyPtr										pPrimaryKey;
 			otl_nocommit_stream								oRslts;
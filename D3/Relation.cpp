@@ -92,7 +92,9 @@ namespace D3
 			m_uParentIdx(D3_UNDEFINED_ID),
 			m_uChildIdx(D3_UNDEFINED_ID),
 			m_Flags(flags),
-			m_pSwitchColumn(NULL)
+			m_pSwitchColumn(NULL),
+			m_uBatchFaultSize(0),
+			m_bLoadLazyColumns(false)
 	{
 		Init(strInstanceClassName, pSwitchColumn, strSwitchColumnValue);
 	}
@@ -109,7 +111,9 @@ namespace D3
 			m_uParentIdx(D3_UNDEFINED_ID),
 			m_uChildIdx(D3_UNDEFINED_ID),
 			m_Flags(flags),
-			m_pSwitchColumn(NULL)
+			m_pSwitchColumn(NULL),
+			m_uBatchFaultSize(0),
+			m_bLoadLazyColumns(false)
 	{
 		Init(strInstanceClassName, pSwitchColumn, strSwitchColumnValue);
 	}
@@ -2476,7 +2480,7 @@ namespace D3
 
 		// Create and initialise the object
 		//
-		pRelation = (RelationPtr) m_pInstanceClass->CreateInstance();
+		pRelation = (RelationPtr) ObjectArena::CreateInstance(pEntity->GetDatabase()->GetObjectArena(), *m_pInstanceClass);
 
 		pRelation->m_pMetaRelation = this;
 		pRelation->m_pParentKey = pEntity->GetInstanceKey(m_pParentKey->GetMetaKeyIndex());
@@ -3060,7 +3064,175 @@ namespace D3
 		if (!m_pChildDatabase || !m_pParentKey || m_pParentKey->IsNull())
 			return;
 
-		m_pChildDatabase->LoadObjects(this, bRefresh, bLazyFetch);
+		if (m_pMetaRelation->GetBatchFaultSize() > 1)
+		{
+			if (IsNavigated() && !bRefresh)
+				return;
+
+			RelationPtrList					listRelation;
+
+			CollectBatchFaultSiblings(listRelation);
+			LoadAll(listRelation, bRefresh, bLazyFetch);
+			return;
+		}
+
+		if (m_pChildDatabase->LoadObjects(this, bRefresh, bLazyFetch) >= 0 && m_pMetaRelation->GetLoadLazyColumns())
+			LoadLazyColumns();
+	}
+
+
+
+	long Relation::LoadLazyColumns()
+	{
+		EntityPtrList			listEntity;
+
+
+		if (!m_pChildDatabase)
+			return 0;
+
+		GetChildrenSnapshot(listEntity);
+
+		return m_pChildDatabase->LoadLazyColumns(listEntity);
+	}
+
+
+
+	void Relation::CollectBatchFaultSiblings(RelationPtrList & listRelation)
+	{
+		InstanceKeyPtrSetPtr		pSet;
+		InstanceKeyPtrSetItr		itrStart, itrKey;
+		InstanceKeyPtr					pParentKey;
+		EntityPtr								pParent;
+		RelationPtr							pRelation;
+		unsigned int						uMax = m_pMetaRelation->GetBatchFaultSize();
+		unsigned int						uVisited, uMaxVisited = 4 * uMax;
+		bool										bWrapped = false;
+
+
+		listRelation.push_back(this);
+
+		pSet = m_pParentKey->GetMetaKey()->GetInstanceKeySet(GetParentDatabase());
+
+		if (!pSet || pSet->empty())
+			return;
+
+		// Start with the parents following this' parent and wrap around once. Only visit a
+		// few times uMax keys so that traversing a large set whose parents have mostly been
+		// navigated doesn't rescan the whole set on each first navigation.
+		//
+		itrStart = pSet->upper_bound(m_pParentKey);
+
+		for (itrKey = itrStart, uVisited = 0; listRelation.size() < uMax && uVisited < uMaxVisited; uVisited++)
+		{
+			if (itrKey == pSet->end())
+			{
+				if (bWrapped)
+					break;
+
+				bWrapped = true;
+				itrKey = pSet->begin();
+			}
+
+			if (bWrapped && itrKey == itrStart)
+				break;
+
+			pParentKey = (InstanceKeyPtr) *itrKey;
+			itrKey++;
+
+			pParent = pParentKey->GetEntity();
+
+			if (pParentKey == m_pParentKey || !pParent || pParent->IsNew() || pParentKey->IsNull())
+				continue;
+
+			pRelation = pParent->GetChildRelation(m_pMetaRelation, m_pChildDatabase);
+
+			if (pRelation && pRelation != this && !pRelation->IsNavigated())
+				listRelation.push_back(pRelation);
+		}
+	}
+
+
+
+	/* static */
+	long Relation::LoadAll(RelationPtrList & listRelation, bool bRefresh, bool bLazyFetch)
+	{
+		typedef std::map<DatabasePtr, RelationPtrList>		DatabaseRelationsMap;
+
+		DatabaseRelationsMap						mapDBRelations;
+		DatabaseRelationsMap::iterator	itrDBRelations;
+		RelationPtrListItr							itrRelation;
+		RelationPtr											pRelation;
+		long														lTotal = 0, lCount;
+
+
+		// Group the relations by child database
+		//
+		for ( itrRelation =  listRelation.begin();
+					itrRelation != listRelation.end();
+					itrRelation++)
+		{
+			pRelation = *itrRelation;
+
+			if (!pRelation || !pRelation->m_pChildDatabase || !pRelation->m_pParentKey || pRelation->m_pParentKey->IsNull())
+				continue;
+
+			mapDBRelations[pRelation->m_pChildDatabase].push_back(pRelation);
+		}
+
+		for ( itrDBRelations =  mapDBRelations.begin();
+					itrDBRelations != mapDBRelations.end();
+					itrDBRelations++)
+		{
+			lCount = itrDBRelations->first->LoadObjects(itrDBRelations->second, bRefresh, bLazyFetch);
+
+			if (lCount < 0)
+				return lCount;
+
+			EntityPtrList			listLazy;
+
+			for ( itrRelation =  itrDBRelations->second.begin();
+						itrRelation != itrDBRelations->second.end();
+						itrRelation++)
+			{
+				(*itrRelation)->MarkNavigated();
+
+				if ((*itrRelation)->m_pMetaRelation->GetLoadLazyColumns())
+					(*itrRelation)->GetChildrenSnapshot(listLazy);
+			}
+
+			if (!listLazy.empty())
+				itrDBRelations->first->LoadLazyColumns(listLazy);
+
+			lTotal += lCount;
+		}
+
+		return lTotal;
+	}
+
+
+
+	/* static */
+	long Relation::LoadAll(MetaRelationPtr pMR, EntityPtrList & listParent, bool bRefresh, bool bLazyFetch, DatabasePtr pDB)
+	{
+		RelationPtrList									listRelation;
+		EntityPtrListItr								itrParent;
+		RelationPtr											pRelation;
+
+
+		for ( itrParent =  listParent.begin();
+					itrParent != listParent.end();
+					itrParent++)
+		{
+			if (!*itrParent || (*itrParent)->GetMetaEntity() != pMR->GetParentMetaKey()->GetMetaEntity())
+				continue;
+
+			pRelation = (*itrParent)->GetChildRelation(pMR, pDB);
+
+			if (pRelation)
+				listRelation.push_back(pRelation);
+		}
+
+		return LoadAll(listRelation, bRefresh, bLazyFetch);
 	}
 
 
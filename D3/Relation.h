@@ -210,6 +210,8 @@ namespace D3
 			RelationIndex						m_uChildIdx;							//!< The index that meets the criteria: m_pParentKey->GetMetaEntity()->GetChildRelation(idx) == this
 			ColumnPtr								m_pSwitchColumn;					//!< If not NULL, this member is a switch
 			Flags										m_Flags;									//!< See MetaRelation::Flags above
+			unsigned int						m_uBatchFaultSize;				//!< See SetBatchFaultSize()
+			bool										m_bLoadLazyColumns;				//!< See SetLoadLazyColumns()
 			std::string							m_strHSTopicsJSON;				//!< JSON string containing an array of help topics associated with this
 
 			//! Unused ctor() - only here for D3 Class stuff
@@ -345,6 +347,23 @@ namespace D3
 			//! Returns a column that contains the switch value
 			ColumnPtr								GetSwitchColumn()											{ return m_pSwitchColumn; }
 
+			//! Returns the maximum number of relations Relation::LoadAll() loads when one of them is first navigated
+			unsigned int						GetBatchFaultSize() const							{ return m_uBatchFaultSize; }
+			//! Enables batch faulting for instances of this
+			/*! If uSize is greater than 1, Relation::LoadAll() on a relation which hasn't been
+					navigated yet also loads this relation for up to uSize - 1 other resident parents
+					in the same database whose relation hasn't been navigated either (see
+					Relation::LoadAll(RelationPtrList&)). Once navigated, Relation::LoadAll() only
+					accesses the database again if bRefresh is true.
+					The default is 0 which disables batch faulting.
+			*/
+			void										SetBatchFaultSize(unsigned int uSize)	{ m_uBatchFaultSize = uSize; }
+
+			//! Returns true if Relation::LoadAll() also loads the lazy fetch columns of the children
+			bool										GetLoadLazyColumns() const						{ return m_bLoadLazyColumns; }
+			//! If set, Relation::LoadAll() loads all lazy fetch columns of the children with one query per column (see Database::LoadLazyColumns())
+			void										SetLoadLazyColumns(bool bLoad)				{ m_bLoadLazyColumns = bLoad; }
+
 			//! Returns all known and accessible instances of D3::MetaRelation as a JSON stream
 			static std::ostream &			AllAsJSON(RoleUserPtr pRoleUser, std::ostream & ostrm);
 
@@ -503,6 +522,7 @@ short FindBestCompatibilityWithGroupBelow(InstanceKeyPtr pPGPrimaryKey)
 		friend class Entity;					//!< These objects assume ownership.
 
 		D3_CLASS_DECL(Relation);
+		D3_ARENA_OPERATORS;
 
 		protected:
 			#define D3_RELATION_UPDATING	  0x01						//<! flag indicating whether or not this is in the process of being updated
@@ -590,6 +610,24 @@ short FindBestCompatibilityWithGroupBelow(InstanceKeyPtr pPGPrimaryKey)
 			//! Populates the Relation
 			void												LoadAll(bool bRefresh = false, bool bLazyFetch = true);
 
+			//! Populates all relations in the list
+			/*! Relations which are instances of the same MetaRelation and share the same child
+					database are loaded together (see Database::LoadObjects(RelationPtrList&)) which is
+					much cheaper than calling LoadAll() for each relation. All relations loaded
+					successfully are marked as navigated.
+
+					@return long			The number of objects loaded or a negative value if the
+														operation failed.
+			*/
+			static long									LoadAll(RelationPtrList & listRelation, bool bRefresh = false, bool bLazyFetch = true);
+
+			//! Populates relation pMR of each entity in listParent
+			/*! This is a convenience method which collects the child relation pMR (for database pDB)
+					of all entities in listParent and then calls LoadAll(RelationPtrList&). Entities which
+					are not instances of pMR's parent MetaEntity are ignored.
+			*/
+			static long									LoadAll(MetaRelationPtr pMR, EntityPtrList & listParent, bool bRefresh = false, bool bLazyFetch = true, DatabasePtr pDB = NULL);
+
 			//! Writes the complete contents of this as XML to the out stream
 			virtual std::ostream &			AsJSON(RoleUserPtr pRoleUser, std::ostream & ostrm, bool* pFirstChild = NULL);
 
@@ -601,6 +639,9 @@ short FindBestCompatibilityWithGroupBelow(InstanceKeyPtr pPGPrimaryKey)
 			*/
 			void												GetSnapshot(EntityPtrListPtr pEL);
 
+			//! Loads all lazy fetch columns of all children not yet fetched with one query per column
+			long												LoadLazyColumns();
+
 		protected:
 			//! This method returns true if this is not a switched relation or if the child meets the switches criteria.
 			virtual bool								IsValidChild(EntityPtr pKey);
@@ -623,6 +664,9 @@ short FindBestCompatibilityWithGroupBelow(InstanceKeyPtr pPGPrimaryKey)
 			//! Populates the list passed in with all of this' children
 			void												GetChildrenSnapshot(EntityPtrList & listEntity);
 
+			//! Populates listRelation with this followed by up to GetBatchFaultSize() - 1 sibling relations which haven't been navigated
+			void												CollectBatchFaultSiblings(RelationPtrList & listRelation);
+
 			//! Searches the matching key from pChild in m_setChildKey list and returns an iterator
 			InstanceKeyPtrSetItr				FindChild(InstanceKeyPtr pChild, bool bShouldExist = false);
 
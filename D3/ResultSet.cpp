@@ -58,6 +58,7 @@ namespace D3
 
 	ResultSet::ResultSet(DatabasePtr pDB, MetaEntityPtr pME)
 	: m_bKeepObjects(false),
+		m_bLoadLazyColumns(false),
 		m_lID(0),
 		m_pDatabase(pDB),
 		m_pMetaEntity(pME),
@@ -171,6 +172,9 @@ namespace D3
 				pEntity = *itr;
 				pEntity->On_AddedToResultSet(this);
 			}
+
+			if (m_bLoadLazyColumns && !m_pListEntity->empty())
+				m_pDatabase->LoadLazyColumns(*m_pListEntity);
 		}
 	}
 
@@ -228,7 +232,7 @@ namespace D3
 		ResultSet*							pRS = NULL;
 		MetaKeyPtr							pMetaKey;
 		KeyPtr									pKey;
-		ColumnPtrListItr				itrSrceColumn;
+		KeyColumnArrayItr				itrSrceColumn;
 		MetaColumnPtrListItr		itrTrgtColumn;
 		ColumnPtr								pSrce;
 		MetaColumnPtr						pTrgt;
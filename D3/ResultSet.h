@@ -33,6 +33,7 @@ namespace D3
 			DatabasePtr							m_pDatabase;									//!< The resultset holds objects from this database
 			MetaEntityPtr						m_pMetaEntity;								//!< This ResultSet includes objects of this MetaEntity type
 			bool										m_bKeepObjects;								//!< If true, objects fetched remain in the database, else they are discarded when navigating to a new page or closing the result set
+			bool										m_bLoadLazyColumns;						//!< If true, lazy fetch columns of all objects in a page are loaded when the page is loaded
 			bool										m_bInitialised;								//!< Must be true before any navigation methods can be called
 			EntityPtrListPtr				m_pListEntity;								//!< If m_bHasResult=true, contains the entities in the current page
 			unsigned long						m_uTotalSize;									//!< The total number of records in the set
@@ -224,6 +225,16 @@ namespace D3
 			*/
 			void											SetKeepObjects(bool bKeepObjects);
 
+			//! This method indicates whether or not lazy fetch columns are loaded with each page (see also SetLoadLazyColumns(bool))
+			bool											LoadLazyColumns()					{ return m_bLoadLazyColumns; }
+
+			//! Use this method to load lazy fetch columns for whole pages
+			/*! If set, each page loaded also loads all lazy fetch columns of the objects in the
+					page using Database::LoadLazyColumns() which issues one query per lazy fetch
+					column rather than one per column and object. The default is false.
+			*/
+			void											SetLoadLazyColumns(bool bLoadLazyColumns)	{ m_bLoadLazyColumns = bLoadLazyColumns; }
+
 			//! Allows the client to change the size of a page
 			virtual void							SetPageSize(unsigned long uPageSize)		{ m_uPageSize = uPageSize  > 0 ? uPageSize : APAL_DEFAULT_PAGE_SIZE; }
 
@@ -680,7 +680,7 @@ namespace D3
 				{
 					Json::Value&					keyValues(nRoot[iKeys]);
 					Json::Value::UInt			iColumns = 0;
-					ColumnPtrListItr			itr;
+					KeyColumnArrayItr			itr;
 					TemporaryKeyPtr				pTempKey = new TemporaryKey(*(pMetaEntity->GetPrimaryMetaKey()));
 
 					// keyValues must be an array
@@ -1334,7 +1334,7 @@ namespace D3
 		TemporaryKeyPtr						pTmpKey;
 		TemporaryKeyPtrListItr		itrTmpKey;
 		std::string								strThisPred;
-		ColumnPtrListItr					itrCol;
+		KeyColumnArrayItr					itrCol;
 		ColumnPtr									pCol;
 		MetaEntityPtr							pMetaEntity;
 		bool											bQuotedValue = false;
@@ -141,7 +141,7 @@ bool EditObject(EntityPtr pEntity)
 bool EditKey(KeyPtr pKey)
 {
 	ColumnPtr					pCol;
-	ColumnPtrListItr	itrCol;
+	KeyColumnArrayItr	itrCol;
 	int								iWidth = 0;
 	int								iChoice, idx;
 	std::string				strInput;